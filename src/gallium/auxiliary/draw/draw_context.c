@@ -1051,6 +1051,16 @@ draw_collect_pipeline_statistics(struct draw_context *draw,
    draw->collect_statistics = enable;
 }
 
+/**
+ * Returns the vertex cache counters.  These only ever grow, so callers
+ * take the difference of two samples.
+ */
+const struct draw_vertex_cache_stats *
+draw_get_vertex_cache_stats(const struct draw_context *draw)
+{
+   return &draw->pt.vcache_stats;
+}
+
 /**
  * Computes clipper invocation statistics.
  *
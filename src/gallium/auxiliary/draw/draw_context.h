@@ -280,6 +280,18 @@ void draw_set_force_passthrough( struct draw_context *draw,
 void draw_collect_pipeline_statistics(struct draw_context *draw,
                                       boolean enable);
 
+/**
+ * Running totals of the post-transform vertex cache of the LLVM path.
+ */
+struct draw_vertex_cache_stats {
+   uint64_t nr_lookups;   /**< indexed vertices looked up */
+   uint64_t nr_hits;      /**< ... of which were already shaded */
+   uint64_t nr_shaded;    /**< vertices run through the vertex shader */
+};
+
+const struct draw_vertex_cache_stats *
+draw_get_vertex_cache_stats(const struct draw_context *draw);
+
 /*******************************************************************************
  * Draw pipeline 
  */
@@ -44,6 +44,7 @@
 #include "gallivm/lp_bld_printf.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
@@ -62,7 +63,7 @@
 
 static void
 draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *var,
-                   boolean elts);
+                   boolean elts, boolean cached);
 
 
 struct draw_gs_llvm_iface {
@@ -542,6 +543,7 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    struct llvm_vertex_shader *shader =
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
    LLVMTypeRef vertex_header;
+   boolean cached;
    char module_name[64];
 
    variant = MALLOC(sizeof *variant +
@@ -566,8 +568,12 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 
    variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
 
-   draw_llvm_generate(llvm, variant, FALSE);  /* linear */
-   draw_llvm_generate(llvm, variant, TRUE);   /* elts */
+   cached = gallivm_cache_lookup(variant->gallivm,
+                                 key, shader->variant_key_size,
+                                 shader->base.state.tokens);
+
+   draw_llvm_generate(llvm, variant, FALSE, cached);  /* linear */
+   draw_llvm_generate(llvm, variant, TRUE, cached);   /* elts */
 
    gallivm_compile_module(variant->gallivm);
 
@@ -1482,7 +1488,7 @@ draw_gs_llvm_epilogue(const struct lp_build_tgsi_gs_iface *gs_base,
 
 static void
 draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
-                   boolean elts)
+                   boolean elts, boolean cached)
 {
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
@@ -1564,6 +1570,12 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
          LLVMAddAttribute(LLVMGetParam(variant_func, i),
                           LLVMNoAliasAttribute);
 
+   if (cached) {
+      /* The code will be loaded from the on-disk cache */
+      gallivm_cache_stub_function(gallivm, variant_func);
+      return;
+   }
+
    context_ptr               = LLVMGetParam(variant_func, 0);
    io_ptr                    = LLVMGetParam(variant_func, 1);
    vbuffers_ptr              = LLVMGetParam(variant_func, 2);
@@ -2048,7 +2060,8 @@ generate_mask_value(struct draw_gs_llvm_variant *variant,
 
 static void
 draw_gs_llvm_generate(struct draw_llvm *llvm,
-                      struct draw_gs_llvm_variant *variant)
+                      struct draw_gs_llvm_variant *variant,
+                      boolean cached)
 {
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
@@ -2103,6 +2116,12 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
          LLVMAddAttribute(LLVMGetParam(variant_func, i),
                           LLVMNoAliasAttribute);
 
+   if (cached) {
+      /* The code will be loaded from the on-disk cache */
+      gallivm_cache_stub_function(gallivm, variant_func);
+      return;
+   }
+
    context_ptr               = LLVMGetParam(variant_func, 0);
    input_array               = LLVMGetParam(variant_func, 1);
    io_ptr                    = LLVMGetParam(variant_func, 2);
@@ -2197,6 +2216,7 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    struct llvm_geometry_shader *shader =
       llvm_geometry_shader(llvm->draw->gs.geometry_shader);
    LLVMTypeRef vertex_header;
+   boolean cached;
    char module_name[64];
 
    variant = MALLOC(sizeof *variant +
@@ -2221,7 +2241,11 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
 
    variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
 
-   draw_gs_llvm_generate(llvm, variant);
+   cached = gallivm_cache_lookup(variant->gallivm,
+                                 key, shader->variant_key_size,
+                                 shader->base.state.tokens);
+
+   draw_gs_llvm_generate(llvm, variant, cached);
 
    gallivm_compile_module(variant->gallivm);
 
@@ -46,6 +46,8 @@
 
 #include "tgsi/tgsi_scan.h"
 
+#include "draw_context.h"
+
 #ifdef HAVE_LLVM
 struct gallivm_state;
 #endif
@@ -211,6 +213,12 @@ struct draw_context
 
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
+
+      /** bumped for every instance of every draw, as vertex shader
+       * outputs can only be reused within one */
+      unsigned instance_serial;
+
+      struct draw_vertex_cache_stats vcache_stats;
    } pt;
 
    struct {
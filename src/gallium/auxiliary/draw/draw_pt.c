@@ -555,6 +555,7 @@ draw_vbo(struct draw_context *draw,
          draw->instance_id = 0xffffffff;
       }
 
+      draw->pt.instance_serial++;
       draw_new_instance(draw);
 
       if (info->primitive_restart) {
@@ -242,6 +242,21 @@ struct pt_post_vs *draw_pt_post_vs_create( struct draw_context *draw );
 void draw_pt_post_vs_destroy( struct pt_post_vs *pvs );
 
 
+/*******************************************************************************
+ * Batched clip and cull of triangle lists
+ */
+struct pt_clip_cull;
+
+boolean draw_pt_clip_cull_run( struct pt_clip_cull *cc,
+                               struct pt_emit *emit,
+                               const struct draw_vertex_info *vert_info,
+                               const struct draw_prim_info *prim_info );
+
+struct pt_clip_cull *draw_pt_clip_cull_create( struct draw_context *draw );
+
+void draw_pt_clip_cull_destroy( struct pt_clip_cull *cc );
+
+
 /*******************************************************************************
  * Utils: 
  */
@@ -0,0 +1,413 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Batched clip and cull of triangle lists.
+ *
+ * Once a single vertex of a segment needs clipping, the whole segment
+ * normally goes down the draw pipeline, one primitive at a time.  This
+ * stage instead classifies all triangles of the segment at once:
+ * triangles completely outside one of the clip planes and, with face
+ * culling enabled, back/front facing triangles are dropped, triangles
+ * completely inside are sent straight to the vbuf backend, and only the
+ * triangles actually crossing a clip plane go through the pipeline.
+ *
+ * Triangles keep their order, so runs of accepted and clipped triangles
+ * are dispatched one after the other.  As every trip to the backend
+ * translates the whole vertex buffer, segments with many such runs are
+ * sent through the pipeline in one go, still without the rejected
+ * triangles.
+ */
+
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "pipe/p_defines.h"
+#include "draw/draw_context.h"
+#include "draw/draw_private.h"
+#include "draw/draw_pt.h"
+
+#if defined(PIPE_ARCH_SSE)
+#include <xmmintrin.h>
+#endif
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(draw_clip_cull, "DRAW_CLIP_CULL", TRUE)
+
+
+#define CC_ACCEPT  0
+#define CC_CLIP    1
+#define CC_REJECT  2
+
+/** Largest number of accepted/clipped runs dispatched separately */
+#define CC_MAX_RUNS 4
+
+
+struct pt_clip_cull {
+   struct draw_context *draw;
+   boolean enabled;
+
+   unsigned max_tris;
+   ubyte *tri_class;         /**< CC_x for each triangle */
+   ushort *elts;             /**< surviving triangles, in order */
+   float *soa;               /**< x, y, w of the 3 vertices, 9 * max_tris */
+};
+
+
+static boolean
+clip_cull_reserve(struct pt_clip_cull *cc, unsigned nr_tris)
+{
+   unsigned max_tris = align(nr_tris, 4);
+
+   if (max_tris <= cc->max_tris)
+      return TRUE;
+
+   FREE(cc->tri_class);
+   FREE(cc->elts);
+   align_free(cc->soa);
+
+   cc->tri_class = MALLOC(max_tris);
+   cc->elts = MALLOC(max_tris * 3 * sizeof(ushort));
+   cc->soa = align_malloc(max_tris * 9 * sizeof(float), 16);
+   if (!cc->tri_class || !cc->elts || !cc->soa) {
+      cc->max_tris = 0;
+      return FALSE;
+   }
+
+   cc->max_tris = max_tris;
+   return TRUE;
+}
+
+
+/**
+ * Compute a bitmask of the culled triangles in [start, start + 4) from
+ * their clip space coordinates.
+ *
+ * With all w positive, the sign of the window space determinant the cull
+ * stage uses is the sign of det(x, y, w) times the sign of the viewport's
+ * x and y scale.  Triangles with any other w are never culled here.
+ * Triangles with a NaN determinant are neither culled nor kept, but
+ * returned in nan_mask so that the pipeline's cull stage decides.
+ */
+static INLINE unsigned
+cull_tris4(const float *soa, unsigned stride, unsigned start,
+           float det_sign, boolean front_ccw,
+           boolean cull_front, boolean cull_back,
+           unsigned *nan_mask)
+{
+   const float *x0 = soa + 0 * stride + start;
+   const float *y0 = soa + 1 * stride + start;
+   const float *w0 = soa + 2 * stride + start;
+   const float *x1 = soa + 3 * stride + start;
+   const float *y1 = soa + 4 * stride + start;
+   const float *w1 = soa + 5 * stride + start;
+   const float *x2 = soa + 6 * stride + start;
+   const float *y2 = soa + 7 * stride + start;
+   const float *w2 = soa + 8 * stride + start;
+
+#if defined(PIPE_ARCH_SSE)
+   const __m128 zero = _mm_setzero_ps();
+   __m128 X0 = _mm_load_ps(x0), Y0 = _mm_load_ps(y0), W0 = _mm_load_ps(w0);
+   __m128 X1 = _mm_load_ps(x1), Y1 = _mm_load_ps(y1), W1 = _mm_load_ps(w1);
+   __m128 X2 = _mm_load_ps(x2), Y2 = _mm_load_ps(y2), W2 = _mm_load_ps(w2);
+   __m128 det, ccw, front, culled, w_pos, nan;
+
+   det = _mm_mul_ps(X0, _mm_sub_ps(_mm_mul_ps(Y1, W2), _mm_mul_ps(Y2, W1)));
+   det = _mm_sub_ps(det, _mm_mul_ps(X1, _mm_sub_ps(_mm_mul_ps(Y0, W2),
+                                                   _mm_mul_ps(Y2, W0))));
+   det = _mm_add_ps(det, _mm_mul_ps(X2, _mm_sub_ps(_mm_mul_ps(Y0, W1),
+                                                   _mm_mul_ps(Y1, W0))));
+   det = _mm_mul_ps(det, _mm_set1_ps(det_sign));
+
+   w_pos = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(W0, zero),
+                                 _mm_cmpgt_ps(W1, zero)),
+                      _mm_cmpgt_ps(W2, zero));
+
+   nan = _mm_and_ps(_mm_cmpunord_ps(det, det), w_pos);
+   *nan_mask = _mm_movemask_ps(nan);
+
+   ccw = _mm_cmplt_ps(det, zero);
+   front = front_ccw ? ccw : _mm_andnot_ps(ccw, _mm_cmpeq_ps(zero, zero));
+
+   culled = _mm_cmpeq_ps(det, zero);
+   if (cull_front)
+      culled = _mm_or_ps(culled, front);
+   if (cull_back)
+      culled = _mm_or_ps(culled, _mm_andnot_ps(front,
+                                               _mm_cmpeq_ps(zero, zero)));
+
+   return _mm_movemask_ps(_mm_andnot_ps(nan, _mm_and_ps(culled, w_pos)));
+#else
+   unsigned mask = 0;
+   unsigned i;
+
+   *nan_mask = 0;
+
+   for (i = 0; i < 4; i++) {
+      float det;
+      boolean front;
+
+      if (!(w0[i] > 0.0f && w1[i] > 0.0f && w2[i] > 0.0f))
+         continue;
+
+      det = x0[i] * (y1[i] * w2[i] - y2[i] * w1[i]) -
+            x1[i] * (y0[i] * w2[i] - y2[i] * w0[i]) +
+            x2[i] * (y0[i] * w1[i] - y1[i] * w0[i]);
+      det *= det_sign;
+
+      if (util_is_nan(det)) {
+         *nan_mask |= 1 << i;
+         continue;
+      }
+
+      front = (det < 0.0f) == front_ccw;
+
+      if (det == 0.0f ||
+          (front && cull_front) ||
+          (!front && cull_back))
+         mask |= 1 << i;
+   }
+
+   return mask;
+#endif
+}
+
+
+/**
+ * Classify every triangle of the list as CC_ACCEPT, CC_CLIP or
+ * CC_REJECT.
+ */
+static void
+classify_tris(struct pt_clip_cull *cc,
+              const struct draw_vertex_info *vert_info,
+              const struct draw_prim_info *prim_info,
+              unsigned nr_tris)
+{
+   struct draw_context *draw = cc->draw;
+   const struct pipe_rasterizer_state *rast = draw->rasterizer;
+   const unsigned stride = cc->max_tris;
+   const char *verts = (const char *) vert_info->verts;
+   float *soa = cc->soa;
+   unsigned i, j;
+
+   for (i = 0; i < nr_tris; i++) {
+      unsigned and_mask = ~0u, or_mask = 0;
+
+      for (j = 0; j < 3; j++) {
+         unsigned idx = prim_info->linear ? prim_info->start + i * 3 + j
+                                          : prim_info->elts[i * 3 + j];
+         const struct vertex_header *v = (const struct vertex_header *)
+            (verts + idx * vert_info->stride);
+
+         and_mask &= v->clipmask;
+         or_mask |= v->clipmask;
+
+         soa[(j * 3 + 0) * stride + i] = v->pre_clip_pos[0];
+         soa[(j * 3 + 1) * stride + i] = v->pre_clip_pos[1];
+         soa[(j * 3 + 2) * stride + i] = v->pre_clip_pos[3];
+      }
+
+      cc->tri_class[i] = and_mask ? CC_REJECT :
+                         or_mask ? CC_CLIP : CC_ACCEPT;
+   }
+
+   if (rast->cull_face != PIPE_FACE_NONE) {
+      const float *scale = draw->viewports[0].scale;
+      float det_sign = scale[0] * scale[1] < 0.0f ? -1.0f : 1.0f;
+      boolean cull_front = (rast->cull_face & PIPE_FACE_FRONT) != 0;
+      boolean cull_back = (rast->cull_face & PIPE_FACE_BACK) != 0;
+
+      /* pad the last group of four with triangles which are never culled */
+      for (i = nr_tris; i < align(nr_tris, 4); i++) {
+         for (j = 0; j < 9; j++)
+            soa[j * stride + i] = 0.0f;
+      }
+
+      for (i = 0; i < nr_tris; i += 4) {
+         unsigned nan_mask;
+         unsigned mask = cull_tris4(soa, stride, i, det_sign,
+                                    rast->front_ccw, cull_front, cull_back,
+                                    &nan_mask);
+         while (mask) {
+            unsigned k = u_bit_scan(&mask);
+            if (i + k < nr_tris)
+               cc->tri_class[i + k] = CC_REJECT;
+         }
+
+         /* let the pipeline's cull stage decide about these */
+         while (nan_mask) {
+            unsigned k = u_bit_scan(&nan_mask);
+            if (i + k < nr_tris && cc->tri_class[i + k] == CC_ACCEPT)
+               cc->tri_class[i + k] = CC_CLIP;
+         }
+      }
+   }
+}
+
+
+static void
+dispatch(struct pt_clip_cull *cc,
+         struct pt_emit *emit,
+         const struct draw_vertex_info *vert_info,
+         const struct draw_prim_info *prim_info,
+         unsigned tri_class,
+         const ushort *elts,
+         unsigned count)
+{
+   struct draw_prim_info run_info;
+
+   run_info.linear = FALSE;
+   run_info.start = 0;
+   run_info.elts = elts;
+   run_info.count = count;
+   run_info.prim = PIPE_PRIM_TRIANGLES;
+   run_info.flags = prim_info->flags;
+   run_info.primitive_lengths = &run_info.count;
+   run_info.primitive_count = 1;
+
+   if (tri_class == CC_ACCEPT)
+      draw_pt_emit(emit, vert_info, &run_info);
+   else
+      draw_pipeline_run(cc->draw, vert_info, &run_info);
+}
+
+
+/**
+ * Clip, cull and draw a triangle list of which some vertices need
+ * clipping.  Only valid when clipping is the only reason to use the
+ * pipeline.
+ * \return  FALSE if the primitives can't be handled here, in which case
+ *          the caller must send them down the pipeline as usual
+ */
+boolean
+draw_pt_clip_cull_run(struct pt_clip_cull *cc,
+                      struct pt_emit *emit,
+                      const struct draw_vertex_info *vert_info,
+                      const struct draw_prim_info *prim_info)
+{
+   unsigned nr_tris, nr_runs, nr_clipped;
+   unsigned run_class, run_start;
+   unsigned count, i;
+
+   if (!cc->enabled ||
+       prim_info->prim != PIPE_PRIM_TRIANGLES ||
+       prim_info->primitive_count != 1 ||
+       draw_current_shader_uses_viewport_index(cc->draw))
+      return FALSE;
+
+   nr_tris = prim_info->count / 3;
+   if (nr_tris == 0 || !clip_cull_reserve(cc, nr_tris))
+      return FALSE;
+
+   classify_tris(cc, vert_info, prim_info, nr_tris);
+
+   /* compact the surviving triangles, counting runs of the same class */
+   count = 0;
+   nr_runs = 0;
+   nr_clipped = 0;
+   run_class = CC_REJECT;
+   for (i = 0; i < nr_tris; i++) {
+      unsigned tri_class = cc->tri_class[i];
+      unsigned j;
+
+      if (tri_class == CC_REJECT)
+         continue;
+
+      if (tri_class != run_class) {
+         run_class = tri_class;
+         nr_runs++;
+      }
+      nr_clipped += tri_class == CC_CLIP;
+
+      for (j = 0; j < 3; j++) {
+         cc->elts[count++] = prim_info->linear ?
+            (ushort) (prim_info->start + i * 3 + j) :
+            prim_info->elts[i * 3 + j];
+      }
+   }
+
+   if (count == 0)
+      return TRUE;
+
+   if (nr_clipped == 0) {
+      dispatch(cc, emit, vert_info, prim_info, CC_ACCEPT, cc->elts, count);
+   }
+   else if (nr_runs > CC_MAX_RUNS) {
+      dispatch(cc, emit, vert_info, prim_info, CC_CLIP, cc->elts, count);
+   }
+   else {
+      /* walk the surviving triangles again, dispatching each run */
+      run_class = CC_REJECT;
+      run_start = 0;
+      count = 0;
+      for (i = 0; i < nr_tris; i++) {
+         unsigned tri_class = cc->tri_class[i];
+
+         if (tri_class == CC_REJECT)
+            continue;
+
+         if (tri_class != run_class) {
+            if (count > run_start)
+               dispatch(cc, emit, vert_info, prim_info, run_class,
+                        cc->elts + run_start, count - run_start);
+            run_class = tri_class;
+            run_start = count;
+         }
+         count += 3;
+      }
+
+      dispatch(cc, emit, vert_info, prim_info, run_class,
+               cc->elts + run_start, count - run_start);
+   }
+
+   return TRUE;
+}
+
+
+struct pt_clip_cull *
+draw_pt_clip_cull_create(struct draw_context *draw)
+{
+   struct pt_clip_cull *cc = CALLOC_STRUCT(pt_clip_cull);
+   if (!cc)
+      return NULL;
+
+   cc->draw = draw;
+   cc->enabled = debug_get_option_draw_clip_cull();
+
+   return cc;
+}
+
+
+void
+draw_pt_clip_cull_destroy(struct pt_clip_cull *cc)
+{
+   FREE(cc->tri_class);
+   FREE(cc->elts);
+   align_free(cc->soa);
+   FREE(cc);
+}
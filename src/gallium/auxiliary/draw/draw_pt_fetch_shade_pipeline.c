@@ -45,6 +45,7 @@ struct fetch_pipeline_middle_end {
    struct pt_so_emit *so_emit;
    struct pt_fetch *fetch;
    struct pt_post_vs *post_vs;
+   struct pt_clip_cull *clip_cull;
 
    unsigned vertex_data_offset;
    unsigned vertex_size;
@@ -338,14 +339,18 @@ fetch_pipeline_generic(struct draw_pt_middle_end *middle,
     */
    if (draw_current_shader_position_output(draw) != -1) {
 
-      if (draw_pt_post_vs_run( fpme->post_vs, vert_info, prim_info ))
-      {
-         opt |= PT_PIPELINE;
-      }
+      boolean clipped = draw_pt_post_vs_run( fpme->post_vs, vert_info,
+                                             prim_info );
 
-      /* Do we need to run the pipeline?
+      /* Clipping is the only reason to use the pipeline, so try to
+       * reject, cull and emit most triangles in bulk
        */
-      if (opt & PT_PIPELINE) {
+      if (clipped && !(opt & PT_PIPELINE) &&
+          draw_pt_clip_cull_run( fpme->clip_cull, fpme->emit,
+                                 vert_info, prim_info )) {
+         /* done */
+      }
+      else if (clipped || (opt & PT_PIPELINE)) {
          pipeline( fpme, vert_info, prim_info );
       }
       else {
@@ -474,6 +479,9 @@ fetch_pipeline_destroy( struct draw_pt_middle_end *middle )
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   if (fpme->clip_cull)
+      draw_pt_clip_cull_destroy( fpme->clip_cull );
+
    FREE(middle);
 }
 
@@ -504,6 +512,10 @@ draw_pt_fetch_pipeline_or_emit(struct draw_context *draw)
    if (!fpme->post_vs)
       goto fail;
 
+   fpme->clip_cull = draw_pt_clip_cull_create( draw );
+   if (!fpme->clip_cull)
+      goto fail;
+
    fpme->emit = draw_pt_emit_create( draw );
    if (!fpme->emit)
       goto fail;
@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include "os/os_thread.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
@@ -39,6 +41,39 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/**
+ * Maximum number of helper threads running the vertex shader.
+ */
+#define DRAW_MAX_VS_THREADS 16
+
+/**
+ * Minimum number of vertices each thread shades; smaller draws are not
+ * worth waking up the helper threads for.
+ */
+#define DRAW_VS_MIN_RANGE 256
+
+
+/**
+ * Number of shaded vertices kept by the post-transform vertex cache.
+ * Must be a power of two.
+ */
+#define DRAW_VCACHE_SIZE 1024
+
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_num_vs_threads, "DRAW_NUM_VS_THREADS", 0)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vertex_cache, "DRAW_VERTEX_CACHE", TRUE)
+
+
+struct llvm_middle_end;
+
+struct llvm_vs_worker {
+   struct llvm_middle_end *fpme;
+   unsigned index;                /**< range of the vertices to shade */
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -47,6 +82,7 @@ struct llvm_middle_end {
    struct pt_so_emit *so_emit;
    struct pt_fetch *fetch;
    struct pt_post_vs *post_vs;
+   struct pt_clip_cull *clip_cull;
 
 
    unsigned vertex_data_offset;
@@ -56,6 +92,50 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /**
+    * Vertex shading of large fetches is split into num_parts ranges,
+    * shaded by the helper threads and the calling thread in parallel.
+    * Each range is written straight to its place in the output buffer, so
+    * everything downstream sees the vertices in their original order.
+    */
+   struct {
+      const struct draw_fetch_info *fetch_info;
+      struct vertex_header *verts;
+      unsigned num_parts;
+      unsigned fpstate;
+      unsigned clipped[DRAW_MAX_VS_THREADS + 1];
+
+      boolean exit_flag;
+      unsigned num_threads;
+      pipe_thread threads[DRAW_MAX_VS_THREADS];
+      struct llvm_vs_worker workers[DRAW_MAX_VS_THREADS];
+   } shade;
+
+   /**
+    * Post-transform vertex cache for indexed draws.
+    *
+    * A direct mapped cache of shader outputs, indexed by fetch element.
+    * Unlike the per-segment cache of the vsplit front end it lives as long
+    * as the vertex shader inputs stay the same, which is for one instance
+    * of one draw call, so vertices shared by different segments are only
+    * shaded once.  Only the misses of each segment are passed to the
+    * shader, as a compacted element list.
+    */
+   struct {
+      boolean enabled;
+      unsigned serial;             /**< draw->pt.instance_serial of contents */
+      unsigned vertex_size;        /**< size of the entries in data */
+      unsigned tags[DRAW_VCACHE_SIZE];
+      ubyte *data;
+
+      /** Scratch space for the misses of a segment, grown as needed */
+      unsigned *miss_elts;
+      ushort *miss_slots;
+      unsigned miss_capacity;      /**< elements of miss_elts/slots */
+      ubyte *miss_verts;
+      unsigned miss_verts_size;    /**< bytes of miss_verts */
+   } vcache;
 };
 
 
@@ -67,6 +147,13 @@ llvm_middle_end(struct draw_pt_middle_end *middle)
 }
 
 
+static void
+llvm_vcache_invalidate(struct llvm_middle_end *fpme)
+{
+   memset(fpme->vcache.tags, 0xff, sizeof fpme->vcache.tags);
+}
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -260,6 +347,8 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    if (gs) {
       llvm_middle_end_prepare_gs(fpme);
    }
+
+   llvm_vcache_invalidate(fpme);
 }
 
 
@@ -296,6 +385,7 @@ llvm_middle_end_bind_parameters(struct draw_pt_middle_end *middle)
 
    fpme->llvm->jit_context.viewport = (float *) draw->viewports[0].scale;
    fpme->llvm->gs_jit_context.viewport = (float *) draw->viewports[0].scale;
+   llvm_vcache_invalidate(fpme);
 }
 
 
@@ -329,6 +419,284 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Run the vertex shader on one of the shade.num_parts ranges of the
+ * current fetch.  Range boundaries are multiples of the vector length, so
+ * only the last range shades past its end, into the padding of the output
+ * buffer.
+ */
+static void
+llvm_shade_range(struct llvm_middle_end *fpme, unsigned index)
+{
+   struct draw_context *draw = fpme->draw;
+   const struct draw_fetch_info *fetch_info = fpme->shade.fetch_info;
+   const unsigned vector_length = lp_native_vector_width / 32;
+   unsigned parts = fpme->shade.num_parts;
+   unsigned count = fetch_info->count;
+   unsigned begin, end;
+   struct vertex_header *verts;
+
+   begin = MIN2(align(count * index / parts, vector_length), count);
+   if (index + 1 == parts)
+      end = count;
+   else
+      end = MIN2(align(count * (index + 1) / parts, vector_length), count);
+
+   if (begin >= end) {
+      fpme->shade.clipped[index] = 0;
+      return;
+   }
+
+   verts = (struct vertex_header *)
+      ((char *) fpme->shade.verts + begin * fpme->vertex_size);
+
+   if (fetch_info->linear)
+      fpme->shade.clipped[index] =
+         fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          fetch_info->start + begin,
+                                          end - begin,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          draw->start_index,
+                                          draw->start_instance);
+   else
+      fpme->shade.clipped[index] =
+         fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                               verts,
+                                               draw->pt.user.vbuffer,
+                                               fetch_info->elts + begin,
+                                               draw->pt.user.eltMax,
+                                               end - begin,
+                                               fpme->vertex_size,
+                                               draw->pt.vertex_buffer,
+                                               draw->instance_id,
+                                               draw->pt.user.eltBias,
+                                               draw->start_instance);
+}
+
+
+static PIPE_THREAD_ROUTINE( llvm_vs_thread_function, init_data )
+{
+   struct llvm_vs_worker *worker = (struct llvm_vs_worker *) init_data;
+   struct llvm_middle_end *fpme = worker->fpme;
+
+   while (1) {
+      pipe_semaphore_wait(&worker->work_ready);
+
+      if (fpme->shade.exit_flag)
+         break;
+
+      /* same denorm handling as the thread which issued the draw */
+      util_fpstate_set(fpme->shade.fpstate);
+
+      llvm_shade_range(fpme, worker->index);
+
+      pipe_semaphore_signal(&worker->work_done);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Fetch and shade all vertices of fetch_info into verts, using the helper
+ * threads if the fetch is large enough.
+ * \return  non-zero if any of the vertices needs clipping
+ */
+static unsigned
+llvm_shade_vertices(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    struct vertex_header *verts)
+{
+   unsigned parts = 1;
+   unsigned clipped;
+   unsigned i;
+
+   if (fpme->shade.num_threads &&
+       fetch_info->count >= 2 * DRAW_VS_MIN_RANGE)
+      parts = MIN2(fetch_info->count / DRAW_VS_MIN_RANGE,
+                   fpme->shade.num_threads + 1);
+
+   fpme->shade.fetch_info = fetch_info;
+   fpme->shade.verts = verts;
+   fpme->shade.num_parts = parts;
+
+   if (parts > 1) {
+      fpme->shade.fpstate = util_fpstate_get();
+
+      for (i = 1; i < parts; i++)
+         pipe_semaphore_signal(&fpme->shade.workers[i - 1].work_ready);
+
+      llvm_shade_range(fpme, 0);
+
+      for (i = 1; i < parts; i++)
+         pipe_semaphore_wait(&fpme->shade.workers[i - 1].work_done);
+   }
+   else {
+      llvm_shade_range(fpme, 0);
+   }
+
+   fpme->shade.fetch_info = NULL;
+   fpme->shade.verts = NULL;
+
+   clipped = 0;
+   for (i = 0; i < parts; i++)
+      clipped |= fpme->shade.clipped[i];
+
+   return clipped;
+}
+
+
+/**
+ * Make sure the vertex cache can be used for the current vertex size and
+ * holds vertices of the current draw instance only.
+ * \return  FALSE if the cache can't be used
+ */
+static boolean
+llvm_vcache_validate(struct llvm_middle_end *fpme)
+{
+   struct draw_context *draw = fpme->draw;
+
+   if (fpme->vcache.vertex_size != fpme->vertex_size) {
+      FREE(fpme->vcache.data);
+      fpme->vcache.data = MALLOC(DRAW_VCACHE_SIZE * fpme->vertex_size);
+      if (!fpme->vcache.data) {
+         fpme->vcache.vertex_size = 0;
+         return FALSE;
+      }
+      fpme->vcache.vertex_size = fpme->vertex_size;
+      llvm_vcache_invalidate(fpme);
+      fpme->vcache.serial = draw->pt.instance_serial;
+   }
+   else if (fpme->vcache.serial != draw->pt.instance_serial) {
+      llvm_vcache_invalidate(fpme);
+      fpme->vcache.serial = draw->pt.instance_serial;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Make sure the miss scratch arrays can hold count elements, and the miss
+ * vertex buffer verts_size bytes.
+ * \return  FALSE on out of memory
+ */
+static boolean
+llvm_vcache_reserve(struct llvm_middle_end *fpme,
+                    unsigned count, unsigned verts_size)
+{
+   if (count > fpme->vcache.miss_capacity) {
+      FREE(fpme->vcache.miss_elts);
+      fpme->vcache.miss_elts =
+         MALLOC(count * (sizeof(unsigned) + sizeof(ushort)));
+      if (!fpme->vcache.miss_elts) {
+         fpme->vcache.miss_capacity = 0;
+         return FALSE;
+      }
+      fpme->vcache.miss_slots = (ushort *) (fpme->vcache.miss_elts + count);
+      fpme->vcache.miss_capacity = count;
+   }
+
+   if (verts_size > fpme->vcache.miss_verts_size) {
+      FREE(fpme->vcache.miss_verts);
+      fpme->vcache.miss_verts = MALLOC(verts_size);
+      if (!fpme->vcache.miss_verts) {
+         fpme->vcache.miss_verts_size = 0;
+         return FALSE;
+      }
+      fpme->vcache.miss_verts_size = verts_size;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Fetch and shade the vertices of an indexed fetch_info into verts,
+ * taking the vertices found in the vertex cache from there and only
+ * running the shader on the others.
+ * \param nr_shaded  returns the number of vertices actually shaded
+ */
+static unsigned
+llvm_shade_vertices_cached(struct llvm_middle_end *fpme,
+                           const struct draw_fetch_info *fetch_info,
+                           struct vertex_header *verts,
+                           unsigned *nr_shaded)
+{
+   struct draw_context *draw = fpme->draw;
+   const unsigned vertex_size = fpme->vertex_size;
+   const unsigned count = fetch_info->count;
+   struct draw_fetch_info miss_info;
+   struct vertex_header *miss_verts;
+   unsigned *miss_elts;
+   ushort *miss_slots;
+   unsigned nr_misses = 0;
+   unsigned clipped = 0;
+   unsigned i;
+
+   assert(!fetch_info->linear);
+
+   /* Reserve for the worst case, every vertex missing */
+   if (!llvm_vcache_reserve(fpme, count,
+                            vertex_size *
+                            align(count, lp_native_vector_width / 32))) {
+      *nr_shaded = count;
+      return llvm_shade_vertices(fpme, fetch_info, verts);
+   }
+   miss_elts = fpme->vcache.miss_elts;
+   miss_slots = fpme->vcache.miss_slots;
+   miss_verts = (struct vertex_header *) fpme->vcache.miss_verts;
+
+   for (i = 0; i < count; i++) {
+      unsigned elt = fetch_info->elts[i];
+      unsigned slot = elt & (DRAW_VCACHE_SIZE - 1);
+      struct vertex_header *dst = (struct vertex_header *)
+         ((char *) verts + i * vertex_size);
+
+      /* ~0 marks empty entries, so that element is never cached */
+      if (fpme->vcache.tags[slot] == elt && elt != ~0u) {
+         memcpy(dst, fpme->vcache.data + slot * vertex_size, vertex_size);
+         clipped |= dst->clipmask;
+      }
+      else {
+         miss_elts[nr_misses] = elt;
+         miss_slots[nr_misses] = (ushort) i;
+         nr_misses++;
+      }
+   }
+
+   draw->pt.vcache_stats.nr_lookups += count;
+   draw->pt.vcache_stats.nr_hits += count - nr_misses;
+   *nr_shaded = nr_misses;
+
+   if (nr_misses) {
+      miss_info.linear = FALSE;
+      miss_info.start = 0;
+      miss_info.elts = miss_elts;
+      miss_info.count = nr_misses;
+
+      clipped |= llvm_shade_vertices(fpme, &miss_info, miss_verts);
+
+      for (i = 0; i < nr_misses; i++) {
+         unsigned elt = miss_elts[i];
+         unsigned slot = elt & (DRAW_VCACHE_SIZE - 1);
+         const char *src = (const char *) miss_verts + i * vertex_size;
+
+         memcpy((char *) verts + miss_slots[i] * vertex_size, src,
+                vertex_size);
+         memcpy(fpme->vcache.data + slot * vertex_size, src, vertex_size);
+         fpme->vcache.tags[slot] = elt;
+      }
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -347,6 +715,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    boolean free_prim_info = FALSE;
    unsigned opt = fpme->opt;
    unsigned clipped = 0;
+   unsigned nr_shaded = fetch_info->count;
 
    llvm_vert_info.count = fetch_info->count;
    llvm_vert_info.vertex_size = fpme->vertex_size;
@@ -363,32 +732,19 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       draw->statistics.ia_vertices += prim_info->count;
       draw->statistics.ia_primitives +=
          u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
-                                       draw->pt.user.vbuffer,
-                                       fetch_info->start,
-                                       fetch_info->count,
-                                       fpme->vertex_size,
-                                       draw->pt.vertex_buffer,
-                                       draw->instance_id,
-                                       draw->start_index,
-                                       draw->start_instance);
+   if (!fetch_info->linear && fpme->vcache.enabled &&
+       llvm_vcache_validate(fpme))
+      clipped = llvm_shade_vertices_cached(fpme, fetch_info,
+                                           llvm_vert_info.verts, &nr_shaded);
    else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
-                                            draw->pt.user.vbuffer,
-                                            fetch_info->elts,
-                                            draw->pt.user.eltMax,
-                                            fetch_info->count,
-                                            fpme->vertex_size,
-                                            draw->pt.vertex_buffer,
-                                            draw->instance_id,
-                                            draw->pt.user.eltBias,
-                                            draw->start_instance);
+      clipped = llvm_shade_vertices(fpme, fetch_info, llvm_vert_info.verts);
+
+   draw->pt.vcache_stats.nr_shaded += nr_shaded;
+   if (draw->collect_statistics) {
+      draw->statistics.vs_invocations += nr_shaded;
+   }
 
    /* Finished with fetch and vs:
     */
@@ -445,13 +801,16 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       if ((opt & PT_SHADE) && gshader) {
          clipped = draw_pt_post_vs_run( fpme->post_vs, vert_info, prim_info );
       }
-      if (clipped) {
-         opt |= PT_PIPELINE;
-      }
 
-      /* Do we need to run the pipeline? Now will come here if clipped
+      /* Clipping is the only reason to use the pipeline, so try to
+       * reject, cull and emit most triangles in bulk
        */
-      if (opt & PT_PIPELINE) {
+      if (clipped && !(opt & PT_PIPELINE) &&
+          draw_pt_clip_cull_run( fpme->clip_cull, fpme->emit,
+                                 vert_info, prim_info )) {
+         /* done */
+      }
+      else if (clipped || (opt & PT_PIPELINE)) {
          pipeline( fpme, vert_info, prim_info );
       }
       else {
@@ -566,6 +925,22 @@ static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   unsigned i;
+
+   fpme->shade.exit_flag = TRUE;
+   for (i = 0; i < fpme->shade.num_threads; i++) {
+      pipe_semaphore_signal(&fpme->shade.workers[i].work_ready);
+   }
+
+   for (i = 0; i < fpme->shade.num_threads; i++) {
+      pipe_thread_wait(fpme->shade.threads[i]);
+      pipe_semaphore_destroy(&fpme->shade.workers[i].work_ready);
+      pipe_semaphore_destroy(&fpme->shade.workers[i].work_done);
+   }
+
+   FREE(fpme->vcache.data);
+   FREE(fpme->vcache.miss_elts);
+   FREE(fpme->vcache.miss_verts);
 
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
@@ -579,6 +954,9 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   if (fpme->clip_cull)
+      draw_pt_clip_cull_destroy( fpme->clip_cull );
+
    FREE(middle);
 }
 
@@ -587,6 +965,8 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned num_threads;
+   unsigned i;
 
    if (!draw->llvm)
       return NULL;
@@ -613,6 +993,10 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    if (!fpme->post_vs)
       goto fail;
 
+   fpme->clip_cull = draw_pt_clip_cull_create( draw );
+   if (!fpme->clip_cull)
+      goto fail;
+
    fpme->emit = draw_pt_emit_create( draw );
    if (!fpme->emit)
       goto fail;
@@ -627,6 +1011,27 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   fpme->vcache.enabled = debug_get_option_draw_vertex_cache();
+
+   /* Only count the threads actually created, draws wait for them all */
+   num_threads = MIN2(debug_get_option_draw_num_vs_threads(),
+                      DRAW_MAX_VS_THREADS);
+   for (i = 0; i < num_threads; i++) {
+      struct llvm_vs_worker *worker = &fpme->shade.workers[i];
+      worker->fpme = fpme;
+      worker->index = i + 1;
+      pipe_semaphore_init(&worker->work_ready, 0);
+      pipe_semaphore_init(&worker->work_done, 0);
+      fpme->shade.threads[i] = pipe_thread_create(llvm_vs_thread_function,
+                                                  (void *) worker);
+      if (!fpme->shade.threads[i]) {
+         pipe_semaphore_destroy(&worker->work_ready);
+         pipe_semaphore_destroy(&worker->work_done);
+         break;
+      }
+      fpme->shade.num_threads++;
+   }
+
    return &fpme->base;
 
  fail:
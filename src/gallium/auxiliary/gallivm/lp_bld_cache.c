@@ -0,0 +1,680 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * On-disk cache of MC-JIT object code.
+ *
+ * Each cache file holds the relocatable object MC-JIT produced for one
+ * module, preceded by the full key it was generated from.  The key is made
+ * of the caller's variant key, the TGSI tokens and everything else in the
+ * process which influences code generation (LLVM version, CPU features,
+ * debug flags and the modification time of the driver binary itself), so
+ * a stale or foreign file can only ever cause a miss.
+ *
+ * Files are written to a temporary name and renamed into place, which
+ * makes it safe for many processes to share the same directory.
+ *
+ * The on-disk cache is enabled by setting GALLIVM_CACHE_DIR.  It relies on
+ * llvm::ObjectCache, so it is only built when gallivm uses MC-JIT with
+ * LLVM 3.3 or later (see LP_DISK_CACHE).  The old JIT, which is what runs
+ * on x86, emits code straight into executable memory and cannot use it.
+ *
+ * Independently of that, the code compiled for a key is shared by all
+ * modules of the process with the same key for as long as any of them is
+ * alive, regardless of which context or screen they belong to.  A module
+ * hitting shared code skips IR generation and compilation altogether.  With
+ * MC-JIT it never gets an execution engine of its own; the old JIT creates
+ * one with the module, which is released as soon as the hit is known.
+ */
+
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "os/os_thread.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "tgsi/tgsi_parse.h"
+
+#include "lp_bld_debug.h"
+#include "lp_bld_misc.h"
+#include "lp_bld_type.h"
+#include "lp_bld_init.h"
+#include "lp_bld_cache.h"
+
+#include <stdio.h>
+
+#if defined(PIPE_OS_UNIX)
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+
+#define LP_CACHE_MAGIC 0x3143504c /* "LPC1" */
+
+#define LP_SHARED_CODE_BUCKETS 256
+
+#if defined(PIPE_OS_UNIX) && USE_MCJIT && HAVE_LLVM >= 0x0303
+#define LP_DISK_CACHE 1
+#else
+#define LP_DISK_CACHE 0
+#endif
+
+
+struct lp_cache_header
+{
+   uint32_t magic;
+   uint32_t key_size;
+   uint32_t object_size;
+   uint32_t object_crc;
+};
+
+
+/**
+ * The part of every key which is common to the whole process.
+ */
+struct lp_cache_env
+{
+   uint32_t llvm_version;
+   uint32_t pointer_size;
+   uint32_t native_vector_width;
+   uint32_t debug_flags;
+   uint32_t perf_flags;
+   int64_t build_time;
+   struct util_cpu_caps cpu_caps;
+};
+
+
+struct lp_cache_entry
+{
+   char path[1024];
+   uint32_t hash;
+
+   void *key;
+   unsigned key_size;
+
+   /** Object code read from disk, NULL on a miss */
+   void *object;
+   size_t object_size;
+
+   /** Code of a live module with the same key, NULL on a miss */
+   struct lp_shared_code *shared;
+};
+
+
+/**
+ * Code compiled for a key, referenced by every module with that key.
+ */
+struct lp_shared_code
+{
+   struct lp_shared_code *next;   /**< hash bucket chain */
+   uint32_t hash;
+
+   void *key;
+   unsigned key_size;
+
+   unsigned refcount;
+
+   struct lp_generated_code *code;
+   LLVMMCJITMemoryManagerRef memorymgr;
+
+   /** Entry points, in the order lp_cache_entry_prepare() names them */
+   unsigned num_functions;
+   func_pointer *functions;
+};
+
+
+static const char *cache_dir = NULL;
+static struct lp_cache_env cache_env;
+
+pipe_static_mutex(cache_mutex);
+static boolean cache_initialized = FALSE;
+
+static struct lp_shared_code *shared_code[LP_SHARED_CODE_BUCKETS];
+
+
+#if LP_DISK_CACHE
+
+/**
+ * Code generation depends on the exact build of this library, so use its
+ * modification time to tell builds apart.  Without one we cannot trust
+ * anything on disk.
+ */
+static boolean
+lp_cache_get_build_time(int64_t *build_time)
+{
+   Dl_info info;
+   struct stat st;
+
+   if (!dladdr((void *) gallivm_cache_lookup, &info) ||
+       !info.dli_fname ||
+       stat(info.dli_fname, &st) != 0)
+      return FALSE;
+
+   *build_time = (int64_t) st.st_mtime;
+   return TRUE;
+}
+
+
+/**
+ * Read the entry's file, keeping the object code if the key matches.
+ */
+static void
+lp_cache_entry_read(struct lp_cache_entry *entry)
+{
+   struct lp_cache_header header;
+   void *key = NULL;
+   void *object = NULL;
+   FILE *fp;
+
+   fp = fopen(entry->path, "rb");
+   if (!fp)
+      return;
+
+   if (fread(&header, sizeof header, 1, fp) != 1 ||
+       header.magic != LP_CACHE_MAGIC ||
+       header.key_size != entry->key_size ||
+       header.object_size == 0)
+      goto out;
+
+   key = MALLOC(header.key_size);
+   object = MALLOC(header.object_size);
+   if (!key || !object)
+      goto out;
+
+   if (fread(key, header.key_size, 1, fp) != 1 ||
+       memcmp(key, entry->key, header.key_size) != 0 ||
+       fread(object, header.object_size, 1, fp) != 1 ||
+       util_hash_crc32(object, header.object_size) != header.object_crc)
+      goto out;
+
+   entry->object = object;
+   entry->object_size = header.object_size;
+   object = NULL;
+
+out:
+   FREE(object);
+   FREE(key);
+   fclose(fp);
+}
+
+
+/**
+ * Atomically replace the entry's file with the given object code.
+ */
+static void
+lp_cache_entry_write(const struct lp_cache_entry *entry,
+                     const void *data, size_t size)
+{
+   struct lp_cache_header header;
+   char tmp_path[sizeof entry->path + 16];
+   boolean ok;
+   FILE *fp;
+
+   util_snprintf(tmp_path, sizeof tmp_path, "%s.%d",
+                 entry->path, (int) getpid());
+
+   fp = fopen(tmp_path, "wb");
+   if (!fp)
+      return;
+
+   header.magic = LP_CACHE_MAGIC;
+   header.key_size = entry->key_size;
+   header.object_size = (uint32_t) size;
+   header.object_crc = util_hash_crc32(data, size);
+
+   ok = fwrite(&header, sizeof header, 1, fp) == 1 &&
+        fwrite(entry->key, entry->key_size, 1, fp) == 1 &&
+        fwrite(data, size, 1, fp) == 1;
+
+   if (fclose(fp) != 0)
+      ok = FALSE;
+
+   if (!ok || rename(tmp_path, entry->path) != 0)
+      unlink(tmp_path);
+}
+
+#else /* !LP_DISK_CACHE */
+
+static boolean
+lp_cache_get_build_time(int64_t *build_time)
+{
+   return FALSE;
+}
+
+static void
+lp_cache_entry_read(struct lp_cache_entry *entry)
+{
+}
+
+static void
+lp_cache_entry_write(const struct lp_cache_entry *entry,
+                     const void *data, size_t size)
+{
+}
+
+#endif /* !LP_DISK_CACHE */
+
+
+/**
+ * Set up the process wide state once.
+ * \return  TRUE if the on-disk cache can be used
+ */
+static boolean
+lp_cache_init(void)
+{
+   pipe_mutex_lock(cache_mutex);
+
+   if (!cache_initialized) {
+      const char *dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+
+#if !LP_DISK_CACHE
+      if (dir && *dir) {
+         _debug_printf("gallivm: GALLIVM_CACHE_DIR is ignored, the on-disk "
+                       "shader cache needs MC-JIT and LLVM 3.3 or later\n");
+      }
+      dir = NULL;
+#endif
+
+      cache_initialized = TRUE;
+
+      memset(&cache_env, 0, sizeof cache_env);
+      cache_env.llvm_version = HAVE_LLVM;
+      cache_env.pointer_size = sizeof(void *);
+      cache_env.native_vector_width = lp_native_vector_width;
+      cache_env.debug_flags = gallivm_debug;
+      cache_env.perf_flags = gallivm_perf;
+      cache_env.cpu_caps = util_cpu_caps;
+      cache_env.cpu_caps.nr_cpus = 0;
+
+      if (dir && *dir &&
+          lp_cache_get_build_time(&cache_env.build_time)) {
+#if LP_DISK_CACHE
+         mkdir(dir, 0755);
+#endif
+         cache_dir = dir;
+      }
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+
+   return cache_dir != NULL;
+}
+
+
+/**
+ * Find the live code compiled for an entry's key, and reference it.
+ * Must be called with the cache mutex held.
+ */
+static struct lp_shared_code *
+lp_shared_code_find(const struct lp_cache_entry *entry)
+{
+   struct lp_shared_code *shared;
+
+   for (shared = shared_code[entry->hash % LP_SHARED_CODE_BUCKETS];
+        shared; shared = shared->next) {
+      if (shared->hash == entry->hash &&
+          shared->key_size == entry->key_size &&
+          memcmp(shared->key, entry->key, entry->key_size) == 0) {
+         shared->refcount++;
+         return shared;
+      }
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Attach a cache entry to a freshly created gallivm module.
+ *
+ * Must be called before any IR is generated.  The key should capture all
+ * the state the module is generated from besides the TGSI tokens.
+ *
+ * \return  TRUE if the object code was found on disk, in which case the
+ *          caller must only add the entry points, and use
+ *          gallivm_cache_stub_function() instead of building their bodies.
+ */
+boolean
+gallivm_cache_lookup(struct gallivm_state *gallivm,
+                     const void *key, unsigned key_size,
+                     const struct tgsi_token *tokens)
+{
+   struct lp_cache_entry *entry;
+   unsigned tokens_size;
+   boolean use_disk;
+   uint8_t *data;
+
+   assert(!gallivm->cache);
+   assert(!gallivm->compiled);
+
+   /* Unoptimized code is short lived and must not shadow the real thing */
+   if (gallivm->no_opt)
+      return FALSE;
+
+   use_disk = lp_cache_init();
+
+   tokens_size = tokens ? tgsi_num_tokens(tokens) * sizeof *tokens : 0;
+
+   entry = CALLOC_STRUCT(lp_cache_entry);
+   if (!entry)
+      return FALSE;
+
+   entry->key_size = sizeof cache_env + key_size + tokens_size;
+   entry->key = MALLOC(entry->key_size);
+   if (!entry->key) {
+      FREE(entry);
+      return FALSE;
+   }
+
+   data = entry->key;
+   memcpy(data, &cache_env, sizeof cache_env);
+   data += sizeof cache_env;
+   memcpy(data, key, key_size);
+   data += key_size;
+   if (tokens_size)
+      memcpy(data, tokens, tokens_size);
+
+   entry->hash = util_hash_crc32(entry->key, entry->key_size);
+
+   pipe_mutex_lock(cache_mutex);
+   entry->shared = lp_shared_code_find(entry);
+   pipe_mutex_unlock(cache_mutex);
+
+   /*
+    * The old JIT engine is created along with the module and emits code
+    * straight into executable memory; only MC-JIT produces relocatable
+    * objects which can be kept around.
+    */
+   if (!entry->shared && use_disk && !gallivm->engine) {
+      util_snprintf(entry->path, sizeof entry->path, "%s/%08x.o",
+                    cache_dir, entry->hash);
+
+      lp_cache_entry_read(entry);
+
+      if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+         debug_printf("module %s: cache %s (%s)\n",
+                      lp_get_module_id(gallivm->module),
+                      entry->object ? "hit" : "miss", entry->path);
+      }
+   }
+   else if (entry->shared && (gallivm_debug & GALLIVM_DEBUG_PERF)) {
+      debug_printf("module %s: sharing code of key %08x\n",
+                   lp_get_module_id(gallivm->module), entry->hash);
+   }
+
+   gallivm->cache = entry;
+
+   return entry->shared || entry->object;
+}
+
+
+/**
+ * Give an entry point of a module found in the cache a body.
+ *
+ * MC-JIT only looks up symbols in modules which define them, so the
+ * function needs a body, but it is never compiled as the object code is
+ * taken from the cache instead.
+ */
+void
+gallivm_cache_stub_function(struct gallivm_state *gallivm,
+                            LLVMValueRef func)
+{
+   LLVMBasicBlockRef block;
+
+   assert(gallivm->cache);
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, func, "entry");
+   LLVMPositionBuilderAtEnd(gallivm->builder, block);
+   LLVMBuildUnreachable(gallivm->builder);
+}
+
+
+/**
+ * Give the module's entry points names which only depend on the key,
+ * as names generated from per-process counters would not match the
+ * symbols in the cached object code.
+ * \return  TRUE if the object code is coming from the on-disk cache
+ */
+boolean
+lp_cache_entry_prepare(struct lp_cache_entry *entry,
+                       LLVMModuleRef module)
+{
+   LLVMValueRef func;
+   unsigned i = 0;
+
+   for (func = LLVMGetFirstFunction(module); func;
+        func = LLVMGetNextFunction(func)) {
+      char name[32];
+
+      if (LLVMIsDeclaration(func) ||
+          LLVMGetLinkage(func) == LLVMInternalLinkage)
+         continue;
+
+      util_snprintf(name, sizeof name, "lp_cached_%08x_%u", entry->hash, i++);
+      LLVMSetValueName(func, name);
+   }
+
+   return entry->object != NULL;
+}
+
+
+/**
+ * Called by MC-JIT before compiling the module.
+ */
+boolean
+lp_cache_entry_get_object(struct lp_cache_entry *entry,
+                          const void **data, size_t *size)
+{
+   if (!entry->object)
+      return FALSE;
+
+   *data = entry->object;
+   *size = entry->object_size;
+   return TRUE;
+}
+
+
+/**
+ * Called by MC-JIT after compiling the module.
+ */
+void
+lp_cache_entry_put_object(struct lp_cache_entry *entry,
+                          const void *data, size_t size)
+{
+   if (entry->object || !size)
+      return;
+
+   lp_cache_entry_write(entry, data, size);
+}
+
+
+/**
+ * Hand the reference to the code of another module with the same key over
+ * to the caller.
+ * \return  NULL if the module's code has to be compiled
+ */
+struct lp_shared_code *
+lp_cache_entry_take_shared(struct lp_cache_entry *entry)
+{
+   struct lp_shared_code *shared = entry->shared;
+
+   entry->shared = NULL;
+   return shared;
+}
+
+
+/**
+ * Make the freshly compiled code of a module available to all other
+ * modules with the same key.
+ *
+ * The returned object takes over the code and the memory manager, and
+ * holds one reference for the caller.
+ * \return  NULL if the code could not be shared
+ */
+struct lp_shared_code *
+lp_cache_entry_share(struct lp_cache_entry *entry,
+                     LLVMExecutionEngineRef engine,
+                     LLVMModuleRef module,
+                     struct lp_generated_code **code,
+                     LLVMMCJITMemoryManagerRef *memorymgr)
+{
+   struct lp_shared_code *shared, *other;
+   LLVMValueRef func;
+   unsigned i;
+
+   shared = CALLOC_STRUCT(lp_shared_code);
+   if (!shared)
+      return NULL;
+
+   for (func = LLVMGetFirstFunction(module); func;
+        func = LLVMGetNextFunction(func)) {
+      if (!LLVMIsDeclaration(func) &&
+          LLVMGetLinkage(func) != LLVMInternalLinkage)
+         shared->num_functions++;
+   }
+
+   shared->key = MALLOC(entry->key_size);
+   shared->functions = CALLOC(MAX2(shared->num_functions, 1),
+                              sizeof *shared->functions);
+   if (!shared->key || !shared->functions) {
+      FREE(shared->functions);
+      FREE(shared->key);
+      FREE(shared);
+      return NULL;
+   }
+
+   /* This forces code generation with the old JIT */
+   i = 0;
+   for (func = LLVMGetFirstFunction(module); func;
+        func = LLVMGetNextFunction(func)) {
+      if (!LLVMIsDeclaration(func) &&
+          LLVMGetLinkage(func) != LLVMInternalLinkage)
+         shared->functions[i++] =
+            pointer_to_func(LLVMGetPointerToGlobal(engine, func));
+   }
+
+   memcpy(shared->key, entry->key, entry->key_size);
+   shared->key_size = entry->key_size;
+   shared->hash = entry->hash;
+   shared->refcount = 1;
+
+   pipe_mutex_lock(cache_mutex);
+
+   /* Another thread may have compiled the same key in the meantime */
+   other = lp_shared_code_find(entry);
+   if (other) {
+      other->refcount--;
+      pipe_mutex_unlock(cache_mutex);
+      FREE(shared->functions);
+      FREE(shared->key);
+      FREE(shared);
+      return NULL;
+   }
+
+   shared->next = shared_code[shared->hash % LP_SHARED_CODE_BUCKETS];
+   shared_code[shared->hash % LP_SHARED_CODE_BUCKETS] = shared;
+
+   pipe_mutex_unlock(cache_mutex);
+
+   shared->code = *code;
+   shared->memorymgr = *memorymgr;
+   *code = NULL;
+   *memorymgr = NULL;
+
+   return shared;
+}
+
+
+/**
+ * Look up the code of one of the entry points of a module.
+ */
+func_pointer
+lp_shared_code_function(const struct lp_shared_code *shared,
+                        LLVMValueRef func)
+{
+   unsigned hash, index;
+
+   if (sscanf(LLVMGetValueName(func), "lp_cached_%08x_%u",
+              &hash, &index) != 2 ||
+       hash != shared->hash ||
+       index >= shared->num_functions) {
+      assert(0);
+      return NULL;
+   }
+
+   return shared->functions[index];
+}
+
+
+void
+lp_shared_code_unreference(struct lp_shared_code *shared)
+{
+   struct lp_shared_code **prev;
+
+   if (!shared)
+      return;
+
+   pipe_mutex_lock(cache_mutex);
+
+   assert(shared->refcount);
+   if (--shared->refcount) {
+      pipe_mutex_unlock(cache_mutex);
+      return;
+   }
+
+   for (prev = &shared_code[shared->hash % LP_SHARED_CODE_BUCKETS];
+        *prev != shared; prev = &(*prev)->next)
+      assert(*prev);
+   *prev = shared->next;
+
+   pipe_mutex_unlock(cache_mutex);
+
+   lp_free_generated_code(shared->code);
+   lp_free_memory_manager(shared->memorymgr);
+   FREE(shared->functions);
+   FREE(shared->key);
+   FREE(shared);
+}
+
+
+void
+lp_cache_entry_destroy(struct lp_cache_entry *entry)
+{
+   if (entry) {
+      lp_shared_code_unreference(entry->shared);
+      FREE(entry->object);
+      FREE(entry->key);
+      FREE(entry);
+   }
+}
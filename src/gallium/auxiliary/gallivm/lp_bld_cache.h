@@ -0,0 +1,111 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * On-disk cache of the object code generated for a gallivm module.
+ *
+ * Callers describe what a module is going to contain with
+ * gallivm_cache_lookup() before generating any IR.  On a hit they only need
+ * to add the module's entry points with gallivm_cache_stub_function() in the
+ * same order as they would normally be generated; the object code is then
+ * loaded from disk instead of being optimized and compiled.
+ *
+ * The compiled code of a key is also shared in memory by all modules of
+ * the process with that key, see struct lp_shared_code.
+ */
+
+#ifndef LP_BLD_CACHE_H
+#define LP_BLD_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "util/u_pointer.h"
+#include "lp_bld.h"
+#include <llvm-c/ExecutionEngine.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct gallivm_state;
+struct tgsi_token;
+struct lp_cache_entry;
+struct lp_shared_code;
+struct lp_generated_code;
+
+
+boolean
+gallivm_cache_lookup(struct gallivm_state *gallivm,
+                     const void *key, unsigned key_size,
+                     const struct tgsi_token *tokens);
+
+void
+gallivm_cache_stub_function(struct gallivm_state *gallivm,
+                            LLVMValueRef func);
+
+boolean
+lp_cache_entry_prepare(struct lp_cache_entry *entry,
+                       LLVMModuleRef module);
+
+boolean
+lp_cache_entry_get_object(struct lp_cache_entry *entry,
+                          const void **data, size_t *size);
+
+void
+lp_cache_entry_put_object(struct lp_cache_entry *entry,
+                          const void *data, size_t size);
+
+struct lp_shared_code *
+lp_cache_entry_take_shared(struct lp_cache_entry *entry);
+
+struct lp_shared_code *
+lp_cache_entry_share(struct lp_cache_entry *entry,
+                     LLVMExecutionEngineRef engine,
+                     LLVMModuleRef module,
+                     struct lp_generated_code **code,
+                     LLVMMCJITMemoryManagerRef *memorymgr);
+
+void
+lp_cache_entry_destroy(struct lp_cache_entry *entry);
+
+func_pointer
+lp_shared_code_function(const struct lp_shared_code *shared,
+                        LLVMValueRef func);
+
+void
+lp_shared_code_unreference(struct lp_shared_code *shared);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* !LP_BLD_CACHE_H */
@@ -47,6 +47,18 @@
 #define GALLIVM_DEBUG_GC            (1 << 8)
 
 
+/** Optimization passes and code generation fast paths to skip */
+#define GALLIVM_PERF_NO_SROA           (1 << 0)
+#define GALLIVM_PERF_NO_LICM           (1 << 1)
+#define GALLIVM_PERF_NO_SIMPLIFYCFG    (1 << 2)
+#define GALLIVM_PERF_NO_REASSOCIATE    (1 << 3)
+#define GALLIVM_PERF_NO_CONSTPROP      (1 << 4)
+#define GALLIVM_PERF_NO_INSTCOMBINE    (1 << 5)
+#define GALLIVM_PERF_NO_GVN            (1 << 6)
+#define GALLIVM_PERF_NO_OPT            (1 << 7)
+#define GALLIVM_PERF_NO_SAMPLE_FASTPATH (1 << 8)
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,6 +70,8 @@ extern unsigned gallivm_debug;
 #define gallivm_debug 0
 #endif
 
+extern unsigned gallivm_perf;
+
 
 static INLINE void
 lp_build_name(LLVMValueRef val, const char *format, ...)
@@ -37,43 +37,13 @@
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
+#include "lp_bld_cache.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
 #include <llvm-c/BitWriter.h>
 
 
-/* Only MCJIT is available as of LLVM SVN r216982 */
-#if HAVE_LLVM >= 0x0306
-
-#define USE_MCJIT 1
-#define HAVE_AVX 1
-
-#else
-
-/**
- * AVX is supported in:
- * - standard JIT from LLVM 3.2 onwards
- * - MC-JIT from LLVM 3.1
- *   - MC-JIT supports limited OSes (MacOSX and Linux)
- * - standard JIT in LLVM 3.1, with backports
- */
-#if defined(PIPE_ARCH_PPC_64) || defined(PIPE_ARCH_S390) || defined(PIPE_ARCH_ARM) || defined(PIPE_ARCH_AARCH64)
-#  define USE_MCJIT 1
-#  define HAVE_AVX 0
-#elif HAVE_LLVM >= 0x0302 || (HAVE_LLVM == 0x0301 && defined(HAVE_JIT_AVX_SUPPORT))
-#  define USE_MCJIT 0
-#  define HAVE_AVX 1
-#elif HAVE_LLVM == 0x0301 && (defined(PIPE_OS_LINUX) || defined(PIPE_OS_APPLE))
-#  define USE_MCJIT 1
-#  define HAVE_AVX 1
-#else
-#  define USE_MCJIT 0
-#  define HAVE_AVX 0
-#endif
-
-#endif /* HAVE_LLVM >= 0x0306 */
-
 #if USE_MCJIT
 void LLVMLinkInMCJIT();
 #endif
@@ -98,6 +68,24 @@ DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_debug, "GALLIVM_DEBUG", lp_bld_debug_flags,
 #endif
 
 
+unsigned gallivm_perf = 0;
+
+static const struct debug_named_value lp_bld_perf_flags[] = {
+   { "no_sroa",         GALLIVM_PERF_NO_SROA, "skip scalar replacement of aggregates" },
+   { "no_licm",         GALLIVM_PERF_NO_LICM, "skip loop invariant code motion" },
+   { "no_simplifycfg",  GALLIVM_PERF_NO_SIMPLIFYCFG, "skip control flow simplification" },
+   { "no_reassociate",  GALLIVM_PERF_NO_REASSOCIATE, "skip reassociation" },
+   { "no_constprop",    GALLIVM_PERF_NO_CONSTPROP, "skip constant propagation" },
+   { "no_instcombine",  GALLIVM_PERF_NO_INSTCOMBINE, "skip instruction combining" },
+   { "no_gvn",          GALLIVM_PERF_NO_GVN, "skip global value numbering" },
+   { "no_opt",          GALLIVM_PERF_NO_OPT, "compile all code as quickly as possible" },
+   { "no_sample_fastpath", GALLIVM_PERF_NO_SAMPLE_FASTPATH, "use the generic texture sampling paths only" },
+   DEBUG_NAMED_VALUE_END
+};
+
+DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_perf, "GALLIVM_PERF", lp_bld_perf_flags, 0)
+
+
 static boolean gallivm_initialized = FALSE;
 
 unsigned lp_native_vector_width;
@@ -144,19 +132,26 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMSetDataLayout(gallivm->module, td_str);
    free(td_str);
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if (!gallivm->no_opt) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
-       * but there are more on SVN.
+       * but there are more on SVN.  Each can be skipped with GALLIVM_PERF.
        * TODO: Add more passes.
        */
-      LLVMAddScalarReplAggregatesPass(gallivm->passmgr);
-      LLVMAddLICMPass(gallivm->passmgr);
-      LLVMAddCFGSimplificationPass(gallivm->passmgr);
-      LLVMAddReassociatePass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_SROA))
+         LLVMAddScalarReplAggregatesPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_LICM))
+         LLVMAddLICMPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_SIMPLIFYCFG))
+         LLVMAddCFGSimplificationPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_REASSOCIATE))
+         LLVMAddReassociatePass(gallivm->passmgr);
       LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
-      LLVMAddConstantPropagationPass(gallivm->passmgr);
-      LLVMAddInstructionCombiningPass(gallivm->passmgr);
-      LLVMAddGVNPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_CONSTPROP))
+         LLVMAddConstantPropagationPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_INSTCOMBINE))
+         LLVMAddInstructionCombiningPass(gallivm->passmgr);
+      if (!(gallivm_perf & GALLIVM_PERF_NO_GVN))
+         LLVMAddGVNPass(gallivm->passmgr);
    }
    else {
       /* We need at least this pass to prevent the backends to fail in
@@ -198,6 +193,8 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    if (gallivm->builder)
       LLVMDisposeBuilder(gallivm->builder);
 
+   lp_cache_entry_destroy(gallivm->cache);
+
    /* The LLVMContext should be owned by the parent of gallivm. */
 
    gallivm->engine = NULL;
@@ -206,6 +203,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -221,6 +219,8 @@ gallivm_free_code(struct gallivm_state *gallivm)
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
    gallivm->memorymgr = NULL;
+   lp_shared_code_unreference(gallivm->shared);
+   gallivm->shared = NULL;
 }
 
 
@@ -232,7 +232,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if (gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -245,6 +245,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     USE_MCJIT,
+                                                    gallivm->cache,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -306,6 +307,10 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!gallivm->context)
       goto fail;
 
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) ||
+       (gallivm_perf & GALLIVM_PERF_NO_OPT))
+      gallivm->no_opt = TRUE;
+
    gallivm->module = LLVMModuleCreateWithNameInContext(name,
                                                        gallivm->context);
    if (!gallivm->module)
@@ -397,6 +402,8 @@ lp_build_init(void)
    gallivm_debug = debug_get_option_gallivm_debug();
 #endif
 
+   gallivm_perf = debug_get_option_gallivm_perf();
+
    lp_set_target_options();
 
 #if USE_MCJIT
@@ -508,6 +515,29 @@ gallivm_create(const char *name, LLVMContextRef context)
 }
 
 
+/**
+ * Create a new gallivm_state object whose code is generated as quickly as
+ * possible, skipping all but the essential optimizations.  Meant for code
+ * which is needed right away and replaced by optimized code later.
+ */
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->no_opt = TRUE;
+      if (!init_gallivm_state(gallivm, name, context)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   return gallivm;
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -554,6 +584,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
    int64_t time_begin;
+   boolean cached = FALSE;
 
    assert(!gallivm->compiled);
 
@@ -562,13 +593,62 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+   if (gallivm->cache) {
+      if (gallivm->has_pointer_constants) {
+         lp_cache_entry_destroy(gallivm->cache);
+         gallivm->cache = NULL;
+      }
+      else {
+         cached = lp_cache_entry_prepare(gallivm->cache, gallivm->module);
+         gallivm->shared = lp_cache_entry_take_shared(gallivm->cache);
+      }
+   }
+
+   /*
+    * Another module with the same key is alive, so there is nothing to
+    * compile: all the entry points are looked up in its code.
+    */
+   if (gallivm->shared) {
+      gallivm->shared_hit = TRUE;
+
+      if (gallivm->passmgr) {
+         LLVMDisposePassManager(gallivm->passmgr);
+         gallivm->passmgr = NULL;
+      }
+
+#if !USE_MCJIT
+      /*
+       * The old JIT engine had to be created along with the module, as IR
+       * generation needs its target data.  It will never compile anything
+       * now, so take the module back and let the engine go right away.
+       */
+      if (gallivm->engine) {
+         LLVMModuleRef module;
+         char *error = NULL;
+
+         if (!LLVMRemoveModule(gallivm->engine, gallivm->module,
+                               &module, &error)) {
+            LLVMDisposeExecutionEngine(gallivm->engine);
+            gallivm->engine = NULL;
+            gallivm->target = NULL;
+         }
+         else {
+            LLVMDisposeMessage(error);
+         }
+      }
+#endif
+
+      ++gallivm->compiled;
+      return;
+   }
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   /* Run optimization passes */
+   /* Run optimization passes, unless the code is coming from the cache */
    LLVMInitializeFunctionPassManager(gallivm->passmgr);
    func = LLVMGetFirstFunction(gallivm->module);
-   while (func) {
+   while (func && !cached) {
       if (0) {
          debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
       }
@@ -599,6 +679,14 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 #endif
    assert(gallivm->engine);
 
+   if (gallivm->cache) {
+      gallivm->shared = lp_cache_entry_share(gallivm->cache,
+                                             gallivm->engine,
+                                             gallivm->module,
+                                             &gallivm->code,
+                                             &gallivm->memorymgr);
+   }
+
    ++gallivm->compiled;
 }
 
@@ -612,6 +700,13 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    func_pointer jit_func;
 
    assert(gallivm->compiled);
+
+   if (gallivm->shared_hit) {
+      jit_func = lp_shared_code_function(gallivm->shared, func);
+      assert(jit_func);
+      return jit_func;
+   }
+
    assert(gallivm->engine);
 
    code = LLVMGetPointerToGlobal(gallivm->engine, func);
@@ -30,12 +30,49 @@
 #define LP_BLD_INIT_H
 
 
+#include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
 #include "util/u_pointer.h" // for func_pointer
 #include "lp_bld.h"
 #include <llvm-c/ExecutionEngine.h>
 
 
+/* Only MCJIT is available as of LLVM SVN r216982 */
+#if HAVE_LLVM >= 0x0306
+
+#define USE_MCJIT 1
+#define HAVE_AVX 1
+
+#else
+
+/**
+ * AVX is supported in:
+ * - standard JIT from LLVM 3.2 onwards
+ * - MC-JIT from LLVM 3.1
+ *   - MC-JIT supports limited OSes (MacOSX and Linux)
+ * - standard JIT in LLVM 3.1, with backports
+ */
+#if defined(PIPE_ARCH_PPC_64) || defined(PIPE_ARCH_S390) || defined(PIPE_ARCH_ARM) || defined(PIPE_ARCH_AARCH64)
+#  define USE_MCJIT 1
+#  define HAVE_AVX 0
+#elif HAVE_LLVM >= 0x0302 || (HAVE_LLVM == 0x0301 && defined(HAVE_JIT_AVX_SUPPORT))
+#  define USE_MCJIT 0
+#  define HAVE_AVX 1
+#elif HAVE_LLVM == 0x0301 && (defined(PIPE_OS_LINUX) || defined(PIPE_OS_APPLE))
+#  define USE_MCJIT 1
+#  define HAVE_AVX 1
+#else
+#  define USE_MCJIT 0
+#  define HAVE_AVX 0
+#endif
+
+#endif /* HAVE_LLVM >= 0x0306 */
+
+
+struct lp_cache_entry;
+struct lp_shared_code;
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
@@ -47,6 +84,16 @@ struct gallivm_state
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
    unsigned compiled;
+   /** On-disk cache slot, see lp_bld_cache.h */
+   struct lp_cache_entry *cache;
+   /** Code embeds addresses of this process and must not be cached */
+   boolean has_pointer_constants;
+   /** Skip optimizations, see gallivm_create_unoptimized() */
+   boolean no_opt;
+   /** Code shared with other modules of the same key, see lp_bld_cache.c */
+   struct lp_shared_code *shared;
+   /** The shared code was compiled for another module */
+   boolean shared_hit;
 };
 
 
@@ -57,6 +104,9 @@ lp_build_init(void);
 struct gallivm_state *
 gallivm_create(const char *name, LLVMContextRef context);
 
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -70,11 +70,17 @@
 #include <llvm/Support/CBindingWrapping.h>
 #endif
 
+#if HAVE_LLVM >= 0x0303 && HAVE_LLVM < 0x0306
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+#endif
+
 #include "pipe/p_config.h"
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 
 #include "lp_bld_misc.h"
+#include "lp_bld_cache.h"
 
 namespace {
 
@@ -328,9 +334,15 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       typedef std::vector<void *> Vec;
       Vec FunctionBody, ExceptionTable;
       llvm::JITMemoryManager *TheMM;
+#if HAVE_LLVM >= 0x0303
+      llvm::ObjectCache *Cache;
+#endif
 
       GeneratedCode(llvm::JITMemoryManager *MM) {
          TheMM = MM;
+#if HAVE_LLVM >= 0x0303
+         Cache = NULL;
+#endif
       }
 
       ~GeneratedCode() {
@@ -346,6 +358,9 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 #if HAVE_LLVM < 0x0304
 	 for ( i = ExceptionTable.begin(); i != ExceptionTable.end(); ++i )
 	    TheMM->deallocateExceptionTable(*i);
+#endif
+#if HAVE_LLVM >= 0x0303
+         delete Cache;
 #endif
       }
    };
@@ -378,6 +393,16 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          delete (GeneratedCode *) code;
       }
 
+#if HAVE_LLVM >= 0x0303
+      /*
+       * The engine doesn't take ownership of its object cache, so keep it
+       * for as long as the code.
+       */
+      void setObjectCache(llvm::ObjectCache *Cache) {
+         code->Cache = Cache;
+      }
+#endif
+
 #if HAVE_LLVM < 0x0304
       virtual void deallocateExceptionTable(void *ET) {
          // remember for later deallocation
@@ -391,12 +416,48 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       }
 };
 
+
+#if HAVE_LLVM >= 0x0303
+
+/*
+ * Feeds MC-JIT with object code from, and saves what it compiles to, the
+ * on-disk cache entry of a module.  See lp_bld_cache.c.
+ */
+class ShaderObjectCache : public llvm::ObjectCache {
+
+   struct lp_cache_entry *Entry;
+
+   public:
+      ShaderObjectCache(struct lp_cache_entry *E) : Entry(E) {}
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        const llvm::MemoryBuffer *Obj) {
+         lp_cache_entry_put_object(Entry, Obj->getBufferStart(),
+                                   Obj->getBufferSize());
+      }
+
+      virtual llvm::MemoryBuffer *getObject(const llvm::Module *M) {
+         const void *Data;
+         size_t Size;
+
+         if (!lp_cache_entry_get_object(Entry, &Data, &Size))
+            return NULL;
+
+         return llvm::MemoryBuffer::getMemBufferCopy(
+                   llvm::StringRef((const char *) Data, Size),
+                   M->getModuleIdentifier());
+      }
+};
+
+#endif
+
 #endif
 
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
  * - set target options
+ * - hooks up the on-disk cache with MCJIT
  *
  * See also:
  * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
@@ -411,6 +472,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cache_entry *Cache,
                                         char **OutError)
 {
    using namespace llvm;
@@ -521,6 +583,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT = builder.create(builder.selectTarget(TT, MArch, MCPU, MAttrs));
 #endif
    if (JIT) {
+#if HAVE_LLVM >= 0x0303
+      if (useMCJIT && Cache) {
+         ShaderObjectCache *OC = new ShaderObjectCache(Cache);
+         MM->setObjectCache(OC);
+         JIT->setObjectCache(OC);
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
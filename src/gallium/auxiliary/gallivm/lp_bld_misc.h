@@ -40,6 +40,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_cache_entry;
 
 
 extern void
@@ -57,6 +58,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cache_entry *Cache,
                                         char **OutError);
 
 extern void
@@ -810,6 +810,150 @@ lp_build_sample_image_nearest_afloat(struct lp_build_sample_context *bld,
 }
 
 
+/**
+ * Where the texel pairs of lp_build_sample_fetch_texel_pairs() need
+ * fixing up, see lp_build_sample_image_linear().
+ */
+struct lp_build_sample_pairs
+{
+   /** lanes whose right texel is the left one (clamped on the left) */
+   LLVMValueRef left_mask;
+   /** lanes whose left texel is the right one (clamped on the right) */
+   LLVMValueRef right_mask;
+   /** lanes whose right texel is the first of the row (repeat), or NULL */
+   LLVMValueRef wrap_mask;
+   /** lanes of images only one texel wide, which have no pair to load */
+   LLVMValueRef narrow_mask;
+   /** offset of the pair within the row, to find the row start */
+   LLVMValueRef x_offset;
+};
+
+
+/**
+ * Fetch the two horizontally adjacent texels of a 32 bit format starting
+ * at each offset with a single 64 bit load per pixel, instead of gathering
+ * the left and right neighbors separately.
+ * The pairs always lie within the row, except for images one texel wide.
+ * Those are fetched with separate 32 bit loads so that nothing past the
+ * end of the image is ever read, whatever the row padding.
+ */
+static void
+lp_build_sample_fetch_texel_pairs(struct lp_build_sample_context *bld,
+                                  LLVMValueRef data_ptr,
+                                  LLVMValueRef offset,
+                                  const struct lp_build_sample_pairs *pairs_info,
+                                  LLVMValueRef *texel0,
+                                  LLVMValueRef *texel1)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *int_coord_bld = &bld->int_coord_bld;
+   const unsigned length = int_coord_bld->type.length;
+   LLVMTypeRef i64_type = LLVMInt64TypeInContext(gallivm->context);
+   LLVMTypeRef i32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef pairs_type = LLVMVectorType(i64_type, length);
+   LLVMValueRef shuffles0[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef shuffles1[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef shuffles[2 * LP_MAX_VECTOR_LENGTH];
+   struct lp_build_if_state if_ctx;
+   LLVMValueRef pairs_var, pairs;
+   LLVMValueRef lo, hi;
+   unsigned i;
+
+   for (i = 0; i < length; ++i) {
+      shuffles0[i] = lp_build_const_int32(gallivm, 2 * i);
+      shuffles1[i] = lp_build_const_int32(gallivm, 2 * i + 1);
+      shuffles[2 * i] = lp_build_const_int32(gallivm, i);
+      shuffles[2 * i + 1] = lp_build_const_int32(gallivm, length + i);
+   }
+
+   pairs_var = lp_build_alloca(gallivm, pairs_type, "pairs_var");
+
+   lp_build_if(&if_ctx, gallivm,
+               lp_build_any_true_range(int_coord_bld, length,
+                                       pairs_info->narrow_mask));
+   {
+      LLVMValueRef offset1;
+
+      /* only load the right texel where there is one */
+      offset1 = lp_build_andnot(int_coord_bld,
+                                lp_build_const_int_vec(gallivm,
+                                                       int_coord_bld->type, 4),
+                                pairs_info->narrow_mask);
+      offset1 = lp_build_add(int_coord_bld, offset, offset1);
+
+      lo = lp_build_gather(gallivm, length, 32, 32, data_ptr, offset, TRUE);
+      hi = lp_build_gather(gallivm, length, 32, 32, data_ptr, offset1, TRUE);
+      pairs = LLVMBuildShuffleVector(builder, lo, hi,
+                                     LLVMConstVector(shuffles, 2 * length), "");
+      pairs = LLVMBuildBitCast(builder, pairs, pairs_type, "");
+      LLVMBuildStore(builder, pairs, pairs_var);
+   }
+   lp_build_else(&if_ctx);
+   {
+      pairs = LLVMGetUndef(pairs_type);
+      for (i = 0; i < length; ++i) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, i);
+         LLVMValueRef ptr, pair;
+
+         ptr = lp_build_gather_elem_ptr(gallivm, length, data_ptr, offset, i);
+         ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(i64_type, 0), "");
+         pair = LLVMBuildLoad(builder, ptr, "");
+         /* texels are only guaranteed to be 32 bit aligned */
+         lp_set_load_alignment(pair, 4);
+         pairs = LLVMBuildInsertElement(builder, pairs, pair, index, "");
+      }
+      LLVMBuildStore(builder, pairs, pairs_var);
+   }
+   lp_build_endif(&if_ctx);
+
+   /*
+    * Split the pairs into the left and right texels. Bitcasting keeps the
+    * memory order, so the left texel is always the even element.
+    */
+   pairs = LLVMBuildLoad(builder, pairs_var, "");
+   pairs = LLVMBuildBitCast(builder, pairs,
+                            LLVMVectorType(i32_type, 2 * length), "");
+   lo = LLVMBuildShuffleVector(builder, pairs, LLVMGetUndef(LLVMTypeOf(pairs)),
+                               LLVMConstVector(shuffles0, length), "");
+   hi = LLVMBuildShuffleVector(builder, pairs, LLVMGetUndef(LLVMTypeOf(pairs)),
+                               LLVMConstVector(shuffles1, length), "");
+
+   hi = lp_build_select(int_coord_bld, pairs_info->left_mask, lo, hi);
+   lo = lp_build_select(int_coord_bld, pairs_info->right_mask, hi, lo);
+
+   if (pairs_info->wrap_mask) {
+      /*
+       * The first texel of the row isn't next to the last one, fetch it
+       * separately, but only when some pixel actually needs it.
+       */
+      LLVMValueRef hi_var = lp_build_alloca(gallivm, int_coord_bld->vec_type,
+                                            "hi_var");
+
+      LLVMBuildStore(builder, hi, hi_var);
+      lp_build_if(&if_ctx, gallivm,
+                  lp_build_any_true_range(int_coord_bld, length,
+                                          pairs_info->wrap_mask));
+      {
+         LLVMValueRef first;
+
+         first = lp_build_sub(int_coord_bld, offset, pairs_info->x_offset);
+         first = lp_build_gather(gallivm, length, 32, 32, data_ptr, first,
+                                 TRUE);
+         LLVMBuildStore(builder,
+                        lp_build_select(int_coord_bld, pairs_info->wrap_mask,
+                                        first, hi),
+                        hi_var);
+      }
+      lp_build_endif(&if_ctx);
+      hi = LLVMBuildLoad(builder, hi_var, "");
+   }
+
+   *texel0 = lo;
+   *texel1 = hi;
+}
+
+
 /**
  * Fetch texels for image with linear sampling.
  * Return filtered color as two vectors of 16-bit fixed point values.
@@ -823,6 +967,7 @@ lp_build_sample_fetch_image_linear(struct lp_build_sample_context *bld,
                                    LLVMValueRef s_fpart,
                                    LLVMValueRef t_fpart,
                                    LLVMValueRef r_fpart,
+                                   const struct lp_build_sample_pairs *pairs,
                                    LLVMValueRef *colors)
 {
    const unsigned dims = bld->dims;
@@ -907,6 +1052,22 @@ lp_build_sample_fetch_image_linear(struct lp_build_sample_context *bld,
 
    for (k = 0; k < numk; k++) {
       for (j = 0; j < numj; j++) {
+         if (pairs) {
+            /*
+             * Both texels of the row come from a single load, see
+             * lp_build_sample_image_linear().
+             */
+            lp_build_sample_fetch_texel_pairs(bld, data_ptr, offset[k][j][0],
+                                              pairs,
+                                              &neighbors[k][j][0],
+                                              &neighbors[k][j][1]);
+            neighbors[k][j][0] = LLVMBuildBitCast(builder, neighbors[k][j][0],
+                                                  u8n_vec_type, "");
+            neighbors[k][j][1] = LLVMBuildBitCast(builder, neighbors[k][j][1],
+                                                  u8n_vec_type, "");
+            continue;
+         }
+
          for (i = 0; i < 2; i++) {
             LLVMValueRef rgba8;
 
@@ -1024,10 +1185,26 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    LLVMValueRef z_offset0, z_offset1;
    LLVMValueRef offset[2][2][2]; /* [z][y][x] */
    LLVMValueRef x_subcoord[2], y_subcoord[2], z_subcoord[2];
+   struct lp_build_sample_pairs pairs;
+   boolean fetch_pairs;
    unsigned x, y, z;
 
    lp_build_context_init(&i32, bld->gallivm, lp_type_int_vec(32, bld->vector_width));
 
+   /*
+    * For bilinear filtering of clamped or power of two repeated 2D rgba8
+    * images the left and right texels of each row can be fetched with a
+    * single load. Only the pixels wrapping around from the last to the
+    * first texel of a row need another one.
+    */
+   fetch_pairs = dims == 2 &&
+                 util_format_is_rgba8_variant(bld->format_desc) &&
+                 (bld->static_sampler_state->wrap_s == PIPE_TEX_WRAP_CLAMP_TO_EDGE ||
+                  (bld->static_sampler_state->wrap_s == PIPE_TEX_WRAP_REPEAT &&
+                   bld->static_texture_state->pot_width)) &&
+                 !bld->static_sampler_state->force_nearest_s &&
+                 !(gallivm_perf & GALLIVM_PERF_NO_SAMPLE_FASTPATH);
+
    lp_build_extract_image_sizes(bld,
                                 &bld->int_size_bld,
                                 bld->int_coord_type,
@@ -1116,14 +1293,77 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    z_stride = img_stride_vec;
 
    /* do texcoord wrapping and compute texel offsets */
-   lp_build_sample_wrap_linear_int(bld,
-                                   bld->format_desc->block.width,
-                                   s_ipart, &s_fpart, s_float,
-                                   width_vec, x_stride, offsets[0],
-                                   bld->static_texture_state->pot_width,
-                                   bld->static_sampler_state->wrap_s,
-                                   &x_offset0, &x_offset1,
-                                   &x_subcoord[0], &x_subcoord[1]);
+   if (fetch_pairs) {
+      struct lp_build_context *int_coord_bld = &bld->int_coord_bld;
+      LLVMValueRef width_minus_two;
+      LLVMValueRef x0;
+
+      width_minus_two = lp_build_sub(int_coord_bld, width_vec,
+                                     lp_build_const_int_vec(bld->gallivm,
+                                                            int_coord_bld->type,
+                                                            2));
+      pairs.narrow_mask = lp_build_compare(bld->gallivm, int_coord_bld->type,
+                                           PIPE_FUNC_LESS,
+                                           width_minus_two,
+                                           int_coord_bld->zero);
+
+      if (bld->static_sampler_state->wrap_s == PIPE_TEX_WRAP_REPEAT) {
+         LLVMValueRef width_minus_one;
+
+         /*
+          * Where the footprint wraps around the pair is moved one texel to
+          * the left, so the last texel of the row is its right one.
+          */
+         width_minus_one = lp_build_sub(int_coord_bld, width_vec,
+                                        int_coord_bld->one);
+         x0 = LLVMBuildAnd(builder, s_ipart, width_minus_one, "");
+         pairs.left_mask = int_coord_bld->zero;
+         pairs.right_mask = lp_build_compare(bld->gallivm,
+                                             int_coord_bld->type,
+                                             PIPE_FUNC_EQUAL,
+                                             x0, width_minus_one);
+         pairs.wrap_mask = pairs.right_mask;
+         x0 = lp_build_min(int_coord_bld, x0, width_minus_two);
+         x0 = lp_build_max(int_coord_bld, x0, int_coord_bld->zero);
+      }
+      else {
+         /*
+          * Clamp the left texel so the pair always lies within the row, and
+          * remember where the footprint hangs over the left or right edge.
+          */
+         x0 = lp_build_min(int_coord_bld, s_ipart, width_minus_two);
+         x0 = lp_build_max(int_coord_bld, x0, int_coord_bld->zero);
+
+         pairs.left_mask = lp_build_or(int_coord_bld,
+                                       lp_build_compare(bld->gallivm,
+                                                        int_coord_bld->type,
+                                                        PIPE_FUNC_LESS,
+                                                        s_ipart,
+                                                        int_coord_bld->zero),
+                                       pairs.narrow_mask);
+         pairs.right_mask = lp_build_compare(bld->gallivm,
+                                             int_coord_bld->type,
+                                             PIPE_FUNC_GREATER,
+                                             s_ipart, width_minus_two);
+         pairs.wrap_mask = NULL;
+      }
+
+      x_offset0 = lp_build_mul(int_coord_bld, x0, x_stride);
+      x_offset1 = x_offset0;
+      x_subcoord[0] = int_coord_bld->zero;
+      x_subcoord[1] = int_coord_bld->zero;
+      pairs.x_offset = x_offset0;
+   }
+   else {
+      lp_build_sample_wrap_linear_int(bld,
+                                      bld->format_desc->block.width,
+                                      s_ipart, &s_fpart, s_float,
+                                      width_vec, x_stride, offsets[0],
+                                      bld->static_texture_state->pot_width,
+                                      bld->static_sampler_state->wrap_s,
+                                      &x_offset0, &x_offset1,
+                                      &x_subcoord[0], &x_subcoord[1]);
+   }
 
    /* add potential cube/array/mip offsets now as they are constant per pixel */
    if (has_layer_coord(bld->static_texture_state->target)) {
@@ -1187,6 +1427,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    lp_build_sample_fetch_image_linear(bld, data_ptr, offset,
                                       x_subcoord, y_subcoord,
                                       s_fpart, t_fpart, r_fpart,
+                                      fetch_pairs ? &pairs : NULL,
                                       colors);
 }
 
@@ -1355,7 +1596,7 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
 
    lp_build_sample_fetch_image_linear(bld, data_ptr, offset,
                                       x_subcoord, y_subcoord,
-                                      s_fpart, t_fpart, r_fpart,
+                                      s_fpart, t_fpart, r_fpart, NULL,
                                       colors);
 }
 
@@ -46,6 +46,10 @@
 #include <signal.h>
 #endif
 
+#if defined(PIPE_OS_LINUX) && !defined(PIPE_OS_ANDROID)
+#include <sched.h>
+#endif
+
 
 /* pipe_thread
  */
@@ -85,6 +89,27 @@ static INLINE int pipe_thread_destroy( pipe_thread thread )
    return thrd_detach( thread );
 }
 
+/**
+ * Restrict the calling thread to run on the given CPU only.
+ * Returns FALSE if thread affinity is not supported on this platform.
+ */
+static INLINE boolean pipe_thread_pin_to_cpu( unsigned cpu )
+{
+#if defined(PIPE_OS_LINUX) && !defined(PIPE_OS_ANDROID) && defined(CPU_SET)
+   cpu_set_t set;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return sched_setaffinity(0, sizeof set, &set) == 0;
+#else
+   (void) cpu;
+   return FALSE;
+#endif
+}
+
 
 /* pipe_mutex
  */
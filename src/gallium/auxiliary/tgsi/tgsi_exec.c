@@ -60,6 +60,7 @@
 #include "tgsi_exec.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_sse.h"
 
 
 #define DEBUG_EXECUTION 0
@@ -632,6 +633,10 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
 }
 
 
+static void
+decode_ops(struct tgsi_exec_machine *mach);
+
+
 /**
  * Initialize machine state by expanding tokens to full instructions,
  * allocating temporary storage, setting up constants, etc.
@@ -660,6 +665,9 @@ tgsi_exec_machine_bind_shader(
    mach->Tokens = tokens;
    mach->Sampler = sampler;
 
+   FREE(mach->Ops);
+   mach->Ops = NULL;
+
    if (!tokens) {
       /* unbind and free all */
       FREE(mach->Declarations);
@@ -809,6 +817,9 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   if (mach->Processor == TGSI_PROCESSOR_FRAGMENT)
+      decode_ops(mach);
 }
 
 
@@ -869,6 +880,7 @@ void
 tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
+      FREE(mach->Ops);
       FREE(mach->Instructions);
       FREE(mach->Declarations);
 
@@ -4606,6 +4618,584 @@ exec_instruction(
 }
 
 
+/*
+ * Pre-decoded instructions.
+ *
+ * When a fragment shader is bound, every instruction gets a tgsi_exec_op
+ * with the handler that runs it, so tgsi_exec_machine_run() just calls
+ * through the Ops array.  The common ALU instructions whose operands are
+ * plain registers get handlers of their own: their register files, swizzles
+ * and write masks are resolved to channel pointers up front, leaving a few
+ * 4-wide vector operations per channel at run time.  Everything else, and
+ * anything executing under a partial ExecMask, goes to exec_instruction().
+ */
+
+typedef void (* tgsi_exec_op_func)(struct tgsi_exec_machine *mach,
+                                   const struct tgsi_exec_op *op,
+                                   int *pc);
+
+struct tgsi_exec_op_src
+{
+   /** The channel read for each destination channel, NULL for constants */
+   const union tgsi_exec_channel *chan[TGSI_NUM_CHANNELS];
+   /** Constant buffer and element read for each destination channel */
+   unsigned const_buf;
+   int const_pos[TGSI_NUM_CHANNELS];
+   boolean absolute;
+   boolean negate;
+   /** Immediate values, replicated across the quad */
+   union tgsi_exec_channel imm[TGSI_NUM_CHANNELS];
+};
+
+struct tgsi_exec_op
+{
+   tgsi_exec_op_func func;
+   const struct tgsi_full_instruction *inst;
+   struct tgsi_exec_op_src src[3];
+   /** Destination channels, NULL where not written */
+   union tgsi_exec_channel *dst[TGSI_NUM_CHANNELS];
+   unsigned saturate;
+};
+
+
+#if defined(PIPE_ARCH_SSE)
+
+static INLINE __m128
+vec_load(const union tgsi_exec_channel *a)
+{
+   return _mm_loadu_ps(a->f);
+}
+
+static INLINE void
+vec_store(union tgsi_exec_channel *dst, __m128 v)
+{
+   _mm_storeu_ps(dst->f, v);
+}
+
+static INLINE void
+vec_add(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b)
+{
+   vec_store(dst, _mm_add_ps(vec_load(a), vec_load(b)));
+}
+
+static INLINE void
+vec_sub(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b)
+{
+   vec_store(dst, _mm_sub_ps(vec_load(a), vec_load(b)));
+}
+
+static INLINE void
+vec_mul(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b)
+{
+   vec_store(dst, _mm_mul_ps(vec_load(a), vec_load(b)));
+}
+
+/* _mm_min/max_ps return the second operand when the comparison fails,
+ * which matches micro_min/max for NaNs too.
+ */
+static INLINE void
+vec_min(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b)
+{
+   vec_store(dst, _mm_min_ps(vec_load(a), vec_load(b)));
+}
+
+static INLINE void
+vec_max(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b)
+{
+   vec_store(dst, _mm_max_ps(vec_load(a), vec_load(b)));
+}
+
+static INLINE void
+vec_mad(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b,
+        const union tgsi_exec_channel *c)
+{
+   vec_store(dst, _mm_add_ps(_mm_mul_ps(vec_load(a), vec_load(b)),
+                             vec_load(c)));
+}
+
+static INLINE void
+vec_lrp(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b,
+        const union tgsi_exec_channel *c)
+{
+   __m128 vc = vec_load(c);
+   vec_store(dst, _mm_add_ps(_mm_mul_ps(vec_load(a),
+                                        _mm_sub_ps(vec_load(b), vc)),
+                             vc));
+}
+
+static INLINE void
+vec_cmp(union tgsi_exec_channel *dst,
+        const union tgsi_exec_channel *a,
+        const union tgsi_exec_channel *b,
+        const union tgsi_exec_channel *c)
+{
+   __m128 mask = _mm_cmplt_ps(vec_load(a), _mm_setzero_ps());
+   vec_store(dst, _mm_or_ps(_mm_and_ps(mask, vec_load(b)),
+                            _mm_andnot_ps(mask, vec_load(c))));
+}
+
+/** Clamp to [lo, hi], passing NaNs through like store_dest() */
+static INLINE void
+vec_clamp(union tgsi_exec_channel *dst,
+          const union tgsi_exec_channel *a,
+          float lo, float hi)
+{
+   vec_store(dst, _mm_min_ps(_mm_set1_ps(hi),
+                             _mm_max_ps(_mm_set1_ps(lo), vec_load(a))));
+}
+
+#else /* !PIPE_ARCH_SSE */
+
+#define vec_add micro_add
+#define vec_sub micro_sub
+#define vec_mul micro_mul
+#define vec_min micro_min
+#define vec_max micro_max
+#define vec_mad micro_mad
+#define vec_lrp micro_lrp
+#define vec_cmp micro_cmp
+
+static INLINE void
+vec_clamp(union tgsi_exec_channel *dst,
+          const union tgsi_exec_channel *a,
+          float lo, float hi)
+{
+   uint i;
+
+   for (i = 0; i < TGSI_QUAD_SIZE; i++) {
+      if (a->f[i] < lo)
+         dst->f[i] = lo;
+      else if (a->f[i] > hi)
+         dst->f[i] = hi;
+      else
+         dst->i[i] = a->i[i];
+   }
+}
+
+#endif /* !PIPE_ARCH_SSE */
+
+
+/**
+ * Get a pre-decoded source channel.  Returns the register itself when
+ * possible, else fills in and returns tmp.
+ */
+static INLINE const union tgsi_exec_channel *
+fetch_op_src(const struct tgsi_exec_machine *mach,
+             const struct tgsi_exec_op_src *src,
+             uint chan_index,
+             union tgsi_exec_channel *tmp)
+{
+   const union tgsi_exec_channel *chan = src->chan[chan_index];
+
+   if (!chan) {
+      const uint constbuf = src->const_buf;
+      const int pos = src->const_pos[chan_index];
+      uint value = 0;
+
+      assert(mach->Consts[constbuf]);
+
+      /* const buffer bounds check, as in fetch_src_file_channel() */
+      if (pos < (int) mach->ConstsSize[constbuf])
+         value = ((const uint *) mach->Consts[constbuf])[pos];
+
+      tmp->u[0] = tmp->u[1] = tmp->u[2] = tmp->u[3] = value;
+      chan = tmp;
+   }
+
+   if (src->absolute) {
+      micro_abs(tmp, chan);
+      chan = tmp;
+   }
+
+   if (src->negate) {
+      micro_neg(tmp, chan);
+      chan = tmp;
+   }
+
+   return chan;
+}
+
+
+/**
+ * Write the channels computed by a pre-decoded instruction.  All the quad
+ * components are enabled, that's checked by the handlers.
+ */
+static INLINE void
+store_op_dst(const struct tgsi_exec_op *op,
+             const union tgsi_exec_channel *result)
+{
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      union tgsi_exec_channel *dst = op->dst[chan];
+
+      if (!dst)
+         continue;
+
+      switch (op->saturate) {
+      case TGSI_SAT_NONE:
+         *dst = result[chan];
+         break;
+      case TGSI_SAT_ZERO_ONE:
+         vec_clamp(dst, &result[chan], 0.0f, 1.0f);
+         break;
+      case TGSI_SAT_MINUS_PLUS_ONE:
+         vec_clamp(dst, &result[chan], -1.0f, 1.0f);
+         break;
+      default:
+         assert(0);
+      }
+   }
+}
+
+
+static void
+exec_op_generic(struct tgsi_exec_machine *mach,
+                const struct tgsi_exec_op *op,
+                int *pc)
+{
+   exec_instruction(mach, op->inst, pc);
+}
+
+
+static void
+exec_op_mov(struct tgsi_exec_machine *mach,
+            const struct tgsi_exec_op *op,
+            int *pc)
+{
+   union tgsi_exec_channel r[TGSI_NUM_CHANNELS];
+   union tgsi_exec_channel tmp;
+   uint chan;
+
+   if (mach->ExecMask != 0xf) {
+      exec_instruction(mach, op->inst, pc);
+      return;
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->dst[chan])
+         r[chan] = *fetch_op_src(mach, &op->src[0], chan, &tmp);
+   }
+   store_op_dst(op, r);
+   (*pc)++;
+}
+
+
+/** Define a handler for a vector instruction with two sources */
+#define EXEC_OP_BINARY(NAME, VEC_OP)                                   \
+static void                                                           \
+exec_op_##NAME(struct tgsi_exec_machine *mach,                        \
+               const struct tgsi_exec_op *op,                         \
+               int *pc)                                               \
+{                                                                     \
+   union tgsi_exec_channel r[TGSI_NUM_CHANNELS];                      \
+   union tgsi_exec_channel tmp[2];                                    \
+   uint chan;                                                         \
+                                                                      \
+   if (mach->ExecMask != 0xf) {                                       \
+      exec_instruction(mach, op->inst, pc);                           \
+      return;                                                         \
+   }                                                                  \
+                                                                      \
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {                 \
+      if (op->dst[chan]) {                                            \
+         VEC_OP(&r[chan],                                             \
+                fetch_op_src(mach, &op->src[0], chan, &tmp[0]),       \
+                fetch_op_src(mach, &op->src[1], chan, &tmp[1]));      \
+      }                                                               \
+   }                                                                  \
+   store_op_dst(op, r);                                               \
+   (*pc)++;                                                           \
+}
+
+/** Define a handler for a vector instruction with three sources */
+#define EXEC_OP_TRINARY(NAME, VEC_OP)                                  \
+static void                                                           \
+exec_op_##NAME(struct tgsi_exec_machine *mach,                        \
+               const struct tgsi_exec_op *op,                         \
+               int *pc)                                               \
+{                                                                     \
+   union tgsi_exec_channel r[TGSI_NUM_CHANNELS];                      \
+   union tgsi_exec_channel tmp[3];                                    \
+   uint chan;                                                         \
+                                                                      \
+   if (mach->ExecMask != 0xf) {                                       \
+      exec_instruction(mach, op->inst, pc);                           \
+      return;                                                         \
+   }                                                                  \
+                                                                      \
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {                 \
+      if (op->dst[chan]) {                                            \
+         VEC_OP(&r[chan],                                             \
+                fetch_op_src(mach, &op->src[0], chan, &tmp[0]),       \
+                fetch_op_src(mach, &op->src[1], chan, &tmp[1]),       \
+                fetch_op_src(mach, &op->src[2], chan, &tmp[2]));      \
+      }                                                               \
+   }                                                                  \
+   store_op_dst(op, r);                                               \
+   (*pc)++;                                                           \
+}
+
+EXEC_OP_BINARY(add, vec_add)
+EXEC_OP_BINARY(sub, vec_sub)
+EXEC_OP_BINARY(mul, vec_mul)
+EXEC_OP_BINARY(min, vec_min)
+EXEC_OP_BINARY(max, vec_max)
+EXEC_OP_TRINARY(mad, vec_mad)
+EXEC_OP_TRINARY(lrp, vec_lrp)
+EXEC_OP_TRINARY(cmp, vec_cmp)
+
+
+/**
+ * DP3/DP4, summing the products in the same order as exec_dp3/4().  The
+ * dot product source channels are always xyz(w), not the write mask, see
+ * decode_op().
+ */
+static INLINE void
+exec_op_dp(struct tgsi_exec_machine *mach,
+           const struct tgsi_exec_op *op,
+           int *pc,
+           uint num_chans)
+{
+   union tgsi_exec_channel r[TGSI_NUM_CHANNELS];
+   union tgsi_exec_channel tmp[2];
+   uint chan;
+
+   if (mach->ExecMask != 0xf) {
+      exec_instruction(mach, op->inst, pc);
+      return;
+   }
+
+   vec_mul(&r[0],
+           fetch_op_src(mach, &op->src[0], TGSI_CHAN_X, &tmp[0]),
+           fetch_op_src(mach, &op->src[1], TGSI_CHAN_X, &tmp[1]));
+   for (chan = TGSI_CHAN_Y; chan < num_chans; chan++) {
+      vec_mad(&r[0],
+              fetch_op_src(mach, &op->src[0], chan, &tmp[0]),
+              fetch_op_src(mach, &op->src[1], chan, &tmp[1]),
+              &r[0]);
+   }
+   r[1] = r[2] = r[3] = r[0];
+
+   store_op_dst(op, r);
+   (*pc)++;
+}
+
+static void
+exec_op_dp3(struct tgsi_exec_machine *mach,
+            const struct tgsi_exec_op *op,
+            int *pc)
+{
+   exec_op_dp(mach, op, pc, 3);
+}
+
+static void
+exec_op_dp4(struct tgsi_exec_machine *mach,
+            const struct tgsi_exec_op *op,
+            int *pc)
+{
+   exec_op_dp(mach, op, pc, 4);
+}
+
+
+/**
+ * Resolve a source operand, reading the given swizzled channels.
+ * \return FALSE if it isn't a plain register the handlers can read
+ */
+static boolean
+decode_op_src(struct tgsi_exec_machine *mach,
+              struct tgsi_exec_op_src *src,
+              const struct tgsi_full_src_register *reg,
+              uint chan_mask)
+{
+   const int index = reg->Register.Index;
+   uint chan;
+
+   if (reg->Register.Indirect || index < 0)
+      return FALSE;
+
+   if (reg->Register.Dimension &&
+       (reg->Register.File != TGSI_FILE_CONSTANT ||
+        reg->Dimension.Indirect ||
+        reg->Dimension.Index >= PIPE_MAX_CONSTANT_BUFFERS))
+      return FALSE;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      const uint swizzle = tgsi_util_get_full_src_register_swizzle(reg, chan);
+
+      if (!(chan_mask & (1 << chan)))
+         continue;
+
+      switch (reg->Register.File) {
+      case TGSI_FILE_TEMPORARY:
+         if (index >= TGSI_EXEC_NUM_TEMPS)
+            return FALSE;
+         src->chan[chan] = &mach->Temps[index].xyzw[swizzle];
+         break;
+      case TGSI_FILE_INPUT:
+         if (index >= PIPE_MAX_SHADER_INPUTS)
+            return FALSE;
+         src->chan[chan] = &mach->Inputs[index].xyzw[swizzle];
+         break;
+      case TGSI_FILE_OUTPUT:
+         if (index >= PIPE_MAX_SHADER_OUTPUTS)
+            return FALSE;
+         src->chan[chan] = &mach->Outputs[index].xyzw[swizzle];
+         break;
+      case TGSI_FILE_IMMEDIATE:
+         if (index >= (int) mach->ImmLimit)
+            return FALSE;
+         src->imm[chan].f[0] =
+         src->imm[chan].f[1] =
+         src->imm[chan].f[2] =
+         src->imm[chan].f[3] = mach->Imms[index][swizzle];
+         src->chan[chan] = &src->imm[chan];
+         break;
+      case TGSI_FILE_CONSTANT:
+         src->chan[chan] = NULL;
+         src->const_buf = reg->Register.Dimension ? reg->Dimension.Index : 0;
+         src->const_pos[chan] = index * 4 + swizzle;
+         break;
+      default:
+         return FALSE;
+      }
+   }
+
+   src->absolute = reg->Register.Absolute;
+   src->negate = reg->Register.Negate;
+
+   return TRUE;
+}
+
+
+/**
+ * Pick the handler for an instruction and resolve its operands.
+ */
+static void
+decode_op(struct tgsi_exec_machine *mach,
+          struct tgsi_exec_op *op,
+          const struct tgsi_full_instruction *inst)
+{
+   const struct tgsi_full_dst_register *dst = &inst->Dst[0];
+   tgsi_exec_op_func func;
+   uint src_mask = dst->Register.WriteMask;
+   uint chan, i;
+
+   memset(op, 0, sizeof *op);
+   op->func = exec_op_generic;
+   op->inst = inst;
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_MOV:
+      func = exec_op_mov;
+      break;
+   case TGSI_OPCODE_ADD:
+      func = exec_op_add;
+      break;
+   case TGSI_OPCODE_SUB:
+      func = exec_op_sub;
+      break;
+   case TGSI_OPCODE_MUL:
+      func = exec_op_mul;
+      break;
+   case TGSI_OPCODE_MIN:
+      func = exec_op_min;
+      break;
+   case TGSI_OPCODE_MAX:
+      func = exec_op_max;
+      break;
+   case TGSI_OPCODE_MAD:
+      func = exec_op_mad;
+      break;
+   case TGSI_OPCODE_LRP:
+      func = exec_op_lrp;
+      break;
+   case TGSI_OPCODE_CMP:
+      func = exec_op_cmp;
+      break;
+   case TGSI_OPCODE_DP3:
+      func = exec_op_dp3;
+      src_mask = TGSI_WRITEMASK_XYZ;
+      break;
+   case TGSI_OPCODE_DP4:
+      func = exec_op_dp4;
+      src_mask = TGSI_WRITEMASK_XYZW;
+      break;
+   default:
+      return;
+   }
+
+   if (inst->Instruction.Predicate ||
+       inst->Instruction.NumDstRegs != 1 ||
+       dst->Register.Indirect ||
+       dst->Register.Dimension ||
+       dst->Register.Index < 0)
+      return;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (!(dst->Register.WriteMask & (1 << chan)))
+         continue;
+
+      switch (dst->Register.File) {
+      case TGSI_FILE_TEMPORARY:
+         if (dst->Register.Index >= TGSI_EXEC_NUM_TEMPS)
+            return;
+         op->dst[chan] = &mach->Temps[dst->Register.Index].xyzw[chan];
+         break;
+      case TGSI_FILE_OUTPUT:
+         if (dst->Register.Index >= PIPE_MAX_SHADER_OUTPUTS)
+            return;
+         op->dst[chan] = &mach->Outputs[dst->Register.Index].xyzw[chan];
+         break;
+      default:
+         return;
+      }
+   }
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      if (!decode_op_src(mach, &op->src[i], &inst->Src[i], src_mask))
+         return;
+   }
+
+   op->saturate = inst->Instruction.Saturate;
+   op->func = func;
+}
+
+
+/**
+ * Pre-decode the bound instructions, see struct tgsi_exec_op.  The
+ * handlers assume that outputs aren't relocated, i.e. no geometry shaders.
+ */
+static void
+decode_ops(struct tgsi_exec_machine *mach)
+{
+   uint i;
+
+   assert(!mach->Ops);
+
+   mach->Ops = MALLOC(mach->NumInstructions * sizeof *mach->Ops);
+   if (!mach->Ops)
+      return;
+
+   for (i = 0; i < mach->NumInstructions; i++)
+      decode_op(mach, &mach->Ops[i], &mach->Instructions[i]);
+}
+
+
 /**
  * Run TGSI interpreter.
  * \return bitmask of "alive" quad components
@@ -4670,7 +5260,13 @@ tgsi_exec_machine_run( struct tgsi_exec_machine *mach )
 #endif
 
          assert(pc < (int) mach->NumInstructions);
-         exec_instruction(mach, mach->Instructions + pc, &pc);
+         if (mach->Ops) {
+            const struct tgsi_exec_op *op = &mach->Ops[pc];
+            op->func(mach, op, &pc);
+         }
+         else {
+            exec_instruction(mach, mach->Instructions + pc, &pc);
+         }
 
 #if DEBUG_EXECUTION
          for (i = 0; i < TGSI_EXEC_NUM_TEMPS + TGSI_EXEC_NUM_TEMP_EXTRAS; i++) {
@@ -258,6 +258,8 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_exec_op;
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -350,6 +352,9 @@ struct tgsi_exec_machine
    struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
+   /** Pre-decoded Instructions (fragment shaders only), or NULL */
+   struct tgsi_exec_op *Ops;
+
    struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
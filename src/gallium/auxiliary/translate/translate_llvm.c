@@ -0,0 +1,909 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Vertex translation with code generated by gallivm.
+ *
+ * Inputs of any format gallivm can fetch -- which is every vertex format
+ * u_format describes, packed, half float, double, fixed and all -- are
+ * converted to 1 to 4 component float outputs, and elements whose input
+ * and output formats match are copied.  That covers what the draw module
+ * and most drivers ask for, in particular the formats the SSE backend
+ * gives up on.  Anything else is left to translate_generic.
+ *
+ * Four vertices are translated per loop iteration, with the small packed
+ * formats unpacked for all four at once; see build_func().
+ *
+ * Compiling is much slower than the SSE backend's code emission, so the
+ * generated code is kept in a process wide cache shared by all contexts,
+ * keyed by the translate key alone.  The vertex buffers are passed at run
+ * time, so a translate object only holds a reference to its cache entry.
+ */
+
+#include "pipe/p_compiler.h"
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_format.h"
+#include "util/u_hash.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_simple_list.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_swizzle.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "translate.h"
+
+
+/**
+ * Number of unreferenced translators kept around in the cache.
+ */
+#define TRANSLATE_LLVM_CACHE_SIZE 64
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(translate_llvm, "TRANSLATE_LLVM", TRUE)
+
+enum translate_llvm_run {
+   TRANSLATE_LLVM_RUN_LINEAR,
+   TRANSLATE_LLVM_RUN_ELTS8,
+   TRANSLATE_LLVM_RUN_ELTS16,
+   TRANSLATE_LLVM_RUN_ELTS,
+   TRANSLATE_LLVM_RUN_COUNT
+};
+
+
+/** Per input buffer state, as seen by the generated code */
+struct translate_llvm_buffer {
+   const uint8_t *base;
+   unsigned stride;
+   unsigned max_index;
+};
+
+
+typedef void
+(*translate_llvm_func)(const struct translate_llvm_buffer *buffers,
+                       const void *elts,
+                       unsigned start,
+                       unsigned count,
+                       unsigned start_instance,
+                       unsigned instance_id,
+                       void *output_buffer);
+
+
+/**
+ * Compiled code for one translate key, shared by all translate objects
+ * created with that key.
+ */
+struct translate_llvm_variant {
+   struct translate_llvm_variant *next, *prev;   /**< cache list */
+
+   struct translate_key key;
+   uint32_t hash;
+   unsigned refcount;
+
+   struct gallivm_state *gallivm;
+   translate_llvm_func func[TRANSLATE_LLVM_RUN_COUNT];
+};
+
+
+struct translate_llvm {
+   struct translate translate;
+
+   struct translate_llvm_variant *variant;
+   struct translate_llvm_buffer buffers[TRANSLATE_MAX_ATTRIBS];
+};
+
+
+static INLINE struct translate_llvm *
+translate_llvm(struct translate *translate)
+{
+   return (struct translate_llvm *) translate;
+}
+
+
+/**
+ * The process wide cache.  LLVM contexts are not thread safe, so all code
+ * generation happens in a context of our own, under the cache mutex.
+ */
+pipe_static_mutex(cache_mutex);
+static LLVMContextRef cache_context = NULL;
+static struct translate_llvm_variant cache_list;
+static unsigned cache_unused = 0;
+static boolean cache_initialized = FALSE;
+
+
+static boolean
+is_float_output(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+   case PIPE_FORMAT_R32G32_FLOAT:
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Whether the generated code can handle an element.
+ */
+static boolean
+is_element_supported(const struct translate_element *element)
+{
+   const struct util_format_description *desc;
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID)
+      return element->output_format == PIPE_FORMAT_R32_UINT ||
+             element->output_format == PIPE_FORMAT_R32_USCALED ||
+             is_float_output(element->output_format);
+
+   desc = util_format_description(element->input_format);
+   if (!desc ||
+       desc->block.width != 1 ||
+       desc->block.height != 1 ||
+       desc->block.bits % 8 != 0)
+      return FALSE;
+
+   if (element->input_format == element->output_format)
+      return TRUE;
+
+   /* integers would be converted to floats on the way */
+   return is_float_output(element->output_format) &&
+          !util_format_is_pure_integer(element->input_format) &&
+          (desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB ||
+           desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB);
+}
+
+
+/**
+ * Copy size bytes, with no assumption on the alignment of either pointer.
+ */
+static void
+build_copy(struct gallivm_state *gallivm,
+           LLVMValueRef dst, LLVMValueRef src, unsigned size)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   unsigned offset = 0;
+
+   while (offset < size) {
+      unsigned chunk = size - offset >= 4 ? 4 : size - offset >= 2 ? 2 : 1;
+      LLVMTypeRef ptr_type =
+         LLVMPointerType(LLVMIntTypeInContext(gallivm->context, chunk * 8), 0);
+      LLVMValueRef index = lp_build_const_int32(gallivm, offset);
+      LLVMValueRef src_ptr, dst_ptr, value;
+
+      src_ptr = LLVMBuildGEP(builder, src, &index, 1, "");
+      src_ptr = LLVMBuildBitCast(builder, src_ptr, ptr_type, "");
+      dst_ptr = LLVMBuildGEP(builder, dst, &index, 1, "");
+      dst_ptr = LLVMBuildBitCast(builder, dst_ptr, ptr_type, "");
+
+      value = LLVMBuildLoad(builder, src_ptr, "");
+      lp_set_load_alignment(value, 1);
+      lp_set_store_alignment(LLVMBuildStore(builder, value, dst_ptr), 1);
+
+      offset += chunk;
+   }
+}
+
+
+/**
+ * Store the first nr_channels components of a 4 x float vector.
+ */
+static void
+build_store_floats(struct gallivm_state *gallivm,
+                   LLVMValueRef dst, LLVMValueRef rgba, unsigned nr_channels)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef float_type = LLVMFloatTypeInContext(gallivm->context);
+   unsigned i;
+
+   if (nr_channels == 4) {
+      dst = LLVMBuildBitCast(builder, dst,
+                             LLVMPointerType(LLVMVectorType(float_type, 4), 0),
+                             "");
+      lp_set_store_alignment(LLVMBuildStore(builder, rgba, dst), 4);
+      return;
+   }
+
+   dst = LLVMBuildBitCast(builder, dst, LLVMPointerType(float_type, 0), "");
+   for (i = 0; i < nr_channels; i++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, i);
+      LLVMValueRef ptr = LLVMBuildGEP(builder, dst, &index, 1, "");
+      LLVMValueRef value = LLVMBuildExtractElement(builder, rgba, index, "");
+      lp_set_store_alignment(LLVMBuildStore(builder, value, ptr), 4);
+   }
+}
+
+
+/**
+ * Whether an element is fetched for several vertices at once, with the
+ * packed vertices gathered into one vector and unpacked in SoA.  These are
+ * the formats lp_build_fetch_rgba_soa() does not split into per vertex AoS
+ * fetches anyway.  sRGB is left out, as the SoA unpacking would linearize
+ * it unlike the AoS one.
+ */
+static boolean
+is_element_soa(const struct translate_element *element)
+{
+   const struct util_format_description *desc;
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID ||
+       element->instance_divisor ||
+       element->input_format == element->output_format)
+      return FALSE;
+
+   desc = util_format_description(element->input_format);
+   return desc->layout == UTIL_FORMAT_LAYOUT_PLAIN &&
+          desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+          desc->block.bits <= 32 &&
+          (desc->channel[0].type != UTIL_FORMAT_TYPE_FLOAT ||
+           desc->channel[0].size == 32);
+}
+
+
+/**
+ * Generate the code translating one element of one vertex.
+ */
+static void
+build_element(struct gallivm_state *gallivm,
+              const struct translate_element *element,
+              LLVMValueRef buffers,
+              LLVMValueRef index,
+              LLVMValueRef start_instance,
+              LLVMValueRef instance_id,
+              LLVMValueRef dst)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
+   const struct util_format_description *out_desc =
+      util_format_description(element->output_format);
+   const struct util_format_description *in_desc;
+   LLVMValueRef offset, buffer, base, stride, elt, src;
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      LLVMTypeRef type = is_float_output(element->output_format) ?
+         LLVMFloatTypeInContext(gallivm->context) :
+         LLVMInt32TypeInContext(gallivm->context);
+      LLVMValueRef value = instance_id;
+
+      if (is_float_output(element->output_format))
+         value = LLVMBuildUIToFP(builder, value, type, "");
+      dst = LLVMBuildBitCast(builder, dst, LLVMPointerType(type, 0), "");
+      lp_set_store_alignment(LLVMBuildStore(builder, value, dst), 4);
+      return;
+   }
+
+   in_desc = util_format_description(element->input_format);
+
+   offset = lp_build_const_int32(gallivm, element->input_buffer);
+   buffer = LLVMBuildGEP(builder, buffers, &offset, 1, "");
+   base = lp_build_struct_get(gallivm, buffer, 0, "base");
+   stride = lp_build_struct_get(gallivm, buffer, 1, "stride");
+
+   if (element->instance_divisor) {
+      elt = LLVMBuildUDiv(builder, instance_id,
+                          lp_build_const_int32(gallivm,
+                                               element->instance_divisor),
+                          "");
+      elt = LLVMBuildAdd(builder, start_instance, elt, "");
+   }
+   else {
+      /* clamp to avoid going out of bounds */
+      LLVMValueRef max_index =
+         lp_build_struct_get(gallivm, buffer, 2, "max_index");
+      LLVMValueRef less = LLVMBuildICmp(builder, LLVMIntULT,
+                                        index, max_index, "");
+      elt = LLVMBuildSelect(builder, less, index, max_index, "");
+   }
+
+   offset = LLVMBuildMul(builder,
+                         LLVMBuildZExt(builder, elt, int64_type, ""),
+                         LLVMBuildZExt(builder, stride, int64_type, ""),
+                         "");
+   offset = LLVMBuildAdd(builder, offset,
+                         LLVMConstInt(int64_type,
+                                      element->input_offset, 0), "");
+   src = LLVMBuildGEP(builder, base, &offset, 1, "");
+
+   if (element->input_format == element->output_format) {
+      build_copy(gallivm, dst, src, in_desc->block.bits / 8);
+   }
+   else {
+      LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+      LLVMValueRef rgba;
+
+      rgba = lp_build_fetch_rgba_aos(gallivm, in_desc,
+                                     lp_float32_vec4_type(),
+                                     src, zero, zero, zero);
+      build_store_floats(gallivm, dst, rgba, out_desc->nr_channels);
+   }
+}
+
+
+/**
+ * Generate the code translating an SoA element of four vertices.
+ */
+static void
+build_element_soa(struct gallivm_state *gallivm,
+                  const struct translate_element *element,
+                  LLVMValueRef buffers,
+                  LLVMValueRef indices,
+                  LLVMValueRef dst[4])
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type int_type = lp_int32_vec4_type();
+   LLVMTypeRef int_vec_type = lp_build_vec_type(gallivm, int_type);
+   const struct util_format_description *in_desc =
+      util_format_description(element->input_format);
+   const struct util_format_description *out_desc =
+      util_format_description(element->output_format);
+   LLVMValueRef offset, buffer, base, stride, max_index, less, elts, zero;
+   LLVMValueRef soa[4], aos[4];
+   unsigned i;
+
+   offset = lp_build_const_int32(gallivm, element->input_buffer);
+   buffer = LLVMBuildGEP(builder, buffers, &offset, 1, "");
+   base = lp_build_struct_get(gallivm, buffer, 0, "base");
+   stride = lp_build_struct_get(gallivm, buffer, 1, "stride");
+   max_index = lp_build_struct_get(gallivm, buffer, 2, "max_index");
+
+   /* clamp to avoid going out of bounds */
+   max_index = lp_build_broadcast(gallivm, int_vec_type, max_index);
+   less = LLVMBuildICmp(builder, LLVMIntULT, indices, max_index, "");
+   elts = LLVMBuildSelect(builder, less, indices, max_index, "");
+
+   /* build_func() made sure these fit in 31 bits */
+   offset = LLVMBuildMul(builder, elts,
+                         lp_build_broadcast(gallivm, int_vec_type, stride), "");
+   offset = LLVMBuildAdd(builder, offset,
+                         lp_build_const_int_vec(gallivm, int_type,
+                                                element->input_offset), "");
+
+   zero = lp_build_const_int_vec(gallivm, int_type, 0);
+   lp_build_fetch_rgba_soa(gallivm, in_desc, lp_float32_vec4_type(),
+                           base, offset, zero, zero, soa);
+
+   lp_build_transpose_aos(gallivm, lp_float32_vec4_type(), soa, aos);
+
+   for (i = 0; i < 4; i++)
+      build_store_floats(gallivm, dst[i], aos[i], out_desc->nr_channels);
+}
+
+
+/**
+ * Generate the code checking that the byte offsets of all SoA elements
+ * fit in the signed 32 bit offsets lp_build_fetch_rgba_soa() takes.
+ */
+static LLVMValueRef
+build_soa_offsets_fit(struct gallivm_state *gallivm,
+                      const struct translate_key *key,
+                      LLVMValueRef buffers)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
+   LLVMValueRef fit = LLVMConstInt(LLVMInt1TypeInContext(gallivm->context),
+                                   1, 0);
+   unsigned i;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+      LLVMValueRef offset, buffer, stride, max_index, end;
+
+      if (!is_element_soa(element))
+         continue;
+
+      offset = lp_build_const_int32(gallivm, element->input_buffer);
+      buffer = LLVMBuildGEP(builder, buffers, &offset, 1, "");
+      stride = lp_build_struct_get(gallivm, buffer, 1, "stride");
+      max_index = lp_build_struct_get(gallivm, buffer, 2, "max_index");
+
+      end = LLVMBuildMul(builder,
+                         LLVMBuildZExt(builder, max_index, int64_type, ""),
+                         LLVMBuildZExt(builder, stride, int64_type, ""), "");
+      end = LLVMBuildAdd(builder, end,
+                         LLVMConstInt(int64_type, element->input_offset, 0),
+                         "");
+      fit = LLVMBuildAnd(builder, fit,
+                         LLVMBuildICmp(builder, LLVMIntULE, end,
+                                       LLVMConstInt(int64_type,
+                                                    0x7fffffff, 0), ""),
+                         "");
+   }
+
+   return fit;
+}
+
+
+/**
+ * Generate the code fetching the vertex index, or with vector set, the
+ * four vertex indices, at position counter.
+ */
+static LLVMValueRef
+build_index(struct gallivm_state *gallivm,
+            enum translate_llvm_run run,
+            LLVMValueRef start,
+            LLVMValueRef elts,
+            LLVMValueRef counter,
+            boolean vector)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type int_type = lp_int32_vec4_type();
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef elt_type;
+   LLVMValueRef index, ptr;
+   unsigned elt_size;
+
+   if (run == TRANSLATE_LLVM_RUN_LINEAR) {
+      index = LLVMBuildAdd(builder, start, counter, "");
+      if (vector) {
+         LLVMValueRef ramp[4];
+         unsigned i;
+
+         for (i = 0; i < 4; i++)
+            ramp[i] = lp_build_const_int32(gallivm, i);
+         index = lp_build_broadcast(gallivm,
+                                    lp_build_vec_type(gallivm, int_type),
+                                    index);
+         index = LLVMBuildAdd(builder, index, LLVMConstVector(ramp, 4), "");
+      }
+      return index;
+   }
+
+   elt_size = run == TRANSLATE_LLVM_RUN_ELTS8 ? 1 :
+              run == TRANSLATE_LLVM_RUN_ELTS16 ? 2 : 4;
+   elt_type = LLVMIntTypeInContext(context, elt_size * 8);
+
+   ptr = LLVMBuildBitCast(builder, elts, LLVMPointerType(elt_type, 0), "");
+   ptr = LLVMBuildGEP(builder, ptr, &counter, 1, "");
+   if (vector) {
+      ptr = LLVMBuildBitCast(builder, ptr,
+                             LLVMPointerType(LLVMVectorType(elt_type, 4), 0),
+                             "");
+      index = LLVMBuildLoad(builder, ptr, "");
+      lp_set_load_alignment(index, elt_size);
+      if (elt_size != 4)
+         index = LLVMBuildZExt(builder, index,
+                               lp_build_vec_type(gallivm, int_type), "");
+   }
+   else {
+      index = LLVMBuildLoad(builder, ptr, "");
+      if (elt_size != 4)
+         index = LLVMBuildZExt(builder, index, int32_type, "");
+   }
+
+   return index;
+}
+
+
+/**
+ * Generate the function translating count vertices, taking the vertex
+ * indices from start onwards or from an element array.
+ *
+ * The vertices are translated four at a time, so that the elements
+ * lp_build_fetch_rgba_soa() handles get gathered and unpacked for four
+ * vertices with each instruction.  The other elements, and the last
+ * count % 4 vertices, are translated one vertex at a time.
+ */
+static LLVMValueRef
+build_func(struct gallivm_state *gallivm,
+           const struct translate_key *key,
+           enum translate_llvm_run run)
+{
+   static const char *names[TRANSLATE_LLVM_RUN_COUNT] = {
+      "translate_linear", "translate_elts8",
+      "translate_elts16", "translate_elts"
+   };
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_ptr_type =
+      LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef buffer_type, arg_types[7];
+   LLVMTypeRef elem_types[3];
+   LLVMValueRef func, buffers, elts, start, count, start_instance, instance_id;
+   LLVMValueRef output, output_stride, index, vertex, vector_end;
+   struct lp_build_for_loop_state loop;
+   unsigned i;
+
+   elem_types[0] = int8_ptr_type;
+   elem_types[1] = int32_type;
+   elem_types[2] = int32_type;
+   buffer_type = LLVMStructTypeInContext(context, elem_types,
+                                         Elements(elem_types), 0);
+   LP_CHECK_MEMBER_OFFSET(struct translate_llvm_buffer, stride,
+                          gallivm->target, buffer_type, 1);
+   LP_CHECK_MEMBER_OFFSET(struct translate_llvm_buffer, max_index,
+                          gallivm->target, buffer_type, 2);
+   LP_CHECK_STRUCT_SIZE(struct translate_llvm_buffer,
+                        gallivm->target, buffer_type);
+
+   i = 0;
+   arg_types[i++] = LLVMPointerType(buffer_type, 0);   /* buffers */
+   arg_types[i++] = int8_ptr_type;                      /* elts */
+   arg_types[i++] = int32_type;                         /* start */
+   arg_types[i++] = int32_type;                         /* count */
+   arg_types[i++] = int32_type;                         /* start_instance */
+   arg_types[i++] = int32_type;                         /* instance_id */
+   arg_types[i++] = int8_ptr_type;                      /* output_buffer */
+
+   func = LLVMAddFunction(gallivm->module, names[run],
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           arg_types, i, 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   buffers = LLVMGetParam(func, 0);
+   elts = LLVMGetParam(func, 1);
+   start = LLVMGetParam(func, 2);
+   count = LLVMGetParam(func, 3);
+   start_instance = LLVMGetParam(func, 4);
+   instance_id = LLVMGetParam(func, 5);
+   output = LLVMGetParam(func, 6);
+
+   LLVMPositionBuilderAtEnd(builder,
+                            LLVMAppendBasicBlockInContext(context, func,
+                                                          "entry"));
+
+   output_stride = lp_build_const_int32(gallivm, key->output_stride);
+
+   /*
+    * Vertices with huge buffers whose byte offsets don't fit in 31 bits are
+    * all left to the scalar loop.
+    */
+   vector_end = LLVMBuildAnd(builder, count,
+                             lp_build_const_int32(gallivm, ~3), "");
+   vector_end = LLVMBuildSelect(builder,
+                                build_soa_offsets_fit(gallivm, key, buffers),
+                                vector_end, lp_build_const_int32(gallivm, 0),
+                                "");
+
+   lp_build_for_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0),
+                           LLVMIntULT, vector_end,
+                           lp_build_const_int32(gallivm, 4));
+   {
+      LLVMValueRef vertices[4];
+      unsigned j;
+
+      index = build_index(gallivm, run, start, elts, loop.counter, TRUE);
+
+      for (j = 0; j < 4; j++) {
+         vertex = LLVMBuildAdd(builder, loop.counter,
+                               lp_build_const_int32(gallivm, j), "");
+         vertex = LLVMBuildMul(builder, vertex, output_stride, "");
+         vertices[j] = LLVMBuildGEP(builder, output, &vertex, 1, "");
+      }
+
+      for (i = 0; i < key->nr_elements; i++) {
+         const struct translate_element *element = &key->element[i];
+         LLVMValueRef offset = lp_build_const_int32(gallivm,
+                                                    element->output_offset);
+         LLVMValueRef dst[4];
+
+         for (j = 0; j < 4; j++)
+            dst[j] = LLVMBuildGEP(builder, vertices[j], &offset, 1, "");
+
+         if (is_element_soa(element)) {
+            build_element_soa(gallivm, element, buffers, index, dst);
+         }
+         else {
+            for (j = 0; j < 4; j++)
+               build_element(gallivm, element, buffers,
+                             LLVMBuildExtractElement(builder, index,
+                                lp_build_const_int32(gallivm, j), ""),
+                             start_instance, instance_id, dst[j]);
+         }
+      }
+   }
+   lp_build_for_loop_end(&loop);
+
+   lp_build_for_loop_begin(&loop, gallivm, vector_end,
+                           LLVMIntULT, count,
+                           lp_build_const_int32(gallivm, 1));
+   {
+      index = build_index(gallivm, run, start, elts, loop.counter, FALSE);
+
+      vertex = LLVMBuildMul(builder, loop.counter, output_stride, "");
+      vertex = LLVMBuildGEP(builder, output, &vertex, 1, "");
+
+      for (i = 0; i < key->nr_elements; i++) {
+         const struct translate_element *element = &key->element[i];
+         LLVMValueRef offset = lp_build_const_int32(gallivm,
+                                                    element->output_offset);
+
+         build_element(gallivm, element, buffers, index,
+                       start_instance, instance_id,
+                       LLVMBuildGEP(builder, vertex, &offset, 1, ""));
+      }
+   }
+   lp_build_for_loop_end(&loop);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static struct translate_llvm_variant *
+variant_create(const struct translate_key *key, uint32_t hash)
+{
+   struct translate_llvm_variant *variant;
+   LLVMValueRef funcs[TRANSLATE_LLVM_RUN_COUNT];
+   unsigned i;
+
+   variant = CALLOC_STRUCT(translate_llvm_variant);
+   if (!variant)
+      return NULL;
+
+   memcpy(&variant->key, key, translate_keysize(key));
+   variant->hash = hash;
+
+   variant->gallivm = gallivm_create("translate", cache_context);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   for (i = 0; i < TRANSLATE_LLVM_RUN_COUNT; i++)
+      funcs[i] = build_func(variant->gallivm, key, i);
+
+   gallivm_compile_module(variant->gallivm);
+
+   for (i = 0; i < TRANSLATE_LLVM_RUN_COUNT; i++)
+      variant->func[i] = (translate_llvm_func)
+         gallivm_jit_function(variant->gallivm, funcs[i]);
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void
+variant_destroy(struct translate_llvm_variant *variant)
+{
+   gallivm_destroy(variant->gallivm);
+   FREE(variant);
+}
+
+
+/**
+ * Find or create the variant for a key, returning a new reference.
+ */
+static struct translate_llvm_variant *
+variant_get(const struct translate_key *key)
+{
+   struct translate_llvm_variant *variant;
+   uint32_t hash = util_hash_crc32(key, translate_keysize(key));
+
+   pipe_mutex_lock(cache_mutex);
+
+   if (!cache_initialized) {
+      cache_initialized = TRUE;
+      make_empty_list(&cache_list);
+      if (lp_build_init())
+         cache_context = LLVMContextCreate();
+   }
+
+   if (!cache_context) {
+      pipe_mutex_unlock(cache_mutex);
+      return NULL;
+   }
+
+   foreach(variant, &cache_list) {
+      if (variant->hash == hash &&
+          translate_key_compare(&variant->key, key) == 0) {
+         if (variant->refcount++ == 0)
+            cache_unused--;
+         move_to_head(&cache_list, variant);
+         pipe_mutex_unlock(cache_mutex);
+         return variant;
+      }
+   }
+
+   variant = variant_create(key, hash);
+   if (variant) {
+      variant->refcount = 1;
+      insert_at_head(&cache_list, variant);
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+
+   return variant;
+}
+
+
+static void
+variant_release(struct translate_llvm_variant *variant)
+{
+   pipe_mutex_lock(cache_mutex);
+
+   assert(variant->refcount);
+   if (--variant->refcount == 0) {
+      cache_unused++;
+
+      /* evict the least recently used unreferenced variants */
+      while (cache_unused > TRANSLATE_LLVM_CACHE_SIZE) {
+         struct translate_llvm_variant *last = last_elem(&cache_list);
+
+         while (last->refcount)
+            last = last->prev;
+
+         remove_from_list(last);
+         variant_destroy(last);
+         cache_unused--;
+      }
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+static void
+translate_llvm_set_buffer(struct translate *translate,
+                          unsigned buf,
+                          const void *ptr,
+                          unsigned stride,
+                          unsigned max_index)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (buf < TRANSLATE_MAX_ATTRIBS) {
+      tl->buffers[buf].base = (const uint8_t *) ptr;
+      tl->buffers[buf].stride = stride;
+      tl->buffers[buf].max_index = max_index;
+   }
+}
+
+
+static void PIPE_CDECL
+translate_llvm_run_elts(struct translate *translate,
+                        const unsigned *elts,
+                        unsigned count,
+                        unsigned start_instance,
+                        unsigned instance_id,
+                        void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->variant->func[TRANSLATE_LLVM_RUN_ELTS](tl->buffers, elts, 0, count,
+                                                 start_instance, instance_id,
+                                                 output_buffer);
+}
+
+
+static void PIPE_CDECL
+translate_llvm_run_elts16(struct translate *translate,
+                          const uint16_t *elts,
+                          unsigned count,
+                          unsigned start_instance,
+                          unsigned instance_id,
+                          void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->variant->func[TRANSLATE_LLVM_RUN_ELTS16](tl->buffers, elts, 0, count,
+                                                   start_instance, instance_id,
+                                                   output_buffer);
+}
+
+
+static void PIPE_CDECL
+translate_llvm_run_elts8(struct translate *translate,
+                         const uint8_t *elts,
+                         unsigned count,
+                         unsigned start_instance,
+                         unsigned instance_id,
+                         void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->variant->func[TRANSLATE_LLVM_RUN_ELTS8](tl->buffers, elts, 0, count,
+                                                  start_instance, instance_id,
+                                                  output_buffer);
+}
+
+
+static void PIPE_CDECL
+translate_llvm_run(struct translate *translate,
+                   unsigned start,
+                   unsigned count,
+                   unsigned start_instance,
+                   unsigned instance_id,
+                   void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->variant->func[TRANSLATE_LLVM_RUN_LINEAR](tl->buffers, NULL,
+                                                   start, count,
+                                                   start_instance, instance_id,
+                                                   output_buffer);
+}
+
+
+static void
+translate_llvm_release(struct translate *translate)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   variant_release(tl->variant);
+   FREE(tl);
+}
+
+
+struct translate *
+translate_llvm_create(const struct translate_key *key)
+{
+   struct translate_llvm *tl;
+   unsigned i;
+
+   if (!debug_get_option_translate_llvm())
+      return NULL;
+
+   if (key->nr_elements == 0)
+      return NULL;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      if (!is_element_supported(&key->element[i]))
+         return NULL;
+   }
+
+   tl = CALLOC_STRUCT(translate_llvm);
+   if (!tl)
+      return NULL;
+
+   tl->variant = variant_get(key);
+   if (!tl->variant) {
+      FREE(tl);
+      return NULL;
+   }
+
+   tl->translate.key = *key;
+   tl->translate.release = translate_llvm_release;
+   tl->translate.set_buffer = translate_llvm_set_buffer;
+   tl->translate.run_elts = translate_llvm_run_elts;
+   tl->translate.run_elts16 = translate_llvm_run_elts16;
+   tl->translate.run_elts8 = translate_llvm_run_elts8;
+   tl->translate.run = translate_llvm_run;
+
+   return &tl->translate;
+}
@@ -0,0 +1,300 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Background compilation of fragment shader variants.
+ *
+ * With LP_NUM_COMPILE_THREADS set, new variants are first compiled without
+ * optimizations so that drawing can start right away, and queued here to
+ * have their optimized code generated by a pool of helper threads.  Once
+ * done, the optimized code simply replaces the variant's jit functions;
+ * the rasterizer threads pick those up the next time they run the variant.
+ *
+ * LLVM contexts are not thread safe, so each helper thread generates code
+ * in its own context.
+ */
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_simple_list.h"
+#include "os/os_thread.h"
+#include "os/os_time.h"
+#include "lp_context.h"
+#include "lp_jit.h"
+#include "lp_limits.h"
+#include "lp_perf.h"
+#include "lp_state_fs.h"
+#include "lp_compile_queue.h"
+
+#include <llvm-c/Core.h>
+
+
+struct lp_compile_job
+{
+   struct lp_compile_job *next, *prev;
+
+   struct lp_fragment_shader_variant *variant;
+
+   /** Time of lp_compile_queue_add(), to measure the latency */
+   int64_t queue_time;
+
+   boolean running;
+};
+
+
+struct lp_compile_queue
+{
+   /** Jobs not yet picked up by a thread */
+   struct lp_compile_job pending;
+   unsigned num_pending;
+
+   /** Protects everything here and the variants' compile_job */
+   pipe_mutex mutex;
+
+   /** Signalled when a job is added, or when exiting */
+   pipe_condvar work_ready;
+
+   /** Signalled when a running job finishes */
+   pipe_condvar work_done;
+
+   boolean exit_flag;
+
+   /** Totals of the finished jobs, for the driver queries */
+   uint64_t compile_time;  /**< in nanoseconds */
+   uint64_t nr_compiles;
+
+   unsigned num_threads;
+   pipe_thread threads[LP_MAX_COMPILE_THREADS];
+};
+
+
+static PIPE_THREAD_ROUTINE(compile_thread_function, init_data)
+{
+   struct lp_compile_queue *queue = (struct lp_compile_queue *) init_data;
+   LLVMContextRef context = LLVMContextCreate();
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (!queue->exit_flag) {
+      struct lp_compile_job *job;
+      int64_t t0, t1;
+
+      if (is_empty_list(&queue->pending)) {
+         pipe_condvar_wait(queue->work_ready, queue->mutex);
+         continue;
+      }
+
+      job = first_elem(&queue->pending);
+      remove_from_list(job);
+      queue->num_pending--;
+      job->running = TRUE;
+
+      pipe_mutex_unlock(queue->mutex);
+
+      t0 = os_time_get();
+      if (context)
+         llvmpipe_optimize_fs_variant(job->variant, context);
+      t1 = os_time_get();
+
+      pipe_mutex_lock(queue->mutex);
+
+      LP_COUNT(nr_llvm_async_compiles);
+      LP_COUNT_ADD(llvm_async_compile_time, t1 - t0);
+      LP_COUNT_ADD(llvm_async_latency, t1 - job->queue_time);
+      queue->compile_time += (t1 - t0) * 1000;
+      queue->nr_compiles++;
+      job->variant->compile_time[1] = t1 - t0;
+
+      job->variant->compile_job = NULL;
+      FREE(job);
+
+      pipe_condvar_broadcast(queue->work_done);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   if (context)
+      LLVMContextDispose(context);
+
+   return 0;
+}
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads)
+{
+   struct lp_compile_queue *queue;
+   unsigned i;
+
+   queue = CALLOC_STRUCT(lp_compile_queue);
+   if (!queue)
+      return NULL;
+
+   make_empty_list(&queue->pending);
+   pipe_mutex_init(queue->mutex);
+   pipe_condvar_init(queue->work_ready);
+   pipe_condvar_init(queue->work_done);
+
+   queue->num_threads = MIN2(num_threads, LP_MAX_COMPILE_THREADS);
+
+   for (i = 0; i < queue->num_threads; i++) {
+      queue->threads[i] = pipe_thread_create(compile_thread_function,
+                                             (void *) queue);
+   }
+
+   return queue;
+}
+
+
+/**
+ * Stop the threads.  Jobs still pending are dropped, their variants keep
+ * running their unoptimized code.
+ */
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue)
+{
+   unsigned i;
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (!is_empty_list(&queue->pending)) {
+      struct lp_compile_job *job = first_elem(&queue->pending);
+      remove_from_list(job);
+      job->variant->compile_job = NULL;
+      FREE(job);
+   }
+   queue->num_pending = 0;
+
+   queue->exit_flag = TRUE;
+   pipe_condvar_broadcast(queue->work_ready);
+
+   pipe_mutex_unlock(queue->mutex);
+
+   for (i = 0; i < queue->num_threads; i++) {
+      pipe_thread_wait(queue->threads[i]);
+   }
+
+   pipe_condvar_destroy(queue->work_done);
+   pipe_condvar_destroy(queue->work_ready);
+   pipe_mutex_destroy(queue->mutex);
+
+   FREE(queue);
+}
+
+
+/**
+ * Queue a variant made with unoptimized code for optimization.
+ */
+void
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_fragment_shader_variant *variant)
+{
+   struct lp_compile_job *job;
+
+   job = CALLOC_STRUCT(lp_compile_job);
+   if (!job)
+      return;
+
+   job->variant = variant;
+   job->queue_time = os_time_get();
+
+   pipe_mutex_lock(queue->mutex);
+
+   assert(!variant->compile_job);
+   variant->compile_job = job;
+   insert_at_tail(&queue->pending, job);
+   queue->num_pending++;
+
+#ifdef DEBUG
+   lp_count.llvm_async_queue_max = MAX2(lp_count.llvm_async_queue_max,
+                                        queue->num_pending);
+#endif
+
+   pipe_condvar_signal(queue->work_ready);
+
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Make sure no thread touches the variant anymore, before destroying it.
+ * A pending job is cancelled, a running one waited for.
+ */
+void
+lp_compile_queue_remove(struct lp_compile_queue *queue,
+                        struct lp_fragment_shader_variant *variant)
+{
+   pipe_mutex_lock(queue->mutex);
+
+   while (variant->compile_job) {
+      struct lp_compile_job *job = variant->compile_job;
+
+      if (!job->running) {
+         remove_from_list(job);
+         queue->num_pending--;
+         variant->compile_job = NULL;
+         FREE(job);
+         break;
+      }
+
+      pipe_condvar_wait(queue->work_done, queue->mutex);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Number of variants waiting for a thread.
+ */
+unsigned
+lp_compile_queue_depth(struct lp_compile_queue *queue)
+{
+   unsigned depth;
+
+   pipe_mutex_lock(queue->mutex);
+   depth = queue->num_pending;
+   pipe_mutex_unlock(queue->mutex);
+
+   return depth;
+}
+
+
+/**
+ * Get the time spent on and the number of finished jobs so far.
+ */
+void
+lp_compile_queue_get_stats(struct lp_compile_queue *queue,
+                           uint64_t *compile_time,
+                           uint64_t *nr_compiles)
+{
+   pipe_mutex_lock(queue->mutex);
+   *compile_time = queue->compile_time;
+   *nr_compiles = queue->nr_compiles;
+   pipe_mutex_unlock(queue->mutex);
+}
@@ -38,6 +38,7 @@
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
 #include "lp_clear.h"
+#include "lp_compile_queue.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
@@ -93,6 +94,9 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_delete_setup_variants(llvmpipe);
 
+   if (llvmpipe->compile_queue)
+      lp_compile_queue_destroy(llvmpipe->compile_queue);
+
    LLVMContextDispose(llvmpipe->context);
    llvmpipe->context = NULL;
 
@@ -168,6 +172,19 @@ llvmpipe_create_context( struct pipe_screen *screen, void *priv )
    if (!llvmpipe->context)
       goto fail;
 
+   /* Threads for the background compilation of shader variants.  Without
+    * them variants are compiled with full optimization when first used.
+    */
+   {
+      unsigned num_compile_threads =
+         debug_get_num_option("LP_NUM_COMPILE_THREADS", 0);
+      if (num_compile_threads)
+         llvmpipe->compile_queue = lp_compile_queue_create(num_compile_threads);
+
+      llvmpipe->tier_up_threshold =
+         debug_get_num_option("LP_TIER_UP_THRESHOLD", 0);
+   }
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -52,6 +52,7 @@ struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
 struct lp_velems_state;
+struct lp_compile_queue;
 
 struct llvmpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -99,6 +100,14 @@ struct llvmpipe_context {
 
    unsigned active_occlusion_queries;
 
+   /** Always-on counters, sampled by the driver queries */
+   struct {
+      uint64_t draw_time;       /**< in draw_vbo, in nanoseconds */
+      uint64_t compile_time;    /**< generating variants, in nanoseconds */
+      uint64_t nr_compiles;
+      uint64_t nr_resource_flushes;  /**< scenes flushed to access resources */
+   } stats;
+
    unsigned dirty; /**< Mask of LP_NEW_x flags */
 
    /** Mapped vertex buffers */
@@ -156,6 +165,18 @@ struct llvmpipe_context {
 
    /** The LLVMContext to use for LLVM related work */
    LLVMContextRef context;
+
+   /** Background compilation of shader variants, or NULL */
+   struct lp_compile_queue *compile_queue;
+
+   /**
+    * Number of 4x4 blocks a variant shades with unoptimized code before
+    * it is queued for optimization.
+    */
+   unsigned tier_up_threshold;
+
+   /** The bound fragment shader variant */
+   struct lp_fragment_shader_variant *fs_variant;
 };
 
 
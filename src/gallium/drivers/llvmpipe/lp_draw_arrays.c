@@ -35,6 +35,7 @@
 #include "pipe/p_context.h"
 #include "util/u_draw.h"
 #include "util/u_prim.h"
+#include "os/os_time.h"
 
 #include "lp_context.h"
 #include "lp_state.h"
@@ -57,6 +58,7 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    struct draw_context *draw = lp->draw;
    const void *mapped_indices = NULL;
    unsigned i;
+   int64_t t0;
 
    if (!llvmpipe_check_render_cond(lp))
       return;
@@ -69,6 +71,9 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   if (lp->compile_queue)
+      llvmpipe_tier_up_fs_variant( lp );
+
    /*
     * Map vertex buffers
     */
@@ -129,7 +134,9 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
                                     lp->active_statistics_queries > 0);
 
    /* draw! */
+   t0 = os_time_get_nano();
    draw_vbo(draw, info);
+   lp->stats.draw_time += os_time_get_nano() - t0;
 
    /*
     * unmap vertex/index buffers
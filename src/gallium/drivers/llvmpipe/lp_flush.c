@@ -109,22 +109,18 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 
    if ((referenced & LP_REFERENCED_FOR_WRITE) ||
        ((referenced & LP_REFERENCED_FOR_READ) && !read_only)) {
-
-      if (cpu_access) {
-         /*
-          * Flush and wait.
-          */
-         if (do_not_block)
-            return FALSE;
-
-         llvmpipe_finish(pipe, reason);
-      } else {
-         /*
-          * Just flush.
-          */
-
-         llvmpipe_flush(pipe, NULL, reason);
-      }
+      struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+      /*
+       * Flush and wait.  Scenes are rasterized asynchronously, so even
+       * without CPU access the resource is only complete once they are
+       * done, as it may be used by other contexts or the winsys next.
+       */
+      if (cpu_access && do_not_block)
+         return FALSE;
+
+      llvmpipe->stats.nr_resource_flushes++;
+      llvmpipe_finish(pipe, reason);
    }
 
    return TRUE;
@@ -61,7 +61,24 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Max number of rasterizer threads.  The actual number is chosen at
+ * screen creation from the number of CPUs (or LP_NUM_THREADS).
+ */
+#define LP_MAX_THREADS 64
+
+
+/**
+ * Max number of helper threads used by each context for triangle setup
+ * (see LP_NUM_SETUP_THREADS).
+ */
+#define LP_MAX_SETUP_THREADS 7
+
+/**
+ * Max number of threads used by each context for the background
+ * compilation of shader variants (see LP_NUM_COMPILE_THREADS).
+ */
+#define LP_MAX_COMPILE_THREADS 4
 
 
 /**
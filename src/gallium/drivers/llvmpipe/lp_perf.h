@@ -56,8 +56,16 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_rejected_64;
+   unsigned nr_hiz_rejected_16;
+   unsigned nr_hiz_rejected_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_llvm_async_compiles;
+   int64_t llvm_async_compile_time;  /**< total, in microseconds */
+   int64_t llvm_async_latency;  /**< total time from queuing to done */
+   unsigned llvm_async_queue_max;  /**< max variants waiting at once */
+   unsigned nr_llvm_tier_ups;  /**< variants queued once hot */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
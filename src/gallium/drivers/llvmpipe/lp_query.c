@@ -33,6 +33,7 @@
 #include "draw/draw_context.h"
 #include "pipe/p_defines.h"
 #include "util/u_memory.h"
+#include "util/u_string.h"
 #include "os/os_time.h"
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -41,6 +42,8 @@
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "lp_setup.h"
+#include "lp_compile_queue.h"
 
 
 static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
@@ -48,6 +51,85 @@ static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
    return (struct llvmpipe_query *)p;
 }
 
+
+static boolean
+is_driver_query(unsigned type)
+{
+   return type >= PIPE_QUERY_DRIVER_SPECIFIC && type < LP_QUERY_LAST;
+}
+
+
+/**
+ * Current value of a driver specific query's counter.
+ */
+static uint64_t
+sample_driver_query(struct llvmpipe_context *llvmpipe, unsigned type)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+   const struct lp_setup_stats *setup_stats =
+      lp_setup_get_stats(llvmpipe->setup);
+   struct lp_rast_stats rast_stats;
+   uint64_t value = 0;
+   unsigned i;
+
+   switch (type) {
+   case LP_QUERY_DRAW_TIME:
+      return llvmpipe->stats.draw_time;
+   case LP_QUERY_RAST_TIME:
+   case LP_QUERY_SHADE_TIME:
+   case LP_QUERY_BINS:
+      for (i = 0; i < lp_rast_num_tasks(screen->rast); i++) {
+         lp_rast_get_stats(screen->rast, i, &rast_stats);
+         if (type == LP_QUERY_RAST_TIME)
+            value += rast_stats.rast_time;
+         else if (type == LP_QUERY_SHADE_TIME)
+            value += rast_stats.shade_time;
+         else
+            value += rast_stats.nr_bins;
+      }
+      return value;
+   case LP_QUERY_TRIANGLES:
+      return setup_stats->nr_tris;
+   case LP_QUERY_TRIANGLES_CULLED:
+      return setup_stats->nr_tris - MIN2(setup_stats->nr_binned_tris,
+                                         setup_stats->nr_tris);
+   case LP_QUERY_SCENES:
+      return setup_stats->nr_scenes;
+   case LP_QUERY_FLUSHES_FULL:
+      return setup_stats->nr_full_flushes;
+   case LP_QUERY_FLUSHES_FB:
+      return setup_stats->nr_fb_flushes;
+   case LP_QUERY_FLUSHES_RESOURCE:
+      return llvmpipe->stats.nr_resource_flushes;
+   case LP_QUERY_COMPILE_TIME:
+   case LP_QUERY_COMPILES:
+      if (llvmpipe->compile_queue) {
+         uint64_t compile_time, nr_compiles;
+         lp_compile_queue_get_stats(llvmpipe->compile_queue,
+                                    &compile_time, &nr_compiles);
+         value = type == LP_QUERY_COMPILE_TIME ? compile_time : nr_compiles;
+      }
+      if (type == LP_QUERY_COMPILE_TIME)
+         return value + llvmpipe->stats.compile_time;
+      else
+         return value + llvmpipe->stats.nr_compiles;
+   case LP_QUERY_VCACHE_LOOKUPS:
+      return draw_get_vertex_cache_stats(llvmpipe->draw)->nr_lookups;
+   case LP_QUERY_VCACHE_HITS:
+      return draw_get_vertex_cache_stats(llvmpipe->draw)->nr_hits;
+   case LP_QUERY_VERTICES_SHADED:
+      return draw_get_vertex_cache_stats(llvmpipe->draw)->nr_shaded;
+   default:
+      i = type - LP_QUERY_THREAD_RAST_TIME;
+      assert(type >= LP_QUERY_THREAD_RAST_TIME && type < LP_QUERY_LAST);
+      if (i < lp_rast_num_tasks(screen->rast)) {
+         lp_rast_get_stats(screen->rast, i, &rast_stats);
+         return rast_stats.rast_time;
+      }
+      return 0;
+   }
+}
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type,
@@ -55,7 +137,7 @@ llvmpipe_create_query(struct pipe_context *pipe,
 {
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES || is_driver_query(type));
 
    pq = CALLOC_STRUCT( llvmpipe_query );
 
@@ -72,6 +154,10 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->shade_timing) {
+      lp_rast_enable_shade_timing(llvmpipe_screen(pipe->screen)->rast, FALSE);
+   }
+
    /* Ideally we would refcount queries & not get destroyed until the
     * last scene had finished with us.
     */
@@ -101,6 +187,12 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    uint64_t *result = (uint64_t *)vresult;
    int i;
 
+   if (is_driver_query(pq->type)) {
+      /* sampled at begin/end_query, nothing to wait for */
+      *result = pq->end[0] - pq->start[0];
+      return TRUE;
+   }
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -190,6 +282,16 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (is_driver_query(pq->type)) {
+      if (pq->type == LP_QUERY_SHADE_TIME && !pq->shade_timing) {
+         lp_rast_enable_shade_timing(llvmpipe_screen(pipe->screen)->rast,
+                                     TRUE);
+         pq->shade_timing = TRUE;
+      }
+      pq->start[0] = sample_driver_query(llvmpipe, pq->type);
+      return;
+   }
+
    /* Check if the query is already in the scene.  If so, we need to
     * flush the scene now.  Real apps shouldn't re-use a query in a
     * frame of rendering.
@@ -244,6 +346,20 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (is_driver_query(pq->type)) {
+      /*
+       * Work binned before this point may still be in the rasterizer, so
+       * the rasterizer counters lag behind by the scenes in flight.
+       */
+      pq->end[0] = sample_driver_query(llvmpipe, pq->type);
+      if (pq->shade_timing) {
+         lp_rast_enable_shade_timing(llvmpipe_screen(pipe->screen)->rast,
+                                     FALSE);
+         pq->shade_timing = FALSE;
+      }
+      return;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -329,3 +445,66 @@ void llvmpipe_init_query_funcs(struct llvmpipe_context *llvmpipe )
 }
 
 
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *_screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   static const struct pipe_driver_query_info queries[] = {
+      {"draw-time", LP_QUERY_DRAW_TIME, 0, FALSE},
+      {"rast-time", LP_QUERY_RAST_TIME, 0, FALSE},
+      {"shade-time", LP_QUERY_SHADE_TIME, 0, FALSE},
+      {"bins", LP_QUERY_BINS, 0, FALSE},
+      {"triangles", LP_QUERY_TRIANGLES, 0, FALSE},
+      {"triangles-culled", LP_QUERY_TRIANGLES_CULLED, 0, FALSE},
+      {"scenes", LP_QUERY_SCENES, 0, FALSE},
+      {"flushes-scene-full", LP_QUERY_FLUSHES_FULL, 0, FALSE},
+      {"flushes-framebuffer", LP_QUERY_FLUSHES_FB, 0, FALSE},
+      {"flushes-resource", LP_QUERY_FLUSHES_RESOURCE, 0, FALSE},
+      {"compile-time", LP_QUERY_COMPILE_TIME, 0, FALSE},
+      {"compiles", LP_QUERY_COMPILES, 0, FALSE},
+      {"vertex-cache-lookups", LP_QUERY_VCACHE_LOOKUPS, 0, FALSE},
+      {"vertex-cache-hits", LP_QUERY_VCACHE_HITS, 0, FALSE},
+      {"vertices-shaded", LP_QUERY_VERTICES_SHADED, 0, FALSE},
+   };
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+   unsigned num_queries = Elements(queries) + screen->num_threads;
+
+   if (!info)
+      return num_queries;
+
+   if (index >= num_queries)
+      return 0;
+
+   if (index < Elements(queries)) {
+      *info = queries[index];
+   }
+   else {
+      index -= Elements(queries);
+      info->name = screen->thread_query_names[index];
+      info->query_type = LP_QUERY_THREAD_RAST_TIME + index;
+      info->max_value = 0;
+      info->uses_byte_units = FALSE;
+   }
+
+   return 1;
+}
+
+
+/**
+ * Times are in nanoseconds.  Per-thread queries are only there when
+ * rasterizing on separate threads.
+ */
+void llvmpipe_init_screen_query_funcs(struct pipe_screen *_screen)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+   unsigned i;
+
+   for (i = 0; i < screen->num_threads; i++) {
+      util_snprintf(screen->thread_query_names[i],
+                    sizeof screen->thread_query_names[i],
+                    "rast-time-thread%u", i);
+   }
+
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
+}
@@ -39,6 +39,31 @@
 
 
 struct llvmpipe_context;
+struct pipe_screen;
+
+
+/**
+ * Driver specific queries.  The rasterizer threads are shared by all the
+ * contexts of a screen, so the rasterizer counters include their work too.
+ */
+#define LP_QUERY_DRAW_TIME          (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_RAST_TIME          (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_SHADE_TIME         (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_BINS               (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+#define LP_QUERY_TRIANGLES          (PIPE_QUERY_DRIVER_SPECIFIC + 4)
+#define LP_QUERY_TRIANGLES_CULLED   (PIPE_QUERY_DRIVER_SPECIFIC + 5)
+#define LP_QUERY_SCENES             (PIPE_QUERY_DRIVER_SPECIFIC + 6)
+#define LP_QUERY_FLUSHES_FULL       (PIPE_QUERY_DRIVER_SPECIFIC + 7)
+#define LP_QUERY_FLUSHES_FB         (PIPE_QUERY_DRIVER_SPECIFIC + 8)
+#define LP_QUERY_FLUSHES_RESOURCE   (PIPE_QUERY_DRIVER_SPECIFIC + 9)
+#define LP_QUERY_COMPILE_TIME       (PIPE_QUERY_DRIVER_SPECIFIC + 10)
+#define LP_QUERY_COMPILES           (PIPE_QUERY_DRIVER_SPECIFIC + 11)
+#define LP_QUERY_VCACHE_LOOKUPS     (PIPE_QUERY_DRIVER_SPECIFIC + 12)
+#define LP_QUERY_VCACHE_HITS        (PIPE_QUERY_DRIVER_SPECIFIC + 13)
+#define LP_QUERY_VERTICES_SHADED    (PIPE_QUERY_DRIVER_SPECIFIC + 14)
+/** Time spent on bins by each rasterizer thread, one query per thread */
+#define LP_QUERY_THREAD_RAST_TIME   (PIPE_QUERY_DRIVER_SPECIFIC + 15)
+#define LP_QUERY_LAST               (LP_QUERY_THREAD_RAST_TIME + LP_MAX_THREADS)
 
 
 struct llvmpipe_query {
@@ -50,11 +75,15 @@ struct llvmpipe_query {
    unsigned num_primitives_written;
 
    struct pipe_query_data_pipeline_statistics stats;
+
+   boolean shade_timing;            /* shade time query being counted */
 };
 
 
 extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
+extern void llvmpipe_init_screen_query_funcs(struct pipe_screen *screen);
+
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
 #endif /* LP_QUERY_H */
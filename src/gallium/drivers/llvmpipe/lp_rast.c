@@ -26,11 +26,16 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_string.h"
+#include "util/u_atomic.h"
 
 #include "os/os_time.h"
 
@@ -66,17 +71,42 @@ lp_rast_begin( struct lp_rasterizer *rast,
 
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
-   lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   scene->begin_rast_time = os_time_get();
+
+   lp_scene_begin_hiz( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_threads );
 }
 
 
+/**
+ * Finish rasterizing the current scene and signal its fence.
+ * Called once per scene by one thread, after all threads are done
+ * with the scene's bins.  Once the fence is signalled setup releases
+ * and reuses the scene, so it must not be touched afterwards.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = NULL;
+
+   if (LP_DEBUG & DEBUG_SCENE) {
+      int64_t now = os_time_get();
+      debug_printf("scene %d: binned %d us, queued %d us, rasterized %d us\n",
+                   scene->fence ? scene->fence->id : -1,
+                   (int) (scene->queue_time - scene->begin_binning_time),
+                   (int) (scene->begin_rast_time - scene->queue_time),
+                   (int) (now - scene->begin_rast_time));
+   }
+
+   lp_fence_reference(&fence, scene->fence);
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -106,6 +136,142 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    /* reset pointers to color and depth tile(s) */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
    task->depth_tile = NULL;
+
+   /*
+    * The cache holds a single layer.  It is allocated by the thread
+    * using it so that it ends up in memory local to it.
+    */
+   if (task->rast->tile_cache && !task->tile_cache)
+      task->tile_cache = align_malloc(LP_TILE_CACHE_SIZE, 64);
+   task->use_tile_cache = task->tile_cache && task->scene->fb_max_layer == 0;
+   task->cached_tiles = 0;
+}
+
+
+/**
+ * Copy a tile's rows between the framebuffer and the tile cache.
+ */
+static void
+lp_rast_copy_tile(uint8_t *dst, unsigned dst_stride,
+                  const uint8_t *src, unsigned src_stride,
+                  unsigned width_bytes, unsigned height)
+{
+   unsigned y;
+
+   for (y = 0; y < height; y++) {
+      memcpy(dst, src, width_bytes);
+      dst += dst_stride;
+      src += src_stride;
+   }
+}
+
+
+/**
+ * Make the tile cache hold the current color tile, loading it unless
+ * it is going to be overwritten entirely.
+ */
+uint8_t *
+lp_rast_cache_color_tile(struct lp_rasterizer_task *task,
+                         unsigned buf, enum lp_texture_usage usage)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned format_bytes = util_format_get_blocksize(scene->fb.cbufs[buf]->format);
+   uint8_t *tile = task->tile_cache + buf * LP_TILE_CACHE_COLOR_SIZE;
+
+   assert(task->use_tile_cache);
+   assert(!task->color_tiles[buf]);
+   assert(format_bytes <= LP_TILE_CACHE_COLOR_SIZE / (TILE_SIZE * TILE_SIZE));
+
+   task->color_tiles[buf] = tile;
+   task->color_strides[buf] = TILE_SIZE * format_bytes;
+   task->cached_tiles |= LP_CACHED_COLOR(buf);
+
+   if (usage != LP_TEX_USAGE_WRITE_ALL) {
+      lp_rast_copy_tile(tile, task->color_strides[buf],
+                        scene->cbufs[buf].map +
+                        scene->cbufs[buf].stride * task->y +
+                        format_bytes * task->x,
+                        scene->cbufs[buf].stride,
+                        task->width * format_bytes, task->height);
+      LP_COUNT(nr_color_tile_load);
+   }
+
+   return tile;
+}
+
+
+/**
+ * Make the tile cache hold the current depth tile, loading it unless
+ * it is going to be overwritten entirely.
+ */
+uint8_t *
+lp_rast_cache_depth_tile(struct lp_rasterizer_task *task,
+                         enum lp_texture_usage usage)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned format_bytes = util_format_get_blocksize(scene->fb.zsbuf->format);
+   uint8_t *tile = task->tile_cache +
+                   PIPE_MAX_COLOR_BUFS * LP_TILE_CACHE_COLOR_SIZE;
+
+   assert(task->use_tile_cache);
+   assert(!task->depth_tile);
+   assert(format_bytes <= LP_TILE_CACHE_DEPTH_SIZE / (TILE_SIZE * TILE_SIZE));
+
+   task->depth_tile = tile;
+   task->depth_stride = TILE_SIZE * format_bytes;
+   task->cached_tiles |= LP_CACHED_DEPTH;
+
+   if (usage != LP_TEX_USAGE_WRITE_ALL) {
+      lp_rast_copy_tile(tile, task->depth_stride,
+                        scene->zsbuf.map +
+                        scene->zsbuf.stride * task->y +
+                        format_bytes * task->x,
+                        scene->zsbuf.stride,
+                        task->width * format_bytes, task->height);
+   }
+
+   return tile;
+}
+
+
+/**
+ * Write the cached tiles back to the framebuffer.
+ */
+static void
+lp_rast_flush_tile_cache(struct lp_rasterizer_task *task)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned buf;
+
+   for (buf = 0; buf < scene->fb.nr_cbufs; buf++) {
+      if (task->cached_tiles & LP_CACHED_COLOR(buf)) {
+         unsigned format_bytes =
+            util_format_get_blocksize(scene->fb.cbufs[buf]->format);
+
+         lp_rast_copy_tile(scene->cbufs[buf].map +
+                           scene->cbufs[buf].stride * task->y +
+                           format_bytes * task->x,
+                           scene->cbufs[buf].stride,
+                           task->color_tiles[buf],
+                           task->color_strides[buf],
+                           task->width * format_bytes, task->height);
+         LP_COUNT(nr_color_tile_store);
+      }
+   }
+
+   if (task->cached_tiles & LP_CACHED_DEPTH) {
+      unsigned format_bytes = util_format_get_blocksize(scene->fb.zsbuf->format);
+
+      lp_rast_copy_tile(scene->zsbuf.map +
+                        scene->zsbuf.stride * task->y +
+                        format_bytes * task->x,
+                        scene->zsbuf.stride,
+                        task->depth_tile,
+                        task->depth_stride,
+                        task->width * format_bytes, task->height);
+   }
+
+   task->cached_tiles = 0;
 }
 
 
@@ -122,6 +288,7 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    unsigned cbuf = arg.clear_rb->cbuf;
    union util_color uc;
    enum pipe_format format;
+   uint8_t *dst;
 
    /* we never bin clear commands for non-existing buffers */
    assert(cbuf < scene->fb.nr_cbufs);
@@ -138,12 +305,14 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
 
-   util_fill_box(scene->cbufs[cbuf].map,
+   dst = lp_rast_get_color_tile_pointer(task, cbuf, LP_TEX_USAGE_WRITE_ALL);
+
+   util_fill_box(dst,
                  format,
-                 scene->cbufs[cbuf].stride,
+                 task->color_strides[cbuf],
                  scene->cbufs[cbuf].layer_stride,
-                 task->x,
-                 task->y,
+                 0,
+                 0,
                  0,
                  task->width,
                  task->height,
@@ -155,6 +324,47 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Update the hierarchical z of the current tile after a z/stencil clear.
+ */
+static void
+lp_rast_clear_hiz(struct lp_rasterizer_task *task,
+                  uint64_t clear_value, uint64_t clear_mask)
+{
+   const struct lp_scene *scene = task->scene;
+   enum pipe_format format = scene->fb.zsbuf->format;
+   const struct util_format_description *desc = util_format_description(format);
+   uint64_t z_mask = util_pack64_mask_z(format, ~0);
+   unsigned bx0 = task->x / LP_HIZ_BLOCK_SIZE;
+   unsigned by0 = task->y / LP_HIZ_BLOCK_SIZE;
+   unsigned bx1 = MIN2(bx0 + TILE_SIZE / LP_HIZ_BLOCK_SIZE, scene->hiz.stride);
+   unsigned by1 = MIN2(by0 + TILE_SIZE / LP_HIZ_BLOCK_SIZE, scene->hiz.rows);
+   unsigned bx, by;
+   float z;
+
+   if (!(clear_mask & z_mask))
+      return;
+
+   if ((clear_mask & z_mask) == z_mask) {
+      desc->unpack_z_float(&z, 0, (const uint8_t *) &clear_value, 0, 1, 1);
+   }
+   else {
+      z = LP_HIZ_UNKNOWN;
+   }
+
+   for (by = by0; by < by1; by++) {
+      float *row = scene->hiz.zmax + by * scene->hiz.stride;
+      for (bx = bx0; bx < bx1; bx++) {
+         /* blocks straddling the framebuffer's edge are only partly cleared */
+         if (bx < scene->hiz.full_x && by < scene->hiz.full_y)
+            row[bx] = z;
+         else
+            row[bx] = MAX2(row[bx], z);
+      }
+   }
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
@@ -171,7 +381,7 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
    uint32_t clear_mask = (uint32_t) clear_mask64;
    const unsigned height = task->height;
    const unsigned width = task->width;
-   const unsigned dst_stride = scene->zsbuf.stride;
+   unsigned dst_stride;
    uint8_t *dst;
    unsigned i, j;
    unsigned block_size;
@@ -185,9 +395,19 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 
    if (scene->fb.zsbuf) {
       unsigned layer;
-      uint8_t *dst_layer = lp_rast_get_depth_tile_pointer(task, LP_TEX_USAGE_READ_WRITE);
+      uint8_t *dst_layer;
+      enum lp_texture_usage usage = LP_TEX_USAGE_READ_WRITE;
+
       block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
 
+      /* no need to load the tile when all of it is overwritten */
+      if (block_size == 8 ? clear_mask64 == ~(uint64_t) 0 :
+          clear_mask == (uint32_t) (((uint64_t) 1 << (block_size * 8)) - 1))
+         usage = LP_TEX_USAGE_WRITE_ALL;
+
+      dst_layer = lp_rast_get_depth_tile_pointer(task, usage);
+      dst_stride = task->depth_stride;
+
       clear_value &= clear_mask;
 
       for (layer = 0; layer <= scene->fb_max_layer; layer++) {
@@ -266,6 +486,9 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          }
          dst_layer += scene->zsbuf.layer_stride;
       }
+
+      if (scene->hiz.zmax)
+         lp_rast_clear_hiz(task, clear_value64, clear_mask64);
    }
 }
 
@@ -285,7 +508,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
-   unsigned x, y;
+   unsigned bx, by, x, y;
 
    if (inputs->disable) {
       /* This command was partially binned and has been disabled */
@@ -301,53 +524,75 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
-   /* render the whole 64x64 tile in 4x4 chunks */
-   for (y = 0; y < task->height; y += 4){
-      for (x = 0; x < task->width; x += 4) {
-         uint8_t *color[PIPE_MAX_COLOR_BUFS];
-         unsigned stride[PIPE_MAX_COLOR_BUFS];
-         uint8_t *depth = NULL;
-         unsigned depth_stride = 0;
-         unsigned i;
-
-         /* color buffer */
-         for (i = 0; i < scene->fb.nr_cbufs; i++){
-            if (scene->fb.cbufs[i]) {
-               stride[i] = scene->cbufs[i].stride;
-               color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
-                                                          tile_y + y, inputs->layer);
-            }
-            else {
-               stride[i] = 0;
-               color[i] = NULL;
-            }
-         }
+   if (lp_rast_hiz_reject(task, inputs, tile_x, tile_y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_rejected_64);
+      return;
+   }
 
-         /* depth buffer */
-         if (scene->zsbuf.map) {
-            depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
-                                                    tile_y + y, inputs->layer);
-            depth_stride = scene->zsbuf.stride;
+   /* render the whole 64x64 tile in 16x16 blocks of 4x4 chunks */
+   for (by = 0; by < task->height; by += 16) {
+      for (bx = 0; bx < task->width; bx += 16) {
+         if (lp_rast_hiz_reject(task, inputs, tile_x + bx, tile_y + by, 16)) {
+            LP_COUNT(nr_hiz_rejected_16);
+            continue;
          }
 
-         /* Propagate non-interpolated raster state. */
-         task->thread_data.raster_state.viewport_index = inputs->viewport_index;
+         for (y = by; y < MIN2(by + 16, task->height); y += 4) {
+            for (x = bx; x < MIN2(bx + 16, task->width); x += 4) {
+               uint8_t *color[PIPE_MAX_COLOR_BUFS];
+               unsigned stride[PIPE_MAX_COLOR_BUFS];
+               uint8_t *depth = NULL;
+               unsigned depth_stride = 0;
+               unsigned i;
+               int64_t shade_start;
+
+               /* color buffer */
+               for (i = 0; i < scene->fb.nr_cbufs; i++){
+                  if (scene->fb.cbufs[i]) {
+                     color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
+                                                                tile_y + y, inputs->layer);
+                     stride[i] = task->color_strides[i];
+                  }
+                  else {
+                     stride[i] = 0;
+                     color[i] = NULL;
+                  }
+               }
 
-         /* run shader on 4x4 block */
-         BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            0xffff,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
-         END_JIT_CALL();
+               /* depth buffer */
+               if (scene->zsbuf.map) {
+                  depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
+                                                          tile_y + y, inputs->layer);
+                  depth_stride = task->depth_stride;
+               }
+
+               lp_rast_hiz_shaded(task, inputs, tile_x + x, tile_y + y);
+
+               /* Propagate non-interpolated raster state. */
+               task->thread_data.raster_state.viewport_index = inputs->viewport_index;
+
+               /* run shader on 4x4 block */
+               lp_rast_count_invocation(task, variant);
+               shade_start = lp_rast_shade_time_begin(task);
+               BEGIN_JIT_CALL(state, task);
+               variant->jit_function[RAST_WHOLE]( &state->jit_context,
+                                                  tile_x + x, tile_y + y,
+                                                  inputs->frontfacing,
+                                                  GET_A0(inputs),
+                                                  GET_DADX(inputs),
+                                                  GET_DADY(inputs),
+                                                  color,
+                                                  depth,
+                                                  0xffff,
+                                                  &task->thread_data,
+                                                  stride,
+                                                  depth_stride);
+               END_JIT_CALL();
+               lp_rast_shade_time_end(task, shade_start);
+            }
+         }
+
+         lp_rast_hiz_covered(task, inputs, tile_x + bx, tile_y + by);
       }
    }
 }
@@ -393,6 +638,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
    unsigned i;
+   int64_t shade_start;
 
    assert(state);
 
@@ -408,9 +654,9 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
-         stride[i] = scene->cbufs[i].stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
+         stride[i] = task->color_strides[i];
       }
       else {
          stride[i] = 0;
@@ -420,8 +666,8 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 
    /* depth buffer */
    if (scene->zsbuf.map) {
-      depth_stride = scene->zsbuf.stride;
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
+      depth_stride = task->depth_stride;
    }
 
    assert(lp_check_alignment(state->jit_context.u8_blend_color, 16));
@@ -434,11 +680,15 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
       /* not very accurate would need a popcount on the mask */
       /* always count this not worth bothering? */
       task->ps_invocations += 1 * variant->ps_inv_multiplier;
+      lp_rast_count_invocation(task, variant);
+
+      lp_rast_hiz_shaded(task, inputs, x, y);
 
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
       /* run shader on 4x4 block */
+      shade_start = lp_rast_shade_time_begin(task);
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
                                             x, y,
@@ -453,6 +703,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                             stride,
                                             depth_stride);
       END_JIT_CALL();
+      lp_rast_shade_time_end(task, shade_start);
    }
 }
 
@@ -517,11 +768,59 @@ lp_rast_end_query(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Determine how primitives drawn with the given state interact with the
+ * hierarchical z buffer.
+ */
+static unsigned
+lp_rast_hiz_mode(const struct lp_scene *scene,
+                 const struct lp_rast_state *state)
+{
+   const struct lp_fragment_shader_variant *variant = state->variant;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &variant->shader->info.base;
+   unsigned mode = 0;
+
+   if (!scene->hiz.zmax || !key->depth.enabled)
+      return 0;
+
+   switch (key->depth.func) {
+   case PIPE_FUNC_NEVER:
+   case PIPE_FUNC_EQUAL:
+      /* depth values never change */
+      break;
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      /*
+       * Depth values never increase.  Skipping blocks is only safe when
+       * failing the depth test has no side effects, and the depth of whole
+       * blocks is only known when none of their pixels can be discarded.
+       */
+      if (!info->writes_z && !key->stencil[0].enabled) {
+         mode |= LP_HIZ_REJECT;
+         if (key->depth.writemask &&
+             !info->uses_kill &&
+             !key->alpha.enabled &&
+             !key->blend.alpha_to_coverage)
+            mode |= LP_HIZ_LOWER;
+      }
+      break;
+   default:
+      if (key->depth.writemask)
+         mode |= info->writes_z ? LP_HIZ_INVALIDATE : LP_HIZ_RAISE;
+      break;
+   }
+
+   return mode;
+}
+
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+   task->hiz_mode = lp_rast_hiz_mode(task->scene, task->state);
 }
 
 
@@ -538,6 +837,11 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
 
+   if (task->cached_tiles)
+      lp_rast_flush_tile_cache(task);
+
+   lp_rast_flush_invocations(task);
+
    /* debug */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
    task->depth_tile = NULL;
@@ -609,12 +913,17 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y )
 {
+   int64_t start = os_time_get_nano();
+
    lp_rast_tile_begin( task, bin, x, y );
 
    do_rasterize_bin(task, bin, x, y);
 
    lp_rast_tile_end(task);
 
+   task->stats.nr_bins++;
+   task->stats.rast_time += os_time_get_nano() - start;
+
 
    /* Debug/Perf flags:
     */
@@ -627,20 +936,6 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- * 
- * Try to avoid doing pointless work in this case.
- */
-static boolean
-is_empty_bin( const struct cmd_bin *bin )
-{
-   return bin->head == NULL;
-}
-
-
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -650,25 +945,32 @@ rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
    task->scene = scene;
+   task->time_shading = p_atomic_read(&task->rast->shade_timing) != 0;
 
    if (!task->rast->no_rast && !scene->discard) {
-      /* loop over scene bins, rasterize each */
+      /* loop over scene bins, rasterize each.  Empty bins (ones that
+       * would just load the contents of the tile and store them again
+       * unchanged) are never handed out by the bin iterator.
+       */
       {
          struct cmd_bin *bin;
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin, i, j);
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
+            rasterize_bin(task, bin, i, j);
          }
       }
    }
 
-
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
+   /* publish the counters of the scene for lp_rast_get_stats() */
+   pipe_mutex_lock(task->stats_mutex);
+   task->total_stats.nr_bins += task->stats.nr_bins;
+   task->total_stats.rast_time += task->stats.rast_time;
+   task->total_stats.shade_time += task->stats.shade_time;
+   pipe_mutex_unlock(task->stats_mutex);
+   memset(&task->stats, 0, sizeof task->stats);
 
    task->scene = NULL;
 }
@@ -718,20 +1020,47 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Number of rasterizer tasks, i.e. of sets of per-thread counters.
+ */
+unsigned
+lp_rast_num_tasks( const struct lp_rasterizer *rast )
+{
+   return MAX2(1, rast->num_threads);
+}
+
+
+/**
+ * Get the counters of one rasterizer thread.  They are updated once per
+ * scene, so they don't include the scene currently being rasterized.
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_get_stats( struct lp_rasterizer *rast,
+                   unsigned thread,
+                   struct lp_rast_stats *stats )
 {
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
+   struct lp_rasterizer_task *task = &rast->tasks[thread];
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
+   assert(thread < lp_rast_num_tasks(rast));
+
+   pipe_mutex_lock(task->stats_mutex);
+   *stats = task->total_stats;
+   pipe_mutex_unlock(task->stats_mutex);
+}
+
+
+/**
+ * Start or stop timing fragment shader execution.  Calls nest; timing
+ * takes effect from the next scene on.
+ */
+void
+lp_rast_enable_shade_timing( struct lp_rasterizer *rast,
+                             boolean enable )
+{
+   if (enable)
+      p_atomic_inc(&rast->shade_timing);
+   else
+      p_atomic_dec(&rast->shade_timing);
 }
 
 
@@ -740,7 +1069,7 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. thread[0] signals the scene's fence once all threads are done
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -749,6 +1078,15 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    boolean debug = false;
    unsigned fpstate = util_fpstate_get();
 
+   if (task->cpu >= 0 && !pipe_thread_pin_to_cpu(task->cpu)) {
+      /* Only report the first failure, the others are likely the same. */
+      static int pin_failures = 0;
+
+      if (p_atomic_cmpxchg(&pin_failures, 0, 1) == 0)
+         _debug_printf("llvmpipe: thread %d failed to pin to cpu %d\n",
+                       task->thread_index, task->cpu);
+   }
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -766,7 +1104,7 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
-          *  - map the framebuffer surfaces
+          *  - set up the hierarchical z buffer
           */
          lp_rast_begin( rast, 
                         lp_scene_dequeue( rast->full_scenes, TRUE ) );
@@ -787,23 +1125,99 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0]:
+       *  - signal the scene's fence, setup then releases the scene
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
    return 0;
 }
 
 
+/**
+ * Fill cpus[] with CPU numbers ordered so that CPUs of the same NUMA node
+ * are adjacent.  Consecutive rasterizer threads get neighbouring ranges of
+ * bins, so this keeps each band of the framebuffer on a single node.
+ * \return number of CPUs written, or 0 if the topology is unknown
+ */
+static unsigned
+get_numa_cpu_order(int *cpus, unsigned max_cpus)
+{
+   unsigned count = 0;
+#if defined(PIPE_OS_LINUX) && !defined(PIPE_OS_ANDROID)
+   unsigned node;
+
+   for (node = 0; count < max_cpus; node++) {
+      char path[64];
+      char line[1024];
+      char *p;
+      FILE *f;
+
+      util_snprintf(path, sizeof path,
+                    "/sys/devices/system/node/node%u/cpulist", node);
+      f = fopen(path, "r");
+      if (!f)
+         break;
+
+      if (!fgets(line, sizeof line, f))
+         line[0] = '\0';
+      fclose(f);
+
+      /* The list looks like "0-7,16-23" */
+      p = line;
+      while (*p && count < max_cpus) {
+         char *end;
+         long first = strtol(p, &end, 10), last;
+         if (end == p)
+            break;
+         last = first;
+         if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+         }
+         while (first <= last && count < max_cpus)
+            cpus[count++] = first++;
+         p = *end == ',' ? end + 1 : end;
+      }
+   }
+#endif
+   return count;
+}
+
+
+/**
+ * Decide which CPU each rasterizer thread runs on.  With LP_PIN_THREADS
+ * set, thread i is pinned to the i-th CPU in NUMA node order, so a given
+ * thread always rasterizes the same part of the framebuffer on the same
+ * core.  Otherwise the threads float.
+ */
+static void
+assign_rast_cpus(struct lp_rasterizer *rast)
+{
+   int cpus[LP_MAX_THREADS];
+   unsigned num_cpus = 0;
+   unsigned i;
+
+   if (debug_get_bool_option("LP_PIN_THREADS", FALSE)) {
+      num_cpus = get_numa_cpu_order(cpus, Elements(cpus));
+      if (num_cpus == 0) {
+         num_cpus = MIN2(util_cpu_caps.nr_cpus, Elements(cpus));
+         for (i = 0; i < num_cpus; i++)
+            cpus[i] = i;
+      }
+   }
+
+   for (i = 0; i < rast->num_threads; i++)
+      rast->tasks[i].cpu = num_cpus ? cpus[i % num_cpus] : -1;
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -815,7 +1229,6 @@ create_rast_threads(struct lp_rasterizer *rast)
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
       rast->threads[i] = pipe_thread_create(thread_function,
                                             (void *) &rast->tasks[i]);
    }
@@ -844,15 +1257,34 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
-   for (i = 0; i < Elements(rast->tasks); i++) {
+   assert(num_threads <= LP_MAX_THREADS);
+
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof *rast->threads);
+      if (!rast->threads) {
+         goto no_threads;
+      }
+   }
+
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->cpu = -1;
+      pipe_mutex_init(task->stats_mutex);
    }
 
    rast->num_threads = num_threads;
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
+   rast->tile_cache = debug_get_bool_option("LP_TILE_CACHE", FALSE);
+
+   assign_rast_cpus(rast);
 
    create_rast_threads(rast);
 
@@ -863,6 +1295,10 @@ lp_rast_create( unsigned num_threads )
 
    return rast;
 
+no_threads:
+   FREE(rast->tasks);
+no_tasks:
+   lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
 no_rast:
@@ -893,7 +1329,11 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    /* Clean up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
+   }
+
+   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+      align_free(rast->tasks[i].tile_cache);
+      pipe_mutex_destroy(rast->tasks[i].stats_mutex);
    }
 
    /* for synchronizing rasterization threads */
@@ -901,6 +1341,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
@@ -143,6 +143,16 @@ struct lp_rast_clear_rb {
 };
 
 
+/**
+ * Counters kept by each rasterizer thread, sampled by the driver queries.
+ */
+struct lp_rast_stats {
+   uint64_t nr_bins;     /**< bins rasterized */
+   uint64_t rast_time;   /**< time spent on them, in nanoseconds */
+   uint64_t shade_time;  /**< part of it spent in fragment shaders */
+};
+
+
 #define GET_A0(inputs) ((float (*)[4])((inputs)+1))
 #define GET_DADX(inputs) ((float (*)[4])((char *)((inputs) + 1) + (inputs)->stride))
 #define GET_DADY(inputs) ((float (*)[4])((char *)((inputs) + 1) + 2 * (inputs)->stride))
@@ -160,8 +170,17 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
+unsigned
+lp_rast_num_tasks( const struct lp_rasterizer *rast );
+
+void
+lp_rast_get_stats( struct lp_rasterizer *rast,
+                   unsigned thread,
+                   struct lp_rast_stats *stats );
+
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_enable_shade_timing( struct lp_rasterizer *rast,
+                             boolean enable );
 
 
 union lp_rast_cmd_arg {
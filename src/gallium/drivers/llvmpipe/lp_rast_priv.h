@@ -29,7 +29,10 @@
 #define LP_RAST_PRIV_H
 
 #include "os/os_thread.h"
+#include "os/os_time.h"
 #include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
 #include "lp_rast.h"
@@ -73,6 +76,19 @@ extern const struct lp_rasterizer_task *jit_task;
 #endif
 
 
+/**
+ * Layout of lp_rasterizer_task::tile_cache: a tile of the largest color
+ * format for each color buffer, followed by a depth tile.
+ */
+#define LP_TILE_CACHE_COLOR_SIZE (TILE_SIZE * TILE_SIZE * 16)
+#define LP_TILE_CACHE_DEPTH_SIZE (TILE_SIZE * TILE_SIZE * 8)
+#define LP_TILE_CACHE_SIZE (PIPE_MAX_COLOR_BUFS * LP_TILE_CACHE_COLOR_SIZE + \
+                            LP_TILE_CACHE_DEPTH_SIZE)
+
+#define LP_CACHED_COLOR(buf) (1 << (buf))
+#define LP_CACHED_DEPTH      (1 << PIPE_MAX_COLOR_BUFS)
+
+
 struct lp_rasterizer;
 struct cmd_bin;
 
@@ -91,19 +107,52 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /** Row strides of color_tiles[] and depth_tile, in bytes */
+   unsigned color_strides[PIPE_MAX_COLOR_BUFS];
+   unsigned depth_stride;
+
+   /**
+    * Thread-local copies of the current tile's color and depth buffers,
+    * written back at the end of the tile (LP_TILE_CACHE).
+    */
+   uint8_t *tile_cache;
+   boolean use_tile_cache;
+   unsigned cached_tiles;  /**< mask of LP_CACHED_COLOR(i), LP_CACHED_DEPTH */
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
    /** "my" index */
    unsigned thread_index;
 
+   /** CPU this thread is pinned to, or -1 if not pinned */
+   int cpu;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /** LP_HIZ_x flags for the current state */
+   unsigned hiz_mode;
+
+   /** Counters for the driver queries of the current scene, only
+    * accessed by this thread
+    */
+   struct lp_rast_stats stats;
+
+   /** Counters of all the finished scenes.  64 bit values may tear on
+    * 32 bit hosts, so these are only accessed with stats_mutex held.
+    */
+   struct lp_rast_stats total_stats;
+   pipe_mutex stats_mutex;
+
+   /** Invocations of counted_variant not yet added to the variant */
+   struct lp_fragment_shader_variant *counted_variant;
+   int32_t counted_invocations;
+   boolean time_shading;
+
    pipe_semaphore work_ready;
-   pipe_semaphore work_done;
 };
 
 
@@ -123,14 +172,22 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread (at least one, for
+    * synchronous rasterization)
+    */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
+
+   /** Render tiles in thread-local buffers (LP_TILE_CACHE) */
+   boolean tile_cache;
+
+   /** Number of active queries needing fragment shader timing */
+   int32_t shade_timing;
 };
 
 
@@ -140,6 +197,14 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          unsigned x, unsigned y,
                          unsigned mask);
 
+uint8_t *
+lp_rast_cache_color_tile(struct lp_rasterizer_task *task,
+                         unsigned buf, enum lp_texture_usage usage);
+
+uint8_t *
+lp_rast_cache_depth_tile(struct lp_rasterizer_task *task,
+                         enum lp_texture_usage usage);
+
 
 
 /**
@@ -162,9 +227,13 @@ lp_rast_get_color_tile_pointer(struct lp_rasterizer_task *task,
       struct pipe_surface *cbuf = scene->fb.cbufs[buf];
       assert(cbuf);
 
+      if (task->use_tile_cache)
+         return lp_rast_cache_color_tile(task, buf, usage);
+
       format_bytes = util_format_get_blocksize(cbuf->format);
       task->color_tiles[buf] = scene->cbufs[buf].map + scene->cbufs[buf].stride * task->y +
                                format_bytes * task->x;
+      task->color_strides[buf] = scene->cbufs[buf].stride;
    }
 
    return task->color_tiles[buf];
@@ -190,9 +259,13 @@ lp_rast_get_depth_tile_pointer(struct lp_rasterizer_task *task,
       struct pipe_surface *dbuf = scene->fb.zsbuf;
       assert(dbuf);
 
+      if (task->use_tile_cache)
+         return lp_rast_cache_depth_tile(task, usage);
+
       format_bytes = util_format_get_blocksize(dbuf->format);
       task->depth_tile = scene->zsbuf.map + scene->zsbuf.stride * task->y +
                          format_bytes * task->x;
+      task->depth_stride = scene->zsbuf.stride;
    }
 
    return task->depth_tile;
@@ -224,7 +297,7 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
 
    px = x % TILE_SIZE;
    py = y % TILE_SIZE;
-   pixel_offset = px * format_bytes + py * task->scene->cbufs[buf].stride;
+   pixel_offset = px * format_bytes + py * task->color_strides[buf];
 
    color = color + pixel_offset;
 
@@ -260,7 +333,7 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
    px = x % TILE_SIZE;
    py = y % TILE_SIZE;
-   pixel_offset = px * format_bytes + py * task->scene->zsbuf.stride;
+   pixel_offset = px * format_bytes + py * task->depth_stride;
 
    depth = depth + pixel_offset;
 
@@ -274,6 +347,213 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/*
+ * Hierarchical z.
+ *
+ * The scene's hiz.zmax array holds an upper bound of the depth values of
+ * each LP_HIZ_BLOCK_SIZE^2 block of the depth buffer.  Where a primitive's
+ * depth over a block is entirely above it, a LESS/LEQUAL test cannot pass,
+ * so the block is rejected without running the shader at all.
+ */
+#define LP_HIZ_REJECT      0x1  /**< blocks may be rejected */
+#define LP_HIZ_LOWER       0x2  /**< covered blocks end up below the prim */
+#define LP_HIZ_RAISE       0x4  /**< shaded blocks may end up above the prim */
+#define LP_HIZ_INVALIDATE  0x8  /**< shaded blocks end up unknown */
+
+
+/**
+ * Compute the range of a primitive's depth over a size x size square
+ * of pixels, as it ends up in the depth buffer.  The margin accounts for
+ * rounding differences with the shader's own interpolation and for the
+ * precision of the depth format.
+ */
+static INLINE void
+lp_rast_hiz_bounds(const struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y, unsigned size,
+                   float *zmin, float *zmax)
+{
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float zx = dzdx * (float) x;
+   const float zy = dzdy * (float) y;
+   const float dx = dzdx * (float) size;
+   const float dy = dzdy * (float) size;
+   const float z = a0 + zx + zy;
+   const float eps = task->scene->hiz.ulp +
+                     (fabsf(a0) + fabsf(zx) + fabsf(zy) +
+                      fabsf(dx) + fabsf(dy)) * (8.0f * FLT_EPSILON);
+
+   /* the shader clamps z to 1.0, and unorm formats to 0.0 as well */
+   *zmin = MIN2(z + MIN2(dx, 0.0f) + MIN2(dy, 0.0f), 1.0f) - eps;
+   *zmax = MAX2(z + MAX2(dx, 0.0f) + MAX2(dy, 0.0f), 0.0f) + eps;
+}
+
+
+/**
+ * Test whether a primitive fails the depth test everywhere in a
+ * square of pixels.
+ * \param x, y  location of the square in window coords
+ * \param size  4, 16 or 64
+ */
+static INLINE boolean
+lp_rast_hiz_reject(const struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y, unsigned size)
+{
+   const struct lp_scene *scene = task->scene;
+   const unsigned bx0 = x / LP_HIZ_BLOCK_SIZE;
+   const unsigned by0 = y / LP_HIZ_BLOCK_SIZE;
+   const unsigned bx1 = (x + size - 1) / LP_HIZ_BLOCK_SIZE;
+   const unsigned by1 = (y + size - 1) / LP_HIZ_BLOCK_SIZE;
+   float block_max = 0.0f;
+   float zmin, zmax;
+   unsigned bx, by;
+
+   if (!(task->hiz_mode & LP_HIZ_REJECT))
+      return FALSE;
+
+   /* never mind squares beyond the framebuffer's edge */
+   if (bx1 >= scene->hiz.stride || by1 >= scene->hiz.rows)
+      return FALSE;
+
+   for (by = by0; by <= by1; by++) {
+      const float *row = scene->hiz.zmax + by * scene->hiz.stride;
+      for (bx = bx0; bx <= bx1; bx++)
+         block_max = MAX2(block_max, row[bx]);
+   }
+
+   lp_rast_hiz_bounds(task, inputs, x, y, size, &zmin, &zmax);
+
+   return zmin > block_max;
+}
+
+
+/**
+ * Update the hierarchical z of a LP_HIZ_BLOCK_SIZE^2 block after shading
+ * all of its pixels.
+ */
+static INLINE void
+lp_rast_hiz_covered(const struct lp_rasterizer_task *task,
+                    const struct lp_rast_shader_inputs *inputs,
+                    unsigned x, unsigned y)
+{
+   const struct lp_scene *scene = task->scene;
+   const unsigned bx = x / LP_HIZ_BLOCK_SIZE;
+   const unsigned by = y / LP_HIZ_BLOCK_SIZE;
+   float zmin, zmax;
+
+   if (!(task->hiz_mode & LP_HIZ_LOWER) ||
+       bx >= scene->hiz.full_x || by >= scene->hiz.full_y)
+      return;
+
+   lp_rast_hiz_bounds(task, inputs, x, y, LP_HIZ_BLOCK_SIZE, &zmin, &zmax);
+
+   /*
+    * Every pixel ends up with the lesser of its old value and the
+    * primitive's depth.
+    */
+   if (zmax < scene->hiz.zmax[by * scene->hiz.stride + bx])
+      scene->hiz.zmax[by * scene->hiz.stride + bx] = zmax;
+}
+
+
+/**
+ * Update the hierarchical z of the block containing a 4x4 block of pixels
+ * after shading some of them.
+ */
+static INLINE void
+lp_rast_hiz_shaded(const struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y)
+{
+   const struct lp_scene *scene = task->scene;
+   const unsigned bx = x / LP_HIZ_BLOCK_SIZE;
+   const unsigned by = y / LP_HIZ_BLOCK_SIZE;
+   float *block_max;
+   float zmin, zmax;
+
+   if (!(task->hiz_mode & (LP_HIZ_RAISE | LP_HIZ_INVALIDATE)) ||
+       bx >= scene->hiz.stride || by >= scene->hiz.rows)
+      return;
+
+   block_max = &scene->hiz.zmax[by * scene->hiz.stride + bx];
+
+   if (task->hiz_mode & LP_HIZ_INVALIDATE) {
+      *block_max = LP_HIZ_UNKNOWN;
+   }
+   else {
+      lp_rast_hiz_bounds(task, inputs, x, y, 4, &zmin, &zmax);
+      *block_max = MAX2(*block_max, zmax);
+   }
+}
+
+
+
+/**
+ * Fragment shader timing, only done while a shade-time query is active as
+ * reading the clock around every 4x4 block is not free.
+ */
+static INLINE int64_t
+lp_rast_shade_time_begin(const struct lp_rasterizer_task *task)
+{
+   return task->time_shading ? os_time_get_nano() : 0;
+}
+
+static INLINE void
+lp_rast_shade_time_end(struct lp_rasterizer_task *task, int64_t start)
+{
+   if (task->time_shading)
+      task->stats.shade_time += os_time_get_nano() - start;
+}
+
+
+/**
+ * Add this thread's count of shader invocations to the variant, see
+ * lp_rast_count_invocation().
+ */
+static INLINE void
+lp_rast_flush_invocations(struct lp_rasterizer_task *task)
+{
+   if (task->counted_invocations) {
+      int32_t *invocations = &task->counted_variant->invocations;
+      int32_t old = p_atomic_read(invocations);
+
+      for (;;) {
+         int32_t prev = p_atomic_cmpxchg(invocations, old,
+                                         old + task->counted_invocations);
+         if (prev == old)
+            break;
+         old = prev;
+      }
+
+      task->counted_invocations = 0;
+   }
+
+   task->counted_variant = NULL;
+}
+
+
+/**
+ * Count the invocations of each fragment shader variant, which tells the
+ * hot variants worth optimizing (LP_TIER_UP_THRESHOLD).  Counts are kept
+ * per thread and only added to the variant when the thread moves on to
+ * another variant or tile.
+ */
+static INLINE void
+lp_rast_count_invocation(struct lp_rasterizer_task *task,
+                         struct lp_fragment_shader_variant *variant)
+{
+   if (variant != task->counted_variant) {
+      lp_rast_flush_invocations(task);
+      task->counted_variant = variant;
+   }
+
+   task->counted_invocations++;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -292,13 +572,14 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
    unsigned i;
+   int64_t shade_start;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
-         stride[i] = scene->cbufs[i].stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
+         stride[i] = task->color_strides[i];
       }
       else {
          stride[i] = 0;
@@ -308,7 +589,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
 
    if (scene->zsbuf.map) {
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
-      depth_stride = scene->zsbuf.stride;
+      depth_stride = task->depth_stride;
    }
 
    /*
@@ -319,11 +600,15 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
       /* not very accurate would need a popcount on the mask */
       /* always count this not worth bothering? */
       task->ps_invocations += 1 * variant->ps_inv_multiplier;
+      lp_rast_count_invocation(task, variant);
+
+      lp_rast_hiz_shaded(task, inputs, x, y);
 
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
       /* run shader on 4x4 block */
+      shade_start = lp_rast_shade_time_begin(task);
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_WHOLE]( &state->jit_context,
                                          x, y,
@@ -338,6 +623,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                          stride,
                                          depth_stride);
       END_JIT_CALL();
+      lp_rast_shade_time_end(task, shade_start);
    }
 }
 
@@ -301,6 +301,11 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    __m128i span_1;                /* 0,dcdx,2dcdx,3dcdx for plane 1 */
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
+
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_rejected_16);
+      return;
+   }
    
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
@@ -411,6 +416,11 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_rejected_4);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &unused);
 
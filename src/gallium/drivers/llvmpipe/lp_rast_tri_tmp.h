@@ -169,6 +169,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_rejected_64);
+      return;
+   }
+
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
@@ -229,6 +234,12 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       LP_COUNT(nr_partially_covered_16);
+
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_rejected_16);
+         continue;
+      }
+
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
@@ -244,7 +255,14 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_16);
+
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_rejected_16);
+         continue;
+      }
+
       block_full_16(task, tri, px, py);
+      lp_rast_hiz_covered(task, &tri->inputs, px, py);
    }
 }
 
@@ -272,6 +290,11 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_rejected_16);
+      return;
+   }
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -337,6 +360,11 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_rejected_4);
+      return;
+   }
+
    /* Iterate over partials:
     */
    {
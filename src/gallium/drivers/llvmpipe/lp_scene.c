@@ -27,10 +27,12 @@
 
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
 #include "util/u_simple_list.h"
 #include "util/u_format.h"
+#include "os/os_time.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
@@ -62,8 +64,6 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,7 +90,6 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
@@ -146,6 +145,70 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
 }
 
 
+/**
+ * Set up the hierarchical z buffer of the zsbuf for the scene.
+ * It only covers the first layer of level 0, so it has to be thrown away
+ * when that is rendered to along with other layers.
+ * Called by the rasterizer, as the hiz buffer may still be in use by the
+ * previous scene until then.
+ */
+void
+lp_scene_begin_hiz(struct lp_scene *scene)
+{
+   struct pipe_surface *zsbuf = scene->fb.zsbuf;
+   struct llvmpipe_resource *lpr;
+   const struct util_format_description *desc;
+   const struct util_format_channel_description *chan;
+
+   if (!zsbuf)
+      return;
+
+   lpr = llvmpipe_resource(zsbuf->texture);
+
+   if (!lpr->hiz ||
+       zsbuf->u.tex.level != 0 ||
+       zsbuf->u.tex.first_layer != 0)
+      return;
+
+   if (scene->fb_max_layer != 0 || (LP_PERF & PERF_NO_HIZ)) {
+      llvmpipe_resource_invalidate_hiz(zsbuf->texture);
+      return;
+   }
+
+   desc = util_format_description(zsbuf->format);
+   chan = &desc->channel[desc->swizzle[0]];
+
+   scene->hiz.zmax = lpr->hiz;
+   scene->hiz.stride = lpr->hiz_stride;
+   scene->hiz.rows = lpr->hiz_rows;
+
+   /*
+    * Blocks straddling the edge of a framebuffer smaller than the resource
+    * are never completely rendered to.
+    */
+   scene->hiz.full_x = scene->fb.width >= zsbuf->texture->width0 ?
+                       lpr->hiz_stride : scene->fb.width / LP_HIZ_BLOCK_SIZE;
+   scene->hiz.full_y = scene->fb.height >= zsbuf->texture->height0 ?
+                       lpr->hiz_rows : scene->fb.height / LP_HIZ_BLOCK_SIZE;
+
+   /*
+    * Float to unorm conversion may round either way, and is done in
+    * single precision, which cannot represent more than 24 bits.
+    */
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT)
+      scene->hiz.ulp = 0.0f;
+   else if (chan->size < 24)
+      scene->hiz.ulp = 1.0f / (float) ((1 << chan->size) - 1);
+   else
+      scene->hiz.ulp = 1.0f / (float) (1 << 22);
+}
+
+
+/**
+ * Map the framebuffer surfaces for rasterization.
+ * Called by setup when queuing the scene, so that the winsys is only
+ * ever called from the context's thread.
+ */
 void
 lp_scene_begin_rasterization(struct lp_scene *scene)
 {
@@ -202,6 +265,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 /**
  * Free all the temporary data in a scene.
+ * Called by setup once the scene's fence is signalled, as this unmaps
+ * the framebuffer surfaces and releases the resources referenced by the
+ * scene.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
@@ -230,6 +296,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       scene->zsbuf.map = NULL;
    }
 
+   scene->hiz.zmax = NULL;
+
    /* Reset all command lists:
     */
    for (i = 0; i < scene->tiles_x; i++) {
@@ -246,6 +314,9 @@ lp_scene_end_rasterization(struct lp_scene *scene )
     */
    assert(lp_scene_is_empty(scene));
 
+   memset(scene->bin_mask, 0, sizeof scene->bin_mask);
+   scene->num_active_bins = 0;
+
    /* Decrement texture ref counts
     */
    {
@@ -286,8 +357,6 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       list->head->used = 0;
    }
 
-   lp_fence_reference(&scene->fence, NULL);
-
    scene->resources = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
@@ -313,6 +382,15 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
          bin->tail = block;
       }
       else {
+         /* First command block of this bin: flag the bin as active so
+          * the rasterizer will visit it.
+          */
+         unsigned idx = bin - &scene->tile[0][0];
+         unsigned x = idx / TILES_Y;
+         unsigned y = idx % TILES_Y;
+         unsigned bit = y * TILES_X + x;
+         scene->bin_mask[bit / 32] |= 1u << (bit % 32);
+
          bin->head = block;
          bin->tail = block;
       }
@@ -426,81 +504,143 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
 /**
  * Does this scene have a reference to the given resource?
+ * \return bitmask of LP_REFERENCED_FOR_READ/WRITE
  */
-boolean
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
+   unsigned referenced = LP_UNREFERENCED;
    int i;
 
-   for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+   /* the scene's render targets */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+   for (ref = scene->resources; ref && !referenced; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            referenced = LP_REFERENCED_FOR_READ;
+            break;
+         }
+      }
    }
 
-   return FALSE;
+   return referenced;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Prepare the scene's bins for rasterization by num_threads threads.
+ * The non-empty bins are collected in raster order and split into one
+ * contiguous range per thread.  The split is made by bin position, not
+ * by bin count, so that a thread owns the same band of the framebuffer
+ * from one scene to the next; load imbalance is left to work stealing.
+ * \param num_threads  number of rasterizer threads, or 0 if rasterizing
+ *                     synchronously
+ */
+void
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   unsigned num_queues = MAX2(1, num_threads);
+   unsigned count = 0;
+   unsigned i;
+
+   assert(num_queues <= LP_MAX_THREADS);
+
+   for (i = 0; i < TILE_MASK_WORDS; i++) {
+      unsigned mask = scene->bin_mask[i];
+      while (mask) {
+         unsigned bit = i * 32 + u_bit_scan(&mask);
+         unsigned x = bit % TILES_X;
+         unsigned y = bit / TILES_X;
+         assert(x < scene->tiles_x);
+         assert(y < scene->tiles_y);
+         assert(scene->tile[x][y].head);
+         scene->active_bins[count++] = (y << 16) | x;
+      }
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+
+   scene->num_active_bins = count;
+   scene->num_bin_queues = num_queues;
+
+   {
+      unsigned num_bins = scene->tiles_x * scene->tiles_y;
+      unsigned idx = 0;
+
+      for (i = 0; i < num_queues; i++) {
+         /* first bin position owned by the following queue */
+         unsigned limit = num_bins * (i + 1) / num_queues;
+
+         scene->bin_queues[i].next = idx;
+         while (idx < count) {
+            uint32_t pos = scene->active_bins[idx];
+            if ((pos >> 16) * scene->tiles_x + (pos & 0xffff) >= limit)
+               break;
+            idx++;
+         }
+         scene->bin_queues[i].end = idx;
+      }
+      assert(idx == count);
    }
-   return TRUE;
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+/**
+ * Try to claim the next bin of the given queue.
+ * \return index into lp_scene::active_bins, or -1 if the queue is empty
+ */
+static int
+claim_bin(struct lp_bin_queue *queue)
 {
-   scene->curr_x = scene->curr_y = -1;
+   int32_t next = p_atomic_read(&queue->next);
+
+   while (next < queue->end) {
+      int32_t prev = p_atomic_cmpxchg(&queue->next, next, next + 1);
+      if (prev == next)
+         return next;
+      next = prev;
+   }
+
+   return -1;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return pointer to next bin to be rendered by the given thread.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  A thread takes bins from its own queue
+ * first, then steals from the queues of the other threads.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y )
 {
-   struct cmd_bin *bin = NULL;
-
-   pipe_mutex_lock(scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   unsigned num_queues = scene->num_bin_queues;
+   unsigned i;
+
+   assert(thread_index < num_queues);
+
+   for (i = 0; i < num_queues; i++) {
+      unsigned q = (thread_index + i) % num_queues;
+      int idx = claim_bin(&scene->bin_queues[q]);
+      if (idx >= 0) {
+         uint32_t pos = scene->active_bins[idx];
+         *x = pos & 0xffff;
+         *y = pos >> 16;
+         return lp_scene_get_bin(scene, *x, *y);
+      }
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
-
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   /* no more bins left */
+   return NULL;
 }
 
 
@@ -512,6 +652,7 @@ void lp_scene_begin_binning( struct lp_scene *scene,
 
    assert(lp_scene_is_empty(scene));
 
+   scene->begin_binning_time = os_time_get();
    scene->discard = discard;
    util_copy_framebuffer_state(&scene->fb, fb);
 
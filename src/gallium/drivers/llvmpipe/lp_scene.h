@@ -48,6 +48,10 @@ struct lp_rast_state;
 #define TILES_X (LP_MAX_WIDTH / TILE_SIZE)
 #define TILES_Y (LP_MAX_HEIGHT / TILE_SIZE)
 
+/* Number of 32-bit words in the bitmask of bins which received commands.
+ */
+#define TILE_MASK_WORDS ((TILES_X * TILES_Y + 31) / 32)
+
 
 /* Commands per command block (ideally so sizeof(cmd_block) is a power of
  * two in size.)
@@ -117,6 +121,23 @@ struct data_block_list {
 
 struct resource_ref;
 
+
+/**
+ * A thread's share of the non-empty bins of a scene.
+ *
+ * Each queue is a contiguous range of lp_scene::active_bins.  The owning
+ * thread claims bins from the front of its own range and, once that is
+ * exhausted, steals from the other threads' ranges.  Claims are made with
+ * a compare-and-swap on 'next' so no lock is taken per bin.
+ */
+struct lp_bin_queue {
+   int32_t next;      /**< index of the next unclaimed entry */
+   int32_t end;       /**< one past the last entry of this queue */
+   /* keep each queue on its own cache line */
+   int32_t pad[14];
+};
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -144,6 +165,18 @@ struct lp_scene {
       unsigned layer_stride;
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
+   /* Hierarchical z buffer of the zsbuf, if it can be used for this
+    * scene - valid only between lp_scene_begin_hiz() and
+    * end_rasterization().
+    */
+   struct {
+      float *zmax;
+      unsigned stride;          /**< blocks per row */
+      unsigned rows;
+      unsigned full_x, full_y;  /**< blocks entirely inside the fb */
+      float ulp;                /**< precision of the depth format */
+   } hiz;
+
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
@@ -164,6 +197,17 @@ struct lp_scene {
     */
    unsigned resource_reference_size;
 
+   /** Memory kept alive by the scene while it is queued for
+    * rasterization (scene_size plus resource_reference_size).  Written
+    * by setup when the scene is queued, used for throttling.
+    */
+   unsigned queued_size;
+
+   /** Timestamps (os_time_get() microseconds) for LP_DEBUG=scene */
+   int64_t begin_binning_time;
+   int64_t queue_time;
+   int64_t begin_rast_time;
+
    boolean alloc_failed;
    boolean discard;
    /**
@@ -172,8 +216,21 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /** Bitmask of bins which had a command block allocated, indexed
+    * by y * TILES_X + x.  Maintained by the binner so the rasterizer
+    * never has to visit empty bins.
+    */
+   uint32_t bin_mask[TILE_MASK_WORDS];
+
+   /** Non-empty bins in raster order, packed as (y << 16) | x.  Built
+    * by lp_scene_bin_iter_begin() from bin_mask.
+    */
+   unsigned num_active_bins;
+   uint32_t active_bins[TILES_X * TILES_Y];
+
+   /** Per-thread ranges of active_bins for rasterization */
+   unsigned num_bin_queues;
+   struct lp_bin_queue bin_queues[LP_MAX_THREADS];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -198,8 +255,8 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
                                         boolean initializing_scene);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -378,10 +435,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y );
 
 
 
@@ -401,6 +459,9 @@ lp_scene_end_binning( struct lp_scene *scene );
 void
 lp_scene_begin_rasterization(struct lp_scene *scene);
 
+void
+lp_scene_begin_hiz(struct lp_scene *scene);
+
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
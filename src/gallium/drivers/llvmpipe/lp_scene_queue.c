@@ -35,10 +35,17 @@
 #include "util/u_ringbuffer.h"
 #include "util/u_memory.h"
 #include "lp_scene_queue.h"
+#include "lp_setup_context.h"	/* for MAX_SCENES */
 
 
 
-#define MAX_SCENE_QUEUE 4
+/**
+ * Number of packets the ring is sized for.  The ring keeps one dword free
+ * and must be a power of two, so twice MAX_SCENES leaves room for all the
+ * scenes a context can have in flight.  Setup queues scenes while holding
+ * the screen's rast_mutex and must not wait for the rasterizer there.
+ */
+#define MAX_SCENE_QUEUE (2 * MAX_SCENES)
 
 struct scene_packet {
    struct util_packet header;
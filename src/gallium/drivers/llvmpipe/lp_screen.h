@@ -38,6 +38,7 @@
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
 #include "gallivm/lp_bld.h"
+#include "lp_limits.h"
 
 
 struct sw_winsys;
@@ -57,6 +58,9 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Names of the per-thread driver queries */
+   char thread_query_names[LP_MAX_THREADS][32];
 };
 
 
@@ -63,24 +63,87 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Wait until the given scene has been rasterized, then release it and
+ * drop its fence.
+ *
+ * The release unmaps the framebuffer surfaces and drops the resource
+ * references, which may call into the winsys, so it is done here on the
+ * context's thread rather than by the rasterizer.
+ */
+static void
+lp_setup_wait_scene(struct lp_scene *scene)
+{
+   if (scene->fence) {
+      if (LP_DEBUG & DEBUG_SETUP)
+         debug_printf("%s: wait for scene %d\n",
+                      __FUNCTION__, scene->fence->id);
+
+      lp_fence_wait(scene->fence);
+      lp_scene_end_rasterization(scene);
+      lp_fence_reference(&scene->fence, NULL);
+   }
+}
+
+
+/**
+ * Release the queued scenes which have already been rasterized, so that
+ * the resources they reference are not reported as busy anymore.
+ */
+static void
+lp_setup_retire_scenes(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene != setup->scene &&
+          scene->fence && lp_fence_signalled(scene->fence))
+         lp_setup_wait_scene(scene);
+   }
+}
+
+
+/**
+ * Take the next scene of the ring for binning.
+ *
+ * Besides waiting for the scene itself to be rasterized, throttle on the
+ * memory held by the other queued scenes: while it exceeds
+ * LP_MAX_SCENE_SIZE, wait for the oldest of them.
+ */
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
+   unsigned queued_size = 0;
+   unsigned i;
+
    assert(setup->scene == NULL);
 
    setup->scene_idx++;
-   setup->scene_idx %= Elements(setup->scenes);
+   setup->scene_idx %= setup->num_scenes;
 
    setup->scene = setup->scenes[setup->scene_idx];
 
-   if (setup->scene->fence) {
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+   for (i = 1; i < setup->num_scenes; i++) {
+      struct lp_scene *scene =
+         setup->scenes[(setup->scene_idx + i) % setup->num_scenes];
+      if (scene->fence && !lp_fence_signalled(scene->fence))
+         queued_size += scene->queued_size;
+   }
 
-      lp_fence_wait(setup->scene->fence);
+   /* oldest scenes come right after the one we are about to reuse */
+   for (i = 1; i < setup->num_scenes && queued_size > LP_MAX_SCENE_SIZE; i++) {
+      struct lp_scene *scene =
+         setup->scenes[(setup->scene_idx + i) % setup->num_scenes];
+      if (scene->fence) {
+         lp_setup_wait_scene(scene);
+         queued_size -= MIN2(queued_size, scene->queued_size);
+      }
    }
 
+   lp_setup_wait_scene(setup->scene);
+
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
 
 }
@@ -152,6 +215,7 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 {
    struct lp_scene *scene = setup->scene;
    struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+   unsigned i;
 
    scene->num_active_queries = setup->active_binned_queries;
    memcpy(scene->active_queries, setup->active_queries,
@@ -164,12 +228,31 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
+   scene->queued_size = scene->scene_size + scene->resource_reference_size;
+   scene->queue_time = os_time_get();
+   setup->stats.nr_scenes++;
+
+   /* Map the framebuffer here, the winsys is not thread safe. */
+   lp_scene_begin_rasterization(scene);
+
+   /* The scene is rasterized asynchronously; the rasterizer signals its
+    * fence when done and setup releases it when it comes back to it.
+    * Setup may carry on binning into the next scene of the ring meanwhile.
+    */
    pipe_mutex_lock(screen->rast_mutex);
+
+   /* Display targets must not be displayed before the scene is done. */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      struct pipe_surface *cbuf = scene->fb.cbufs[i];
+
+      if (cbuf && llvmpipe_resource(cbuf->texture)->dt)
+         lp_fence_reference(&llvmpipe_resource(cbuf->texture)->dt_fence,
+                            scene->fence);
+   }
+
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -187,9 +270,10 @@ begin_binning( struct lp_setup_context *setup )
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  It is signalled once, by the rasterizer
+    * thread which finishes the scene:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -331,6 +415,8 @@ set_scene_state( struct lp_setup_context *setup,
 fail:
    if (setup->scene) {
       lp_scene_end_rasterization(setup->scene);
+      /* the scene was never queued so its fence will not be signalled */
+      lp_fence_reference(&setup->scene->fence, NULL);
       setup->scene = NULL;
    }
 
@@ -361,6 +447,9 @@ lp_setup_bind_framebuffer( struct lp_setup_context *setup,
 
    /* Flush any old scene.
     */
+   if (setup->state != SETUP_FLUSHED)
+      setup->stats.nr_fb_flushes++;
+
    set_scene_state( setup, SETUP_FLUSHED, __FUNCTION__ );
 
    /*
@@ -531,6 +620,7 @@ lp_setup_clear( struct lp_setup_context *setup,
    if (flags & PIPE_CLEAR_DEPTHSTENCIL) {
       unsigned flagszs = flags & PIPE_CLEAR_DEPTHSTENCIL;
       if (!lp_setup_try_clear_zs(setup, depth, stencil, flagszs)) {
+         setup->stats.nr_full_flushes++;
          lp_setup_flush(setup, NULL, __FUNCTION__);
 
          if (!lp_setup_try_clear_zs(setup, depth, stencil, flagszs))
@@ -543,6 +633,7 @@ lp_setup_clear( struct lp_setup_context *setup,
       for (i = 0; i < setup->fb.nr_cbufs; i++) {
          if ((flags & (1 << (2 + i))) && setup->fb.cbufs[i]) {
             if (!lp_setup_try_clear_color_buffer(setup, color, i)) {
+               setup->stats.nr_full_flushes++;
                lp_setup_flush(setup, NULL, __FUNCTION__);
 
                if (!lp_setup_try_clear_color_buffer(setup, color, i))
@@ -948,11 +1039,13 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
  * being rendered and the current scene being built.
  */
 unsigned
-lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
+lp_setup_is_resource_referenced( struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
    unsigned i;
 
+   lp_setup_retire_scenes(setup);
+
    /* check the render targets */
    for (i = 0; i < setup->fb.nr_cbufs; i++) {
       if (setup->fb.cbufs[i] && setup->fb.cbufs[i]->texture == texture)
@@ -962,10 +1055,14 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < Elements(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
+   /* check textures and render targets referenced by the scenes,
+    * including those still queued for rasterization
+    */
+   for (i = 0; i < setup->num_scenes; i++) {
+      unsigned referenced =
+         lp_scene_is_resource_referenced(setup->scenes[i], texture);
+      if (referenced) {
+         return referenced;
       }
    }
 
@@ -1223,6 +1320,8 @@ lp_setup_update_state( struct lp_setup_context *setup,
        * Cannot call lp_setup_flush_and_restart() directly here
        * because of potential recursion.
        */
+      setup->stats.nr_full_flushes++;
+
       if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
          return FALSE;
 
@@ -1259,18 +1358,20 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   /* wait for the queued scenes and free them all */
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
-         lp_fence_wait(scene->fence);
+      lp_setup_wait_scene(scene);
 
       lp_scene_destroy(scene);
    }
 
    lp_fence_reference(&setup->last_fence, NULL);
 
+   if (setup->tri_batch)
+      lp_setup_destroy_tri_batch(setup->tri_batch);
+
    FREE( setup );
 }
 
@@ -1293,6 +1394,16 @@ lp_setup_create( struct pipe_context *pipe,
       goto no_setup;
    }
 
+   /* Helper threads for the triangle setup of large draws.  Not having
+    * them is not fatal, triangles are then set up on this thread only.
+    */
+   {
+      unsigned num_setup_threads =
+         debug_get_num_option("LP_NUM_SETUP_THREADS", screen->num_threads / 4);
+      if (num_setup_threads)
+         setup->tri_batch = lp_setup_create_tri_batch(setup, num_setup_threads);
+   }
+
    lp_setup_init_vbuf(setup);
    
    /* Used only in update_state():
@@ -1310,7 +1421,10 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_render(draw, &setup->base);
 
    /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
+   setup->num_scenes = debug_get_num_option("LP_NUM_SCENES", DEFAULT_SCENES);
+   setup->num_scenes = CLAMP(setup->num_scenes, 1, MAX_SCENES);
+
+   for (i = 0; i < setup->num_scenes; i++) {
       setup->scenes[i] = lp_scene_create( pipe );
       if (!setup->scenes[i]) {
          goto no_scenes;
@@ -1334,6 +1448,8 @@ no_scenes:
 
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
+   if (setup->tri_batch)
+      lp_setup_destroy_tri_batch(setup->tri_batch);
    FREE(setup);
 no_setup:
    return NULL;
@@ -1456,6 +1572,13 @@ fail:
 }
 
 
+const struct lp_setup_stats *
+lp_setup_get_stats(const struct lp_setup_context *setup)
+{
+   return &setup->stats;
+}
+
+
 boolean
 lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
@@ -1463,6 +1586,8 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 
    assert(setup->state == SETUP_ACTIVE);
 
+   setup->stats.nr_full_flushes++;
+
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
       return FALSE;
    
@@ -47,6 +47,20 @@ struct pipe_fence_handle;
 struct lp_setup_variant;
 struct lp_setup_context;
 
+
+/**
+ * Counters kept by setup, sampled by the driver queries.
+ */
+struct lp_setup_stats
+{
+   uint64_t nr_tris;         /**< triangles received */
+   uint64_t nr_binned_tris;  /**< triangles which were not culled */
+   uint64_t nr_scenes;       /**< scenes sent to the rasterizer */
+   uint64_t nr_full_flushes; /**< scenes flushed for lack of memory */
+   uint64_t nr_fb_flushes;   /**< scenes flushed by framebuffer changes */
+};
+
+
 void lp_setup_reset( struct lp_setup_context *setup );
 
 struct lp_setup_context *
@@ -136,7 +150,7 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
                                     struct pipe_sampler_state **samplers);
 
 unsigned
-lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
+lp_setup_is_resource_referenced( struct lp_setup_context *setup,
                                 const struct pipe_resource *texture );
 
 void
@@ -159,6 +173,9 @@ void
 lp_setup_end_query(struct lp_setup_context *setup,
                    struct llvmpipe_query *pq);
 
+const struct lp_setup_stats *
+lp_setup_get_stats(const struct lp_setup_context *setup);
+
 static INLINE unsigned
 lp_clamp_viewport_idx(int idx)
 {
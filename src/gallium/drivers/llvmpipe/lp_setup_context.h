@@ -54,8 +54,20 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-#define MAX_SCENES 2
+/** Max number of scenes in the ring.  The actual number is set with
+ * LP_NUM_SCENES (default DEFAULT_SCENES).
+ */
+#define MAX_SCENES 16
+#define DEFAULT_SCENES 4
+
+/** Number of triangles queued for parallel setup before they are binned */
+#define LP_SETUP_BATCH_SIZE 1024
+
+/** Minimum number of vertices in a draw call for parallel setup */
+#define LP_SETUP_MIN_BATCH 64
+
+
+struct lp_setup_tri_batch;
 
 
 
@@ -87,13 +99,19 @@ struct lp_setup_context
    struct draw_stage *vbuf;
    unsigned num_threads;
    unsigned scene_idx;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   unsigned num_scenes;
+   struct lp_scene *scenes[MAX_SCENES];  /**< ring of all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
+   /** Queue of triangles for parallel setup, NULL if disabled */
+   struct lp_setup_tri_batch *tri_batch;
+
    struct lp_fence *last_fence;
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
+   struct lp_setup_stats stats;
+
    boolean flatshade_first;
    boolean ccw_is_frontface;
    boolean scissor_test;
@@ -172,6 +190,16 @@ void lp_setup_choose_point( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
+struct lp_setup_tri_batch *
+lp_setup_create_tri_batch(struct lp_setup_context *setup,
+                          unsigned num_threads);
+
+void lp_setup_destroy_tri_batch(struct lp_setup_tri_batch *batch);
+
+void lp_setup_begin_tri_batch(struct lp_setup_context *setup, unsigned nr);
+
+void lp_setup_end_tri_batch(struct lp_setup_context *setup);
+
 boolean lp_setup_update_state( struct lp_setup_context *setup,
                             boolean update_scene);
 
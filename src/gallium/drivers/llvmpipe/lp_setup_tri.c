@@ -33,6 +33,8 @@
 #include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_sse.h"
+#include "util/u_prim.h"
+#include "os/os_thread.h"
 #include "lp_perf.h"
 #include "lp_setup_context.h"
 #include "lp_rast.h"
@@ -255,22 +257,39 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 
 
 /**
- * Do basic setup for triangle rasterization and determine which
- * framebuffer tiles are touched.  Put the triangle in the scene's
- * bins for the tiles which we overlap.
+ * A triangle which has been culled and allocated, but whose
+ * interpolants and edge planes remain to be computed before binning.
+ */
+struct lp_setup_tri_job {
+   struct lp_rast_triangle *tri;   /**< NULL if the triangle was culled */
+   const float (*v[3])[4];
+   struct fixed_position position;
+   struct u_rect bbox;
+   int nr_planes;
+   unsigned viewport_index;
+   unsigned layer;
+   boolean frontfacing;
+};
+
+
+/**
+ * Cull the triangle against the draw region and allocate its storage in
+ * the scene.  This part of triangle setup touches the scene and so must
+ * run on the setup thread.
+ * \return FALSE if the scene ran out of memory.  Culled triangles are
+ *         reported with job->tri == NULL.
  */
 static boolean
-do_triangle_ccw(struct lp_setup_context *setup,
-                struct fixed_position* position,
-                const float (*v0)[4],
-                const float (*v1)[4],
-                const float (*v2)[4],
-                boolean frontfacing )
+prepare_triangle_ccw(struct lp_setup_context *setup,
+                     const struct fixed_position *position,
+                     const float (*v0)[4],
+                     const float (*v1)[4],
+                     const float (*v2)[4],
+                     boolean frontfacing,
+                     struct lp_setup_tri_job *job)
 {
    struct lp_scene *scene = setup->scene;
    const struct lp_setup_variant_key *key = &setup->setup.variant->key;
-   struct lp_rast_triangle *tri;
-   struct lp_rast_plane *plane;
    struct u_rect bbox;
    unsigned tri_bytes;
    int nr_planes = 3;
@@ -280,6 +299,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
    /* Area should always be positive here */
    assert(position->area > 0);
 
+   job->tri = NULL;
+
    if (0)
       lp_setup_print_triangle(setup, v0, v1, v2);
 
@@ -336,24 +357,49 @@ do_triangle_ccw(struct lp_setup_context *setup,
    bbox.x0 = MAX2(bbox.x0, 0);
    bbox.y0 = MAX2(bbox.y0, 0);
 
-   tri = lp_setup_alloc_triangle(scene,
-                                 key->num_inputs,
-                                 nr_planes,
-                                 &tri_bytes);
-   if (!tri)
+   job->tri = lp_setup_alloc_triangle(scene,
+                                      key->num_inputs,
+                                      nr_planes,
+                                      &tri_bytes);
+   if (!job->tri)
       return FALSE;
 
-#if 0
-   tri->v[0][0] = v0[0][0];
-   tri->v[1][0] = v1[0][0];
-   tri->v[2][0] = v2[0][0];
-   tri->v[0][1] = v0[0][1];
-   tri->v[1][1] = v1[0][1];
-   tri->v[2][1] = v2[0][1];
-#endif
-
    LP_COUNT(nr_tris);
 
+   job->v[0] = v0;
+   job->v[1] = v1;
+   job->v[2] = v2;
+   job->position = *position;
+   job->bbox = bbox;
+   job->nr_planes = nr_planes;
+   job->viewport_index = viewport_index;
+   job->layer = layer;
+   job->frontfacing = frontfacing;
+
+   return TRUE;
+}
+
+
+/**
+ * Compute the interpolants and edge planes of a prepared triangle.
+ * This only reads the setup state and writes the triangle's own
+ * storage, so several triangles may be done in parallel.
+ */
+static void
+setup_triangle_coefs(const struct lp_setup_context *setup,
+                     struct lp_setup_tri_job *job)
+{
+   const struct fixed_position *position = &job->position;
+   const float (*v0)[4] = job->v[0];
+   const float (*v1)[4] = job->v[1];
+   const float (*v2)[4] = job->v[2];
+   struct lp_rast_triangle *tri = job->tri;
+   const struct u_rect bbox = job->bbox;
+   const int nr_planes = job->nr_planes;
+   const unsigned viewport_index = job->viewport_index;
+   const boolean frontfacing = job->frontfacing;
+   struct lp_rast_plane *plane;
+
    /* Setup parameter interpolants:
     */
    setup->setup.variant->jit_function( v0,
@@ -367,7 +413,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.frontfacing = frontfacing;
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
-   tri->inputs.layer = layer;
+   tri->inputs.layer = job->layer;
    tri->inputs.viewport_index = viewport_index;
 
    if (0)
@@ -571,7 +617,38 @@ do_triangle_ccw(struct lp_setup_context *setup,
       plane[6].eo = 0;
    }
 
-   return lp_setup_bin_triangle(setup, tri, &bbox, nr_planes, viewport_index);
+}
+
+
+/**
+ * Do basic setup for triangle rasterization and determine which
+ * framebuffer tiles are touched.  Put the triangle in the scene's
+ * bins for the tiles which we overlap.
+ */
+static boolean
+do_triangle_ccw(struct lp_setup_context *setup,
+                struct fixed_position* position,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4],
+                boolean frontfacing )
+{
+   struct lp_setup_tri_job job;
+
+   if (!prepare_triangle_ccw(setup, position, v0, v1, v2, frontfacing, &job))
+      return FALSE;
+
+   if (!job.tri)
+      return TRUE;
+
+   setup_triangle_coefs(setup, &job);
+
+   if (!lp_setup_bin_triangle(setup, job.tri, &job.bbox,
+                              job.nr_planes, job.viewport_index))
+      return FALSE;
+
+   setup->stats.nr_binned_tris++;
+   return TRUE;
 }
 
 /*
@@ -818,6 +895,261 @@ fail:
 }
 
 
+/**
+ * Batched triangle setup.
+ *
+ * For large draws the triangles of a vbuf draw call are culled and
+ * allocated one by one on the setup thread, then their interpolants and
+ * edge planes -- the bulk of the setup work -- are computed by
+ * num_threads helper threads and the setup thread in parallel.  Finally
+ * the triangles are binned on the setup thread in primitive order, so
+ * that the command order in each bin is the same as without batching.
+ */
+struct lp_setup_worker {
+   struct lp_setup_tri_batch *batch;
+   unsigned index;                /**< range of the batch to process */
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+};
+
+struct lp_setup_tri_batch {
+   struct lp_setup_context *setup;
+   boolean active;                /**< queue triangles instead of binning */
+   boolean exit_flag;
+
+   unsigned count;
+   struct lp_setup_tri_job jobs[LP_SETUP_BATCH_SIZE];
+
+   unsigned num_threads;
+   pipe_thread threads[LP_MAX_SETUP_THREADS];
+   struct lp_setup_worker workers[LP_MAX_SETUP_THREADS];
+};
+
+
+/**
+ * Compute the coefficients for one of the num_threads + 1 ranges of the
+ * batch.  Range 0 is done by the setup thread itself.
+ */
+static void
+setup_triangle_range(struct lp_setup_tri_batch *batch, unsigned index)
+{
+   unsigned parts = batch->num_threads + 1;
+   unsigned begin = batch->count * index / parts;
+   unsigned end = batch->count * (index + 1) / parts;
+   unsigned i;
+
+   for (i = begin; i < end; i++)
+      setup_triangle_coefs(batch->setup, &batch->jobs[i]);
+}
+
+
+static PIPE_THREAD_ROUTINE( setup_thread_function, init_data )
+{
+   struct lp_setup_worker *worker = (struct lp_setup_worker *) init_data;
+   struct lp_setup_tri_batch *batch = worker->batch;
+
+   while (1) {
+      pipe_semaphore_wait(&worker->work_ready);
+
+      if (batch->exit_flag)
+         break;
+
+      setup_triangle_range(batch, worker->index);
+
+      pipe_semaphore_signal(&worker->work_done);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Create the triangle batch and its helper threads.
+ * \param num_threads  number of helper threads, in addition to the
+ *                     setup thread
+ */
+struct lp_setup_tri_batch *
+lp_setup_create_tri_batch(struct lp_setup_context *setup,
+                          unsigned num_threads)
+{
+   struct lp_setup_tri_batch *batch;
+   unsigned i;
+
+   batch = CALLOC_STRUCT(lp_setup_tri_batch);
+   if (!batch)
+      return NULL;
+
+   batch->setup = setup;
+
+   /* Only count the threads actually created, flushes wait for them all */
+   num_threads = MIN2(num_threads, LP_MAX_SETUP_THREADS);
+   for (i = 0; i < num_threads; i++) {
+      struct lp_setup_worker *worker = &batch->workers[i];
+      worker->batch = batch;
+      worker->index = i + 1;
+      pipe_semaphore_init(&worker->work_ready, 0);
+      pipe_semaphore_init(&worker->work_done, 0);
+      batch->threads[i] = pipe_thread_create(setup_thread_function,
+                                             (void *) worker);
+      if (!batch->threads[i]) {
+         pipe_semaphore_destroy(&worker->work_ready);
+         pipe_semaphore_destroy(&worker->work_done);
+         break;
+      }
+      batch->num_threads++;
+   }
+
+   return batch;
+}
+
+
+void
+lp_setup_destroy_tri_batch(struct lp_setup_tri_batch *batch)
+{
+   unsigned i;
+
+   assert(batch->count == 0);
+
+   batch->exit_flag = TRUE;
+   for (i = 0; i < batch->num_threads; i++) {
+      pipe_semaphore_signal(&batch->workers[i].work_ready);
+   }
+
+   for (i = 0; i < batch->num_threads; i++) {
+      pipe_thread_wait(batch->threads[i]);
+      pipe_semaphore_destroy(&batch->workers[i].work_ready);
+      pipe_semaphore_destroy(&batch->workers[i].work_done);
+   }
+
+   FREE(batch);
+}
+
+
+/**
+ * Start queuing triangles, if the draw is large enough for batching to
+ * pay off.
+ * \param nr  number of vertices/indices in the draw call
+ */
+void
+lp_setup_begin_tri_batch(struct lp_setup_context *setup, unsigned nr)
+{
+   struct lp_setup_tri_batch *batch = setup->tri_batch;
+
+   if (batch && batch->num_threads &&
+       nr >= LP_SETUP_MIN_BATCH &&
+       u_reduced_prim(setup->prim) == PIPE_PRIM_TRIANGLES) {
+      assert(batch->count == 0);
+      batch->active = TRUE;
+   }
+}
+
+
+/**
+ * Set up and bin all queued triangles.
+ */
+static void
+flush_tri_batch(struct lp_setup_context *setup)
+{
+   struct lp_setup_tri_batch *batch = setup->tri_batch;
+   unsigned count = batch->count;
+   unsigned i;
+
+   if (count == 0)
+      return;
+
+   if (count >= LP_SETUP_MIN_BATCH / 2) {
+      for (i = 0; i < batch->num_threads; i++)
+         pipe_semaphore_signal(&batch->workers[i].work_ready);
+
+      setup_triangle_range(batch, 0);
+
+      for (i = 0; i < batch->num_threads; i++)
+         pipe_semaphore_wait(&batch->workers[i].work_done);
+   }
+   else {
+      for (i = 0; i < count; i++)
+         setup_triangle_coefs(setup, &batch->jobs[i]);
+   }
+
+   batch->count = 0;
+
+   for (i = 0; i < count; i++) {
+      struct lp_setup_tri_job *job = &batch->jobs[i];
+
+      if (!lp_setup_bin_triangle(setup, job->tri, &job->bbox,
+                                 job->nr_planes, job->viewport_index)) {
+         /* Out of bin memory.  Restart the scene and redo this and the
+          * remaining triangles without batching, as their storage was
+          * allocated in the scene which is now gone.
+          */
+         if (!lp_setup_flush_and_restart(setup))
+            return;
+
+         for (; i < count; i++) {
+            job = &batch->jobs[i];
+            if (!do_triangle_ccw(setup, &job->position,
+                                 job->v[0], job->v[1], job->v[2],
+                                 job->frontfacing)) {
+               if (!lp_setup_flush_and_restart(setup))
+                  return;
+
+               do_triangle_ccw(setup, &job->position,
+                               job->v[0], job->v[1], job->v[2],
+                               job->frontfacing);
+            }
+         }
+         return;
+      }
+
+      setup->stats.nr_binned_tris++;
+   }
+}
+
+
+/**
+ * Stop queuing triangles and bin the outstanding ones.  Must be called
+ * before the vertices passed to setup->triangle() go away.
+ */
+void
+lp_setup_end_tri_batch(struct lp_setup_context *setup)
+{
+   struct lp_setup_tri_batch *batch = setup->tri_batch;
+
+   if (batch && batch->active) {
+      flush_tri_batch(setup);
+      batch->active = FALSE;
+   }
+}
+
+
+/**
+ * Queue a triangle in the batch.
+ * \return FALSE if the scene is out of memory
+ */
+static boolean
+queue_triangle_ccw(struct lp_setup_context *setup,
+                   struct fixed_position *position,
+                   const float (*v0)[4],
+                   const float (*v1)[4],
+                   const float (*v2)[4],
+                   boolean front)
+{
+   struct lp_setup_tri_batch *batch = setup->tri_batch;
+   struct lp_setup_tri_job *job = &batch->jobs[batch->count];
+
+   if (!prepare_triangle_ccw(setup, position, v0, v1, v2, front, job))
+      return FALSE;
+
+   if (job->tri) {
+      batch->count++;
+      if (batch->count == Elements(batch->jobs))
+         flush_tri_batch(setup);
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Try to draw the triangle, restart the scene on failure.
  */
@@ -828,6 +1160,16 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
                                 const float (*v2)[4],
                                 boolean front)
 {
+   if (setup->tri_batch && setup->tri_batch->active) {
+      if (queue_triangle_ccw( setup, position, v0, v1, v2, front ))
+         return;
+
+      /* Out of scene memory: bin what we have, then go the usual way,
+       * which restarts the scene.
+       */
+      flush_tri_batch(setup);
+   }
+
    if (!do_triangle_ccw( setup, position, v0, v1, v2, front ))
    {
       if (!lp_setup_flush_and_restart(setup))
@@ -931,6 +1273,8 @@ static void triangle_cw( struct lp_setup_context *setup,
 {
    struct fixed_position position;
 
+   setup->stats.nr_tris++;
+
    calc_fixed_position(setup, &position, v0, v1, v2);
 
    if (position.area < 0) {
@@ -952,6 +1296,8 @@ static void triangle_ccw( struct lp_setup_context *setup,
 {
    struct fixed_position position;
 
+   setup->stats.nr_tris++;
+
    calc_fixed_position(setup, &position, v0, v1, v2);
 
    if (position.area > 0)
@@ -969,6 +1315,8 @@ static void triangle_both( struct lp_setup_context *setup,
    struct fixed_position position;
    struct llvmpipe_context *lp_context = (struct llvmpipe_context *)setup->pipe;
 
+   setup->stats.nr_tris++;
+
    if (lp_context->active_statistics_queries &&
        !llvmpipe_rasterization_disabled(lp_context)) {
       lp_context->pipeline_statistics.c_primitives++;
@@ -1004,6 +1352,7 @@ static void triangle_nop( struct lp_setup_context *setup,
 			  const float (*v1)[4],
 			  const float (*v2)[4] )
 {
+   setup->stats.nr_tris++;
 }
 
 
@@ -46,6 +46,12 @@
 #define LP_MAX_VBUF_INDEXES 1024
 #define LP_MAX_VBUF_SIZE    4096
 
+/* Vertex buffer size when triangle setup is done in parallel: large
+ * enough to hold LP_MAX_VBUF_INDEXES typical vertices, so that draw calls
+ * carry enough triangles to be worth splitting between threads.
+ */
+#define LP_MAX_VBUF_SIZE_BATCHED (64 * 1024)
+
   
 
 /** cast wrapper */
@@ -146,6 +152,8 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   lp_setup_begin_tri_batch(setup, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -324,6 +332,8 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    default:
       assert(0);
    }
+
+   lp_setup_end_tri_batch(setup);
 }
 
 
@@ -344,6 +354,8 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   lp_setup_begin_tri_batch(setup, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -519,6 +531,8 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   lp_setup_end_tri_batch(setup);
 }
 
 
@@ -586,7 +600,9 @@ void
 lp_setup_init_vbuf(struct lp_setup_context *setup)
 {
    setup->base.max_indices = LP_MAX_VBUF_INDEXES;
-   setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   setup->base.max_vertex_buffer_bytes = setup->tri_batch ?
+                                         LP_MAX_VBUF_SIZE_BATCHED :
+                                         LP_MAX_VBUF_SIZE;
 
    setup->base.get_vertex_info = lp_setup_get_vertex_info;
    setup->base.allocate_vertices = lp_setup_allocate_vertices;
@@ -67,6 +67,7 @@
 #include "util/u_string.h"
 #include "util/u_simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_atomic.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -77,6 +78,7 @@
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_conv.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_tgsi.h"
@@ -92,6 +94,7 @@
 #include "lp_bld_blend.h"
 #include "lp_bld_depth.h"
 #include "lp_bld_interp.h"
+#include "lp_compile_queue.h"
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
@@ -2152,10 +2155,10 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
-                  unsigned partial_mask)
+                  unsigned partial_mask,
+                  boolean cached)
 {
    struct gallivm_state *gallivm = variant->gallivm;
    const struct lp_fragment_shader_variant_key *key = &variant->key;
@@ -2266,6 +2269,12 @@ generate_fragment(struct llvmpipe_context *lp,
 
    variant->function[partial_mask] = function;
 
+   if (cached) {
+      /* The code will be loaded from the on-disk cache */
+      gallivm_cache_stub_function(gallivm, function);
+      return;
+   }
+
    /* XXX: need to propagate noalias down into color param now we are
     * passing a pointer-to-pointer?
     */
@@ -2540,14 +2549,69 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
 }
 
 
+/**
+ * Generate and compile the code of a variant into variant->gallivm.
+ */
+static void
+generate_variant_code(struct lp_fragment_shader *shader,
+                      struct lp_fragment_shader_variant *variant)
+{
+   boolean cached;
+
+   lp_jit_init_types(variant);
+
+   cached = gallivm_cache_lookup(variant->gallivm,
+                                 &variant->key, shader->variant_key_size,
+                                 shader->base.tokens);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, variant, RAST_EDGE_TEST, cached);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE, cached);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   gallivm_free_ir(variant->gallivm);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * \param optimize  whether to optimize the code, or to generate it as
+ *                  quickly as possible, to be optimized in the background
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+                 const struct lp_fragment_shader_variant_key *key,
+                 boolean optimize)
 {
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
@@ -2561,7 +2625,10 @@ generate_variant(struct llvmpipe_context *lp,
    util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
                  shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (optimize)
+      variant->gallivm = gallivm_create(module_name, lp->context);
+   else
+      variant->gallivm = gallivm_create_unoptimized(module_name, lp->context);
    if (!variant->gallivm) {
       FREE(variant);
       return NULL;
@@ -2605,43 +2672,56 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   generate_variant_code(shader, variant);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
+   return variant;
+}
 
-   /*
-    * Compile everything
-    */
 
-   gallivm_compile_module(variant->gallivm);
+/**
+ * Replace the unoptimized code of a variant with optimized code.
+ *
+ * Called from the background compilation threads, each with an LLVM
+ * context of its own.  The code is generated for a private copy of the
+ * variant, as the original may be used for drawing meanwhile, and only the
+ * jit functions are replaced.  The unoptimized code stays around until the
+ * variant is destroyed, as scenes in flight might still be running it.
+ */
+void
+llvmpipe_optimize_fs_variant(struct lp_fragment_shader_variant *variant,
+                             LLVMContextRef context)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   struct lp_fragment_shader_variant *tmp;
+   char module_name[64];
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+   tmp = CALLOC_STRUCT(lp_fragment_shader_variant);
+   if (!tmp)
+      return;
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
+   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                 shader->no, variant->no);
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   tmp->gallivm = gallivm_create(module_name, context);
+   if (!tmp->gallivm) {
+      FREE(tmp);
+      return;
    }
 
-   gallivm_free_ir(variant->gallivm);
+   memcpy(&tmp->key, &variant->key, shader->variant_key_size);
+   tmp->shader = shader;
+   tmp->no = variant->no;
+   tmp->opaque = variant->opaque;
+   tmp->ps_inv_multiplier = variant->ps_inv_multiplier;
 
-   return variant;
+   generate_variant_code(shader, tmp);
+
+   assert(!variant->optimized_gallivm);
+   variant->optimized_gallivm = tmp->gallivm;
+   variant->jit_function[RAST_EDGE_TEST] = tmp->jit_function[RAST_EDGE_TEST];
+   variant->jit_function[RAST_WHOLE] = tmp->jit_function[RAST_WHOLE];
+
+   FREE(tmp);
 }
 
 
@@ -2775,7 +2855,26 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      debug_printf("llvmpipe: fs #%u var #%u: %d blocks shaded, tier %u,"
+                   " compiled in %u + %u usec\n",
+                   variant->shader->no,
+                   variant->no,
+                   variant->invocations,
+                   variant->tier,
+                   (unsigned) variant->compile_time[0],
+                   (unsigned) variant->compile_time[1]);
+   }
+
+   if (lp->compile_queue)
+      lp_compile_queue_remove(lp->compile_queue, variant);
+
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
+
    gallivm_destroy(variant->gallivm);
+   if (variant->optimized_gallivm)
+      gallivm_destroy(variant->optimized_gallivm);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -3156,17 +3255,23 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       }
 
       /*
-       * Generate the new variant.
+       * Generate the new variant.  With background compilation, only
+       * generate quick unoptimized code now.
        */
       t0 = os_time_get();
-      variant = generate_variant(lp, shader, &key);
+      variant = generate_variant(lp, shader, &key, lp->compile_queue == NULL);
       t1 = os_time_get();
       dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+      lp->stats.compile_time += dt * 1000;
+      lp->stats.nr_compiles++;
 
       /* Put the new variant into the list */
       if (variant) {
+         variant->compile_time[0] = dt;
+         variant->tier = lp->compile_queue ? 0 : 1;
+
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
@@ -3176,7 +3281,32 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
+
+   if (lp->compile_queue)
+      llvmpipe_tier_up_fs_variant(lp);
+}
+
+
+/**
+ * Queue the bound variant for optimization once it is hot enough.
+ *
+ * Invocations are counted by the rasterizer threads, so scenes still in
+ * flight are not accounted for yet; this is called for every draw.
+ */
+void
+llvmpipe_tier_up_fs_variant(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+
+   if (variant && variant->tier == 0 &&
+       (unsigned) p_atomic_read(&variant->invocations) >=
+       lp->tier_up_threshold) {
+      variant->tier = 1;
+      LP_COUNT(nr_llvm_tier_ups);
+      lp_compile_queue_add(lp->compile_queue, variant);
+   }
 }
 
 
@@ -40,6 +40,7 @@
 
 struct tgsi_token;
 struct lp_fragment_shader;
+struct lp_compile_job;
 
 
 /** Indexes into jit_function[] array */
@@ -113,6 +114,22 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /** Optimized code replacing the initial one, see lp_compile_queue.c */
+   struct gallivm_state *optimized_gallivm;
+   struct lp_compile_job *compile_job;
+
+   /**
+    * 0 while running unoptimized code, 1 once the optimized code is
+    * compiled or queued for compilation.
+    */
+   unsigned tier;
+
+   /** 4x4 blocks shaded so far, counted by the rasterizer threads */
+   int32_t invocations;
+
+   /** Time spent generating the code of each tier, in microseconds */
+   int64_t compile_time[2];
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
@@ -150,6 +167,13 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_optimize_fs_variant(struct lp_fragment_shader_variant *variant,
+                             LLVMContextRef context);
+
+void
+llvmpipe_tier_up_fs_variant(struct llvmpipe_context *lp);
+
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
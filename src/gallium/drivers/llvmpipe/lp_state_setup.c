@@ -35,6 +35,7 @@
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_flow.h"
@@ -717,7 +718,8 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    LLVMTypeRef arg_types[7];
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
-   int64_t t0 = 0, t1;
+   boolean cached;
+   int64_t t0, t1;
 
    if (0)
       goto fail;
@@ -738,13 +740,13 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    builder = gallivm->builder;
 
-   if (LP_DEBUG & DEBUG_COUNTERS) {
-      t0 = os_time_get();
-   }
+   t0 = os_time_get();
 
    memcpy(&variant->key, key, key->size);
    variant->list_item_global.base = variant;
 
+   cached = gallivm_cache_lookup(gallivm, key, key->size, NULL);
+
    /* Currently always deal with full 4-wide vertex attributes from
     * the vertices.
     */
@@ -768,6 +770,12 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    LLVMSetFunctionCallConv(variant->function, LLVMCCallConv);
 
+   if (cached) {
+      /* The code will be loaded from the on-disk cache */
+      gallivm_cache_stub_function(gallivm, variant->function);
+      goto compile;
+   }
+
    args.v0       = LLVMGetParam(variant->function, 0);
    args.v1       = LLVMGetParam(variant->function, 1);
    args.v2       = LLVMGetParam(variant->function, 2);
@@ -799,6 +807,7 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    gallivm_verify_function(gallivm, variant->function);
 
+compile:
    gallivm_compile_module(gallivm);
 
    variant->jit_function = (lp_jit_setup_triangle)
@@ -811,8 +820,10 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    /*
     * Update timing information:
     */
+   t1 = os_time_get();
+   lp->stats.compile_time += (t1 - t0) * 1000;
+   lp->stats.nr_compiles++;
    if (LP_DEBUG & DEBUG_COUNTERS) {
-      t1 = os_time_get();
       LP_COUNT_ADD(llvm_compile_time, t1 - t0);
       LP_COUNT_ADD(nr_llvm_compiles, 1);
    }
@@ -97,6 +97,8 @@ lp_resource_copy(struct pipe_context *pipe,
          = llvmpipe_get_texture_image_address(dst_tex, dstz,
                                               dst_level);
 
+      llvmpipe_resource_invalidate_hiz(dst);
+
       if (dst_linear_ptr && src_linear_ptr) {
          util_copy_box(dst_linear_ptr, format,
                        llvmpipe_resource_stride(&dst_tex->base, dst_level),
@@ -180,9 +182,18 @@ static void lp_blit(struct pipe_context *pipe,
 }
 
 
+/**
+ * Called before a resource is shared, e.g. presented.  Wait for the
+ * scenes rendering to it, as they are rasterized asynchronously.
+ */
 static void
 lp_flush_resource(struct pipe_context *ctx, struct pipe_resource *resource)
 {
+   llvmpipe_flush_resource(ctx, resource, 0,
+                           TRUE, /* read_only */
+                           FALSE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
 }
 
 
@@ -0,0 +1,598 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and benchmarks for the texture sampling fast paths.
+ *
+ * Every sampler is compiled twice, with and without the fast paths (see
+ * GALLIVM_PERF_NO_SAMPLE_FASTPATH), and both versions must return the
+ * same texels.
+ */
+
+
+#include "util/u_memory.h"
+#include "util/u_format.h"
+
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_sample.h"
+#include "lp_test.h"
+
+
+typedef void (*sample_test_ptr_t)(const float *s, const float *t, float *res);
+
+
+/** Number of calls timed per sample */
+#define NUM_CALLS 64
+
+
+/**
+ * The texture being sampled.  All of its state is constant in the
+ * generated code.
+ */
+struct sample_test_texture
+{
+   struct lp_sampler_dynamic_state base;
+
+   unsigned width;
+   unsigned height;
+   int32_t row_stride[PIPE_MAX_TEXTURE_LEVELS];
+   int32_t img_stride[PIPE_MAX_TEXTURE_LEVELS];
+   int32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS];
+   float border_color[4];
+   uint8_t *data;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_pixel\t"
+           "cycles_per_pixel_generic\t"
+           "format\t"
+           "wrap_s\t"
+           "wrap_t\t"
+           "width\t"
+           "height\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              const struct util_format_description *desc,
+              unsigned wrap_s,
+              unsigned wrap_t,
+              unsigned width,
+              unsigned height,
+              double cycles,
+              double cycles_generic,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles);
+   fprintf(fp, "%.1f\t", cycles_generic);
+
+   fprintf(fp, "%s\t%s\t%s\t%u\t%u\n",
+           desc->short_name,
+           util_dump_tex_wrap(wrap_s, TRUE),
+           util_dump_tex_wrap(wrap_t, TRUE),
+           width, height);
+
+   fflush(fp);
+}
+
+
+static LLVMValueRef
+texture_int(const struct lp_sampler_dynamic_state *state,
+            struct gallivm_state *gallivm, unsigned value)
+{
+   return lp_build_const_int32(gallivm, value);
+}
+
+
+static LLVMValueRef
+texture_int_array(const struct lp_sampler_dynamic_state *state,
+                  struct gallivm_state *gallivm, const int32_t *array)
+{
+   LLVMTypeRef array_type =
+      LLVMArrayType(LLVMInt32TypeInContext(gallivm->context),
+                    PIPE_MAX_TEXTURE_LEVELS);
+
+   return LLVMBuildBitCast(gallivm->builder,
+                           lp_build_const_int_pointer(gallivm, array),
+                           LLVMPointerType(array_type, 0), "");
+}
+
+
+static LLVMValueRef
+texture_width(const struct lp_sampler_dynamic_state *state,
+              struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int(state, gallivm,
+                      ((const struct sample_test_texture *)state)->width);
+}
+
+
+static LLVMValueRef
+texture_height(const struct lp_sampler_dynamic_state *state,
+               struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int(state, gallivm,
+                      ((const struct sample_test_texture *)state)->height);
+}
+
+
+static LLVMValueRef
+texture_one(const struct lp_sampler_dynamic_state *state,
+            struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int(state, gallivm, 1);
+}
+
+
+static LLVMValueRef
+texture_zero(const struct lp_sampler_dynamic_state *state,
+             struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int(state, gallivm, 0);
+}
+
+
+static LLVMValueRef
+texture_row_stride(const struct lp_sampler_dynamic_state *state,
+                   struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int_array(state, gallivm,
+                            ((const struct sample_test_texture *)state)->row_stride);
+}
+
+
+static LLVMValueRef
+texture_img_stride(const struct lp_sampler_dynamic_state *state,
+                   struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int_array(state, gallivm,
+                            ((const struct sample_test_texture *)state)->img_stride);
+}
+
+
+static LLVMValueRef
+texture_mip_offsets(const struct lp_sampler_dynamic_state *state,
+                    struct gallivm_state *gallivm, unsigned unit)
+{
+   return texture_int_array(state, gallivm,
+                            ((const struct sample_test_texture *)state)->mip_offsets);
+}
+
+
+static LLVMValueRef
+texture_base_ptr(const struct lp_sampler_dynamic_state *state,
+                 struct gallivm_state *gallivm, unsigned unit)
+{
+   const struct sample_test_texture *tex =
+      (const struct sample_test_texture *)state;
+
+   return LLVMBuildBitCast(gallivm->builder,
+                           lp_build_const_int_pointer(gallivm, tex->data),
+                           LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0),
+                           "");
+}
+
+
+static LLVMValueRef
+sampler_float_zero(const struct lp_sampler_dynamic_state *state,
+                   struct gallivm_state *gallivm, unsigned unit)
+{
+   return lp_build_const_float(gallivm, 0.0f);
+}
+
+
+static LLVMValueRef
+sampler_border_color(const struct lp_sampler_dynamic_state *state,
+                     struct gallivm_state *gallivm, unsigned unit)
+{
+   const struct sample_test_texture *tex =
+      (const struct sample_test_texture *)state;
+
+   return LLVMBuildBitCast(gallivm->builder,
+                           lp_build_const_int_pointer(gallivm, tex->border_color),
+                           LLVMPointerType(LLVMFloatTypeInContext(gallivm->context), 0),
+                           "");
+}
+
+
+static void
+init_texture(struct sample_test_texture *tex,
+             unsigned width, unsigned height)
+{
+   unsigned i;
+
+   memset(tex, 0, sizeof *tex);
+
+   tex->base.width = texture_width;
+   tex->base.height = texture_height;
+   tex->base.depth = texture_one;
+   tex->base.first_level = texture_zero;
+   tex->base.last_level = texture_zero;
+   tex->base.row_stride = texture_row_stride;
+   tex->base.img_stride = texture_img_stride;
+   tex->base.base_ptr = texture_base_ptr;
+   tex->base.mip_offsets = texture_mip_offsets;
+   tex->base.min_lod = sampler_float_zero;
+   tex->base.max_lod = sampler_float_zero;
+   tex->base.lod_bias = sampler_float_zero;
+   tex->base.border_color = sampler_border_color;
+
+   tex->width = width;
+   tex->height = height;
+
+   /*
+    * No row padding, unlike llvmpipe_texture_layout(), as draw may sample
+    * textures of other drivers laid out that way.
+    */
+   tex->row_stride[0] = width * 4;
+   tex->img_stride[0] = tex->row_stride[0] * height;
+
+   tex->data = align_malloc(tex->img_stride[0], 16);
+   for (i = 0; i < (unsigned)tex->img_stride[0]; ++i)
+      tex->data[i] = rand() & 0xff;
+}
+
+
+static LLVMValueRef
+add_sample_test(struct gallivm_state *gallivm,
+                struct sample_test_texture *tex,
+                const struct lp_static_texture_state *texture_state,
+                const struct lp_static_sampler_state *sampler_state,
+                struct lp_type type)
+{
+   LLVMModuleRef module = gallivm->module;
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[3];
+   LLVMValueRef func;
+   LLVMValueRef s_ptr, t_ptr, res_ptr;
+   LLVMBasicBlockRef block;
+   LLVMValueRef coords[5];
+   LLVMValueRef offsets[3] = { NULL, NULL, NULL };
+   LLVMValueRef texel[4];
+   unsigned i;
+
+   args[2] = args[1] = args[0] = LLVMPointerType(vec_type, 0);
+   func = LLVMAddFunction(module, "test",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, 3, 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   s_ptr = LLVMGetParam(func, 0);
+   t_ptr = LLVMGetParam(func, 1);
+   res_ptr = LLVMGetParam(func, 2);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   coords[0] = LLVMBuildLoad(builder, s_ptr, "s");
+   coords[1] = LLVMBuildLoad(builder, t_ptr, "t");
+   coords[2] = coords[3] = coords[4] = LLVMGetUndef(vec_type);
+
+   lp_build_sample_soa(gallivm, texture_state, sampler_state, &tex->base,
+                       type, FALSE, 0, 0, coords, offsets,
+                       NULL, NULL, NULL, LP_SAMPLER_LOD_SCALAR,
+                       texel);
+
+   for (i = 0; i < 4; ++i) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, i);
+      LLVMValueRef ptr = LLVMBuildGEP(builder, res_ptr, &index, 1, "");
+      LLVMBuildStore(builder, texel[i], ptr);
+   }
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/**
+ * Compile the sampler, with or without the sampling fast paths.
+ */
+static sample_test_ptr_t
+compile_sample_test(struct gallivm_state **gallivm,
+                    struct sample_test_texture *tex,
+                    const struct lp_static_texture_state *texture_state,
+                    const struct lp_static_sampler_state *sampler_state,
+                    struct lp_type type,
+                    boolean fastpath)
+{
+   const unsigned saved_perf = gallivm_perf;
+   LLVMValueRef func;
+   sample_test_ptr_t sample_test_ptr;
+
+   if (fastpath)
+      gallivm_perf &= ~GALLIVM_PERF_NO_SAMPLE_FASTPATH;
+   else
+      gallivm_perf |= GALLIVM_PERF_NO_SAMPLE_FASTPATH;
+
+   *gallivm = gallivm_create("test_module", LLVMGetGlobalContext());
+
+   func = add_sample_test(*gallivm, tex, texture_state, sampler_state, type);
+
+   gallivm_compile_module(*gallivm);
+
+   sample_test_ptr = (sample_test_ptr_t)gallivm_jit_function(*gallivm, func);
+
+   gallivm_free_ir(*gallivm);
+
+   gallivm_perf = saved_perf;
+
+   return sample_test_ptr;
+}
+
+
+/**
+ * Average the cycle counts, ignoring outliers (see lp_test_blend.c).
+ */
+static double
+average_cycles(const int64_t *cycles, unsigned n)
+{
+   double sum = 0.0, sum2 = 0.0;
+   double avg, std;
+   unsigned i, m;
+
+   for (i = 0; i < n; ++i) {
+      sum += cycles[i];
+      sum2 += cycles[i]*cycles[i];
+   }
+
+   avg = sum/n;
+   std = sqrtf((sum2 - n*avg*avg)/n);
+
+   m = 0;
+   sum = 0.0;
+   for (i = 0; i < n; ++i) {
+      if (fabs(cycles[i] - avg) <= 4.0*std) {
+         sum += cycles[i];
+         ++m;
+      }
+   }
+
+   return m ? sum/m : avg;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_one(unsigned verbose,
+         FILE *fp,
+         enum pipe_format format,
+         unsigned wrap_s,
+         unsigned wrap_t,
+         unsigned width,
+         unsigned height)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   const struct lp_type type = lp_float32_vec4_type();
+   struct lp_static_texture_state texture_state;
+   struct lp_static_sampler_state sampler_state;
+   struct sample_test_texture tex;
+   struct gallivm_state *gallivm_fast, *gallivm_generic;
+   sample_test_ptr_t sample_fast, sample_generic;
+   const unsigned n = LP_TEST_NUM_SAMPLES;
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   int64_t cycles_generic[LP_TEST_NUM_SAMPLES];
+   PIPE_ALIGN_VAR(16) float s[4];
+   PIPE_ALIGN_VAR(16) float t[4];
+   PIPE_ALIGN_VAR(16) float res[4][4];
+   PIPE_ALIGN_VAR(16) float ref[4][4];
+   boolean success = TRUE;
+   unsigned i, j, k;
+
+   if (verbose >= 1)
+      printf("Testing %s %s/%s %ux%u ...\n", desc->short_name,
+             util_dump_tex_wrap(wrap_s, TRUE),
+             util_dump_tex_wrap(wrap_t, TRUE),
+             width, height);
+
+   init_texture(&tex, width, height);
+
+   memset(&texture_state, 0, sizeof texture_state);
+   texture_state.format = format;
+   texture_state.swizzle_r = PIPE_SWIZZLE_RED;
+   texture_state.swizzle_g = PIPE_SWIZZLE_GREEN;
+   texture_state.swizzle_b = PIPE_SWIZZLE_BLUE;
+   texture_state.swizzle_a = PIPE_SWIZZLE_ALPHA;
+   texture_state.target = PIPE_TEXTURE_2D;
+   texture_state.pot_width = util_is_power_of_two(width);
+   texture_state.pot_height = util_is_power_of_two(height);
+   texture_state.pot_depth = 1;
+   texture_state.level_zero_only = 1;
+
+   memset(&sampler_state, 0, sizeof sampler_state);
+   sampler_state.wrap_s = wrap_s;
+   sampler_state.wrap_t = wrap_t;
+   sampler_state.wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler_state.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler_state.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler_state.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   sampler_state.normalized_coords = 1;
+   sampler_state.min_max_lod_equal = 1;
+
+   sample_fast = compile_sample_test(&gallivm_fast, &tex,
+                                     &texture_state, &sampler_state,
+                                     type, TRUE);
+   sample_generic = compile_sample_test(&gallivm_generic, &tex,
+                                        &texture_state, &sampler_state,
+                                        type, FALSE);
+
+   for (i = 0; i < n && success; ++i) {
+      int64_t start_counter;
+
+      /* a quad straddling the edges of the texture every now and then */
+      s[0] = random_float() * 1.5f - 0.25f;
+      t[0] = random_float() * 1.5f - 0.25f;
+      for (j = 1; j < 4; ++j) {
+         s[j] = s[0] + (j & 1) * 0.5f / width;
+         t[j] = t[0] + (j >> 1) * 0.5f / height;
+      }
+
+      sample_generic(s, t, &ref[0][0]);
+      sample_fast(s, t, &res[0][0]);
+
+      start_counter = rdtsc();
+      for (j = 0; j < NUM_CALLS; ++j)
+         sample_generic(s, t, &ref[0][0]);
+      cycles_generic[i] = rdtsc() - start_counter;
+
+      start_counter = rdtsc();
+      for (j = 0; j < NUM_CALLS; ++j)
+         sample_fast(s, t, &res[0][0]);
+      cycles[i] = rdtsc() - start_counter;
+
+      for (j = 0; j < 4; ++j) {
+         for (k = 0; k < 4; ++k) {
+            if (res[j][k] != ref[j][k])
+               success = FALSE;
+         }
+      }
+
+      if (!success) {
+         if (verbose < 1)
+            printf("Testing %s %s/%s %ux%u ...\n", desc->short_name,
+                   util_dump_tex_wrap(wrap_s, TRUE),
+                   util_dump_tex_wrap(wrap_t, TRUE),
+                   width, height);
+         printf("MISMATCH\n");
+         for (k = 0; k < 4; ++k) {
+            printf("  (%.9g, %.9g): %.9g %.9g %.9g %.9g obtained\n",
+                   s[k], t[k], res[0][k], res[1][k], res[2][k], res[3][k]);
+            printf("  %*s %.9g %.9g %.9g %.9g expected\n",
+                   28, "", ref[0][k], ref[1][k], ref[2][k], ref[3][k]);
+         }
+      }
+   }
+
+   if (fp)
+      write_tsv_row(fp, desc, wrap_s, wrap_t, width, height,
+                    average_cycles(cycles, i) / (NUM_CALLS * type.length),
+                    average_cycles(cycles_generic, i) / (NUM_CALLS * type.length),
+                    success);
+
+   gallivm_destroy(gallivm_fast);
+   gallivm_destroy(gallivm_generic);
+   align_free(tex.data);
+
+   return success;
+}
+
+
+static const enum pipe_format
+sample_formats[] = {
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+};
+
+
+static const unsigned
+sample_wraps[] = {
+   PIPE_TEX_WRAP_CLAMP_TO_EDGE,
+   PIPE_TEX_WRAP_REPEAT,
+};
+
+
+static const unsigned
+sample_sizes[][2] = {
+   {   1,   1 },
+   {   1,   7 },
+   {   2,   2 },
+   {   5,   3 },
+   {  64,  64 },
+   { 257,  31 },
+};
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i, j, k, l;
+
+   for (i = 0; i < Elements(sample_formats); ++i) {
+      for (j = 0; j < Elements(sample_wraps); ++j) {
+         for (k = 0; k < Elements(sample_wraps); ++k) {
+            for (l = 0; l < Elements(sample_sizes); ++l) {
+               if (!test_one(verbose, fp, sample_formats[i],
+                             sample_wraps[j], sample_wraps[k],
+                             sample_sizes[l][0], sample_sizes[l][1]))
+                  success = FALSE;
+            }
+         }
+      }
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   boolean success = TRUE;
+   unsigned i;
+
+   for (i = 0; i < n; ++i) {
+      unsigned size = rand() % Elements(sample_sizes);
+
+      if (!test_one(verbose, fp,
+                    sample_formats[rand() % Elements(sample_formats)],
+                    sample_wraps[rand() % Elements(sample_wraps)],
+                    sample_wraps[rand() % Elements(sample_wraps)],
+                    sample_sizes[size][0], sample_sizes[size][1]))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_one(verbose, fp, PIPE_FORMAT_B8G8R8A8_UNORM,
+                   PIPE_TEX_WRAP_CLAMP_TO_EDGE, PIPE_TEX_WRAP_CLAMP_TO_EDGE,
+                   256, 256);
+}
@@ -44,6 +44,7 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
@@ -262,6 +263,18 @@ llvmpipe_resource_create(struct pipe_screen *_screen,
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
       }
+
+      if ((lpr->base.bind & PIPE_BIND_DEPTH_STENCIL) &&
+          util_format_has_depth(util_format_description(lpr->base.format)) &&
+          !llvmpipe_resource_is_1d(&lpr->base)) {
+         lpr->hiz_stride = align(lpr->base.width0, LP_HIZ_BLOCK_SIZE) /
+                           LP_HIZ_BLOCK_SIZE;
+         lpr->hiz_rows = align(lpr->base.height0, LP_HIZ_BLOCK_SIZE) /
+                         LP_HIZ_BLOCK_SIZE;
+         lpr->hiz = MALLOC(lpr->hiz_stride * lpr->hiz_rows * sizeof(float));
+         /* not fatal, hierarchical z is simply not used then */
+         llvmpipe_resource_invalidate_hiz(&lpr->base);
+      }
    }
    else {
       /* other data (vertex buffer, const buffer, etc) */
@@ -312,6 +325,7 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    if (lpr->dt) {
       /* display target */
       struct sw_winsys *winsys = screen->winsys;
+      lp_fence_reference(&lpr->dt_fence, NULL);
       winsys->displaytarget_destroy(winsys, lpr->dt);
    }
    else if (llvmpipe_resource_is_texture(pt)) {
@@ -326,6 +340,8 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       align_free(lpr->data);
    }
 
+   FREE(lpr->hiz);
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -595,6 +611,8 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       /* Do something to notify sharing contexts of a texture change.
        */
       screen->timestamp++;
+
+      llvmpipe_resource_invalidate_hiz(resource);
    }
 
    map +=
@@ -29,11 +29,20 @@
 #define LP_TEXTURE_H
 
 
+#include <float.h>
+
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
 #include "lp_limits.h"
 
 
+/** Size of the blocks of the hierarchical z buffer, in pixels */
+#define LP_HIZ_BLOCK_SIZE 16
+
+/** Hierarchical z value of a block whose depth values are unknown */
+#define LP_HIZ_UNKNOWN FLT_MAX
+
+
 enum lp_texture_usage
 {
    LP_TEX_USAGE_READ = 100,
@@ -47,6 +56,7 @@ struct pipe_screen;
 struct llvmpipe_context;
 
 struct sw_displaytarget;
+struct lp_fence;
 
 
 /**
@@ -75,6 +85,13 @@ struct llvmpipe_resource
     */
    struct sw_displaytarget *dt;
 
+   /**
+    * Fence of the last scene rendering to the display target above, which
+    * has to be waited for before it is displayed.  Protected by the
+    * screen's rast_mutex.
+    */
+   struct lp_fence *dt_fence;
+
    /**
     * Malloc'ed data for regular textures, or a mapping to dt above.
     */
@@ -85,6 +102,15 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Hierarchical z buffer of depth textures: an upper bound of the depth
+    * values of each LP_HIZ_BLOCK_SIZE^2 block of the first layer of level 0.
+    * Maintained by the rasterizer, see lp_rast_hiz_reject().
+    */
+   float *hiz;
+   unsigned hiz_stride;  /**< blocks per row */
+   unsigned hiz_rows;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -175,6 +201,23 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+/**
+ * Forget about the depth values of a resource, after they were
+ * modified outside of the rasterizer.
+ */
+static INLINE void
+llvmpipe_resource_invalidate_hiz(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned i;
+
+   if (lpr->hiz) {
+      for (i = 0; i < lpr->hiz_stride * lpr->hiz_rows; i++)
+         lpr->hiz[i] = LP_HIZ_UNKNOWN;
+   }
+}
+
+
 static INLINE unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
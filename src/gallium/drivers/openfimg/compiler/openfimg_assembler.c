@@ -31,11 +31,15 @@
 #include "openfimg_util.h"
 #include "openfimg_texture.h"
 
+#define OF_NUM_REGS		32
+
 struct of_ir_assembler {
 	struct of_context *ctx;
 	struct of_ir_shader *shader;
 	uint32_t *dwords;
 	unsigned cur_instr;
+	unsigned cycle;
+	unsigned ready[OF_NUM_REGS][OF_IR_VEC_SIZE];
 };
 
 struct of_instr_bitfield {
@@ -326,7 +330,9 @@ instr_emit(struct of_ir_assembler *opt, struct of_ir_instruction *instr,
 		dwords[2] |= CF_WORD2_JUMP_OFFS((uint32_t)offset);
 	}
 
-	if (shader->type == OF_SHADER_PIXEL && instr->opc == OF_OP_TEXLD)
+	/* Texture swizzles are only known with a context. */
+	if (shader->type == OF_SHADER_PIXEL && instr->opc == OF_OP_TEXLD
+	    && opt->ctx)
 		patch_texld(opt, dwords);
 
 	/* TODO: Implement predicate support */
@@ -406,6 +412,56 @@ generate_code(struct of_ir_assembler *opt, struct of_ir_ast_node *node)
  * A pass to collect stats needed to generate target bytecode.
  */
 
+static void
+count_reg(struct of_ir_shader *shader, struct of_ir_register *reg)
+{
+	if (reg && reg->type == OF_IR_REG_R)
+		shader->stats.num_regs = max(shader->stats.num_regs,
+						reg->num + 1U);
+}
+
+static void
+count_regs(struct of_ir_shader *shader, struct of_ir_instruction *ins)
+{
+	unsigned i;
+
+	count_reg(shader, ins->dst);
+	for (i = 0; i < ins->num_srcs; ++i)
+		count_reg(shader, ins->srcs[i]);
+}
+
+/*
+ * Estimates execution time assuming that instructions are issued in order,
+ * one per cycle, stalling until all temporary register operands are ready.
+ * Control flow is not followed, so loops are accounted only once.
+ */
+static void
+count_cycles(struct of_ir_assembler *opt, struct of_ir_instruction *ins)
+{
+	struct of_ir_register *dst = ins->dst;
+	unsigned cycle = opt->cycle;
+	unsigned i, comp;
+
+	for (i = 0; i < ins->num_srcs; ++i) {
+		struct of_ir_register *src = ins->srcs[i];
+
+		if (src->type != OF_IR_REG_R)
+			continue;
+
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+			cycle = max(cycle,
+				opt->ready[src->num][src->swizzle[comp]]);
+	}
+
+	if (dst && dst->type == OF_IR_REG_R)
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+			if (reg_comp_used(dst, comp))
+				opt->ready[dst->num][comp] =
+						cycle + instr_latency(ins);
+
+	opt->cycle = cycle + 1;
+}
+
 static void
 collect_stats(struct of_ir_assembler *opt, struct of_ir_ast_node *node)
 {
@@ -421,19 +477,25 @@ collect_stats(struct of_ir_assembler *opt, struct of_ir_ast_node *node)
 			if (!LIST_IS_EMPTY(&child->list.instrs)) {
 				ins = LIST_ENTRY(struct of_ir_instruction,
 						child->list.instrs.next, list);
-				if (ins->num_srcs == 3)
+				if (ins->num_srcs == 3) {
 					++opt->shader->stats.num_instrs;
+					++opt->cycle;
+				}
 			} else {
 				list_del(&child->parent_list);
 				continue;
 			}
-			LIST_FOR_EACH_ENTRY(ins, &child->list.instrs, list)
+			LIST_FOR_EACH_ENTRY(ins, &child->list.instrs, list) {
 				++opt->shader->stats.num_instrs;
+				count_regs(opt->shader, ins);
+				count_cycles(opt, ins);
+			}
 
 			continue; }
 
 		case OF_IR_NODE_IF_THEN:
 			++opt->shader->stats.num_instrs;
+			++opt->cycle;
 			break;
 
 		default:
@@ -446,6 +508,7 @@ collect_stats(struct of_ir_assembler *opt, struct of_ir_ast_node *node)
 		case OF_IR_NODE_DEPART:
 		case OF_IR_NODE_REPEAT:
 			++opt->shader->stats.num_instrs;
+			++opt->cycle;
 			break;
 		case OF_IR_NODE_REGION:
 			if (LIST_IS_EMPTY(&child->nodes))
@@ -463,6 +526,22 @@ collect_stats(struct of_ir_assembler *opt, struct of_ir_ast_node *node)
  * Bytecode generator entry point.
  */
 
+static void
+prepare_code(struct of_ir_assembler *opt, struct of_context *ctx,
+	     struct of_ir_shader *shader)
+{
+	memset(opt, 0, sizeof(*opt));
+
+	opt->ctx = ctx;
+	opt->shader = shader;
+
+	shader->stats.num_instrs = 0;
+	shader->stats.num_regs = 0;
+	RUN_PASS(shader, opt, collect_stats);
+	shader->stats.num_cycles = opt->cycle;
+	OF_IR_DUMP_AST(shader, NULL, 0, "pre-assembler");
+}
+
 int
 of_ir_generate_code(struct of_context *ctx, struct of_ir_shader *shader,
 		    struct pipe_resource **buffer, unsigned *num_instrs)
@@ -471,14 +550,7 @@ of_ir_generate_code(struct of_context *ctx, struct of_ir_shader *shader,
 	struct of_ir_assembler opt;
 	uint32_t *dwords;
 
-	memset(&opt, 0, sizeof(opt));
-
-	opt.ctx = ctx;
-	opt.shader = shader;
-
-	shader->stats.num_instrs = 0;
-	RUN_PASS(shader, &opt, collect_stats);
-	OF_IR_DUMP_AST(shader, NULL, 0, "pre-assembler");
+	prepare_code(&opt, ctx, shader);
 
 	shader->buffer = pipe_buffer_create(ctx->base.screen,
 					PIPE_BIND_CUSTOM, PIPE_USAGE_IMMUTABLE,
@@ -511,13 +583,35 @@ fail:
 	return -1;
 }
 
+int
+of_ir_generate_code_mem(struct of_context *ctx, struct of_ir_shader *shader,
+			uint32_t **dwords, unsigned *num_instrs)
+{
+	struct of_ir_assembler opt;
+
+	prepare_code(&opt, ctx, shader);
+
+	opt.dwords = CALLOC(shader->stats.num_instrs, 4 * sizeof(uint32_t));
+	if (!opt.dwords) {
+		ERROR_MSG("failed to allocate shader code");
+		return -1;
+	}
+
+	RUN_PASS(shader, &opt, generate_code);
+
+	*dwords = opt.dwords;
+	*num_instrs = shader->stats.num_instrs;
+
+	return 0;
+}
+
 /*
  * Disassembler.
  */
 
-static void
-disassemble_code(uint32_t *dwords, unsigned num_dwords,
-		 enum of_shader_type type)
+void
+of_ir_disassemble(uint32_t *dwords, unsigned num_dwords,
+		  enum of_shader_type type)
 {
 	struct of_ir_shader *shader = of_ir_shader_create(type);
 	static const char mask_templ[] = "_x_y_z_w";
@@ -608,7 +702,7 @@ of_shader_disassemble(struct of_context *ctx, struct pipe_resource *buffer,
 	if (!dwords)
 		return -1;
 
-	disassemble_code(dwords, num_dwords, type);
+	of_ir_disassemble(dwords, num_dwords, type);
 
 	if (transfer)
 		pipe_buffer_unmap(&ctx->base, transfer);
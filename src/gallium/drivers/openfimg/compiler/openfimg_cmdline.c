@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2014 Tomasz Figa <tomasz.figa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Offline shader compiler
+ *
+ * Compiles TGSI text files without a device, printing disassembly, code size,
+ * register usage and time spent in every compilation stage. With --batch,
+ * a whole corpus of shaders is compiled and one line of statistics is printed
+ * per shader, to track code quality and compile time regressions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os/os_time.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_text.h"
+#include "tgsi/tgsi_dump.h"
+
+#include "openfimg_compiler.h"
+#include "openfimg_program.h"
+#include "openfimg_ir_priv.h"
+#include "openfimg_util.h"
+
+#define MAX_INSTRS	512
+
+struct of_cmdline_options {
+	bool batch;
+	bool binary;
+	bool quiet;
+	unsigned repeat;
+};
+
+struct of_cmdline_totals {
+	unsigned num_shaders;
+	unsigned num_failed;
+	unsigned num_instrs;
+	unsigned num_cycles;
+	unsigned num_regs;
+	unsigned num_immediates;
+	struct of_shader_timings timings;
+};
+
+static char *
+read_file(const char *filename)
+{
+	FILE *file;
+	char *text;
+	long size;
+
+	file = fopen(filename, "rb");
+	if (!file) {
+		fprintf(stderr, "couldn't open `%s'\n", filename);
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0
+	    || fseek(file, 0, SEEK_SET)) {
+		fprintf(stderr, "couldn't read `%s'\n", filename);
+		fclose(file);
+		return NULL;
+	}
+
+	/* tgsi_text_translate() needs a terminated string. */
+	text = MALLOC(size + 1);
+	if (!text || fread(text, 1, size, file) != (size_t)size) {
+		fprintf(stderr, "couldn't read `%s'\n", filename);
+		FREE(text);
+		fclose(file);
+		return NULL;
+	}
+
+	text[size] = '\0';
+	fclose(file);
+
+	return text;
+}
+
+/*
+ * Writes the program in the format expected by shader override support
+ * (see openfimg_program.c), so the result can be tried on a device.
+ */
+static int
+write_binary(struct of_shader_stateobj *so, const uint32_t *dwords)
+{
+	char path[] = "Xs_YYYYYYYY.bin";
+	struct of_shader_binary_header hdr;
+	unsigned num_consts;
+	uint32_t zero[4];
+	unsigned i;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s_%08x.bin",
+			(so->type == OF_SHADER_VERTEX) ? "vs" : "fs",
+			so->hash);
+
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "couldn't create `%s'\n", path);
+		return -1;
+	}
+
+	num_consts = so->first_immediate + so->num_immediates / 4;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.header_size = sizeof(hdr);
+	hdr.instruct_size = so->num_instrs;
+	hdr.const_float_size = num_consts;
+
+	memset(zero, 0, sizeof(zero));
+
+	fwrite(&hdr, sizeof(hdr), 1, file);
+	fwrite(dwords, 16, so->num_instrs, file);
+	for (i = 0; i < so->first_immediate; ++i)
+		fwrite(zero, sizeof(zero), 1, file);
+	fwrite(so->immediates, 16, so->num_immediates / 4, file);
+
+	if (fclose(file)) {
+		fprintf(stderr, "couldn't write `%s'\n", path);
+		return -1;
+	}
+
+	printf("wrote %s\n", path);
+
+	return 0;
+}
+
+static int64_t
+total_time(const struct of_shader_timings *t)
+{
+	return t->translate + t->ssa + t->optimize + t->regalloc
+		+ t->assemble;
+}
+
+static void
+add_timings(struct of_shader_timings *sum,
+	    const struct of_shader_timings *t)
+{
+	sum->translate += t->translate;
+	sum->ssa += t->ssa;
+	sum->optimize += t->optimize;
+	sum->regalloc += t->regalloc;
+	sum->assemble += t->assemble;
+}
+
+static void
+print_header(void)
+{
+	printf("%-32s %4s %6s %6s %4s %5s %9s %9s %9s %9s %9s %9s\n",
+		"shader", "type", "instrs", "cycles", "regs", "imms",
+		"translate", "ssa", "optimize", "regalloc", "assemble",
+		"total");
+}
+
+static void
+print_row(const char *name, const char *type, unsigned num_instrs,
+	  unsigned num_cycles, unsigned num_regs, unsigned num_immediates,
+	  const struct of_shader_timings *t)
+{
+	printf("%-32s %4s %6u %6u %4u %5u %9lld %9lld %9lld %9lld %9lld %9lld\n",
+		name, type, num_instrs, num_cycles, num_regs, num_immediates,
+		(long long)t->translate, (long long)t->ssa,
+		(long long)t->optimize, (long long)t->regalloc,
+		(long long)t->assemble, (long long)total_time(t));
+}
+
+/*
+ * Compiles the program repeatedly and keeps timings of the fastest run,
+ * to filter out noise when tracking compile time.
+ */
+static int
+compile_program(struct of_shader_stateobj *so, unsigned repeat,
+		uint32_t **dwords)
+{
+	struct of_shader_timings best;
+	unsigned i;
+
+	memset(&best, 0, sizeof(best));
+
+	for (i = 0; i < repeat; ++i) {
+		int64_t start;
+		int ret;
+
+		FREE(*dwords);
+		*dwords = NULL;
+
+		ret = of_shader_compile(so);
+		if (ret)
+			return ret;
+
+		start = os_time_get();
+		ret = of_ir_generate_code_mem(NULL, so->ir, dwords,
+						&so->num_instrs);
+		if (ret)
+			return ret;
+		so->timings.assemble = os_time_get() - start;
+
+		if (!i || total_time(&so->timings) < total_time(&best))
+			best = so->timings;
+	}
+
+	so->timings = best;
+
+	return 0;
+}
+
+static int
+compile_file(const char *filename, const struct of_cmdline_options *opts,
+	     struct of_cmdline_totals *totals)
+{
+	struct tgsi_token toks[65536];
+	struct tgsi_parse_context parse;
+	struct of_shader_stateobj so;
+	uint32_t *dwords = NULL;
+	const char *type;
+	char *text;
+	int ret = -1;
+
+	++totals->num_shaders;
+
+	text = read_file(filename);
+	if (!text)
+		goto fail;
+
+	if (!tgsi_text_translate(text, toks, Elements(toks))) {
+		fprintf(stderr, "could not parse `%s'\n", filename);
+		goto fail;
+	}
+
+	memset(&so, 0, sizeof(so));
+	so.tokens = toks;
+	so.hash = of_hash_oneshot(toks,
+				tgsi_num_tokens(toks) * sizeof(toks[0]));
+
+	tgsi_parse_init(&parse, toks);
+	switch (parse.FullHeader.Processor.Processor) {
+	case TGSI_PROCESSOR_VERTEX:
+		so.type = OF_SHADER_VERTEX;
+		type = "VERT";
+		break;
+	case TGSI_PROCESSOR_FRAGMENT:
+		so.type = OF_SHADER_PIXEL;
+		type = "FRAG";
+		break;
+	default:
+		fprintf(stderr, "`%s' is not a vertex or fragment shader\n",
+			filename);
+		tgsi_parse_free(&parse);
+		goto fail;
+	}
+	tgsi_parse_free(&parse);
+
+	if (!opts->batch && (of_mesa_debug & OF_DBG_DISASM)) {
+		printf("%s: tgsi:\n", type);
+		tgsi_dump(toks, 0);
+	}
+
+	ret = compile_program(&so, opts->repeat, &dwords);
+	if (ret) {
+		fprintf(stderr, "`%s': compilation failed\n", filename);
+		goto fail_shader;
+	}
+
+	if (so.num_instrs > MAX_INSTRS) {
+		fprintf(stderr, "`%s': program too big (%u > %u)\n",
+			filename, so.num_instrs, MAX_INSTRS);
+		ret = -1;
+		goto fail_shader;
+	}
+
+	if (opts->binary) {
+		ret = write_binary(&so, dwords);
+		if (ret)
+			goto fail_shader;
+	}
+
+	if (opts->batch) {
+		print_row(filename, type, so.num_instrs,
+				so.ir->stats.num_cycles,
+				so.ir->stats.num_regs, so.num_immediates,
+				&so.timings);
+	} else {
+		if (!opts->quiet) {
+			printf("%s: disasm:\n", type);
+			fflush(stdout);
+			of_ir_disassemble(dwords, 4 * so.num_instrs, so.type);
+		}
+
+		printf("%s: %u instructions, %u cycles, %u registers, "
+			"%u immediates\n", type, so.num_instrs,
+			so.ir->stats.num_cycles, so.ir->stats.num_regs,
+			so.num_immediates);
+		print_header();
+		print_row(filename, type, so.num_instrs,
+				so.ir->stats.num_cycles,
+				so.ir->stats.num_regs, so.num_immediates,
+				&so.timings);
+	}
+
+	totals->num_instrs += so.num_instrs;
+	totals->num_cycles += so.ir->stats.num_cycles;
+	totals->num_regs += so.ir->stats.num_regs;
+	totals->num_immediates += so.num_immediates;
+	add_timings(&totals->timings, &so.timings);
+
+fail_shader:
+	FREE(dwords);
+	of_shader_destroy(&so);
+fail:
+	FREE(text);
+	if (ret)
+		++totals->num_failed;
+
+	return ret;
+}
+
+static void
+print_usage(void)
+{
+	printf("Usage: of_compiler [OPTIONS]... FILE...\n");
+	printf("    --verbose         - verbose compiler/debug messages\n");
+	printf("    --ast             - dump AST after each processing stage\n");
+	printf("    --tgsi            - dump input TGSI program\n");
+	printf("    --no-dce          - disable dead code elimination\n");
+	printf("    --no-cp           - disable copy propagation\n");
+	printf("    --no-sched        - disable instruction scheduling\n");
+	printf("    --quiet           - do not print disassembly\n");
+	printf("    --binary          - write {vs,fs}_XXXXXXXX.bin files for\n");
+	printf("                        OF_MESA_DEBUG=shadovr\n");
+	printf("    --batch           - compile all files, one line per shader\n");
+	printf("    --repeat N        - compile N times, report fastest run\n");
+	printf("    --help            - show this message\n");
+	printf("Times are given in microseconds.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct of_cmdline_options opts;
+	struct of_cmdline_totals totals;
+	int ret = 0, n = 1;
+
+	memset(&opts, 0, sizeof(opts));
+	memset(&totals, 0, sizeof(totals));
+	opts.repeat = 1;
+
+	while (n < argc) {
+		if (!strcmp(argv[n], "--verbose")) {
+			of_mesa_debug |= OF_DBG_MSGS;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--ast")) {
+			of_mesa_debug |= OF_DBG_AST_DUMP;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--tgsi")) {
+			of_mesa_debug |= OF_DBG_DISASM;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--no-dce")) {
+			of_mesa_debug |= OF_DBG_SHADER_NO_DCE;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--no-cp")) {
+			of_mesa_debug |= OF_DBG_SHADER_NO_CP;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--no-sched")) {
+			of_mesa_debug |= OF_DBG_SHADER_NO_SCHED;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--quiet")) {
+			opts.quiet = true;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--binary")) {
+			opts.binary = true;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--batch")) {
+			opts.batch = true;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--repeat") && n + 1 < argc) {
+			opts.repeat = MAX2(atoi(argv[n + 1]), 1);
+			n += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--help")) {
+			print_usage();
+			return 0;
+		}
+
+		break;
+	}
+
+	if (n == argc) {
+		print_usage();
+		return 1;
+	}
+
+	if (opts.batch)
+		print_header();
+
+	for (; n < argc; ++n)
+		if (compile_file(argv[n], &opts, &totals))
+			ret = 1;
+
+	if (opts.batch) {
+		unsigned compiled = totals.num_shaders - totals.num_failed;
+
+		print_row("total", "", totals.num_instrs, totals.num_cycles,
+				totals.num_regs, totals.num_immediates,
+				&totals.timings);
+		printf("%u shaders, %u failed", totals.num_shaders,
+			totals.num_failed);
+		if (compiled)
+			printf(", %.1f instructions, %.1f cycles, "
+				"%.1f registers and %.1f us per shader",
+				(double)totals.num_instrs / compiled,
+				(double)totals.num_cycles / compiled,
+				(double)totals.num_regs / compiled,
+				(double)total_time(&totals.timings) / compiled);
+		printf("\n");
+	}
+
+	return ret;
+}
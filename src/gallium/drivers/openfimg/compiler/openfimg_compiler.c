@@ -1734,6 +1734,7 @@ fail:
 static void
 compile_free(struct of_compile_context *ctx)
 {
+	util_hash_table_destroy(ctx->subroutine_ht);
 	of_stack_destroy(ctx->loop_stack);
 	tgsi_parse_free(&ctx->parser);
 	FREE(ctx);
@@ -1748,11 +1749,13 @@ of_shader_compile(struct of_shader_stateobj *so)
 {
 	struct of_compile_context *ctx;
 	unsigned ps_output_temp = 0;
-	int64_t start;
+	bool schedule = !(of_mesa_debug & OF_DBG_SHADER_NO_SCHED);
+	int64_t start, time;
 	int ret;
 
-	start = os_time_get();
+	start = time = os_time_get();
 
+retry:
 	of_ir_shader_destroy(so->ir);
 	so->ir = NULL;
 	FREE(so->immediates);
@@ -1809,24 +1812,46 @@ of_shader_compile(struct of_shader_stateobj *so)
 
 	compile_free(ctx);
 
+	so->timings.translate = os_time_get() - time;
+	time += so->timings.translate;
+
 	ret = of_ir_to_ssa(so->ir);
 	if (ret) {
 		ERROR_MSG("failed to create SSA form");
 		return -1;
 	}
 
-	ret = of_ir_optimize(so->ir);
+	so->timings.ssa = os_time_get() - time;
+	time += so->timings.ssa;
+
+	ret = of_ir_optimize(so->ir, schedule);
 	if (ret) {
 		ERROR_MSG("failed to optimize shader");
 		return -1;
 	}
 
+	so->timings.optimize = os_time_get() - time;
+	time += so->timings.optimize;
+
 	ret = of_ir_assign_registers(so->ir);
+	if (ret && schedule) {
+		/*
+		 * Scheduling can extend live ranges past what the register
+		 * file can hold. Compile the shader again in original order.
+		 */
+		DBG("register allocation of program %p failed, retrying without scheduling",
+			so);
+		schedule = false;
+		time = os_time_get();
+		goto retry;
+	}
 	if (ret) {
 		ERROR_MSG("failed to create executable form");
 		return -1;
 	}
 
+	so->timings.regalloc = os_time_get() - time;
+
 	DBG("compilation of program %p took %lld ms",
 		so, (os_time_get() - start) / 1000);
 
@@ -1857,6 +1882,7 @@ of_shader_assemble(struct of_context *ctx, struct of_shader_stateobj *so)
 	pipe_resource_reference(&so->buffer, NULL);
 	so->num_instrs = num_instrs;
 	so->buffer = buffer;
+	so->timings.assemble = os_time_get() - start;
 
 	DBG("assembly of program %p took %lld ms",
 		so, (os_time_get() - start) / 1000);
@@ -429,14 +429,15 @@ int of_ir_to_ssa(struct of_ir_shader *shader);
  * Performs optimization passes on intermediate representation of a program.
  * Requires the program to be in SSA form. Keeps the program in SSA form.
  * @param shader A shader object to optimize.
+ * @param sched True if instructions should be scheduled.
  * @return Zero on success, non-zero on failure.
  */
-int of_ir_optimize(struct of_ir_shader *shader);
+int of_ir_optimize(struct of_ir_shader *shader, bool sched);
 /**
  * Assigns registers to variables used in a program.
  * Requires the program to be in SSA form. Destroys SSA form of the program.
  * @param shader A shader object to assign registers in.
- * @return Zero on succees, non-zero on failure.
+ * @return Zero on succees, non-zero on failure (e.g. out of registers).
  */
 int of_ir_assign_registers(struct of_ir_shader *shader);
 /**
@@ -451,5 +452,27 @@ int of_ir_assign_registers(struct of_ir_shader *shader);
  */
 int of_ir_generate_code(struct of_context *ctx, struct of_ir_shader *shader,
 			struct pipe_resource **buffer, unsigned *num_instrs);
+/**
+ * Generates binary code from intermediate representation of a program
+ * into system memory, without the need for a GPU buffer.
+ * @param ctx Driver's pipe context or NULL. Without a context texture
+ * swizzles are not patched into the code.
+ * @param shader A shader object containing the program to generate code from.
+ * @param dwords Output pointer to store newly allocated code to. Must be
+ * freed by the caller with FREE().
+ * @param num_instrs Pointer to variable to which resulting number of
+ * instructions should be stored.
+ * @return Zero on succees, non-zero on failure.
+ */
+int of_ir_generate_code_mem(struct of_context *ctx, struct of_ir_shader *shader,
+			    uint32_t **dwords, unsigned *num_instrs);
+/**
+ * Disassembles binary code and prints the output to debugging output.
+ * @param dwords Binary code to disassemble.
+ * @param num_dwords Size of binary code in 32-bit words.
+ * @param type Target shader unit of specified binary code.
+ */
+void of_ir_disassemble(uint32_t *dwords, unsigned num_dwords,
+		       enum of_shader_type type);
 
 #endif /* OF_IR_H_ */
@@ -101,6 +101,10 @@ struct of_ir_optimizer {
 	struct of_stack *maps_stack;		/**< Stack of copy propagation maps. */
 	struct of_ir_var_map *maps;		/**< Current copy propagation map. */
 
+	/* Fields used by scheduler. */
+	uint16_t *sched_uses;			/**< Remaining uses of each variable. */
+	uint16_t *sched_defs;			/**< Index of defining instruction in list plus one. */
+
 	/* Fields used by register allocator. */
 	struct util_slab_mempool valset_slab;	/**< Memory pool for value sets. */
 	struct util_slab_mempool chunk_slab;	/**< Memory pool for coalescer chunks. */
@@ -114,6 +118,7 @@ struct of_ir_optimizer {
 	struct util_dynarray chunk_queue;	/**< Sorted array of coalescer chunks. */
 	unsigned chunk_queue_len;		/**< Number of chunks in chunk_queue. */
 	unsigned parity :1;			/**< Current parity for round robin assignment. */
+	unsigned out_of_regs :1;		/**< True if a variable could not be colored. */
 };
 
 /**
@@ -248,6 +253,8 @@ struct of_ir_shader {
 	struct {
 		unsigned num_vars;	/**< Number of variables in program. */
 		unsigned num_instrs;	/**< Number of instructions in program. */
+		unsigned num_regs;	/**< Number of temporary registers used. */
+		unsigned num_cycles;	/**< Estimated execution time in cycles. */
 	} stats; /**< Statistics for various purposes. */
 
 	/** Register type information array specific for this shader. */
@@ -411,4 +418,40 @@ reg_comp_used(struct of_ir_register *reg, unsigned comp)
 	return reg->mask & BIT(comp);
 }
 
+/*
+ * Instruction helpers.
+ */
+
+/** Estimated result latency of simple arithmetic operations. */
+#define OF_IR_LATENCY_ALU	1
+/** Estimated result latency of exponential, logarithm and reciprocals. */
+#define OF_IR_LATENCY_SFU	4
+/** Estimated result latency of texture sampling. */
+#define OF_IR_LATENCY_TEX	8
+
+/**
+ * Estimates number of cycles after which result of an instruction can be
+ * used by following instructions.
+ * @param ins Instruction object.
+ * @return Estimated result latency in cycles.
+ */
+static INLINE unsigned
+instr_latency(struct of_ir_instruction *ins)
+{
+	switch (ins->opc) {
+	case OF_OP_TEXLD:
+	case OF_OP_TEXLDC:
+		return OF_IR_LATENCY_TEX;
+	case OF_OP_EXP:
+	case OF_OP_EXP_LIT:
+	case OF_OP_LOG:
+	case OF_OP_LOG_LIT:
+	case OF_OP_RCP:
+	case OF_OP_RSQ:
+		return OF_IR_LATENCY_SFU;
+	default:
+		return OF_IR_LATENCY_ALU;
+	}
+}
+
 #endif /* OF_IR_PRIV_H_ */
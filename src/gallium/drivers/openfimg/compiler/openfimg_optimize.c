@@ -624,6 +624,372 @@ src_propagation(struct of_ir_optimizer *opt, struct of_ir_ast_node *node)
 	}
 }
 
+/*
+ * List scheduling of instructions inside list nodes.
+ *
+ * Instructions are reordered according to dependencies between SSA
+ * variables, so that results of long latency operations, like texture
+ * sampling, are consumed as late as possible. When too many variables
+ * become alive, instructions ending live ranges are preferred instead to
+ * keep register pressure low. Instructions accessing registers other
+ * than variables keep their original order.
+ */
+
+/*
+ * Number of live scalar variables above which pressure is reduced. Half of
+ * temporary registers, to leave room for variables alive at list entry.
+ */
+#define OF_IR_SCHED_MAX_LIVE	(16 * OF_IR_VEC_SIZE)
+
+struct of_ir_sched_node {
+	struct of_ir_instruction *ins;	/**< Instruction to schedule. */
+	unsigned num_preds;		/**< Number of unscheduled predecessors. */
+	unsigned ready;			/**< Cycle when all operands are ready. */
+	unsigned height;		/**< Stall cycles of path to list end. */
+	unsigned latency;		/**< Latency of instruction result. */
+	bool scheduled;			/**< True if already scheduled. */
+};
+
+struct of_ir_scheduler {
+	struct of_ir_ast_node *list;	/**< List node being scheduled. */
+	struct of_ir_sched_node *nodes;	/**< Array of list instructions. */
+	unsigned num_nodes;		/**< Number of list instructions. */
+	uint32_t *deps;			/**< Bitmap of dependencies. */
+	unsigned cycle;			/**< Current cycle. */
+	unsigned live;			/**< Number of live variables. */
+};
+
+static bool
+sched_ordered(struct of_ir_optimizer *opt, struct of_ir_instruction *ins)
+{
+	const struct of_ir_opc_info *info = of_ir_get_opc_info(ins->opc);
+	unsigned i;
+
+	if (info->type != OF_IR_ALU)
+		return true;
+
+	if (!ins->dst || ins->dst->type != OF_IR_REG_VAR)
+		return true;
+
+	for (i = 0; i < ins->num_srcs; ++i) {
+		struct of_ir_register *src = ins->srcs[i];
+
+		if (src->type != OF_IR_REG_VAR
+		    && of_ir_get_reg_info(opt->shader, src->type)->writable)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+sched_add_dep(struct of_ir_scheduler *sched, unsigned pred, unsigned succ)
+{
+	unsigned bit = succ * sched->num_nodes + pred;
+
+	if (of_bitmap_get(sched->deps, bit))
+		return;
+
+	of_bitmap_set(sched->deps, bit);
+	++sched->nodes[succ].num_preds;
+}
+
+static void
+sched_build_deps(struct of_ir_optimizer *opt, struct of_ir_scheduler *sched)
+{
+	unsigned last_ordered = 0;
+	unsigned i, j, comp;
+
+	for (i = 0; i < sched->num_nodes; ++i) {
+		struct of_ir_sched_node *node = &sched->nodes[i];
+		struct of_ir_instruction *ins = node->ins;
+
+		for (j = 0; j < ins->num_srcs; ++j) {
+			struct of_ir_register *src = ins->srcs[j];
+
+			if (src->type != OF_IR_REG_VAR)
+				continue;
+
+			for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp) {
+				uint16_t def;
+
+				if (!reg_comp_used(src, comp)
+				    || !src->var[comp])
+					continue;
+
+				def = opt->sched_defs[src->var[comp]];
+				if (def)
+					sched_add_dep(sched, def - 1, i);
+			}
+		}
+
+		if (sched_ordered(opt, ins)) {
+			if (last_ordered)
+				sched_add_dep(sched, last_ordered - 1, i);
+			last_ordered = i + 1;
+		}
+
+		if (!ins->dst || ins->dst->type != OF_IR_REG_VAR)
+			continue;
+
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp) {
+			if (!reg_comp_used(ins->dst, comp))
+				continue;
+
+			opt->sched_defs[ins->dst->var[comp]] = i + 1;
+		}
+	}
+
+	/* Heights can be computed in reverse order, because successors
+	 * always follow their predecessors in original order. Only latency
+	 * exceeding a single cycle is counted, so chains of simple arithmetic
+	 * keep their original order, which is usually the best for pressure. */
+	for (i = sched->num_nodes; i-- > 0;) {
+		struct of_ir_sched_node *node = &sched->nodes[i];
+		unsigned row = i * sched->num_nodes;
+
+		for (j = 0; j < i; ++j) {
+			struct of_ir_sched_node *pred = &sched->nodes[j];
+
+			if (!of_bitmap_get(sched->deps, row + j))
+				continue;
+
+			pred->height = max(pred->height, node->height
+					+ pred->latency - OF_IR_LATENCY_ALU);
+		}
+	}
+}
+
+static int
+sched_pressure_delta(struct of_ir_optimizer *opt,
+		     struct of_ir_instruction *ins)
+{
+	int delta = 0;
+	unsigned i, comp;
+
+	if (ins->dst && ins->dst->type == OF_IR_REG_VAR)
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+			if (reg_comp_used(ins->dst, comp))
+				++delta;
+
+	for (i = 0; i < ins->num_srcs; ++i) {
+		struct of_ir_register *src = ins->srcs[i];
+
+		if (src->type != OF_IR_REG_VAR)
+			continue;
+
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+			if (reg_comp_used(src, comp) && src->var[comp]
+			    && opt->sched_uses[src->var[comp]] == 1)
+				--delta;
+	}
+
+	return delta;
+}
+
+static bool
+sched_better(struct of_ir_optimizer *opt, struct of_ir_scheduler *sched,
+	     struct of_ir_sched_node *a, struct of_ir_sched_node *b)
+{
+	bool a_avail = a->ready <= sched->cycle;
+	bool b_avail = b->ready <= sched->cycle;
+	int a_delta, b_delta;
+
+	/* Avoid the NOP needed by lists starting with 3-source operations. */
+	if (!sched->cycle
+	    && (a->ins->num_srcs == 3) != (b->ins->num_srcs == 3))
+		return b->ins->num_srcs == 3;
+
+	if (a_avail != b_avail)
+		return a_avail;
+
+	if (!a_avail && a->ready != b->ready)
+		return a->ready < b->ready;
+
+	a_delta = sched_pressure_delta(opt, a->ins);
+	b_delta = sched_pressure_delta(opt, b->ins);
+
+	if (sched->live >= OF_IR_SCHED_MAX_LIVE && a_delta != b_delta)
+		return a_delta < b_delta;
+
+	return a->height > b->height;
+}
+
+static void
+sched_issue(struct of_ir_optimizer *opt, struct of_ir_scheduler *sched,
+	    unsigned index)
+{
+	struct of_ir_sched_node *node = &sched->nodes[index];
+	struct of_ir_instruction *ins = node->ins;
+	int delta = sched_pressure_delta(opt, ins);
+	unsigned i, comp;
+
+	sched->cycle = max(sched->cycle, node->ready);
+	node->scheduled = true;
+
+	for (i = index + 1; i < sched->num_nodes; ++i) {
+		struct of_ir_sched_node *succ = &sched->nodes[i];
+
+		if (!of_bitmap_get(sched->deps, i * sched->num_nodes + index))
+			continue;
+
+		succ->ready = max(succ->ready, sched->cycle + node->latency);
+		--succ->num_preds;
+	}
+
+	if (delta < 0 && (unsigned)-delta > sched->live)
+		sched->live = 0;
+	else
+		sched->live += delta;
+
+	for (i = 0; i < ins->num_srcs; ++i) {
+		struct of_ir_register *src = ins->srcs[i];
+
+		if (src->type != OF_IR_REG_VAR)
+			continue;
+
+		for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+			if (reg_comp_used(src, comp) && src->var[comp]
+			    && opt->sched_uses[src->var[comp]])
+				--opt->sched_uses[src->var[comp]];
+	}
+
+	list_del(&ins->list);
+	list_addtail(&ins->list, &sched->list->list.instrs);
+	++sched->cycle;
+}
+
+static void
+schedule_list(struct of_ir_optimizer *opt, struct of_ir_ast_node *node)
+{
+	struct of_ir_scheduler sched;
+	struct of_ir_instruction *ins;
+	unsigned i, count;
+
+	memset(&sched, 0, sizeof(sched));
+	sched.list = node;
+
+	LIST_FOR_EACH_ENTRY(ins, &node->list.instrs, list)
+		++sched.num_nodes;
+
+	if (!sched.num_nodes)
+		return;
+
+	sched.nodes = CALLOC(sched.num_nodes, sizeof(*sched.nodes));
+	sched.deps = CALLOC(1, OF_BITMAP_BYTES_FOR_BITS(sched.num_nodes
+							* sched.num_nodes));
+	if (!sched.nodes || !sched.deps) {
+		DBG("failed to allocate scheduler data");
+		goto out;
+	}
+
+	i = 0;
+	LIST_FOR_EACH_ENTRY(ins, &node->list.instrs, list) {
+		sched.nodes[i].ins = ins;
+		sched.nodes[i].latency = instr_latency(ins);
+		sched.nodes[i].height = sched.nodes[i].latency
+						- OF_IR_LATENCY_ALU;
+		++i;
+	}
+
+	sched_build_deps(opt, &sched);
+
+	/* Instructions are moved to the tail of the list once scheduled. */
+	for (count = 0; count < sched.num_nodes; ++count) {
+		struct of_ir_sched_node *best = NULL;
+
+		for (i = 0; i < sched.num_nodes; ++i) {
+			struct of_ir_sched_node *cur = &sched.nodes[i];
+
+			if (cur->scheduled || cur->num_preds)
+				continue;
+
+			if (!best || sched_better(opt, &sched, cur, best))
+				best = cur;
+		}
+
+		assert(best);
+		sched_issue(opt, &sched, best - sched.nodes);
+	}
+
+out:
+	LIST_FOR_EACH_ENTRY(ins, &node->list.instrs, list) {
+		if (!ins->dst || ins->dst->type != OF_IR_REG_VAR)
+			continue;
+
+		for (i = 0; i < OF_IR_VEC_SIZE; ++i)
+			if (reg_comp_used(ins->dst, i))
+				opt->sched_defs[ins->dst->var[i]] = 0;
+	}
+
+	FREE(sched.deps);
+	FREE(sched.nodes);
+}
+
+static void
+schedule(struct of_ir_optimizer *opt, struct of_ir_ast_node *node)
+{
+	struct of_ir_ast_node *child;
+
+	if (node->type == OF_IR_NODE_LIST)
+		return schedule_list(opt, node);
+
+	LIST_FOR_EACH_ENTRY(child, &node->nodes, parent_list)
+		schedule(opt, child);
+}
+
+static void
+count_uses_reg(struct of_ir_optimizer *opt, struct of_ir_register *reg)
+{
+	unsigned comp;
+
+	if (!reg || reg->type != OF_IR_REG_VAR)
+		return;
+
+	for (comp = 0; comp < OF_IR_VEC_SIZE; ++comp)
+		if (reg_comp_used(reg, comp) && reg->var[comp])
+			++opt->sched_uses[reg->var[comp]];
+}
+
+static void
+count_uses_phis(struct of_ir_optimizer *opt, struct list_head *phis,
+		unsigned count)
+{
+	struct of_ir_phi *phi;
+	unsigned i;
+
+	LIST_FOR_EACH_ENTRY(phi, phis, list)
+		for (i = 0; i < count; ++i)
+			++opt->sched_uses[phi->src[i]];
+}
+
+static void
+count_uses(struct of_ir_optimizer *opt, struct of_ir_ast_node *node)
+{
+	struct of_ir_ast_node *child;
+	struct of_ir_instruction *ins;
+	unsigned i;
+
+	switch (node->type) {
+	case OF_IR_NODE_LIST:
+		LIST_FOR_EACH_ENTRY(ins, &node->list.instrs, list)
+			for (i = 0; i < ins->num_srcs; ++i)
+				count_uses_reg(opt, ins->srcs[i]);
+		return;
+	case OF_IR_NODE_IF_THEN:
+		count_uses_reg(opt, node->if_then.reg);
+		break;
+	default:
+		break;
+	}
+
+	LIST_FOR_EACH_ENTRY(child, &node->nodes, parent_list)
+		count_uses(opt, child);
+
+	count_uses_phis(opt, &node->ssa.loop_phis, node->ssa.repeat_count + 1);
+	count_uses_phis(opt, &node->ssa.phis, node->ssa.depart_count);
+}
+
 /*
  * Optimize-specific data dumping.
  * TODO: Probably some code could be shared with register allocation.
@@ -697,7 +1063,7 @@ dump_opt_data(struct of_ir_shader *shader, struct of_ir_ast_node *node,
  */
 
 int
-of_ir_optimize(struct of_ir_shader *shader)
+of_ir_optimize(struct of_ir_shader *shader, bool sched)
 {
 	struct of_ir_optimizer *opt;
 	struct of_heap *heap;
@@ -730,6 +1096,19 @@ of_ir_optimize(struct of_ir_shader *shader)
 	RUN_PASS(shader, opt, cleanup);
 	RUN_PASS(shader, opt, validate);
 
+	if (sched) {
+		opt->sched_uses = CALLOC(opt->num_vars,
+						sizeof(*opt->sched_uses));
+		opt->sched_defs = CALLOC(opt->num_vars,
+						sizeof(*opt->sched_defs));
+		if (opt->sched_uses && opt->sched_defs) {
+			RUN_PASS(shader, opt, count_uses);
+			RUN_PASS(shader, opt, schedule);
+		}
+		FREE(opt->sched_defs);
+		FREE(opt->sched_uses);
+	}
+
 	OF_IR_DUMP_AST(shader, dump_opt_data, opt, "post-optimize");
 
 	shader->stats.num_vars = opt->num_vars;
@@ -39,6 +39,15 @@ struct of_shader_semantic {
 	unsigned row	:8;	/**< Index of attribute inside the same semantic */
 };
 
+/** Time spent in compilation stages of a program, in microseconds. */
+struct of_shader_timings {
+	int64_t translate;	/**< TGSI to IR translation. */
+	int64_t ssa;		/**< Conversion to SSA form. */
+	int64_t optimize;	/**< Optimization passes. */
+	int64_t regalloc;	/**< Register assignment. */
+	int64_t assemble;	/**< Binary code generation. */
+};
+
 /** Structure containing shader state object for driver's pipe context. */
 struct of_shader_stateobj {
 	struct of_cso cso;
@@ -64,6 +73,9 @@ struct of_shader_stateobj {
 	/** Array of shader output semantics. */
 	struct of_shader_semantic out_semantics[OF_MAX_ATTRIBS];
 	unsigned num_outputs;	/**< Number of outputs. */
+
+	/** Compilation statistics of last (re)compilation. */
+	struct of_shader_timings timings;
 };
 
 /** Shader program header as generated by proprietary shader compiler. */
@@ -583,7 +583,7 @@ dump_chunk_queue(struct of_ir_optimizer *opt)
 	}
 }
 
-static void
+static int
 color_chunks(struct of_ir_optimizer *opt)
 {
 	struct of_ir_chunk **array = util_dynarray_begin(&opt->chunk_queue);
@@ -617,25 +617,31 @@ color_chunks(struct of_ir_optimizer *opt)
 			}
 		}
 
-		DBG("out of registers?");
-		assert(0);
+		DBG("out of registers");
+		return -1;
 
 done:
 		color_chunk(opt, c, color);
 	}
+
+	return 0;
 }
 
-static void
+static int
 precolor(struct of_ir_optimizer *opt)
 {
+	int ret;
+
 	prepare_chunks(opt);
 	VERBOSE(dump_chunks(opt));
 	prepare_constraints(opt);
 	VERBOSE(dump_constraints(opt));
-	color_constraints(opt);
+	ret = color_constraints(opt);
+	if (ret)
+		return ret;
 	prepare_chunk_queue(opt);
 	VERBOSE(dump_chunk_queue(opt));
-	color_chunks(opt);
+	return color_chunks(opt);
 }
 
 static struct of_ir_constraint *
@@ -1207,7 +1213,12 @@ color_var(struct of_ir_optimizer *opt, struct of_ir_variable *v)
 			break;
 	}
 
-	assert(color != -1U && "color failed");
+	if (color == -1U) {
+		DBG("out of registers");
+		opt->out_of_regs = 1;
+		return;
+	}
+
 	v->color = color;
 }
 
@@ -1523,6 +1534,7 @@ of_ir_assign_registers(struct of_ir_shader *shader)
 {
 	struct of_ir_optimizer *opt;
 	struct of_heap *heap;
+	int ret = 0;
 
 	heap = of_heap_create();
 	opt = of_heap_alloc(heap, sizeof(*opt));
@@ -1566,15 +1578,23 @@ of_ir_assign_registers(struct of_ir_shader *shader)
 	util_dynarray_init(&opt->chunk_queue);
 	util_slab_create(&opt->chunk_slab, sizeof(struct of_ir_chunk),
 				32, UTIL_SLAB_SINGLETHREADED);
-	precolor(opt);
+	ret = precolor(opt);
+	if (ret)
+		goto fail;
 	RUN_PASS(shader, opt, assign_colors);
 	OF_IR_DUMP_AST_VERBOSE(shader, NULL, 0, "post-color-assignment");
+	if (opt->out_of_regs) {
+		ret = -1;
+		goto fail;
+	}
 
 	RUN_PASS(shader, opt, copy_elimination);
 	OF_IR_DUMP_AST(shader, NULL, 0, "post-copy-elimination");
 
 	RUN_PASS(shader, opt, assign_registers);
 
+fail:
+	util_dynarray_fini(&opt->chunk_queue);
 	util_dynarray_fini(&opt->vars);
 	util_dynarray_fini(&opt->affinities);
 	util_dynarray_fini(&opt->constraints);
@@ -1582,5 +1602,5 @@ of_ir_assign_registers(struct of_ir_shader *shader)
 	util_slab_destroy(&opt->valset_slab);
 	of_heap_destroy(heap);
 
-	return 0;
+	return ret;
 }
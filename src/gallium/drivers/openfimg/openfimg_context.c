@@ -125,10 +125,6 @@ of_context_render(struct pipe_context *pctx)
 
 	ctx->dirty |= OF_DIRTY_FRAMEBUFFER | OF_DIRTY_VERTTEX
 			| OF_DIRTY_FRAGTEX;
-
-	++ctx->draw_ticks;
-	if (!(ctx->draw_ticks % 8))
-		of_draw_cache_gc(ctx);
 }
 
 static void
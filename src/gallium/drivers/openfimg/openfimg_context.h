@@ -65,6 +65,7 @@ struct of_vertexbuf_stateobj {
 	unsigned count;
 	uint32_t enabled_mask;
 	uint32_t dirty_mask;
+	uint32_t direct_mask;	/* buffers backed by a BO */
 };
 
 struct of_framebuffer_stateobj {
@@ -89,8 +90,21 @@ struct of_context {
 	struct cso_hash *draw_hash;
 	struct cso_hash *draw_hash_direct;
 	struct list_head draw_lru;
-	unsigned draw_ticks;
 	unsigned draw_cache_entries;
+	unsigned draw_cache_size;
+
+	/* draw path statistics, printed with OF_MESA_DEBUG=stats */
+	struct {
+		unsigned draws_direct;
+		unsigned draws_repacked;
+		unsigned repack_layout;		/* incompatible layout */
+		unsigned repack_user;		/* user vertex buffers */
+		unsigned repack_indices;	/* weak index locality */
+		unsigned cache_hits;
+		unsigned cache_misses;
+		unsigned cache_evictions;
+		uint64_t bytes_repacked;
+	} stats;
 
 	struct util_slab_mempool transfer_pool;
 
@@ -48,6 +48,9 @@
 
 #include <stdlib.h>
 
+/* Memory budget of the draw cache in bytes. */
+DEBUG_GET_ONCE_NUM_OPTION(draw_cache_size, "OF_DRAW_CACHE_SIZE", 8 << 20)
+
 static const float clear_vertices[] = {
 	+1.0f, +1.0f, +1.0f, // RT
 	-1.0f, +1.0f, +1.0f, // LT
@@ -303,6 +306,38 @@ of_build_vertex_data_repack(struct of_context *ctx,
 	}
 }
 
+/*
+ * Charges the entry and the buffers it holds to the draw cache budget.
+ * Buffers of entries bypassing the cache are released right after the
+ * draw, so only the entry itself is charged for them.
+ */
+static void
+of_draw_cache_account(struct of_context *ctx, struct of_vertex_info *vertex)
+{
+	struct pipe_resource *last = NULL;
+	struct of_vertex_buffer *buf;
+	unsigned size = sizeof(*vertex);
+
+	LIST_FOR_EACH_ENTRY(buf, &vertex->buffers, list) {
+		if (buf->cmd == G3D_REQUEST_VERTEX_BUFFER && !buf->direct)
+			ctx->stats.bytes_repacked += buf->length;
+
+		if (vertex->bypass_cache)
+			continue;
+
+		size += sizeof(*buf);
+
+		/* Batches sharing a buffer are always consecutive. */
+		if (buf->buffer && buf->buffer != last) {
+			size += buf->buffer->width0;
+			last = buf->buffer;
+		}
+	}
+
+	ctx->draw_cache_size += size - vertex->size;
+	vertex->size = size;
+}
+
 static void
 of_build_vertex_data(struct of_context *ctx, struct of_vertex_info *vertex)
 {
@@ -311,11 +346,16 @@ of_build_vertex_data(struct of_context *ctx, struct of_vertex_info *vertex)
 	const struct of_vertex_stateobj *vtx = draw->base.vtx;
 	const struct of_vertex_transfer *transfer;
 	struct pipe_transfer *ib_transfer = NULL;
+	struct of_vertex_buffer *buf, *tmp;
 	struct of_vertex_data vdata;
 	const void *indices = NULL;
 	bool primconvert = false;
 	unsigned i;
 
+	/* Drop data built from previous contents of the buffers. */
+	LIST_FOR_EACH_ENTRY_SAFE(buf, tmp, &vertex->buffers, list)
+		of_put_batch_buffer(ctx, buf);
+
 	if (!of_supported_prim(ctx, draw->base.info.mode)) {
 		of_primconvert_run(ctx, vertex);
 		primconvert = true;
@@ -327,7 +367,7 @@ of_build_vertex_data(struct of_context *ctx, struct of_vertex_info *vertex)
 	if (draw->base.info.indexed && draw->ib.buffer) {
 		struct of_resource *rsc = of_resource(draw->ib.buffer);
 
-		vertex->ib_version = rsc->version;
+		vertex->ib_generation = rsc->generation;
 	}
 
 	if (vertex->indexed) {
@@ -349,7 +389,7 @@ of_build_vertex_data(struct of_context *ctx, struct of_vertex_info *vertex)
 		if (vb->buffer) {
 			struct of_resource *rsc = of_resource(vb->buffer);
 
-			vertex->vb_version[buf_idx] = rsc->version;
+			vertex->vb_generation[buf_idx] = rsc->generation;
 		}
 	}
 
@@ -369,28 +409,16 @@ of_build_vertex_data(struct of_context *ctx, struct of_vertex_info *vertex)
 		/* Slow path fallback - full vertex data reordering. */
 		of_build_vertex_data_repack(ctx, &vdata, indices);
 		vertex->direct = false;
-	}
 
-	if (vertex->direct) {
-		for (i = 0; i < draw->base.vtx->num_transfers; ++i)
-			pipe_resource_reference(&vertex->rscs[i], NULL);
-	} else {
-		transfer = draw->base.vtx->transfers;
-		for (i = 0; i < draw->base.vtx->num_transfers;
-		     ++i, ++transfer) {
-			unsigned pipe_idx = transfer->vertex_buffer_index;
-			unsigned buf_idx = vtx->vb_map[pipe_idx];
-			const struct pipe_vertex_buffer *vb
-							= &draw->vb[buf_idx];
-
-			pipe_resource_reference(&vertex->rscs[i], vb->buffer);
-		}
+		if (draw->direct)
+			++ctx->stats.repack_indices;
+		else if (draw->user_vb)
+			++ctx->stats.repack_user;
+		else
+			++ctx->stats.repack_layout;
 	}
 
-	for (; i < OF_MAX_ATTRIBS; ++i)
-		pipe_resource_reference(&vertex->rscs[i], NULL);
-
-	pipe_resource_reference(&vertex->rscs[OF_MAX_ATTRIBS], ib->buffer);
+	of_draw_cache_account(ctx, vertex);
 
 	if (primconvert)
 		of_primconvert_release(ctx, vertex);
@@ -423,7 +451,7 @@ static struct of_vertex_info *of_create_vertex_info(struct of_context *ctx,
 	}
 
 	LIST_INITHEAD(&vertex->lru_list);
-	vertex->first_draw = true;
+	LIST_INITHEAD(&vertex->buffers);
 	vertex->bypass_cache = bypass_cache;
 	vertex->draw_mode = ctx->primtypes[vertex->mode];
 	OF_CSO_GET(&draw->base.vtx->cso);
@@ -431,6 +459,7 @@ static struct of_vertex_info *of_create_vertex_info(struct of_context *ctx,
 
 	of_build_vertex_data(ctx, vertex);
 
+	vertex->hashed_direct = vertex->direct;
 	if (vertex->direct) {
 		hash_key = of_draw_hash_direct(&vertex->key);
 		cso_hash_insert(ctx->draw_hash_direct, hash_key, vertex);
@@ -445,44 +474,43 @@ static struct of_vertex_info *of_create_vertex_info(struct of_context *ctx,
 static void
 of_destroy_vertex_info(struct of_context *ctx, struct of_vertex_info *vertex)
 {
-	const struct of_draw_info *draw = &vertex->key;
 	struct of_vertex_buffer *buffer, *s;
-	int i;
 
 	OF_CSO_PUT(ctx, &vertex->key.base.vtx->cso);
 
-	for (i = 0; i < draw->base.vtx->num_transfers; ++i)
-		pipe_resource_reference(&vertex->rscs[i], NULL);
-
-	pipe_resource_reference(&vertex->rscs[OF_MAX_ATTRIBS], NULL);
-
 	LIST_FOR_EACH_ENTRY_SAFE(buffer, s, &vertex->buffers, list) {
 		pipe_resource_reference(&buffer->buffer, NULL);
 		FREE(buffer);
 	}
 
 	list_del(&vertex->lru_list);
+	ctx->draw_cache_size -= vertex->size;
 	FREE(vertex);
 	--ctx->draw_cache_entries;
 }
 
-void
-of_draw_cache_gc(struct of_context *ctx)
+/*
+ * Evicts least recently used entries until the cache fits in its memory
+ * budget. The entry used by current draw is the most recently used one
+ * and is never evicted.
+ */
+static void
+of_draw_cache_trim(struct of_context *ctx)
 {
+	unsigned budget = debug_get_option_draw_cache_size();
 	struct of_vertex_info *vertex, *s;
 	unsigned removed = 0;
 
-	VDBG("Draw cache GC invoked...");
-
 	LIST_FOR_EACH_ENTRY_SAFE(vertex, s, &ctx->draw_lru, lru_list) {
 		struct cso_hash_iter iter;
 		struct cso_hash *hash;
 		unsigned key;
 
-		if (ctx->draw_ticks - vertex->last_use < 32)
+		if (ctx->draw_cache_size <= budget
+		    || vertex->lru_list.next == &ctx->draw_lru)
 			break;
 
-		if (vertex->direct) {
+		if (vertex->hashed_direct) {
 			hash = ctx->draw_hash_direct;
 			key = of_draw_hash_direct(&vertex->key);
 		} else {
@@ -491,11 +519,9 @@ of_draw_cache_gc(struct of_context *ctx)
 		}
 
 		iter = cso_hash_find(hash, key);
-		while (!cso_hash_iter_is_null(iter)) {
-			if (cso_hash_iter_key(iter) != key
-			|| cso_hash_iter_data(iter) == vertex)
-				break;
-		}
+		while (!cso_hash_iter_is_null(iter)
+		       && cso_hash_iter_data(iter) != vertex)
+			iter = cso_hash_iter_next(iter);
 		assert(cso_hash_iter_data(iter) == vertex);
 		cso_hash_erase(hash, iter);
 
@@ -504,8 +530,10 @@ of_draw_cache_gc(struct of_context *ctx)
 		++removed;
 	}
 
-	VDBG("Removed %u/%u cache entries", removed,
-		ctx->draw_cache_entries + removed);
+	ctx->stats.cache_evictions += removed;
+
+	VDBG("Evicted %u/%u cache entries, %u bytes left", removed,
+		ctx->draw_cache_entries + removed, ctx->draw_cache_size);
 }
 
 /*
@@ -596,11 +624,9 @@ of_emit_draw(struct of_context *ctx, struct of_vertex_info *info,
 		OUT_RING(ring, buf->ctrl_dst_offset);
 		END_PKT(ring, pkt);
 
-		if (info->first_draw || info->bypass_cache)
+		if (info->bypass_cache)
 			of_put_batch_buffer(ctx, buf);
 	}
-
-	info->first_draw = false;
 }
 
 static void
@@ -640,8 +666,8 @@ of_draw(struct of_context *ctx, const struct pipe_draw_info *info)
 		draw->base.vtx = ctx->cso.vtx;
 		draw->base.num_vb = vtx->num_vb;
 		draw->base.vb_mask = vtx->vb_mask;
-		draw->user_vb = false;
-		draw->direct = !vtx->ugly;
+		draw->user_vb = !!(vtx->vb_mask & ~vertexbuf->direct_mask);
+		draw->direct = !vtx->ugly && !draw->user_vb;
 
 		transfer = draw->base.vtx->transfers;
 		for (i = 0; i < draw->base.vtx->num_transfers; ++i, ++transfer) {
@@ -652,14 +678,10 @@ of_draw(struct of_context *ctx, const struct pipe_draw_info *info)
 				sizeof(vertexbuf->vb[pipe_idx]));
 			draw->vb_strides[buf_idx] =
 				vertexbuf->vb[pipe_idx].stride;
-			if (!draw->vb[buf_idx].buffer)
-				draw->user_vb = true;
-			if (draw->vb[buf_idx].stride != ROUND_UP(transfer->width, 4))
+			if (draw->vb[buf_idx].stride
+			    != vtx->direct_strides[buf_idx])
 				draw->direct = false;
 		}
-
-		if (draw->user_vb)
-			draw->direct = false;
 	}
 
 	memcpy(&draw->base.info, info, sizeof(draw->base.info));
@@ -685,15 +707,14 @@ of_draw(struct of_context *ctx, const struct pipe_draw_info *info)
 		bool cached = !LIST_IS_EMPTY(&vertex->buffers)
 				&& !vertex->bypass_cache;
 
-		if (cached && !direct) {
+		/* Only repacked data depends on vertex buffer contents. */
+		if (cached && !vertex->direct) {
 			for (i = 0; i < draw->base.num_vb; ++i) {
 				struct pipe_resource *prsc = draw->vb[i].buffer;
 				struct of_resource *rsc = of_resource(prsc);
 
-				if (vertex->vb_version[i] != rsc->version) {
+				if (vertex->vb_generation[i] != rsc->generation)
 					cached = false;
-					vertex->first_draw = true;
-				}
 			}
 		}
 
@@ -701,23 +722,38 @@ of_draw(struct of_context *ctx, const struct pipe_draw_info *info)
 			struct pipe_resource *prsc = draw->ib.buffer;
 			struct of_resource *rsc = of_resource(prsc);
 
-			if (vertex->ib_version != rsc->version) {
+			if (vertex->ib_generation != rsc->generation)
 				cached = false;
-				vertex->first_draw = true;
-			}
 		}
 
-		if (!cached)
+		if (cached) {
+			++ctx->stats.cache_hits;
+		} else {
+			/*
+			 * Buffers of a direct lookup match may differ from
+			 * the ones the entry was built from, but the hashed
+			 * part of the key is the same.
+			 */
+			memcpy(&vertex->key, draw, sizeof(*draw));
 			of_build_vertex_data(ctx, vertex);
+			++ctx->stats.cache_misses;
+		}
 	} else {
 		vertex = of_create_vertex_info(ctx, draw,
 						draw->user_ib || draw->user_vb);
-		draw->direct = vertex->direct;
+		++ctx->stats.cache_misses;
 	}
 
+	if (vertex->direct)
+		++ctx->stats.draws_direct;
+	else
+		++ctx->stats.draws_repacked;
+
 	list_del(&vertex->lru_list);
 	list_addtail(&vertex->lru_list, &ctx->draw_lru);
-	vertex->last_use = ctx->draw_ticks;
+
+	if (ctx->draw_cache_size > debug_get_option_draw_cache_size())
+		of_draw_cache_trim(ctx);
 
 	of_emit_state(ctx, state_dirty);
 	of_emit_draw(ctx, vertex, state_dirty);
@@ -943,7 +979,6 @@ of_draw_init_solid(struct of_context *ctx)
 
 	draw->base.vtx = &solid_vertex_stateobj;
 	info->draw_mode = PTYPE_TRIANGLES;
-	info->first_draw = false;
 	info->bypass_cache = false;
 	LIST_INITHEAD(&info->buffers);
 
@@ -1002,6 +1037,18 @@ of_draw_fini(struct pipe_context *pctx)
 	struct of_context *ctx = of_context(pctx);
 	struct of_vertex_info *vertex, *s;
 
+	if (of_mesa_debug & OF_DBG_STATS)
+		debug_printf("openfimg: %u direct draws, %u repacked draws, "
+			"repacked for layout %u, user buffers %u, "
+			"indices %u times\n"
+			"openfimg: draw cache %u hits, %u misses, "
+			"%u evictions, %llu bytes repacked\n",
+			ctx->stats.draws_direct, ctx->stats.draws_repacked,
+			ctx->stats.repack_layout, ctx->stats.repack_user,
+			ctx->stats.repack_indices, ctx->stats.cache_hits,
+			ctx->stats.cache_misses, ctx->stats.cache_evictions,
+			(unsigned long long)ctx->stats.bytes_repacked);
+
 	if (ctx->draw) {
 		OF_CSO_PUT(ctx, &ctx->draw->base.vtx->cso);
 		FREE(ctx->draw);
@@ -40,6 +40,20 @@
 
 #include <errno.h>
 
+/*
+ * Generations are allocated from a screen-wide counter, so a cached
+ * generation can never match a different resource allocated later at
+ * the same address.
+ */
+static void
+new_generation(struct of_resource *rsc)
+{
+	struct of_screen *screen = of_screen(rsc->base.b.screen);
+
+	rsc->generation =
+		p_atomic_inc_return((int32_t *)&screen->generation);
+}
+
 static void
 realloc_bo(struct of_resource *rsc, uint32_t size)
 {
@@ -52,6 +66,7 @@ realloc_bo(struct of_resource *rsc, uint32_t size)
 
 	rsc->bo = fd_bo_new(screen->dev, size, flags);
 	rsc->dirty = false;
+	new_generation(rsc);
 }
 
 static void
@@ -62,7 +77,7 @@ of_resource_transfer_flush_region(struct pipe_context *pctx,
 	struct of_resource *rsc = of_resource(ptrans->resource);
 
 	if (ptrans->usage & PIPE_TRANSFER_WRITE)
-		p_atomic_inc(&rsc->version);
+		new_generation(rsc);
 }
 
 static void
@@ -294,6 +309,8 @@ of_resource_from_handle(struct pipe_screen *pscreen,
 	if (!rsc->bo)
 		goto fail;
 
+	new_generation(rsc);
+
 	rsc->base.vtbl = &of_resource_vtbl;
 	rsc->cpp = util_format_get_blocksize(tmpl->format);
 	slice->pitch /= rsc->cpp;
@@ -45,7 +45,8 @@ struct of_resource {
 	uint32_t cpp;
 	struct of_resource_slice slices[MAX_MIP_LEVELS];
 	bool dirty;
-	int32_t version;
+	/* unique within the screen, replaced on every write to the contents */
+	uint32_t generation;
 };
 
 static INLINE struct of_resource *
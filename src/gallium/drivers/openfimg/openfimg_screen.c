@@ -68,6 +68,10 @@ static const struct debug_named_value debug_options[] = {
 		"Disable dead code elimination" },
 	{ "shadnocp",	OF_DBG_SHADER_NO_CP,
 		"Disable copy propagation" },
+	{ "shadnosched", OF_DBG_SHADER_NO_SCHED,
+		"Disable instruction scheduling" },
+	{ "stats",	OF_DBG_STATS,
+		"Print draw statistics on context destruction" },
 	DEBUG_NAMED_VALUE_END
 };
 
@@ -46,6 +46,9 @@ struct of_screen {
 	struct fd_device *dev;
 
 	int64_t cpu_gpu_time_delta;
+
+	/* last resource content generation handed out */
+	uint32_t generation;
 };
 
 static INLINE struct of_screen *
@@ -183,10 +183,16 @@ of_set_vertex_buffers(struct pipe_context *pctx,
 {
 	struct of_context *ctx = of_context(pctx);
 	struct of_vertexbuf_stateobj *so = &ctx->vertexbuf;
+	unsigned i;
 
 	util_set_vertex_buffers_mask(so->vb, &so->enabled_mask, vb, start_slot, count);
 	so->count = util_last_bit(so->enabled_mask);
 
+	so->direct_mask = 0;
+	for (i = 0; i < so->count; ++i)
+		if (so->vb[i].buffer)
+			so->direct_mask |= 1 << i;
+
 	ctx->dirty |= OF_DIRTY_VTXBUF;
 }
 
@@ -653,6 +659,12 @@ of_vertex_state_create(struct pipe_context *pctx, unsigned num_elements,
 		++so->num_transfers;
 	}
 
+	/* Vertex buffers holding exactly the packed data can be used directly. */
+	transfer = so->transfers;
+	for (i = 0; i < so->num_transfers; ++i, ++transfer)
+		so->direct_strides[so->vb_map[transfer->vertex_buffer_index]] =
+						ROUND_UP(transfer->width, 4);
+
 	of_allocate_vertex_buffer(ctx, so, elems);
 
 	return so;
@@ -48,6 +48,8 @@
 #define OF_DBG_SHADER_OVERRIDE	0x20
 #define OF_DBG_SHADER_NO_DCE	0x40
 #define OF_DBG_SHADER_NO_CP	0x80
+#define OF_DBG_STATS		0x100
+#define OF_DBG_SHADER_NO_SCHED	0x200
 extern int of_mesa_debug;
 
 #define FORCE_DEBUG
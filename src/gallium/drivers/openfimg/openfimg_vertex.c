@@ -35,6 +35,7 @@
 #include "openfimg_resource.h"
 #include "openfimg_util.h"
 #include "openfimg_vertex.h"
+#include "openfimg_vertex_pack.h"
 
 #include <util/u_double_list.h>
 
@@ -106,25 +107,6 @@ void of_put_batch_buffer(struct of_context *ctx, struct of_vertex_buffer *buf)
 	FREE(buf);
 }
 
-/**
- * Copies small number of bytes from source buffer to destination buffer.
- * @param dst Destination buffer.
- * @param src Source buffer.
- * @param len Number of buffers to copy.
- */
-static void small_memcpy(uint8_t *dst, const uint8_t *src, uint32_t len)
-{
-	while (len >= 4) {
-		memcpy(dst, src, 4);
-		dst += 4;
-		src += 4;
-		len -= 4;
-	}
-
-	while (len--)
-		*(dst++) = *(src++);
-}
-
 static void
 emit_transfers(struct of_vertex_info *vertex, uint32_t offset, uint32_t count,
 	       uint32_t dst_offset)
@@ -207,6 +189,86 @@ of_prepare_draw_direct(struct of_vertex_data *vdata)
 
 #define IB_SIZE		4096
 
+/*
+ * Auxiliary 8-bit index buffers, used by direct draws to address vertices
+ * in hardware vertex buffer.
+ */
+struct of_aux_indices {
+	struct of_context *ctx;
+	struct pipe_resource *buffer;
+	struct pipe_transfer *transfer;
+	uint8_t *ptr;
+	unsigned offset;
+	uint32_t handle;
+};
+
+static void
+aux_indices_init(struct of_aux_indices *aux, struct of_context *ctx)
+{
+	memset(aux, 0, sizeof(*aux));
+	aux->ctx = ctx;
+	aux->offset = IB_SIZE;
+}
+
+static void
+aux_indices_fini(struct of_aux_indices *aux)
+{
+	if (aux->transfer)
+		pipe_buffer_unmap(&aux->ctx->base, aux->transfer);
+	aux->transfer = NULL;
+
+	pipe_resource_reference(&aux->buffer, NULL);
+}
+
+/**
+ * Gets space for count indices, to be passed to aux_indices_draw().
+ */
+static uint8_t *
+aux_indices_get(struct of_aux_indices *aux, unsigned count)
+{
+	struct of_context *ctx = aux->ctx;
+
+	if (IB_SIZE - aux->offset < ROUND_UP(count, 4)) {
+		aux_indices_fini(aux);
+
+		aux->buffer = pipe_buffer_create(ctx->base.screen,
+						PIPE_BIND_CUSTOM,
+						PIPE_USAGE_IMMUTABLE,
+						IB_SIZE);
+		aux->handle = fd_bo_handle(of_resource(aux->buffer)->bo);
+		aux->offset = 0;
+
+		aux->ptr = pipe_buffer_map(&ctx->base, aux->buffer,
+						PIPE_TRANSFER_WRITE,
+						&aux->transfer);
+	}
+
+	return BUF_ADDR_8(aux->ptr, aux->offset);
+}
+
+/**
+ * Adds indexed draw of count indices written to aux_indices_get() space.
+ */
+static void
+aux_indices_draw(struct of_aux_indices *aux, struct of_vertex_info *vertex,
+		 unsigned count)
+{
+	struct of_vertex_buffer *buf;
+
+	buf = CALLOC_STRUCT(of_vertex_buffer);
+	assert(buf);
+
+	pipe_resource_reference(&buf->buffer, aux->buffer);
+	buf->cmd = G3D_REQUEST_DRAW;
+	buf->length = count;
+	buf->handle = aux->handle;
+	buf->offset = aux->offset;
+	buf->ctrl_dst_offset = G3D_DRAW_INDEXED;
+	of_draw_add_buffer(buf, vertex);
+
+	aux->offset += ROUND_UP(count, 4);
+}
+
 /*
  * Semi-fast path for aligned, sequential vertex data and primitive types
  * that require workarounds for HW bugs.
@@ -220,21 +282,16 @@ of_prepare_draw_direct_wa(struct of_vertex_data *vdata)
 	struct of_vertex_info *vertex = vdata->info;
 	const struct of_draw_info *draw = &vertex->key;
 	const struct of_vertex_stateobj *vtx = draw->base.vtx;
-	struct pipe_transfer *ib_transfer = NULL;
 	const struct of_primitive_data *prim;
-	struct pipe_resource *ib_buf = NULL;
-	struct of_context *ctx = vdata->ctx;
-	struct of_vertex_buffer *buf;
-	unsigned ib_offset = IB_SIZE;
+	struct of_aux_indices aux;
 	unsigned dst_offset = 0;
-	uint32_t ib_handle = 0;
-	void *ib_ptr = NULL;
 	unsigned batch_size;
 	unsigned remaining;
 	unsigned offset;
 
 	prim = &primitive_data[draw->base.info.mode];
 	LIST_INITHEAD(&vertex->buffers);
+	aux_indices_init(&aux, vdata->ctx);
 
 	offset = draw->base.info.start;
 	remaining = draw->base.info.count;
@@ -277,23 +334,7 @@ of_prepare_draw_direct_wa(struct of_vertex_data *vdata)
 
 		count = idx_count - prim->extra;
 
-		if (IB_SIZE - ib_offset < ROUND_UP(idx_count, 4)) {
-			if (ib_transfer)
-				pipe_buffer_unmap(&ctx->base, ib_transfer);
-
-			ib_buf = pipe_buffer_create(ctx->base.screen,
-							PIPE_BIND_CUSTOM,
-							PIPE_USAGE_IMMUTABLE,
-							IB_SIZE);
-			ib_handle = fd_bo_handle(of_resource(ib_buf)->bo);
-			ib_offset = 0;
-
-			ib_ptr = pipe_buffer_map(&ctx->base, ib_buf,
-							PIPE_TRANSFER_WRITE,
-							&ib_transfer);
-		}
-
-		idx = BUF_ADDR_8(ib_ptr, ib_offset);
+		idx = aux_indices_get(&aux, idx_count);
 		if (prim->repeat_first)
 			for (i = 0; i < 3; ++i)
 				*(idx++) = 0;
@@ -303,245 +344,170 @@ of_prepare_draw_direct_wa(struct of_vertex_data *vdata)
 			*idx = count + dst_offset - 1;
 
 		emit_transfers(vertex, offset, count, dst_offset);
-
-		buf = CALLOC_STRUCT(of_vertex_buffer);
-		assert(buf);
-
-		pipe_resource_reference(&buf->buffer, ib_buf);
-		buf->cmd = G3D_REQUEST_DRAW;
-		buf->length = idx_count;
-		buf->handle = ib_handle;
-		buf->offset = ib_offset;
-		buf->ctrl_dst_offset = G3D_DRAW_INDEXED;
-		of_draw_add_buffer(buf, vertex);
+		aux_indices_draw(&aux, vertex, idx_count);
 
 		if (count == remaining)
 			break;
 
-		ib_offset += ROUND_UP(idx_count, 4);
 		remaining -= count - prim->overlap;
 		offset += count - prim->overlap;
 	}
 
-	if (ib_transfer)
-		pipe_buffer_unmap(&ctx->base, ib_transfer);
+	aux_indices_fini(&aux);
 }
 
-#if 0
-static const void *
-get_next_index(const struct pipe_index_buffer *ib, const void *indices,
-	       uint32_t *index)
-{
-	switch (ib->index_size) {
-	case 1:
-		*index = *(const uint8_t *)indices;
-		return (const uint8_t *)indices + 1;
-	case 2:
-		*index = *(const uint16_t *)indices;
-		return (const uint16_t *)indices + 1;
-	case 4:
-		*index = *(const uint32_t *)indices;
-		return (const uint32_t *)indices + 1;
-	default:
-		assert(0);
-		*index = 0;
-		return indices;
-	}
-}
+/* Maximum vertex range and index count of one direct indexed draw */
+#define DIRECT_INDICES_MAX	124
 
-static const void *
-skip_n_indices(const struct pipe_index_buffer *ib, const void *indices,
-	       uint32_t n)
+static INLINE uint32_t
+get_index(const void *indices, unsigned index_size, unsigned i)
 {
-	switch (ib->index_size) {
+	switch (index_size) {
 	case 1:
-		return (const uint8_t *)indices + n;
+		return ((const uint8_t *)indices)[i];
 	case 2:
-		return (const uint16_t *)indices + n;
-	case 4:
-		return (const uint32_t *)indices + n;
+		return ((const uint16_t *)indices)[i];
 	default:
-		assert(0);
-		return indices;
+		return ((const uint32_t *)indices)[i];
 	}
 }
 
 /**
- * Checks locality of indices in index buffer to determine whether it would
- * be efficient to use it directly.
- * @param draw Draw info structure.
- * @param ib Pipe index buffer descriptor.
- * @param indices Pointer to mapped index buffer.
- * @return true if IB should be used directly, false otherwise.
+ * Finds the longest run of whole primitives starting at given index, whose
+ * vertices fit into given range.
+ * @param indices Array of vertex indices.
+ * @param index_size Size (in bytes) of one index.
+ * @param pos Position of first index of the run.
+ * @param count Index count.
+ * @param verts Vertices per primitive.
+ * @param range Maximum vertex range.
+ * @param min_vtx Pointer to store the minimum vertex index of the run.
+ * @param max_vtx Pointer to store the maximum vertex index of the run.
+ * @return Position of first index past the run.
  */
 static unsigned
-of_check_index_ranges(const struct of_vertex_info *vertex,
-		      const void *indices)
+find_index_range(const void *indices, unsigned index_size, unsigned pos,
+		 unsigned count, unsigned verts, unsigned range,
+		 uint32_t *min_vtx, uint32_t *max_vtx)
 {
-	const struct pipe_index_buffer *ib = &vertex->ib;
-	const struct of_draw_info *draw = &vertex->key;
-	unsigned min_vtx, max_vtx;
-	unsigned num_parts;
-	unsigned num_verts;
-	unsigned i;
-
-	/* Check if all vertices would fit into HW vertex buffer. */
-	min_vtx = draw->base.info.min_index;
-	max_vtx = draw->base.info.max_index;
-	if (max_vtx - min_vtx <= draw->base.vtx->batch_size)
-		return true;
-
-	/* Try to partition indices into blocks that would fit. */
-	max_vtx = 0;
-	min_vtx = 0xffffffff;
-	num_verts = 0;
-	num_parts = 0;
-	indices = skip_n_indices(ib, indices, draw->base.info.start);
-	for (i = 0; i < vertex->count; ++i) {
-		uint32_t index;
+	uint32_t lo = 0xffffffff;
+	uint32_t hi = 0;
 
-		indices = get_next_index(ib, indices, &index);
+	while (pos + verts <= count) {
+		uint32_t new_lo = lo;
+		uint32_t new_hi = hi;
+		unsigned i;
 
-		min_vtx = min(min_vtx, index);
-		max_vtx = max(max_vtx, index);
+		for (i = pos; i < pos + verts; ++i) {
+			uint32_t index = get_index(indices, index_size, i);
 
-		if (max_vtx - min_vtx > draw->base.vtx->batch_size) {
-			/* Exhausted HW vertex buffer space. */
-			if (num_verts < 2)
-				return 0;
-
-			max_vtx = 0;
-			min_vtx = 0xffffffff;
-			num_verts = 0;
-			++num_parts;
-
-			continue;
+			new_lo = min(new_lo, index);
+			new_hi = max(new_hi, index);
 		}
 
-		/* Still fits. */
-		++num_verts;
+		if (new_hi - new_lo >= range)
+			break;
+
+		lo = new_lo;
+		hi = new_hi;
+		pos += verts;
 	}
 
-	return num_parts;
+	*min_vtx = lo;
+	*max_vtx = hi;
+	return pos;
 }
-#endif
 
 /*
  * Semi-fast path for aligned vertex data, indices with reasonable locality and
  * primitive types without HW bugs.
  *
- * Both VBOs and IBOs are used directly to feed the GPU, but the draw needs to
- * be split into smaller batches such that all indexed vertices fit into
- * hardware vertex buffer.
+ * VBOs are used directly to feed the GPU, but the draw needs to be split into
+ * smaller batches such that all indexed vertices fit into hardware vertex
+ * buffer. Indices are rebased to the batch with auxiliary index buffers.
  */
 bool
 of_prepare_draw_direct_indices(struct of_vertex_data *vdata,
 			       const void *indices)
 {
-#if 0
 	struct of_vertex_info *vertex = vdata->info;
 	const struct of_draw_info *draw = &vertex->key;
 	const struct of_vertex_stateobj *vtx = draw->base.vtx;
 	const struct pipe_index_buffer *ib = &vertex->ib;
 	const struct of_primitive_data *prim;
-	unsigned min_vtx, max_vtx;
-	unsigned first_idx;
+	struct of_aux_indices aux;
+	unsigned index_size = ib->index_size;
 	unsigned parts_limit;
 	unsigned num_parts;
-	unsigned num_verts;
-	unsigned i;
+	unsigned range;
+	unsigned verts;
+	unsigned pos;
+	int bias = 0;
 
-	parts_limit = 4 * ((vertex->count + vtx->batch_size - 1)
-							/ vtx->batch_size);
+	prim = &primitive_data[vertex->mode];
 
-	num_parts = of_check_index_ranges(vertex, indices);
-	if (!num_parts || num_parts > parts_limit)
+	/* Only primitives that can be split at any primitive boundary. */
+	if (prim->overlap || prim->extra || draw->base.info.primitive_restart)
 		return false;
 
-	prim = &primitive_data[draw->base.info.mode];
+	/* Indices converted by primconvert start at first vertex already. */
+	if (!vertex->trans_func && !vertex->gen_func) {
+		indices = CBUF_ADDR_8(indices, ib->offset
+					+ draw->base.info.start * index_size);
+		bias = draw->base.info.index_bias;
+	}
+
+	verts = prim->min;
+	range = min(vtx->batch_size, DIRECT_INDICES_MAX);
+	parts_limit = 4 * ((vertex->count + range - 1) / range);
+
+	/* Check locality of indices. */
+	num_parts = 0;
+	for (pos = 0; pos + verts <= vertex->count;) {
+		uint32_t min_vtx, max_vtx;
+		unsigned end;
+
+		end = find_index_range(indices, index_size, pos,
+					vertex->count, verts, range,
+					&min_vtx, &max_vtx);
+		if (end == pos || ++num_parts > parts_limit)
+			return false;
+
+		pos = end;
+	}
+
 	LIST_INITHEAD(&vertex->buffers);
+	aux_indices_init(&aux, vdata->ctx);
 
-	/* Partition indices into blocks that will fit into HW buffer. */
-	max_vtx = 0;
-	min_vtx = 0xffffffff;
-	num_verts = 0;
-	first_idx = draw->base.info.start;
-	indices = skip_n_indices(ib, indices, first_idx);
-	for (i = 0; i < vertex->count; ++i) {
-		unsigned new_min_vtx, new_max_vtx;
-		struct of_vertex_buffer *buf;
-		uint32_t index;
-
-		indices = get_next_index(ib, indices, &index);
-
-		new_min_vtx = min(min_vtx, index);
-		new_max_vtx = max(max_vtx, index);
-
-		if (new_max_vtx - new_min_vtx > draw->base.vtx->batch_size) {
-			unsigned slot = 0;
-
-			emit_transfers(vertex, min_vtx,
-					max_vtx - min_vtx + 1, 0);
-
-			buf = CALLOC_STRUCT(of_vertex_buffer);
-			assert(buf);
-
-			pipe_resource_reference(&buf->buffer, ib->buffer);
-			buf->handle = fd_bo_handle(of_resource(ib->buffer)->bo);
-			if (i == 0) {
-				buf->nr_vertices_dst_offset = vertex->count;
-				if (prim->repeat_first)
-					buf->nr_vertices_dst_offset += 3;
-				if (prim->repeat_last)
-					++buf->nr_vertices_dst_offset;
-			}
-			buf->idx_offset = (uint32_t)-min_vtx;
-			buf->idx_size = ib->index_size;
-
-			if (i == 0 && prim->repeat_first) {
-				buf->src_offset[slot] =
-						ib->index_size * first_idx;
-				buf->bytes_used[slot++] = ib->index_size;
-				buf->src_offset[slot] =
-						ib->index_size * first_idx;
-				buf->bytes_used[slot++] = ib->index_size;
-				buf->src_offset[slot] =
-						ib->index_size * first_idx;
-				buf->bytes_used[slot++] = ib->index_size;
-			}
-
-			buf->src_offset[slot] = ib->index_size * first_idx;
-			buf->bytes_used[slot++] = ib->index_size * num_verts;
-
-			if (i == vertex->count - 1 && prim->repeat_last) {
-				buf->src_offset[slot] =
-						ib->index_size * first_idx;
-				buf->bytes_used[slot++] = ib->index_size;
-			}
-
-			buf->cmd = G3D_REQUEST_INDEX_BUFFER;
-			of_draw_add_buffer(buf, vertex);
-
-			max_vtx = 0;
-			min_vtx = 0xffffffff;
-			num_verts = 0;
-			first_idx += num_verts;
-			--num_parts;
-
-			continue;
-		}
+	for (pos = 0; pos + verts <= vertex->count;) {
+		uint32_t min_vtx, max_vtx;
+		unsigned end;
+
+		end = find_index_range(indices, index_size, pos,
+					vertex->count, verts, range,
+					&min_vtx, &max_vtx);
 
-		/* Still fits. */
-		min_vtx = new_min_vtx;
-		max_vtx = new_max_vtx;
-		++num_verts;
+		emit_transfers(vertex, min_vtx + bias,
+				max_vtx - min_vtx + 1, 0);
+
+		while (pos < end) {
+			unsigned count = min(end - pos, DIRECT_INDICES_MAX
+					- DIRECT_INDICES_MAX % verts);
+			uint8_t *idx = aux_indices_get(&aux, count);
+			unsigned i;
+
+			for (i = 0; i < count; ++i)
+				idx[i] = get_index(indices, index_size,
+							pos + i) - min_vtx;
+
+			aux_indices_draw(&aux, vertex, count);
+			pos += count;
+		}
 	}
 
+	aux_indices_fini(&aux);
+
 	return true;
-#else
-	/* FIXME */
-	return false;
-#endif
 }
 
 /*
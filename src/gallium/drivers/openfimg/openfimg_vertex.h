@@ -69,6 +69,8 @@ struct of_vertex_stateobj {
 	unsigned vb_mask;
 	uint16_t batch_size;
 	uint8_t vb_map[PIPE_MAX_ATTRIBS];
+	/* vertex buffer strides (by vb_map index) allowing direct draws */
+	uint8_t direct_strides[OF_MAX_ATTRIBS];
 	uint8_t num_vb;
 	uint8_t num_elements;
 	uint8_t num_transfers;
@@ -99,10 +101,10 @@ struct of_vertex_info {
 
 	struct list_head buffers;
 	unsigned draw_mode;
-	bool first_draw:1;
 	bool bypass_cache:1;
 	bool indexed:1;
 	bool direct:1;
+	bool hashed_direct:1;
 
 	unsigned num_draws;
 
@@ -112,12 +114,13 @@ struct of_vertex_info {
 	u_generate_func gen_func;
 	struct pipe_index_buffer ib;
 
-	uint32_t ib_version;
-	uint32_t vb_version[OF_MAX_ATTRIBS];
-	struct pipe_resource *rscs[OF_MAX_ATTRIBS + 1];
+	/* content generations of the buffers the cached data came from */
+	uint32_t ib_generation;
+	uint32_t vb_generation[OF_MAX_ATTRIBS];
 
 	struct list_head lru_list;
-	unsigned last_use;
+	/* memory charged to the draw cache budget */
+	unsigned size;
 };
 
 struct of_vertex_data {
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 Tomasz Figa <tomasz.figa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef OPENFIMG_VERTEX_PACK_H_
+#define OPENFIMG_VERTEX_PACK_H_
+
+/*
+ * Copy kernels used to repack vertex attributes into the word aligned
+ * layout required by hardware, see openfimg_vertex_pack_template.h.
+ *
+ * This header depends only on gallium core headers, so it can be used
+ * on the host, without libdrm, e.g. by tests/unit/openfimg_pack_test.c.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_config.h"
+
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#define OF_PACK_SSE
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OF_PACK_NEON
+#endif
+
+#define MAKE_FN_NAME(b,s)	b ## _ ## s
+#define FN_NAME(base, suffix)	MAKE_FN_NAME(base, suffix)
+
+/**
+ * Copies small number of bytes from source buffer to destination buffer.
+ * @param dst Destination buffer.
+ * @param src Source buffer.
+ * @param len Number of buffers to copy.
+ */
+static INLINE void
+small_memcpy(uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+	while (len >= 4) {
+		memcpy(dst, src, 4);
+		dst += 4;
+		src += 4;
+		len -= 4;
+	}
+
+	while (len--)
+		*(dst++) = *(src++);
+}
+
+/*
+ * Fixed size copies of attribute data. Neither source nor destination
+ * needs to be aligned.
+ */
+
+static INLINE void
+of_copy_4(uint8_t *dst, const uint8_t *src)
+{
+	memcpy(dst, src, 4);
+}
+
+static INLINE void
+of_copy_8(uint8_t *dst, const uint8_t *src)
+{
+#if defined(OF_PACK_SSE)
+	_mm_storel_epi64((__m128i *)dst,
+			 _mm_loadl_epi64((const __m128i *)src));
+#elif defined(OF_PACK_NEON)
+	vst1_u8(dst, vld1_u8(src));
+#else
+	memcpy(dst, src, 8);
+#endif
+}
+
+static INLINE void
+of_copy_12(uint8_t *dst, const uint8_t *src)
+{
+	of_copy_8(dst, src);
+	of_copy_4(dst + 8, src + 8);
+}
+
+static INLINE void
+of_copy_16(uint8_t *dst, const uint8_t *src)
+{
+#if defined(OF_PACK_SSE)
+	_mm_storeu_si128((__m128i *)dst,
+			 _mm_loadu_si128((const __m128i *)src));
+#elif defined(OF_PACK_NEON)
+	vst1q_u8(dst, vld1q_u8(src));
+#else
+	memcpy(dst, src, 16);
+#endif
+}
+
+#endif
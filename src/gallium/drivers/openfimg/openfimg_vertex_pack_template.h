@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2013 Tomasz Figa <tomasz.figa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Attribute packing loops, instantiated for each index type by
+ * openfimg_vertex_template.h.
+ */
+
+#ifndef INDEX_TYPE
+#error INDEX_TYPE must be defined before including this file.
+#endif
+
+#ifndef SUFFIX
+#error SUFFIX must be defined before including this file.
+#endif
+
+#include "openfimg_vertex_pack.h"
+
+#undef PACK_ATTRIBUTE
+#undef PACK_ATTRIBUTE_GENERIC
+#undef PACK_LOOP
+
+#define PACK_ATTRIBUTE		FN_NAME(of_pack_attribute, SUFFIX)
+#define PACK_ATTRIBUTE_GENERIC	FN_NAME(of_pack_attribute_generic, SUFFIX)
+
+/**
+ * Packs attribute data into words, copying byte by byte.
+ * @param dst Destination buffer.
+ * @param src Source vertex buffer.
+ * @param stride Stride of source vertex buffer.
+ * @param src_width Size (in bytes) of the attribute.
+ * @param idx Array of vertex indices OR index of first vertex.
+ * @param cnt Vertex count.
+ * @return Size (in bytes) of packed data.
+ */
+static unsigned
+PACK_ATTRIBUTE_GENERIC(uint8_t *dst, const void *src, unsigned stride,
+		       uint8_t src_width, INDEX_TYPE idx, unsigned cnt)
+{
+	const uint8_t *data;
+	unsigned size;
+	unsigned width;
+
+	/* Vertices must be word aligned */
+#ifdef SEQUENTIAL
+	data = (const uint8_t *)src + idx * stride;
+#endif
+	width = (src_width + 3) & ~3;
+	size = width * cnt;
+
+	while (cnt--) {
+		unsigned len = src_width;
+#ifndef SEQUENTIAL
+		data = (const uint8_t *)src + *(idx++) * stride;
+#endif
+		small_memcpy(dst, data, len);
+		dst += width;
+#ifdef SEQUENTIAL
+		data += stride;
+#endif
+	}
+
+	return size;
+}
+
+/*
+ * Packs cnt vertices using copy(), which copies exactly width bytes,
+ * four vertices per iteration.
+ */
+#ifdef SEQUENTIAL
+#define PACK_LOOP(copy, width)						\
+	do {								\
+		const uint8_t *data = (const uint8_t *)src + idx * stride; \
+									\
+		for (; cnt >= 4; cnt -= 4) {				\
+			copy(dst, data);				\
+			copy(dst + (width), data + stride);		\
+			copy(dst + 2 * (width), data + 2 * stride);	\
+			copy(dst + 3 * (width), data + 3 * stride);	\
+			dst += 4 * (width);				\
+			data += 4 * stride;				\
+		}							\
+		for (; cnt; --cnt) {					\
+			copy(dst, data);				\
+			dst += (width);					\
+			data += stride;					\
+		}							\
+	} while (0)
+#else
+#define PACK_LOOP(copy, width)						\
+	do {								\
+		const uint8_t *base = (const uint8_t *)src;		\
+									\
+		for (; cnt >= 4; cnt -= 4) {				\
+			copy(dst, base + idx[0] * stride);		\
+			copy(dst + (width), base + idx[1] * stride);	\
+			copy(dst + 2 * (width), base + idx[2] * stride); \
+			copy(dst + 3 * (width), base + idx[3] * stride); \
+			dst += 4 * (width);				\
+			idx += 4;					\
+		}							\
+		for (; cnt; --cnt) {					\
+			copy(dst, base + *(idx++) * stride);		\
+			dst += (width);					\
+		}							\
+	} while (0)
+#endif
+
+/**
+ * Packs attribute data into words. Attributes of 4, 8, 12 and 16 bytes,
+ * which make up most of vertex data, use fixed size (SIMD where available)
+ * copies, the rest is handled by PACK_ATTRIBUTE_GENERIC().
+ * @param dst Destination buffer.
+ * @param src Source vertex buffer.
+ * @param stride Stride of source vertex buffer.
+ * @param src_width Size (in bytes) of the attribute.
+ * @param idx Array of vertex indices OR index of first vertex.
+ * @param cnt Vertex count.
+ * @return Size (in bytes) of packed data.
+ */
+static unsigned
+PACK_ATTRIBUTE(uint8_t *dst, const void *src, unsigned stride,
+	       uint8_t src_width, INDEX_TYPE idx, unsigned cnt)
+{
+	unsigned size = src_width * cnt;
+
+	switch (src_width) {
+	case 4:
+		PACK_LOOP(of_copy_4, 4);
+		break;
+	case 8:
+		PACK_LOOP(of_copy_8, 8);
+		break;
+	case 12:
+		PACK_LOOP(of_copy_12, 12);
+		break;
+	case 16:
+		PACK_LOOP(of_copy_16, 16);
+		break;
+	default:
+		return PACK_ATTRIBUTE_GENERIC(dst, src, stride, src_width,
+					      idx, cnt);
+	}
+
+	return size;
+}
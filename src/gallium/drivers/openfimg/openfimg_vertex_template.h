@@ -29,55 +29,14 @@
 #error SUFFIX must be defined before including this file.
 #endif
 
-#undef PACK_ATTRIBUTE
+#include "openfimg_vertex_pack_template.h"
+
 #undef COPY_VERTICES
 #undef PREPARE_DRAW
 
-#define MAKE_FN_NAME(b,s)	b ## _ ## s
-#define FN_NAME(base, suffix)	MAKE_FN_NAME(base, suffix)
-
-#define PACK_ATTRIBUTE		FN_NAME(of_pack_attribute, SUFFIX)
 #define COPY_VERTICES		FN_NAME(of_copy_vertices, SUFFIX)
 #define PREPARE_DRAW		FN_NAME(__of_prepare_draw, SUFFIX)
 
-/**
- * Packs attribute data into words (uint16_t indexed variant).
- * @param buf Destination buffer.
- * @param xfer Vertex transfer descriptor.
- * @param idx Array of vertex indices.
- * @param cnt Vertex count.
- * @return Size (in bytes) of packed data.
- */
-static unsigned
-PACK_ATTRIBUTE(uint8_t *dst, const void *src, unsigned stride,
-	       uint8_t src_width, INDEX_TYPE idx, unsigned cnt)
-{
-	const uint8_t *data;
-	unsigned size;
-	unsigned width;
-
-	/* Vertices must be word aligned */
-#ifdef SEQUENTIAL
-	data = CBUF_ADDR_8(src, idx * stride);
-#endif
-	width = ROUND_UP(src_width, 4);
-	size = width * cnt;
-
-	while (cnt--) {
-		unsigned len = src_width;
-#ifndef SEQUENTIAL
-		data = CBUF_ADDR_8(src, *(idx++) * stride);
-#endif
-		small_memcpy(dst, data, len);
-		dst += width;
-#ifdef SEQUENTIAL
-		data += stride;
-#endif
-	}
-
-	return size;
-}
-
 /**
  * Prepares input vertex data for hardware processing.
  * @param ctx Hardware context.
@@ -38,6 +38,7 @@
 #include "sp_clear.h"
 #include "sp_context.h"
 #include "sp_query.h"
+#include "sp_rast.h"
 #include "sp_tile_cache.h"
 
 
@@ -70,6 +71,8 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
       for (i = 0; i < softpipe->framebuffer.nr_cbufs; i++) {
          sp_tile_cache_clear(softpipe->cbuf_cache[i], color, 0);
       }
+      if (softpipe->rast)
+         sp_rast_clear(softpipe->rast, PIPE_CLEAR_COLOR);
    }
 
    if (zs_buffers &&
@@ -84,6 +87,8 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
 
       cv = util_pack64_z_stencil(zsbuf->format, depth, stencil);
       sp_tile_cache_clear(softpipe->zsbuf_cache, &zero, cv);
+      if (softpipe->rast)
+         sp_rast_clear(softpipe->rast, PIPE_CLEAR_DEPTHSTENCIL);
    }
 
    softpipe->dirty_render_cache = TRUE;
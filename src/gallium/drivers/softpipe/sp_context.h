@@ -47,6 +47,7 @@
 
 
 struct softpipe_vbuf_render;
+struct sp_rasterizer;
 struct draw_context;
 struct draw_stage;
 struct softpipe_tile_cache;
@@ -157,13 +158,10 @@ struct softpipe_context {
    } pstipple;
 
    /** Software quad rendering pipeline */
-   struct {
-      struct quad_stage *shade;
-      struct quad_stage *depth_test;
-      struct quad_stage *blend;
-      struct quad_stage *pstipple;
-      struct quad_stage *first; /**< points to one of the above stages */
-   } quad;
+   struct quad_pipeline quad;
+
+   /** Threaded tile rasterizer, NULL when rasterizing in the calling thread */
+   struct sp_rasterizer *rast;
 
    /** TGSI exec things */
    struct {
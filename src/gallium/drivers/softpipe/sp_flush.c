@@ -35,6 +35,7 @@
 #include "draw/draw_context.h"
 #include "sp_flush.h"
 #include "sp_context.h"
+#include "sp_rast.h"
 #include "sp_state.h"
 #include "sp_tile_cache.h"
 #include "sp_tex_tile_cache.h"
@@ -52,6 +53,10 @@ softpipe_flush( struct pipe_context *pipe,
 
    draw_flush(softpipe->draw);
 
+   /* write back the rasterizer threads' tiles */
+   if (softpipe->rast)
+      sp_rast_flush(softpipe->rast, flags);
+
    if (flags & SP_FLUSH_TEXTURE_CACHE) {
       unsigned sh;
 
@@ -37,6 +37,7 @@
 
 
 #include "sp_context.h"
+#include "sp_rast.h"
 #include "sp_setup.h"
 #include "sp_state.h"
 #include "sp_prim_vbuf.h"
@@ -49,6 +50,13 @@
 #define SP_MAX_VBUF_INDEXES 1024
 #define SP_MAX_VBUF_SIZE    4096
 
+/**
+ * With threaded rasterization each draw_elements/arrays call is a fork and
+ * join of the rasterizer threads, so hand over larger batches.
+ */
+#define SP_MAX_VBUF_INDEXES_THREADED (16 * SP_MAX_VBUF_INDEXES)
+#define SP_MAX_VBUF_SIZE_THREADED    (64 * SP_MAX_VBUF_SIZE)
+
 typedef const float (*cptrf4)[4];
 
 /**
@@ -345,6 +353,9 @@ sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    default:
       assert(0);
    }
+
+   if (softpipe->rast)
+      sp_rast_draw(softpipe->rast);
 }
 
 
@@ -585,6 +596,9 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   if (softpipe->rast)
+      sp_rast_draw(softpipe->rast);
 }
 
 /*
@@ -650,8 +664,14 @@ sp_create_vbuf_backend(struct softpipe_context *sp)
 
    assert(sp->draw);
 
-   cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
-   cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   if (sp->rast) {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES_THREADED;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE_THREADED;
+   }
+   else {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   }
 
    cvbr->base.get_vertex_info = sp_vbuf_get_vertex_info;
    cvbr->base.allocate_vertices = sp_vbuf_allocate_vertices;
@@ -667,7 +687,7 @@ sp_create_vbuf_backend(struct softpipe_context *sp)
 
    cvbr->softpipe = sp;
 
-   cvbr->setup = sp_setup_create_context(cvbr->softpipe);
+   cvbr->setup = sp_setup_create_context(cvbr->softpipe, &sp->quad, sp->rast);
 
    return &cvbr->base;
 }
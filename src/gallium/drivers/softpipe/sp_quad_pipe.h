@@ -31,9 +31,15 @@
 #ifndef SP_QUAD_PIPE_H
 #define SP_QUAD_PIPE_H
 
+#include "pipe/p_state.h"
+
 
 struct softpipe_context;
+struct softpipe_tile_cache;
 struct quad_header;
+struct quad_pipeline;
+struct tgsi_exec_machine;
+struct pipe_query_data_pipeline_statistics;
 
 
 /**
@@ -43,6 +49,7 @@ struct quad_header;
  */
 struct quad_stage {
    struct softpipe_context *softpipe;
+   struct quad_pipeline *pipeline;  /**< the pipeline this stage is part of */
 
    struct quad_stage *next;
 
@@ -55,6 +62,28 @@ struct quad_stage {
 };
 
 
+/**
+ * A quad pipeline: the stages plus the per-thread resources they render
+ * with.  The context owns one, and with threaded rasterization each
+ * rasterizer task owns another one (see sp_rast.c).
+ */
+struct quad_pipeline {
+   struct quad_stage *shade;
+   struct quad_stage *depth_test;
+   struct quad_stage *blend;
+   struct quad_stage *pstipple;
+   struct quad_stage *first; /**< points to one of the above stages */
+
+   struct tgsi_exec_machine *fs_machine;
+   struct softpipe_tile_cache *cbuf_cache[PIPE_MAX_COLOR_BUFS];
+   struct softpipe_tile_cache *zsbuf_cache;
+
+   /** Where to count fragments and pipeline statistics */
+   uint64_t *occlusion_count;
+   struct pipe_query_data_pipeline_statistics *stats;
+};
+
+
 struct quad_stage *sp_quad_polygon_stipple_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_earlyz_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_shade_stage( struct softpipe_context *softpipe );
@@ -67,6 +96,10 @@ struct quad_stage *sp_quad_blend_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_colormask_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_output_stage( struct softpipe_context *softpipe );
 
-void sp_build_quad_pipeline(struct softpipe_context *sp);
+boolean sp_init_quad_pipeline(struct softpipe_context *sp,
+                              struct quad_pipeline *qp);
+void sp_destroy_quad_pipeline(struct quad_pipeline *qp);
+void sp_build_quad_pipeline(struct softpipe_context *sp,
+                            struct quad_pipeline *qp);
 
 #endif /* SP_QUAD_PIPE_H */
@@ -0,0 +1,879 @@
+/**************************************************************************
+ * 
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * 
+ **************************************************************************/
+
+/**
+ * Threaded tile rasterizer.
+ *
+ * The vbuf backend's setup context doesn't rasterize primitives itself
+ * when threading is enabled but records them here, in a bin for each
+ * screen tile they may touch.  sp_rast_draw() then lets every thread walk
+ * the bins of the tiles it owns and feed their primitives, in submission
+ * order, to its own setup context and quad pipeline, clipped to the tile.
+ *
+ * Since a tile is only ever touched by one thread, and the primitives hit
+ * each pixel in the same order as without threading, the results are
+ * identical to single-threaded rendering.
+ */
+
+#include "pipe/p_defines.h"
+#include "os/os_thread.h"
+#include "tgsi/tgsi_exec.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "sp_context.h"
+#include "sp_flush.h"
+#include "sp_quad_pipe.h"
+#include "sp_rast.h"
+#include "sp_setup.h"
+#include "sp_state.h"
+#include "sp_tex_sample.h"
+#include "sp_tex_tile_cache.h"
+#include "sp_texture.h"
+#include "sp_tile_cache.h"
+
+
+#define SP_RAST_TRI   0
+#define SP_RAST_LINE  1
+#define SP_RAST_POINT 2
+
+
+/** A binned primitive; the vertices live in the vbuf backend's buffer */
+struct sp_rast_prim
+{
+   unsigned type;
+   const float (*v[3])[4];
+};
+
+
+/** The primitives touching one tile, as indices into sp_rasterizer::prims */
+struct sp_rast_bin
+{
+   unsigned *prims;
+   unsigned count;
+   unsigned size;
+};
+
+
+/**
+ * Per-thread rendering state.  Task 0 runs in the calling thread.
+ */
+struct sp_rast_task
+{
+   struct sp_rasterizer *rast;
+   unsigned index;
+
+   struct setup_context *setup;
+   struct quad_pipeline quad;
+
+   struct sp_tgsi_sampler *sampler;
+   struct softpipe_tex_tile_cache *tex_cache[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+
+   uint64_t occlusion_count;
+   struct pipe_query_data_pipeline_statistics stats;
+
+   pipe_semaphore work_ready;
+};
+
+
+struct sp_rasterizer
+{
+   struct softpipe_context *softpipe;
+
+   unsigned num_threads;
+   struct sp_rast_task tasks[SP_MAX_THREADS];
+   pipe_thread threads[SP_MAX_THREADS];
+
+   pipe_semaphore work_done;
+   boolean exit_flag;
+
+   /** The calling thread's floating point state, for the workers */
+   unsigned fpstate;
+
+   struct sp_rast_prim *prims;
+   unsigned num_prims;
+   unsigned max_prims;
+
+   struct sp_rast_bin *bins;
+   unsigned tiles_x, tiles_y;
+
+   /** Whole-surface clears waiting in the context's tile caches */
+   boolean clears_pending;
+};
+
+
+static INLINE unsigned
+tile_owner(const struct sp_rasterizer *rast, unsigned tx, unsigned ty)
+{
+   return (tx + ty) % rast->num_threads;
+}
+
+
+/**
+ * Make room for one more primitive, and for one more entry in each bin
+ * of the given range of tiles.
+ * \return FALSE if out of memory
+ */
+static boolean
+reserve_bins(struct sp_rasterizer *rast,
+             unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+   unsigned tx, ty;
+
+   if (rast->num_prims == rast->max_prims) {
+      unsigned max_prims = MAX2(2 * rast->max_prims, 1024);
+      struct sp_rast_prim *prims =
+         REALLOC(rast->prims, rast->max_prims * sizeof *prims,
+                 max_prims * sizeof *prims);
+      if (!prims)
+         return FALSE;
+      rast->prims = prims;
+      rast->max_prims = max_prims;
+   }
+
+   for (ty = y0; ty <= y1; ty++) {
+      for (tx = x0; tx <= x1; tx++) {
+         struct sp_rast_bin *bin = &rast->bins[ty * rast->tiles_x + tx];
+
+         if (bin->count == bin->size) {
+            unsigned size = MAX2(2 * bin->size, 64);
+            unsigned *prims = REALLOC(bin->prims, bin->size * sizeof *prims,
+                                      size * sizeof *prims);
+            if (!prims)
+               return FALSE;
+            bin->prims = prims;
+            bin->size = size;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Append a primitive and put it in the bins of the tiles overlapping
+ * the given bounding box, which is clipped to the cliprect here.
+ * \return FALSE if out of memory, in which case nothing was binned
+ */
+static boolean
+bin_prim(struct sp_rasterizer *rast, const struct sp_rast_prim *prim,
+         float minx, float miny, float maxx, float maxy)
+{
+   const struct pipe_scissor_state *cliprect = &rast->softpipe->cliprect;
+   unsigned x0, y0, x1, y1, tx, ty;
+
+   if (!rast->bins)
+      return FALSE;
+
+   minx = MAX2(minx, (float) cliprect->minx);
+   miny = MAX2(miny, (float) cliprect->miny);
+   maxx = MIN2(maxx, (float) cliprect->maxx - 1);
+   maxy = MIN2(maxy, (float) cliprect->maxy - 1);
+
+   if (minx > maxx || miny > maxy)
+      return TRUE;
+
+   x0 = (unsigned) minx / TILE_SIZE;
+   y0 = (unsigned) miny / TILE_SIZE;
+   x1 = MIN2((unsigned) maxx / TILE_SIZE, rast->tiles_x - 1);
+   y1 = MIN2((unsigned) maxy / TILE_SIZE, rast->tiles_y - 1);
+
+   if (!reserve_bins(rast, x0, y0, x1, y1))
+      return FALSE;
+
+   for (ty = y0; ty <= y1; ty++) {
+      for (tx = x0; tx <= x1; tx++) {
+         struct sp_rast_bin *bin = &rast->bins[ty * rast->tiles_x + tx];
+
+         bin->prims[bin->count++] = rast->num_prims;
+      }
+   }
+
+   rast->prims[rast->num_prims++] = *prim;
+
+   return TRUE;
+}
+
+
+static void
+draw_prim_direct(struct sp_rasterizer *rast, const struct sp_rast_prim *prim);
+
+
+/**
+ * Bin a primitive.  When out of memory, rasterize what is binned so far
+ * to make room, and as a last resort draw the primitive right away.
+ */
+static void
+add_prim(struct sp_rasterizer *rast, const struct sp_rast_prim *prim,
+         float minx, float miny, float maxx, float maxy)
+{
+   if (bin_prim(rast, prim, minx, miny, maxx, maxy))
+      return;
+
+   sp_rast_draw(rast);
+
+   if (bin_prim(rast, prim, minx, miny, maxx, maxy))
+      return;
+
+   draw_prim_direct(rast, prim);
+}
+
+
+void
+sp_rast_bin_tri(struct sp_rasterizer *rast,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4])
+{
+   struct sp_rast_prim prim;
+
+   prim.type = SP_RAST_TRI;
+   prim.v[0] = v0;
+   prim.v[1] = v1;
+   prim.v[2] = v2;
+
+   add_prim(rast, &prim,
+            MIN3(v0[0][0], v1[0][0], v2[0][0]) - 1.0f,
+            MIN3(v0[0][1], v1[0][1], v2[0][1]) - 1.0f,
+            MAX3(v0[0][0], v1[0][0], v2[0][0]) + 1.0f,
+            MAX3(v0[0][1], v1[0][1], v2[0][1]) + 1.0f);
+}
+
+
+void
+sp_rast_bin_line(struct sp_rasterizer *rast,
+                 const float (*v0)[4],
+                 const float (*v1)[4])
+{
+   struct sp_rast_prim prim;
+
+   prim.type = SP_RAST_LINE;
+   prim.v[0] = v0;
+   prim.v[1] = v1;
+   prim.v[2] = NULL;
+
+   add_prim(rast, &prim,
+            MIN2(v0[0][0], v1[0][0]) - 1.0f,
+            MIN2(v0[0][1], v1[0][1]) - 1.0f,
+            MAX2(v0[0][0], v1[0][0]) + 1.0f,
+            MAX2(v0[0][1], v1[0][1]) + 1.0f);
+}
+
+
+void
+sp_rast_bin_point(struct sp_rasterizer *rast,
+                  const float (*v0)[4],
+                  float half_size)
+{
+   struct sp_rast_prim prim;
+
+   prim.type = SP_RAST_POINT;
+   prim.v[0] = v0;
+   prim.v[1] = NULL;
+   prim.v[2] = NULL;
+
+   add_prim(rast, &prim,
+            v0[0][0] - half_size - 1.0f,
+            v0[0][1] - half_size - 1.0f,
+            v0[0][0] + half_size + 1.0f,
+            v0[0][1] + half_size + 1.0f);
+}
+
+
+static INLINE void
+draw_prim(struct sp_rast_task *task, const struct sp_rast_prim *prim)
+{
+   switch (prim->type) {
+   case SP_RAST_TRI:
+      sp_setup_tri(task->setup, prim->v[0], prim->v[1], prim->v[2]);
+      break;
+   case SP_RAST_LINE:
+      sp_setup_line(task->setup, prim->v[0], prim->v[1]);
+      break;
+   case SP_RAST_POINT:
+      sp_setup_point(task->setup, prim->v[0]);
+      break;
+   default:
+      assert(0);
+   }
+}
+
+
+/**
+ * Draw the binned primitives of the tiles owned by a task.
+ */
+static void
+rasterize_bins(struct sp_rast_task *task)
+{
+   struct sp_rasterizer *rast = task->rast;
+   const struct pipe_scissor_state *cliprect = &rast->softpipe->cliprect;
+   unsigned tx, ty, i;
+
+   for (ty = 0; ty < rast->tiles_y; ty++) {
+      for (tx = 0; tx < rast->tiles_x; tx++) {
+         const struct sp_rast_bin *bin = &rast->bins[ty * rast->tiles_x + tx];
+         struct pipe_scissor_state rect;
+
+         if (!bin->count || tile_owner(rast, tx, ty) != task->index)
+            continue;
+
+         rect.minx = MAX2(cliprect->minx, tx * TILE_SIZE);
+         rect.miny = MAX2(cliprect->miny, ty * TILE_SIZE);
+         rect.maxx = MIN2(cliprect->maxx, (tx + 1) * TILE_SIZE);
+         rect.maxy = MIN2(cliprect->maxy, (ty + 1) * TILE_SIZE);
+         sp_setup_set_cliprect(task->setup, &rect);
+
+         for (i = 0; i < bin->count; i++)
+            draw_prim(task, &rast->prims[bin->prims[i]]);
+      }
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( thread_function, init_data )
+{
+   struct sp_rast_task *task = (struct sp_rast_task *) init_data;
+   struct sp_rasterizer *rast = task->rast;
+
+   while (1) {
+      pipe_semaphore_wait(&task->work_ready);
+
+      if (rast->exit_flag)
+         break;
+
+      /* round and flush like the calling thread does */
+      util_fpstate_set(rast->fpstate);
+
+      rasterize_bins(task);
+
+      pipe_semaphore_signal(&rast->work_done);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Hand the context's pending whole-surface clears over to the tile caches
+ * of the tasks owning the tiles.
+ */
+static void
+move_clears(struct sp_rasterizer *rast)
+{
+   struct softpipe_context *sp = rast->softpipe;
+   unsigned tx, ty, i;
+   int layer;
+
+   for (ty = 0; ty < rast->tiles_y; ty++) {
+      for (tx = 0; tx < rast->tiles_x; tx++) {
+         struct sp_rast_task *task = &rast->tasks[tile_owner(rast, tx, ty)];
+
+         for (i = 0; i < sp->framebuffer.nr_cbufs; i++) {
+            struct softpipe_tile_cache *tc = sp->cbuf_cache[i];
+
+            if (!tc->surface)
+               continue;
+
+            for (layer = 0; layer < tc->num_maps; layer++) {
+               sp_tile_cache_move_clear(task->quad.cbuf_cache[i], tc,
+                                        tile_address(tx * TILE_SIZE,
+                                                     ty * TILE_SIZE, layer));
+            }
+         }
+
+         if (sp->zsbuf_cache->surface) {
+            struct softpipe_tile_cache *tc = sp->zsbuf_cache;
+
+            for (layer = 0; layer < tc->num_maps; layer++) {
+               sp_tile_cache_move_clear(task->quad.zsbuf_cache, tc,
+                                        tile_address(tx * TILE_SIZE,
+                                                     ty * TILE_SIZE, layer));
+            }
+         }
+      }
+   }
+}
+
+
+/**
+ * Point a task's sampler at its own texture tile caches, bound to the
+ * context's fragment sampler views.
+ */
+static void
+update_task_samplers(struct sp_rast_task *task)
+{
+   struct softpipe_context *sp = task->rast->softpipe;
+   const struct sp_tgsi_sampler *fs_sampler =
+      sp->tgsi.sampler[PIPE_SHADER_FRAGMENT];
+   unsigned num = sp->num_sampler_views[PIPE_SHADER_FRAGMENT];
+   unsigned i;
+
+   memcpy(task->sampler->sp_sampler, fs_sampler->sp_sampler,
+          sizeof task->sampler->sp_sampler);
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      struct sp_sampler_view *sview = &task->sampler->sp_sview[i];
+      struct pipe_sampler_view *view =
+         i < num ? sp->sampler_views[PIPE_SHADER_FRAGMENT][i] : NULL;
+      struct softpipe_tex_tile_cache *tc;
+
+      if (view && !task->tex_cache[i])
+         task->tex_cache[i] = sp_create_tex_tile_cache(&sp->pipe);
+
+      tc = task->tex_cache[i];
+      if (!tc) {
+         memset(sview, 0, sizeof *sview);
+         continue;
+      }
+
+      sp_tex_tile_cache_set_sampler_view(tc, view);
+
+      if (!view) {
+         memset(sview, 0, sizeof *sview);
+         continue;
+      }
+
+      if (tc->texture) {
+         struct softpipe_resource *spt = softpipe_resource(tc->texture);
+         if (spt->timestamp != tc->timestamp) {
+            sp_tex_tile_cache_validate_texture(tc);
+            tc->timestamp = spt->timestamp;
+         }
+      }
+
+      *sview = fs_sampler->sp_sview[i];
+      sview->cache = tc;
+   }
+}
+
+
+/**
+ * Get the tasks ready to draw with the context's current state.
+ */
+static void
+begin_tasks(struct sp_rasterizer *rast)
+{
+   struct softpipe_context *sp = rast->softpipe;
+   unsigned i;
+
+   if (rast->clears_pending) {
+      if (rast->bins) {
+         move_clears(rast);
+      }
+      else {
+         /* no tiles to move them to, write them out instead */
+         for (i = 0; i < sp->framebuffer.nr_cbufs; i++)
+            sp_flush_tile_cache(sp->cbuf_cache[i]);
+         sp_flush_tile_cache(sp->zsbuf_cache);
+      }
+      rast->clears_pending = FALSE;
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct sp_rast_task *task = &rast->tasks[i];
+
+      sp_build_quad_pipeline(sp, &task->quad);
+      sp_setup_prepare(task->setup);
+      update_task_samplers(task);
+
+      task->occlusion_count = 0;
+      memset(&task->stats, 0, sizeof task->stats);
+   }
+
+   rast->fpstate = util_fpstate_get();
+}
+
+
+/**
+ * Add the tasks' counters to the context's.
+ */
+static void
+end_tasks(struct sp_rasterizer *rast)
+{
+   struct softpipe_context *sp = rast->softpipe;
+   unsigned i;
+
+   /*
+    * Primitives were already counted once when binned, the tasks count
+    * them once per tile.
+    */
+   for (i = 0; i < rast->num_threads; i++) {
+      sp->occlusion_count += rast->tasks[i].occlusion_count;
+      sp->pipeline_statistics.ps_invocations +=
+         rast->tasks[i].stats.ps_invocations;
+   }
+}
+
+
+/**
+ * Rasterize everything binned since the last call, on all threads, and
+ * wait for it to finish.
+ */
+void
+sp_rast_draw(struct sp_rasterizer *rast)
+{
+   unsigned i;
+
+   if (!rast->num_prims)
+      return;
+
+   begin_tasks(rast);
+
+   for (i = 1; i < rast->num_threads; i++)
+      pipe_semaphore_signal(&rast->tasks[i].work_ready);
+
+   rasterize_bins(&rast->tasks[0]);
+
+   for (i = 1; i < rast->num_threads; i++)
+      pipe_semaphore_wait(&rast->work_done);
+
+   end_tasks(rast);
+
+   for (i = 0; i < rast->tiles_x * rast->tiles_y; i++)
+      rast->bins[i].count = 0;
+   rast->num_prims = 0;
+}
+
+
+/**
+ * The context bound a new fragment shader variant; bind it to the tasks'
+ * interpreters too.
+ */
+void
+sp_rast_bind_fragment_shader(struct sp_rasterizer *rast)
+{
+   struct softpipe_context *sp = rast->softpipe;
+   unsigned i;
+
+   if (!sp->fs_variant)
+      return;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct sp_rast_task *task = &rast->tasks[i];
+
+      sp->fs_variant->prepare(sp->fs_variant, task->quad.fs_machine,
+                              (struct tgsi_sampler *) task->sampler);
+   }
+}
+
+
+/**
+ * Flush the tasks' tile caches and point them at the new surfaces, and
+ * resize the bins.  Called before the context updates its own caches.
+ */
+void
+sp_rast_set_framebuffer(struct sp_rasterizer *rast,
+                        const struct pipe_framebuffer_state *fb)
+{
+   unsigned tiles_x = (fb->width + TILE_SIZE - 1) / TILE_SIZE;
+   unsigned tiles_y = (fb->height + TILE_SIZE - 1) / TILE_SIZE;
+   unsigned i, j;
+
+   assert(!rast->num_prims);
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct sp_rast_task *task = &rast->tasks[i];
+
+      for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++) {
+         struct pipe_surface *cb = j < fb->nr_cbufs ? fb->cbufs[j] : NULL;
+         struct softpipe_tile_cache *tc = task->quad.cbuf_cache[j];
+
+         if (sp_tile_cache_get_surface(tc) != cb) {
+            sp_flush_tile_cache(tc);
+            sp_tile_cache_set_surface(tc, cb);
+         }
+      }
+
+      if (sp_tile_cache_get_surface(task->quad.zsbuf_cache) != fb->zsbuf) {
+         sp_flush_tile_cache(task->quad.zsbuf_cache);
+         sp_tile_cache_set_surface(task->quad.zsbuf_cache, fb->zsbuf);
+      }
+   }
+
+   if (tiles_x != rast->tiles_x || tiles_y != rast->tiles_y) {
+      for (i = 0; i < rast->tiles_x * rast->tiles_y; i++)
+         FREE(rast->bins[i].prims);
+      FREE(rast->bins);
+
+      rast->bins = CALLOC(tiles_x * tiles_y, sizeof *rast->bins);
+      if (rast->bins) {
+         rast->tiles_x = tiles_x;
+         rast->tiles_y = tiles_y;
+      }
+      else {
+         rast->tiles_x = 0;
+         rast->tiles_y = 0;
+      }
+   }
+}
+
+
+/**
+ * The context is clearing whole surfaces through its own tile caches:
+ * drop whatever the tasks have cached of them, and move the clears over
+ * to the tasks before the next draw.
+ */
+void
+sp_rast_clear(struct sp_rasterizer *rast, unsigned buffers)
+{
+   unsigned i, j;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct sp_rast_task *task = &rast->tasks[i];
+
+      if (buffers & PIPE_CLEAR_COLOR) {
+         for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++)
+            sp_tile_cache_discard(task->quad.cbuf_cache[j]);
+      }
+
+      if (buffers & PIPE_CLEAR_DEPTHSTENCIL)
+         sp_tile_cache_discard(task->quad.zsbuf_cache);
+   }
+
+   rast->clears_pending = TRUE;
+}
+
+
+/**
+ * Write back the tasks' tiles, and drop their cached texture tiles if
+ * requested.
+ */
+void
+sp_rast_flush(struct sp_rasterizer *rast, unsigned flags)
+{
+   unsigned i, j;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct sp_rast_task *task = &rast->tasks[i];
+
+      if (flags & SP_FLUSH_TEXTURE_CACHE) {
+         for (j = 0; j < PIPE_MAX_SHADER_SAMPLER_VIEWS; j++) {
+            if (task->tex_cache[j])
+               sp_flush_tex_tile_cache(task->tex_cache[j]);
+         }
+      }
+
+      for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++)
+         sp_flush_tile_cache(task->quad.cbuf_cache[j]);
+
+      sp_flush_tile_cache(task->quad.zsbuf_cache);
+   }
+}
+
+
+/**
+ * Draw a primitive on the calling thread without binning it, for when
+ * there is no memory for the bins.  Task 0 draws it across the whole
+ * cliprect, so all tasks' tiles are written back before and after, as a
+ * tile must not be cached by two tasks.
+ */
+static void
+draw_prim_direct(struct sp_rasterizer *rast, const struct sp_rast_prim *prim)
+{
+   struct sp_rast_task *task = &rast->tasks[0];
+
+   begin_tasks(rast);
+   sp_rast_flush(rast, 0);
+
+   sp_setup_set_cliprect(task->setup, &rast->softpipe->cliprect);
+   draw_prim(task, prim);
+
+   sp_rast_flush(rast, 0);
+   end_tasks(rast);
+}
+
+
+boolean
+sp_rast_is_texture_referenced(struct sp_rasterizer *rast,
+                              const struct pipe_resource *texture)
+{
+   unsigned i, j;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      for (j = 0; j < PIPE_MAX_SHADER_SAMPLER_VIEWS; j++) {
+         const struct softpipe_tex_tile_cache *tc = rast->tasks[i].tex_cache[j];
+         if (tc && tc->texture == texture)
+            return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+static boolean
+init_task(struct sp_rasterizer *rast, struct sp_rast_task *task,
+          unsigned index)
+{
+   struct softpipe_context *sp = rast->softpipe;
+   unsigned i;
+
+   task->rast = rast;
+   task->index = index;
+
+   pipe_semaphore_init(&task->work_ready, 0);
+
+   if (!sp_init_quad_pipeline(sp, &task->quad))
+      return FALSE;
+
+   task->quad.fs_machine = tgsi_exec_machine_create();
+   if (!task->quad.fs_machine)
+      return FALSE;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      task->quad.cbuf_cache[i] = sp_create_tile_cache(&sp->pipe);
+      if (!task->quad.cbuf_cache[i])
+         return FALSE;
+   }
+
+   task->quad.zsbuf_cache = sp_create_tile_cache(&sp->pipe);
+   if (!task->quad.zsbuf_cache)
+      return FALSE;
+
+   task->quad.occlusion_count = &task->occlusion_count;
+   task->quad.stats = &task->stats;
+
+   task->sampler = sp_create_tgsi_sampler();
+   if (!task->sampler)
+      return FALSE;
+
+   task->setup = sp_setup_create_context(sp, &task->quad, NULL);
+   if (!task->setup)
+      return FALSE;
+
+   return TRUE;
+}
+
+
+static void
+destroy_task(struct sp_rast_task *task)
+{
+   unsigned i;
+
+   if (task->setup)
+      sp_setup_destroy_context(task->setup);
+
+   sp_destroy_quad_pipeline(&task->quad);
+
+   if (task->quad.fs_machine)
+      tgsi_exec_machine_destroy(task->quad.fs_machine);
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
+      sp_destroy_tile_cache(task->quad.cbuf_cache[i]);
+   sp_destroy_tile_cache(task->quad.zsbuf_cache);
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++)
+      sp_destroy_tex_tile_cache(task->tex_cache[i]);
+
+   FREE(task->sampler);
+
+   pipe_semaphore_destroy(&task->work_ready);
+}
+
+
+/**
+ * Create a rasterizer drawing with num_threads threads, including the
+ * calling one.  Must be called after the context's quad pipeline and tile
+ * caches are set up.
+ * \return NULL on failure, or if no helper thread could be started
+ */
+struct sp_rasterizer *
+sp_rast_create(struct softpipe_context *softpipe, unsigned num_threads)
+{
+   struct sp_rasterizer *rast;
+   unsigned i;
+
+   assert(num_threads > 1 && num_threads <= SP_MAX_THREADS);
+
+   rast = CALLOC_STRUCT(sp_rasterizer);
+   if (!rast)
+      return NULL;
+
+   rast->softpipe = softpipe;
+
+   rast->num_threads = num_threads;
+
+   for (i = 0; i < num_threads; i++) {
+      if (!init_task(rast, &rast->tasks[i], i)) {
+         do {
+            destroy_task(&rast->tasks[i]);
+         } while (i--);
+         FREE(rast);
+         return NULL;
+      }
+   }
+
+   pipe_semaphore_init(&rast->work_done, 0);
+
+   /* Draws wait for every thread, so only keep the ones which started */
+   for (i = 1; i < num_threads; i++) {
+      rast->threads[i] = pipe_thread_create(thread_function,
+                                            (void *) &rast->tasks[i]);
+      if (!rast->threads[i])
+         break;
+   }
+
+   if (i < num_threads) {
+      rast->num_threads = i;
+      while (i < num_threads)
+         destroy_task(&rast->tasks[i++]);
+
+      if (rast->num_threads < 2) {
+         sp_rast_destroy(rast);
+         return NULL;
+      }
+   }
+
+   return rast;
+}
+
+
+void
+sp_rast_destroy(struct sp_rasterizer *rast)
+{
+   unsigned i;
+
+   rast->exit_flag = TRUE;
+   for (i = 1; i < rast->num_threads; i++)
+      pipe_semaphore_signal(&rast->tasks[i].work_ready);
+
+   for (i = 1; i < rast->num_threads; i++)
+      pipe_thread_wait(rast->threads[i]);
+
+   for (i = 0; i < rast->num_threads; i++)
+      destroy_task(&rast->tasks[i]);
+
+   pipe_semaphore_destroy(&rast->work_done);
+
+   for (i = 0; i < rast->tiles_x * rast->tiles_y; i++)
+      FREE(rast->bins[i].prims);
+   FREE(rast->bins);
+   FREE(rast->prims);
+
+   FREE(rast);
+}
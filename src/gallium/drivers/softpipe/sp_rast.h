@@ -0,0 +1,96 @@
+/**************************************************************************
+ * 
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * 
+ **************************************************************************/
+
+/**
+ * Threaded tile rasterizer.
+ *
+ * Primitives coming out of the vbuf backend are binned per TILE_SIZE
+ * screen tile, and at the end of each draw call the tiles are rasterized
+ * by a pool of threads.  Each tile is owned by exactly one thread, which
+ * renders through its own quad pipeline, tile caches and TGSI machine.
+ */
+
+#ifndef SP_RAST_H
+#define SP_RAST_H
+
+#include "pipe/p_compiler.h"
+
+
+/** Max number of rasterizer threads, including the calling thread */
+#define SP_MAX_THREADS 16
+
+
+struct softpipe_context;
+struct sp_rasterizer;
+struct pipe_framebuffer_state;
+struct pipe_resource;
+
+
+struct sp_rasterizer *
+sp_rast_create(struct softpipe_context *softpipe, unsigned num_threads);
+
+void
+sp_rast_destroy(struct sp_rasterizer *rast);
+
+void
+sp_rast_bin_tri(struct sp_rasterizer *rast,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4]);
+
+void
+sp_rast_bin_line(struct sp_rasterizer *rast,
+                 const float (*v0)[4],
+                 const float (*v1)[4]);
+
+void
+sp_rast_bin_point(struct sp_rasterizer *rast,
+                  const float (*v0)[4],
+                  float half_size);
+
+void
+sp_rast_draw(struct sp_rasterizer *rast);
+
+void
+sp_rast_bind_fragment_shader(struct sp_rasterizer *rast);
+
+void
+sp_rast_set_framebuffer(struct sp_rasterizer *rast,
+                        const struct pipe_framebuffer_state *fb);
+
+void
+sp_rast_clear(struct sp_rasterizer *rast, unsigned buffers);
+
+void
+sp_rast_flush(struct sp_rasterizer *rast, unsigned flags);
+
+boolean
+sp_rast_is_texture_referenced(struct sp_rasterizer *rast,
+                              const struct pipe_resource *texture);
+
+
+#endif /* SP_RAST_H */
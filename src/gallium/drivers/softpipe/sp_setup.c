@@ -35,6 +35,7 @@
 #include "sp_context.h"
 #include "sp_quad.h"
 #include "sp_quad_pipe.h"
+#include "sp_rast.h"
 #include "sp_setup.h"
 #include "sp_state.h"
 #include "draw/draw_context.h"
@@ -75,6 +76,15 @@ struct edge {
 struct setup_context {
    struct softpipe_context *softpipe;
 
+   /** The quad pipeline fragments are sent down */
+   struct quad_pipeline *pipeline;
+
+   /** If set, bin primitives for the rasterizer tasks instead of drawing */
+   struct sp_rasterizer *rast;
+
+   /** Scissor/surface bounds, restricted to a tile for rasterizer tasks */
+   struct pipe_scissor_state cliprect;
+
    /* Vertices are just an array of floats making up each attribute in
     * turn.  Currently fixed at 4 floats, but should change in time.
     * Codegen will help cope with this.
@@ -128,7 +138,7 @@ struct setup_context {
 static INLINE void
 quad_clip(struct setup_context *setup, struct quad_header *quad)
 {
-   const struct pipe_scissor_state *cliprect = &setup->softpipe->cliprect;
+   const struct pipe_scissor_state *cliprect = &setup->cliprect;
    const int minx = (int) cliprect->minx;
    const int maxx = (int) cliprect->maxx;
    const int miny = (int) cliprect->miny;
@@ -162,13 +172,13 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
    quad_clip( setup, quad );
 
    if (quad->inout.mask) {
-      struct softpipe_context *sp = setup->softpipe;
+      struct quad_stage *first = setup->pipeline->first;
 
 #if DEBUG_FRAGS
       setup->numFragsEmitted += util_bitcount(quad->inout.mask);
 #endif
 
-      sp->quad.first->run( sp->quad.first, &quad, 1 );
+      first->run( first, &quad, 1 );
    }
 }
 
@@ -203,7 +213,7 @@ flush_spans(struct setup_context *setup)
    const int xleft1 = setup->span.left[1];
    const int xright0 = setup->span.right[0];
    const int xright1 = setup->span.right[1];
-   struct quad_stage *pipe = setup->softpipe->quad.first;
+   struct quad_stage *pipe = setup->pipeline->first;
 
    const int minleft = block_x(MIN2(xleft0, xleft1));
    const int maxright = MAX2(xright0, xright1);
@@ -709,7 +719,7 @@ subtriangle(struct setup_context *setup,
             struct edge *eright,
             int lines)
 {
-   const struct pipe_scissor_state *cliprect = &setup->softpipe->cliprect;
+   const struct pipe_scissor_state *cliprect = &setup->cliprect;
    const int minx = (int) cliprect->minx;
    const int maxx = (int) cliprect->maxx;
    const int miny = (int) cliprect->miny;
@@ -830,6 +840,16 @@ sp_setup_tri(struct setup_context *setup,
    if (!setup_sort_vertices( setup, det, v0, v1, v2 ))
       return;
 
+   if (setup->rast) {
+      /* the rasterizer tasks draw it, tile by tile */
+      sp_rast_bin_tri(setup->rast, v0, v1, v2);
+
+      if (setup->softpipe->active_statistics_queries) {
+         setup->pipeline->stats->c_primitives++;
+      }
+      return;
+   }
+
    setup_tri_coefficients( setup );
    setup_tri_edges( setup );
 
@@ -863,7 +883,7 @@ sp_setup_tri(struct setup_context *setup,
    flush_spans( setup );
 
    if (setup->softpipe->active_statistics_queries) {
-      setup->softpipe->pipeline_statistics.c_primitives++;
+      setup->pipeline->stats->c_primitives++;
    }
 
 #if DEBUG_FRAGS
@@ -1096,6 +1116,11 @@ sp_setup_line(struct setup_context *setup,
    if (dx == 0 && dy == 0)
       return;
 
+   if (setup->rast) {
+      sp_rast_bin_line(setup->rast, v0, v1);
+      return;
+   }
+
    if (!setup_line_coefficients(setup, v0, v1))
       return;
 
@@ -1233,6 +1258,11 @@ sp_setup_point(struct setup_context *setup,
 
    assert(setup->softpipe->reduced_prim == PIPE_PRIM_POINTS);
 
+   if (setup->rast) {
+      sp_rast_bin_point(setup->rast, v0, halfSize);
+      return;
+   }
+
    if (setup->softpipe->layer_slot > 0) {
       layer = *(unsigned *)v0[setup->softpipe->layer_slot];
       layer = MIN2(layer, setup->max_layer);
@@ -1449,7 +1479,9 @@ sp_setup_prepare(struct setup_context *setup)
 
    setup->max_layer = max_layer;
 
-   sp->quad.first->begin( sp->quad.first );
+   setup->cliprect = sp->cliprect;
+
+   setup->pipeline->first->begin( setup->pipeline->first );
 
    if (sp->reduced_api_prim == PIPE_PRIM_TRIANGLES &&
        sp->rasterizer->fill_front == PIPE_POLYGON_MODE_FILL &&
@@ -1464,6 +1496,19 @@ sp_setup_prepare(struct setup_context *setup)
 }
 
 
+/**
+ * Restrict rasterization to the given rectangle, which must lie within
+ * the context's cliprect.  Used by the rasterizer tasks to draw one tile
+ * at a time.
+ */
+void
+sp_setup_set_cliprect(struct setup_context *setup,
+                      const struct pipe_scissor_state *cliprect)
+{
+   setup->cliprect = *cliprect;
+}
+
+
 void
 sp_setup_destroy_context(struct setup_context *setup)
 {
@@ -1473,14 +1518,21 @@ sp_setup_destroy_context(struct setup_context *setup)
 
 /**
  * Create a new primitive setup/render stage.
+ * \param pipeline  the quad pipeline to send fragments down
+ * \param rast  if not NULL, bin the primitives for this rasterizer's
+ *              tasks rather than drawing them
  */
 struct setup_context *
-sp_setup_create_context(struct softpipe_context *softpipe)
+sp_setup_create_context(struct softpipe_context *softpipe,
+                        struct quad_pipeline *pipeline,
+                        struct sp_rasterizer *rast)
 {
    struct setup_context *setup = CALLOC_STRUCT(setup_context);
    unsigned i;
 
    setup->softpipe = softpipe;
+   setup->pipeline = pipeline;
+   setup->rast = rast;
 
    for (i = 0; i < MAX_QUADS; i++) {
       setup->quad[i].coef = setup->coef;
@@ -29,6 +29,9 @@
 
 struct setup_context;
 struct softpipe_context;
+struct quad_pipeline;
+struct sp_rasterizer;
+struct pipe_scissor_state;
 
 void 
 sp_setup_tri( struct setup_context *setup,
@@ -46,8 +49,12 @@ sp_setup_point( struct setup_context *setup,
              const float (*v0)[4] );
 
 
-struct setup_context *sp_setup_create_context( struct softpipe_context *softpipe );
+struct setup_context *sp_setup_create_context( struct softpipe_context *softpipe,
+                                               struct quad_pipeline *pipeline,
+                                               struct sp_rasterizer *rast );
 void sp_setup_prepare( struct setup_context *setup );
+void sp_setup_set_cliprect( struct setup_context *setup,
+                            const struct pipe_scissor_state *cliprect );
 void sp_setup_destroy_context( struct setup_context *setup );
 
 #endif
@@ -33,6 +33,7 @@
 #include "draw/draw_context.h"
 #include "draw/draw_vertex.h"
 #include "sp_context.h"
+#include "sp_rast.h"
 #include "sp_screen.h"
 #include "sp_state.h"
 #include "sp_texture.h"
@@ -275,6 +276,10 @@ update_fragment_shader(struct softpipe_context *softpipe, unsigned prim)
                                     softpipe->fs_machine,
                                     (struct tgsi_sampler *) softpipe->
                                     tgsi.sampler[PIPE_SHADER_FRAGMENT]);
+
+      /* and the rasterizer threads' interpreters */
+      if (softpipe->rast)
+         sp_rast_bind_fragment_shader(softpipe->rast);
    }
    else {
       softpipe->fs_variant = NULL;
@@ -403,7 +408,7 @@ softpipe_update_derived(struct softpipe_context *softpipe, unsigned prim)
                           SP_NEW_DEPTH_STENCIL_ALPHA |
                           SP_NEW_FRAMEBUFFER |
                           SP_NEW_FS))
-      sp_build_quad_pipeline(softpipe);
+      sp_build_quad_pipeline(softpipe, &softpipe->quad);
 
    softpipe->dirty = 0;
 }
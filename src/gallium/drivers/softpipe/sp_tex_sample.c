@@ -587,7 +587,7 @@ get_texel_2d_no_border(const struct sp_sampler_view *sp_sview,
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
 
-   return &tile->data.color[y][x][0];
+   return sp_tex_tile_texel(sp_sview->cache, tile, x, y);
 }
 
 
@@ -829,10 +829,10 @@ get_texel_quad_2d_no_border_single_tile(const struct sp_sampler_view *sp_sview,
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
       
-   out[0] = &tile->data.color[y  ][x  ][0];
-   out[1] = &tile->data.color[y  ][x+1][0];
-   out[2] = &tile->data.color[y+1][x  ][0];
-   out[3] = &tile->data.color[y+1][x+1][0];
+   out[0] = sp_tex_tile_texel(sp_sview->cache, tile, x,   y  );
+   out[1] = sp_tex_tile_texel(sp_sview->cache, tile, x+1, y  );
+   out[2] = sp_tex_tile_texel(sp_sview->cache, tile, x,   y+1);
+   out[3] = sp_tex_tile_texel(sp_sview->cache, tile, x+1, y+1);
 }
 
 
@@ -885,7 +885,7 @@ get_texel_3d_no_border(const struct sp_sampler_view *sp_sview,
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
 
-   return &tile->data.color[y][x][0];
+   return sp_tex_tile_texel(sp_sview->cache, tile, x, y);
 }
 
 
@@ -1866,6 +1866,18 @@ mip_filter_linear(struct sp_sampler_view *sp_sview,
 
    compute_lambda_lod(sp_sview, sp_samp, s, t, p, lod_in, control, lod);
 
+   /* if some pixel samples two levels, have misses load the next level
+    * too
+    */
+   for (j = 0; j < TGSI_QUAD_SIZE; j++) {
+      if (lod[j] >= 0.0 &&
+          psview->u.tex.first_level + (int)lod[j] <
+          (int) psview->u.tex.last_level) {
+         sp_sview->cache->prefetch = TRUE;
+         break;
+      }
+   }
+
    for (j = 0; j < TGSI_QUAD_SIZE; j++) {
       int level0 = psview->u.tex.first_level + (int)lod[j];
 
@@ -1894,6 +1906,8 @@ mip_filter_linear(struct sp_sampler_view *sp_sview,
       }
    }
 
+   sp_sview->cache->prefetch = FALSE;
+
    if (DEBUG_TEX) {
       print_sample_4(__FUNCTION__, rgba);
    }
@@ -32,6 +32,7 @@
  *    Brian Paul
  */
 
+#include "util/u_debug.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 #include "util/u_tile.h"
@@ -41,13 +42,25 @@
 #include "sp_texture.h"
 #include "sp_tex_tile_cache.h"
 
-   
+
+DEBUG_GET_ONCE_BOOL_OPTION(tex_cache_stats, "SOFTPIPE_TEX_CACHE_STATS", FALSE)
+
+
+/** Texels of softpipe_tex_tile_cache::fallback_tile, never written */
+static float zero_texels[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
+
+
+#define FOR_EACH_TILE(tc, tile) \
+   for (tile = &(tc)->entries[0][0]; \
+        tile < &(tc)->entries[0][0] + NUM_TEX_TILE_SETS * TEX_TILE_WAYS; \
+        tile++)
+
 
 struct softpipe_tex_tile_cache *
 sp_create_tex_tile_cache( struct pipe_context *pipe )
 {
    struct softpipe_tex_tile_cache *tc;
-   uint pos;
+   struct softpipe_tex_cached_tile *tile;
 
    /* make sure max texture size works */
    assert((TEX_TILE_SIZE << TEX_ADDR_BITS) >= (1 << (SP_MAX_TEXTURE_2D_LEVELS-1)));
@@ -55,31 +68,66 @@ sp_create_tex_tile_cache( struct pipe_context *pipe )
    tc = CALLOC_STRUCT( softpipe_tex_tile_cache );
    if (tc) {
       tc->pipe = pipe;
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         tc->entries[pos].addr.bits.invalid = 1;
+      FOR_EACH_TILE(tc, tile) {
+         tile->addr.bits.invalid = 1;
       }
-      tc->last_tile = &tc->entries[0]; /* any tile */
+      tc->last_tile = &tc->entries[0][0]; /* any tile */
+      tc->fallback_tile.addr.bits.invalid = 1;
+      tc->fallback_tile.data.ptr = zero_texels;
    }
    return tc;
 }
 
 
-void
-sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
+static void
+unmap_textures(struct softpipe_tex_tile_cache *tc)
 {
-   if (tc) {
-      uint pos;
+   unsigned i;
 
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         /*assert(tc->entries[pos].x < 0);*/
+   for (i = 0; i < Elements(tc->maps); i++) {
+      if (tc->maps[i].trans) {
+         tc->pipe->transfer_unmap(tc->pipe, tc->maps[i].trans);
+         tc->maps[i].trans = NULL;
+         tc->maps[i].map = NULL;
       }
-      if (tc->transfer) {
-         tc->pipe->transfer_unmap(tc->pipe, tc->transfer);
+   }
+}
+
+
+/**
+ * Invalidate all tiles, and free their storage too if free_data is set.
+ */
+static void
+invalidate_tiles(struct softpipe_tex_tile_cache *tc, boolean free_data)
+{
+   struct softpipe_tex_cached_tile *tile;
+
+   FOR_EACH_TILE(tc, tile) {
+      tile->addr.bits.invalid = 1;
+      if (free_data) {
+         FREE(tile->data.ptr);
+         tile->data.ptr = NULL;
       }
-      if (tc->tex_trans) {
-         tc->pipe->transfer_unmap(tc->pipe, tc->tex_trans);
+   }
+}
+
+
+void
+sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
+{
+   if (tc) {
+      if (debug_get_option_tex_cache_stats()) {
+         debug_printf("softpipe: texture cache %p: %llu hits, %llu misses, "
+                      "%llu prefetches\n", (void *) tc,
+                      (unsigned long long) tc->hits,
+                      (unsigned long long) tc->misses,
+                      (unsigned long long) tc->prefetches);
       }
 
+      unmap_textures(tc);
+      invalidate_tiles(tc, TRUE);
+      pipe_resource_reference(&tc->texture, NULL);
+
       FREE( tc );
    }
 }
@@ -92,14 +140,10 @@ sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 void
 sp_tex_tile_cache_validate_texture(struct softpipe_tex_tile_cache *tc)
 {
-   unsigned i;
-
    assert(tc);
    assert(tc->texture);
 
-   for (i = 0; i < Elements(tc->entries); i++) {
-      tc->entries[i].addr.bits.invalid = 1;
-   }
+   invalidate_tiles(tc, FALSE);
 }
 
 static boolean
@@ -116,6 +160,37 @@ sp_tex_tile_is_compat_view(struct softpipe_tex_tile_cache *tc,
            tc->swizzle_a == view->swizzle_a);
 }
 
+
+/**
+ * Can tiles of the given format be stored as ubytes?  That is the case
+ * for the plain 8-bit unorm formats, whose float texels are just the
+ * ubytes scaled by 1/255.
+ */
+static boolean
+is_unorm8_format(enum pipe_format format)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned chan;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       !desc->unpack_rgba_8unorm)
+      return FALSE;
+
+   for (chan = 0; chan < desc->nr_channels; chan++) {
+      if (desc->channel[chan].type == UTIL_FORMAT_TYPE_VOID)
+         continue;
+      if (desc->channel[chan].type != UTIL_FORMAT_TYPE_UNSIGNED ||
+          !desc->channel[chan].normalized ||
+          desc->channel[chan].pure_integer ||
+          desc->channel[chan].size != 8)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Specify the sampler view to cache.
  */
@@ -124,18 +199,11 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
                                    struct pipe_sampler_view *view)
 {
    struct pipe_resource *texture = view ? view->texture : NULL;
-   uint i;
-
-   assert(!tc->transfer);
 
    if (!sp_tex_tile_is_compat_view(tc, view)) {
       pipe_resource_reference(&tc->texture, texture);
 
-      if (tc->tex_trans_map) {
-         tc->pipe->transfer_unmap(tc->pipe, tc->tex_trans);
-         tc->tex_trans = NULL;
-         tc->tex_trans_map = NULL;
-      }
+      unmap_textures(tc);
 
       if (view) {
          tc->swizzle_r = view->swizzle_r;
@@ -143,15 +211,14 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
          tc->swizzle_b = view->swizzle_b;
          tc->swizzle_a = view->swizzle_a;
          tc->format = view->format;
+         tc->unorm8 = is_unorm8_format(view->format);
       }
 
-      /* mark as entries as invalid/empty */
-      /* XXX we should try to avoid this when the teximage hasn't changed */
-      for (i = 0; i < Elements(tc->entries); i++) {
-         tc->entries[i].addr.bits.invalid = 1;
-      }
-
-      tc->tex_face = -1; /* any invalid value here */
+      /* Free the tiles too, as the tile size may change with the format,
+       * and so that caches of unused views don't hold on to memory.
+       * XXX we should try to avoid this when the teximage hasn't changed
+       */
+      invalidate_tiles(tc, TRUE);
    }
 }
 
@@ -165,14 +232,10 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
 void
 sp_flush_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 {
-   int pos;
-
    if (tc->texture) {
       /* caching a texture, mark all entries as empty */
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         tc->entries[pos].addr.bits.invalid = 1;
-      }
-      tc->tex_face = -1;
+      invalidate_tiles(tc, FALSE);
+      unmap_textures(tc);
    }
 
 }
@@ -180,10 +243,10 @@ sp_flush_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 
 /**
  * Given the texture face, level, zslice, x and y values, compute
- * the cache entry position/index where we'd hope to find the
- * cached texture tile.
- * This is basically a direct-map cache.
- * XXX There's probably lots of ways in which we can improve this.
+ * the cache set where we'd hope to find the cached texture tile.
+ * Neighbouring tiles (including the next mipmap level's) map to
+ * different sets, so the tiles a filter needs at once don't evict
+ * each other.
  */
 static INLINE uint
 tex_cache_pos( union tex_tile_address addr )
@@ -194,9 +257,185 @@ tex_cache_pos( union tex_tile_address addr )
                  addr.bits.face + 
                  addr.bits.level * 7);
 
-   return entry % NUM_TEX_TILE_ENTRIES;
+   return entry % NUM_TEX_TILE_SETS;
 }
 
+
+/**
+ * Look the tile up in its set.  Returns NULL on a miss, with *victim
+ * set to the entry to replace.
+ */
+static struct softpipe_tex_cached_tile *
+lookup_tile(struct softpipe_tex_tile_cache *tc, union tex_tile_address addr,
+            struct softpipe_tex_cached_tile **victim)
+{
+   struct softpipe_tex_cached_tile *set = tc->entries[tex_cache_pos(addr)];
+   unsigned way;
+
+   *victim = &set[0];
+   for (way = 0; way < TEX_TILE_WAYS; way++) {
+      if (set[way].addr.value == addr.value)
+         return &set[way];
+
+      /* prefer empty entries, then the least recently used one */
+      if (!(*victim)->addr.bits.invalid &&
+          (set[way].addr.bits.invalid ||
+           (int) (set[way].last_used - (*victim)->last_used) < 0))
+         *victim = &set[way];
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Get the mapped image of the tile's face/level/zslice.
+ */
+static struct pipe_transfer *
+map_texture(struct softpipe_tex_tile_cache *tc, union tex_tile_address addr,
+            void **map)
+{
+   struct pipe_resource *texture = tc->texture;
+   unsigned i = addr.bits.level & 1;
+
+   /* check if we need to get a new transfer */
+   if (!tc->maps[i].trans ||
+       tc->maps[i].face != addr.bits.face ||
+       tc->maps[i].level != addr.bits.level ||
+       tc->maps[i].z != addr.bits.z) {
+      /* get new transfer (view into texture) */
+      unsigned width, height, layer;
+
+      if (tc->maps[i].trans) {
+         tc->pipe->transfer_unmap(tc->pipe, tc->maps[i].trans);
+         tc->maps[i].trans = NULL;
+         tc->maps[i].map = NULL;
+      }
+
+      width = u_minify(texture->width0, addr.bits.level);
+      if (texture->target == PIPE_TEXTURE_1D_ARRAY) {
+         height = texture->array_size;
+         layer = 0;
+      }
+      else {
+         height = u_minify(texture->height0, addr.bits.level);
+         layer = addr.bits.face + addr.bits.z;
+      }
+
+      tc->maps[i].map =
+         pipe_transfer_map(tc->pipe, texture,
+                           addr.bits.level,
+                           layer,
+                           PIPE_TRANSFER_READ | PIPE_TRANSFER_UNSYNCHRONIZED,
+                           0, 0, width, height, &tc->maps[i].trans);
+
+      tc->maps[i].face = addr.bits.face;
+      tc->maps[i].level = addr.bits.level;
+      tc->maps[i].z = addr.bits.z;
+   }
+
+   *map = tc->maps[i].map;
+   return tc->maps[i].trans;
+}
+
+
+/**
+ * Load the texels of the tile at addr into the given cache entry.
+ */
+static boolean
+fill_tile(struct softpipe_tex_tile_cache *tc,
+          struct softpipe_tex_cached_tile *tile,
+          union tex_tile_address addr)
+{
+   boolean zs = util_format_is_depth_or_stencil(tc->format);
+   unsigned x = addr.bits.x * TEX_TILE_SIZE;
+   unsigned y = addr.bits.y * TEX_TILE_SIZE;
+   struct pipe_transfer *pt;
+   void *map;
+
+   if (!tile->data.ptr) {
+      unsigned texel_size = tc->unorm8 ? 4 : 4 * sizeof(float);
+
+      tile->data.ptr = MALLOC(TEX_TILE_SIZE * TEX_TILE_SIZE * texel_size);
+      if (!tile->data.ptr)
+         return FALSE;
+   }
+
+   pt = map_texture(tc, addr, &map);
+   if (!map)
+      return FALSE;
+
+   /* Get tile from the transfer (view into texture), explicitly passing
+    * the image format.
+    */
+   if (tc->unorm8) {
+      const struct util_format_description *desc =
+         util_format_description(tc->format);
+      unsigned w = TEX_TILE_SIZE, h = TEX_TILE_SIZE;
+
+      if (!u_clip_tile(x, y, &w, &h, &pt->box)) {
+         desc->unpack_rgba_8unorm(&tile->data.unorm8[0][0][0],
+                                  TEX_TILE_SIZE * 4,
+                                  (const uint8_t *) map + y * pt->stride +
+                                  x * (desc->block.bits / 8),
+                                  pt->stride, w, h);
+      }
+   } else if (!zs && util_format_is_pure_uint(tc->format)) {
+      pipe_get_tile_ui_format(pt, map, x, y,
+                              TEX_TILE_SIZE,
+                              TEX_TILE_SIZE,
+                              tc->format,
+                              (unsigned *) tile->data.colorui);
+   } else if (!zs && util_format_is_pure_sint(tc->format)) {
+      pipe_get_tile_i_format(pt, map, x, y,
+                             TEX_TILE_SIZE,
+                             TEX_TILE_SIZE,
+                             tc->format,
+                             (int *) tile->data.colori);
+   } else {
+      pipe_get_tile_rgba_format(pt, map, x, y,
+                                TEX_TILE_SIZE,
+                                TEX_TILE_SIZE,
+                                tc->format,
+                                (float *) tile->data.color);
+   }
+
+   tile->addr = addr;
+   tile->last_used = tc->clock++;
+   return TRUE;
+}
+
+
+/**
+ * Load the tile of the next mipmap level which covers the tile at addr,
+ * unless it's cached already.
+ */
+static void
+prefetch_next_level(struct softpipe_tex_tile_cache *tc,
+                    union tex_tile_address addr)
+{
+   struct softpipe_tex_cached_tile *victim;
+
+   if (addr.bits.level >= tc->texture->last_level)
+      return;
+
+   addr.bits.level++;
+   addr.bits.x >>= 1;
+   if (tc->texture->target != PIPE_TEXTURE_1D &&
+       tc->texture->target != PIPE_TEXTURE_1D_ARRAY)
+      addr.bits.y >>= 1;
+   if (tc->texture->target == PIPE_TEXTURE_3D)
+      addr.bits.z >>= 1;
+
+   if (!lookup_tile(tc, addr, &victim)) {
+      if (fill_tile(tc, victim, addr))
+         tc->prefetches++;
+      else
+         victim->addr.bits.invalid = 1;
+   }
+}
+
+
 /**
  * Similar to sp_get_cached_tile() but for textures.
  * Tiles are read-only and indexed with more params.
@@ -205,90 +444,39 @@ const struct softpipe_tex_cached_tile *
 sp_find_cached_tile_tex(struct softpipe_tex_tile_cache *tc, 
                         union tex_tile_address addr )
 {
-   struct softpipe_tex_cached_tile *tile;
-   boolean zs = util_format_is_depth_or_stencil(tc->format);
-
-   tile = tc->entries + tex_cache_pos( addr );
+   struct softpipe_tex_cached_tile *tile, *victim;
 
-   if (addr.value != tile->addr.value) {
+   /* the last tile may have been hit many times without going through
+    * here, keep it from looking unused
+    */
+   tc->last_tile->last_used = tc->clock++;
 
+   tile = lookup_tile(tc, addr, &victim);
+   if (tile) {
+      tc->hits++;
+      tile->last_used = tc->clock++;
+   }
+   else {
       /* cache miss.  Most misses are because we've invalidated the
        * texture cache previously -- most commonly on binding a new
        * texture.  Currently we effectively flush the cache on texture
        * bind.
        */
-#if 0
-      _debug_printf("miss at %u:  x=%d y=%d z=%d face=%d level=%d\n"
-                    "   tile %u:  x=%d y=%d z=%d face=%d level=%d\n",
-                    pos, x/TILE_SIZE, y/TILE_SIZE, z, face, level,
-                    pos, tile->addr.bits.x, tile->addr.bits.y, tile->z, tile->face, tile->level);
-#endif
-
-      /* check if we need to get a new transfer */
-      if (!tc->tex_trans ||
-          tc->tex_face != addr.bits.face ||
-          tc->tex_level != addr.bits.level ||
-          tc->tex_z != addr.bits.z) {
-         /* get new transfer (view into texture) */
-         unsigned width, height, layer;
-
-         if (tc->tex_trans_map) {
-            tc->pipe->transfer_unmap(tc->pipe, tc->tex_trans);
-            tc->tex_trans = NULL;
-            tc->tex_trans_map = NULL;
-         }
-
-         width = u_minify(tc->texture->width0, addr.bits.level);
-         if (tc->texture->target == PIPE_TEXTURE_1D_ARRAY) {
-            height = tc->texture->array_size;
-            layer = 0;
-         }
-         else {
-            height = u_minify(tc->texture->height0, addr.bits.level);
-            layer = addr.bits.face + addr.bits.z;
-         }
-
-         tc->tex_trans_map =
-            pipe_transfer_map(tc->pipe, tc->texture,
-                              addr.bits.level,
-                              layer,
-                              PIPE_TRANSFER_READ | PIPE_TRANSFER_UNSYNCHRONIZED,
-                              0, 0, width, height, &tc->tex_trans);
-
-         tc->tex_face = addr.bits.face;
-         tc->tex_level = addr.bits.level;
-         tc->tex_z = addr.bits.z;
+      tc->misses++;
+
+      tile = victim;
+      if (!fill_tile(tc, tile, addr)) {
+         /* out of memory, or the texture couldn't be mapped.  Hand out
+          * some texels rather than crash; the last tile may not have any
+          * either.
+          */
+         tile->addr.bits.invalid = 1;
+         if (!tile->data.ptr)
+            tile = &tc->fallback_tile;
       }
-
-      /* Get tile from the transfer (view into texture), explicitly passing
-       * the image format.
-       */
-      if (!zs && util_format_is_pure_uint(tc->format)) {
-         pipe_get_tile_ui_format(tc->tex_trans, tc->tex_trans_map,
-                                 addr.bits.x * TEX_TILE_SIZE,
-                                 addr.bits.y * TEX_TILE_SIZE,
-                                 TEX_TILE_SIZE,
-                                 TEX_TILE_SIZE,
-                                 tc->format,
-                                 (unsigned *) tile->data.colorui);
-      } else if (!zs && util_format_is_pure_sint(tc->format)) {
-         pipe_get_tile_i_format(tc->tex_trans, tc->tex_trans_map,
-                                addr.bits.x * TEX_TILE_SIZE,
-                                addr.bits.y * TEX_TILE_SIZE,
-                                TEX_TILE_SIZE,
-                                TEX_TILE_SIZE,
-                                tc->format,
-                                (int *) tile->data.colori);
-      } else {
-         pipe_get_tile_rgba_format(tc->tex_trans, tc->tex_trans_map,
-                                   addr.bits.x * TEX_TILE_SIZE,
-                                   addr.bits.y * TEX_TILE_SIZE,
-                                   TEX_TILE_SIZE,
-                                   TEX_TILE_SIZE,
-                                   tc->format,
-                                   (float *) tile->data.color);
+      else if (tc->prefetch) {
+         prefetch_next_level(tc, addr);
       }
-      tile->addr = addr;
    }
 
    tc->last_tile = tile;
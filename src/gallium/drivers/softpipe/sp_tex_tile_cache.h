@@ -30,6 +30,7 @@
 
 
 #include "pipe/p_compiler.h"
+#include "util/u_math.h"
 #include "sp_limits.h"
 
 
@@ -63,38 +64,59 @@ union tex_tile_address {
 };
 
 
+/**
+ * A cached tile.  The texels are stored as TEX_TILE_SIZE rows of
+ * TEX_TILE_SIZE RGBA texels, either as floats/ints, or as ubytes when the
+ * cache is storing an 8-bit unorm format natively (see
+ * softpipe_tex_tile_cache::unorm8).
+ */
 struct softpipe_tex_cached_tile
 {
    union tex_tile_address addr;
+   unsigned last_used;  /**< softpipe_tex_tile_cache::clock, for LRU */
    union {
-      float color[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-      unsigned int colorui[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-      int colori[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-   } data;
+      float (*color)[TEX_TILE_SIZE][4];
+      unsigned int (*colorui)[TEX_TILE_SIZE][4];
+      int (*colori)[TEX_TILE_SIZE][4];
+      ubyte (*unorm8)[TEX_TILE_SIZE][4];
+      void *ptr;
+   } data;  /**< allocated on first use */
 };
 
 /*
- * The number of cache entries.
- * Should not be decreased to lower than 16, and even that
- * seems too low to avoid cache thrashing in some cases (because
- * the cache is direct mapped, see tex_cache_pos() function).
+ * The cache is set associative, with NUM_TEX_TILE_SETS sets of
+ * TEX_TILE_WAYS tiles each, replaced in LRU order.  Tiles which are
+ * neighbours in x, y or z map to different sets, see tex_cache_pos().
+ */
+#define NUM_TEX_TILE_SETS 16
+#define TEX_TILE_WAYS 4
+
+/**
+ * Number of texels sp_tex_tile_texel() can hand out from native tiles
+ * before reusing one.  Must be at least the number of texels a filter
+ * holds on to at a time (8, for trilinear 3D).
  */
-#define NUM_TEX_TILE_ENTRIES 16
+#define TEX_TEXEL_RING 16
 
 struct softpipe_tex_tile_cache
 {
    struct pipe_context *pipe;
-   struct pipe_transfer *transfer;
-   void *transfer_map;
 
    struct pipe_resource *texture;  /**< if caching a texture */
    unsigned timestamp;
 
-   struct softpipe_tex_cached_tile entries[NUM_TEX_TILE_ENTRIES];
+   struct softpipe_tex_cached_tile entries[NUM_TEX_TILE_SETS][TEX_TILE_WAYS];
+   unsigned clock;
 
-   struct pipe_transfer *tex_trans;
-   void *tex_trans_map;
-   int tex_face, tex_level, tex_z;
+   /**
+    * Mapped images of the texture, one for even and one for odd mipmap
+    * levels so that trilinear filtering doesn't keep remapping.
+    */
+   struct {
+      struct pipe_transfer *trans;
+      void *map;
+      int face, level, z;
+   } maps[2];
 
    unsigned swizzle_r;
    unsigned swizzle_g;
@@ -102,7 +124,26 @@ struct softpipe_tex_tile_cache
    unsigned swizzle_a;
    enum pipe_format format;
 
+   /** Tiles hold the texels as ubytes rather than floats */
+   boolean unorm8;
+
+   /**
+    * Also load the next mipmap level's tile on a miss.  Set by the sampler
+    * while filtering between mipmap levels.
+    */
+   boolean prefetch;
+
    struct softpipe_tex_cached_tile *last_tile;  /**< most recently retrieved tile */
+
+   /** Zero texels handed out when a tile can't be filled */
+   struct softpipe_tex_cached_tile fallback_tile;
+
+   /** Texels converted from native tiles */
+   float texels[TEX_TEXEL_RING][4];
+   unsigned next_texel;
+
+   /** Statistics, see SOFTPIPE_TEX_CACHE_STATS */
+   uint64_t hits, misses, prefetches;
 };
 
 
@@ -153,12 +194,39 @@ static INLINE const struct softpipe_tex_cached_tile *
 sp_get_cached_tile_tex(struct softpipe_tex_tile_cache *tc, 
                        union tex_tile_address addr )
 {
-   if (tc->last_tile->addr.value == addr.value)
+   if (tc->last_tile->addr.value == addr.value) {
+      tc->hits++;
       return tc->last_tile;
+   }
 
    return sp_find_cached_tile_tex( tc, addr );
 }
 
 
+/**
+ * Get texel (x, y) of a tile as floats.  The texel is converted if the
+ * tile stores ubytes, and the result is valid until TEX_TEXEL_RING more
+ * texels have been fetched.
+ */
+static INLINE const float *
+sp_tex_tile_texel(struct softpipe_tex_tile_cache *tc,
+                  const struct softpipe_tex_cached_tile *tile,
+                  unsigned x, unsigned y)
+{
+   if (tc->unorm8) {
+      const ubyte *src = tile->data.unorm8[y][x];
+      float *texel = tc->texels[tc->next_texel++ % TEX_TEXEL_RING];
+
+      texel[0] = ubyte_to_float(src[0]);
+      texel[1] = ubyte_to_float(src[1]);
+      texel[2] = ubyte_to_float(src[2]);
+      texel[3] = ubyte_to_float(src[3]);
+      return texel;
+   }
+
+   return tile->data.color[y][x];
+}
+
+
 #endif /* SP_TEX_TILE_CACHE_H */
 
@@ -85,6 +85,19 @@ clear_clear_flag(uint *bitvec, union tile_address addr, unsigned max)
    assert(pos / 32 < max);
    bitvec[pos / 32] &= ~(1 << (pos & 31));
 }
+
+
+/**
+ * Mark the tile at (x,y) as cleared.
+ */
+static INLINE void
+set_clear_flag(uint *bitvec, union tile_address addr, unsigned max)
+{
+   int pos;
+   pos = addr_to_clear_pos(addr);
+   assert(pos / 32 < max);
+   bitvec[pos / 32] |= (1 << (pos & 31));
+}
    
 
 struct softpipe_tile_cache *
@@ -650,3 +663,44 @@ sp_tile_cache_clear(struct softpipe_tile_cache *tc,
    }
    tc->last_tile_addr.bits.invalid = 1;
 }
+
+
+/**
+ * Throw away all cached tiles and pending clears without writing anything
+ * back to the surface.  For when the whole surface is about to be cleared
+ * through another cache of the same surface.
+ */
+void
+sp_tile_cache_discard(struct softpipe_tile_cache *tc)
+{
+   uint pos;
+
+   if (tc->clear_flags)
+      memset(tc->clear_flags, 0, tc->clear_flags_size);
+
+   for (pos = 0; pos < Elements(tc->tile_addrs); pos++) {
+      tc->tile_addrs[pos].bits.invalid = 1;
+   }
+   tc->last_tile_addr.bits.invalid = 1;
+}
+
+
+/**
+ * Hand the pending clear of the tile at addr, if any, over from src to
+ * dst, which must be caching the same surface.  dst must not have the
+ * tile cached.
+ */
+void
+sp_tile_cache_move_clear(struct softpipe_tile_cache *dst,
+                         struct softpipe_tile_cache *src,
+                         union tile_address addr)
+{
+   assert(dst->surface == src->surface);
+
+   if (is_clear_flag_set(src->clear_flags, addr, src->clear_flags_size)) {
+      clear_clear_flag(src->clear_flags, addr, src->clear_flags_size);
+      set_clear_flag(dst->clear_flags, addr, dst->clear_flags_size);
+      dst->clear_color = src->clear_color;
+      dst->clear_val = src->clear_val;
+   }
+}
@@ -127,6 +127,14 @@ extern struct softpipe_cached_tile *
 sp_find_cached_tile(struct softpipe_tile_cache *tc, 
                     union tile_address addr );
 
+extern void
+sp_tile_cache_discard(struct softpipe_tile_cache *tc);
+
+extern void
+sp_tile_cache_move_clear(struct softpipe_tile_cache *dst,
+                         struct softpipe_tile_cache *src,
+                         union tile_address addr);
+
 
 static INLINE union tile_address
 tile_address( unsigned x,
@@ -0,0 +1,251 @@
+/* Measure vertex throughput of draws which need clipping: a large grid of
+ * small triangles, extending well beyond all sides of the view volume and
+ * with every other triangle facing backwards, drawn with back face
+ * culling.  Useful for comparing the draw module's clip and cull paths,
+ * e.g. by running with DRAW_CLIP_CULL=0/1.
+ */
+
+#include <stdio.h>
+#include "graw_util.h"
+#include "os/os_time.h"
+#include "util/u_memory.h"
+
+static struct graw_info info;
+
+static const int WIDTH = 512;
+static const int HEIGHT = 512;
+
+static int GridSize = 256;
+static int NumFrames = 20;
+static boolean Cull = TRUE;
+
+static unsigned NumVertices;
+
+
+struct vertex {
+   float position[4];
+   float color[4];
+};
+
+
+static void
+set_vertex(struct vertex *v, int i, int j)
+{
+   /* the grid spans three times the view volume in x, y and z */
+   v->position[0] = 6.0f * i / GridSize - 3.0f;
+   v->position[1] = 6.0f * j / GridSize - 3.0f;
+   v->position[2] = 3.0f * (i + j) / GridSize - 3.0f;
+   v->position[3] = 1.0f;
+   v->color[0] = (float) i / GridSize;
+   v->color[1] = (float) j / GridSize;
+   v->color[2] = 0.5f;
+   v->color[3] = 1.0f;
+}
+
+
+static void set_vertices( void )
+{
+   struct pipe_vertex_element ve[2];
+   struct pipe_vertex_buffer vbuf;
+   struct vertex *vertices, *v;
+   void *handle;
+   int i, j;
+
+   NumVertices = GridSize * GridSize * 6;
+   vertices = MALLOC(NumVertices * sizeof *vertices);
+   if (!vertices)
+      exit(1);
+
+   v = vertices;
+   for (j = 0; j < GridSize; j++) {
+      for (i = 0; i < GridSize; i++) {
+         /* odd cells are wound the other way */
+         boolean flip = (i + j) & 1;
+
+         set_vertex(v++, i, j);
+         set_vertex(v++, flip ? i : i + 1, flip ? j + 1 : j);
+         set_vertex(v++, flip ? i + 1 : i, flip ? j : j + 1);
+
+         set_vertex(v++, i + 1, j);
+         set_vertex(v++, flip ? i : i + 1, flip ? j + 1 : j + 1);
+         set_vertex(v++, flip ? i + 1 : i, j + 1);
+      }
+   }
+
+   memset(ve, 0, sizeof ve);
+
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, color);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   memset(&vbuf, 0, sizeof vbuf);
+
+   vbuf.stride = sizeof( struct vertex );
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = pipe_buffer_create_with_data(info.ctx,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_DEFAULT,
+                                              NumVertices * sizeof *vertices,
+                                              vertices);
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+
+   FREE(vertices);
+}
+
+
+static void set_vertex_shader( void )
+{
+   void *handle;
+   const char *text =
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "  0: MOV OUT[1], IN[1]\n"
+      "  1: MOV OUT[0], IN[0]\n"
+      "  2: END\n";
+
+   handle = graw_parse_vertex_shader(info.ctx, text);
+   info.ctx->bind_vs_state(info.ctx, handle);
+}
+
+
+static void set_fragment_shader( void )
+{
+   void *handle;
+   const char *text =
+      "FRAG\n"
+      "DCL IN[0], COLOR, LINEAR\n"
+      "DCL OUT[0], COLOR\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: END\n";
+
+   handle = graw_parse_fragment_shader(info.ctx, text);
+   info.ctx->bind_fs_state(info.ctx, handle);
+}
+
+
+static void set_rasterizer( void )
+{
+   struct pipe_rasterizer_state rasterizer;
+   void *handle;
+
+   memset(&rasterizer, 0, sizeof rasterizer);
+   rasterizer.cull_face = Cull ? PIPE_FACE_BACK : PIPE_FACE_NONE;
+   rasterizer.front_ccw = 1;
+   rasterizer.depth_clip = 1;
+   rasterizer.half_pixel_center = 1;
+   rasterizer.bottom_edge_rule = 1;
+
+   handle = info.ctx->create_rasterizer_state(info.ctx, &rasterizer);
+   info.ctx->bind_rasterizer_state(info.ctx, handle);
+}
+
+
+static void finish( void )
+{
+   struct pipe_fence_handle *fence = NULL;
+
+   info.ctx->flush(info.ctx, &fence, 0);
+   if (fence) {
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+}
+
+
+static void draw( void )
+{
+   union pipe_color_union clear_color = { {0.2f, 0.2f, 0.2f, 1.0f} };
+   int64_t start, end;
+   double secs, mtris;
+   int frame;
+
+   /* warm up, so that shader compilation is not measured */
+   info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+                   &clear_color, 1.0, 0);
+   util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, 6);
+   finish();
+
+   start = os_time_get();
+
+   for (frame = 0; frame < NumFrames; frame++) {
+      info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+                      &clear_color, 1.0, 0);
+      util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, NumVertices);
+      finish();
+   }
+
+   end = os_time_get();
+
+   secs = (end - start) / 1000000.0;
+   mtris = (double) NumVertices / 3 * NumFrames / 1000000.0;
+
+   printf("%dx%d grid, %d frames, cull %s: %.3f secs, %.2f Mtris/s\n",
+          GridSize, GridSize, NumFrames, Cull ? "on" : "off",
+          secs, secs > 0.0 ? mtris / secs : 0.0);
+
+   graw_util_flush_front(&info);
+}
+
+
+static void init( void )
+{
+   if (!graw_util_create_window(&info, WIDTH, HEIGHT, 1, TRUE))
+      exit(1);
+
+   graw_util_default_state(&info, TRUE);
+
+   set_rasterizer();
+
+   graw_util_viewport(&info, 0, 0, WIDTH, HEIGHT, 0.0, 1.0);
+
+   set_vertices();
+   set_vertex_shader();
+   set_fragment_shader();
+}
+
+
+static void args(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ) {
+      if (graw_parse_args(&i, argc, argv)) {
+         /* ok */
+      }
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         NumFrames = atoi(argv[i + 1]);
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+         GridSize = MAX2(atoi(argv[i + 1]), 1);
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-c") == 0) {
+         Cull = FALSE;
+         i++;
+      }
+      else {
+         printf("Invalid arg %s\n", argv[i]);
+         printf("Usage: clip-cull [-n frames] [-g grid size] [-c (no culling)]\n");
+         exit(1);
+      }
+   }
+}
+
+int main( int argc, char *argv[] )
+{
+   args(argc, argv);
+   init();
+
+   graw_set_display_func( draw );
+   graw_main_loop();
+   return 0;
+}
@@ -0,0 +1,235 @@
+/* Measure fill rate by drawing a stack of blended, depth tested
+ * full-window quads.  Mostly useful for comparing the llvmpipe fragment
+ * paths, e.g. by running with LP_NATIVE_VECTOR_WIDTH=128/256.
+ */
+
+#include <stdio.h>
+#include "graw_util.h"
+#include "os/os_time.h"
+
+static struct graw_info info;
+
+static int WIDTH = 1024;
+static int HEIGHT = 1024;
+
+#define NUM_LAYERS 64
+
+static int NumFrames = 20;
+static boolean Blend = TRUE;
+
+
+struct vertex {
+   float position[4];
+   float color[4];
+};
+
+static struct vertex vertices[NUM_LAYERS * 6];
+
+
+static void set_vertices( void )
+{
+   static const float corners[6][2] = {
+      { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f },
+      { -1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+   };
+   struct pipe_vertex_element ve[2];
+   struct pipe_vertex_buffer vbuf;
+   void *handle;
+   unsigned i, j;
+
+   /* back to front, so that every layer passes the depth test */
+   for (i = 0; i < NUM_LAYERS; i++) {
+      float z = 0.9f - 1.8f * i / NUM_LAYERS;
+
+      for (j = 0; j < 6; j++) {
+         struct vertex *v = &vertices[i * 6 + j];
+
+         v->position[0] = corners[j][0];
+         v->position[1] = corners[j][1];
+         v->position[2] = z;
+         v->position[3] = 1.0f;
+         v->color[0] = (float) (i & 1);
+         v->color[1] = (float) ((i >> 1) & 1);
+         v->color[2] = (float) j / 6.0f;
+         v->color[3] = 0.5f;
+      }
+   }
+
+   memset(ve, 0, sizeof ve);
+
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, color);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   memset(&vbuf, 0, sizeof vbuf);
+
+   vbuf.stride = sizeof( struct vertex );
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = pipe_buffer_create_with_data(info.ctx,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_DEFAULT,
+                                              sizeof(vertices),
+                                              vertices);
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+}
+
+
+static void set_vertex_shader( void )
+{
+   void *handle;
+   const char *text =
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "  0: MOV OUT[1], IN[1]\n"
+      "  1: MOV OUT[0], IN[0]\n"
+      "  2: END\n";
+
+   handle = graw_parse_vertex_shader(info.ctx, text);
+   info.ctx->bind_vs_state(info.ctx, handle);
+}
+
+
+static void set_fragment_shader( void )
+{
+   void *handle;
+   const char *text =
+      "FRAG\n"
+      "DCL IN[0], COLOR, LINEAR\n"
+      "DCL OUT[0], COLOR\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: END\n";
+
+   handle = graw_parse_fragment_shader(info.ctx, text);
+   info.ctx->bind_fs_state(info.ctx, handle);
+}
+
+
+static void set_blend( void )
+{
+   struct pipe_blend_state blend;
+   void *handle;
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend.rt[0].blend_enable = Blend;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ZERO;
+
+   handle = info.ctx->create_blend_state(info.ctx, &blend);
+   info.ctx->bind_blend_state(info.ctx, handle);
+}
+
+
+static void finish( void )
+{
+   struct pipe_fence_handle *fence = NULL;
+
+   info.ctx->flush(info.ctx, &fence, 0);
+   if (fence) {
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+}
+
+
+static void draw( void )
+{
+   union pipe_color_union clear_color = { {0.2f, 0.2f, 0.2f, 1.0f} };
+   int64_t start, end;
+   double secs, mpixels;
+   int frame;
+
+   /* warm up, so that shader compilation is not measured */
+   info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+                   &clear_color, 1.0, 0);
+   util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, 6);
+   finish();
+
+   start = os_time_get();
+
+   for (frame = 0; frame < NumFrames; frame++) {
+      info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+                      &clear_color, 1.0, 0);
+      util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, NUM_LAYERS * 6);
+      finish();
+   }
+
+   end = os_time_get();
+
+   secs = (end - start) / 1000000.0;
+   mpixels = (double) WIDTH * HEIGHT * NUM_LAYERS * NumFrames / 1000000.0;
+
+   printf("%dx%d, %d layers, %d frames, blend %s: %.3f secs, %.1f Mpixels/s\n",
+          WIDTH, HEIGHT, NUM_LAYERS, NumFrames, Blend ? "on" : "off",
+          secs, secs > 0.0 ? mpixels / secs : 0.0);
+
+   graw_util_flush_front(&info);
+}
+
+
+static void init( void )
+{
+   if (!graw_util_create_window(&info, WIDTH, HEIGHT, 1, TRUE))
+      exit(1);
+
+   graw_util_default_state(&info, TRUE);
+
+   set_blend();
+
+   graw_util_viewport(&info, 0, 0, WIDTH, HEIGHT, 0.0, 1.0);
+
+   set_vertices();
+   set_vertex_shader();
+   set_fragment_shader();
+}
+
+
+static void args(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ) {
+      if (graw_parse_args(&i, argc, argv)) {
+         /* ok */
+      }
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         NumFrames = atoi(argv[i + 1]);
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+         WIDTH = HEIGHT = atoi(argv[i + 1]);
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-b") == 0) {
+         Blend = FALSE;
+         i++;
+      }
+      else {
+         printf("Invalid arg %s\n", argv[i]);
+         printf("Usage: fill-rate [-n frames] [-s size] [-b (no blending)]\n");
+         exit(1);
+      }
+   }
+}
+
+int main( int argc, char *argv[] )
+{
+   args(argc, argv);
+   init();
+
+   graw_set_display_func( draw );
+   graw_main_loop();
+   return 0;
+}
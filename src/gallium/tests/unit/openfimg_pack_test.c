@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Tomasz Figa <tomasz.figa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Test case and benchmark for the openfimg vertex attribute packing
+ * kernels.  The kernels must produce exactly the same bytes as the
+ * byte-wise generic loop, for every attribute width and index type.
+ *
+ * Usage: ./openfimg_pack_test [vertices per benchmark run]
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os/os_time.h"
+#include "util/u_memory.h"
+
+#include "openfimg/openfimg_vertex_pack.h"
+
+#define SUFFIX		idx8
+#define INDEX_TYPE	const uint8_t*
+#undef SEQUENTIAL
+#include "openfimg/openfimg_vertex_pack_template.h"
+#undef INDEX_TYPE
+#undef SUFFIX
+
+#define SUFFIX		idx16
+#define INDEX_TYPE	const uint16_t*
+#undef SEQUENTIAL
+#include "openfimg/openfimg_vertex_pack_template.h"
+#undef INDEX_TYPE
+#undef SUFFIX
+
+#define SUFFIX		idx32
+#define INDEX_TYPE	const uint32_t*
+#undef SEQUENTIAL
+#include "openfimg/openfimg_vertex_pack_template.h"
+#undef INDEX_TYPE
+#undef SUFFIX
+
+#define SUFFIX		seq
+#define INDEX_TYPE	uint32_t
+#define SEQUENTIAL
+#include "openfimg/openfimg_vertex_pack_template.h"
+#undef INDEX_TYPE
+#undef SEQUENTIAL
+#undef SUFFIX
+
+
+#define MAX_VERTICES	256
+#define MAX_STRIDE	64
+#define NUM_RUNS	64
+
+
+static const char *index_names[] = { "idx8", "idx16", "idx32", "seq" };
+
+static uint8_t vertex_data[MAX_VERTICES * MAX_STRIDE + MAX_STRIDE];
+static uint8_t idx8[MAX_VERTICES];
+static uint16_t idx16[MAX_VERTICES];
+static uint32_t idx32[MAX_VERTICES];
+
+
+/**
+ * Packs cnt vertices with either the generic loop or the kernels.
+ */
+static unsigned
+pack(unsigned index_type, boolean generic, uint8_t *dst, const uint8_t *src,
+     unsigned stride, uint8_t width, unsigned first, unsigned cnt)
+{
+   switch (index_type) {
+   case 0:
+      return generic ?
+         of_pack_attribute_generic_idx8(dst, src, stride, width, idx8 + first, cnt) :
+         of_pack_attribute_idx8(dst, src, stride, width, idx8 + first, cnt);
+   case 1:
+      return generic ?
+         of_pack_attribute_generic_idx16(dst, src, stride, width, idx16 + first, cnt) :
+         of_pack_attribute_idx16(dst, src, stride, width, idx16 + first, cnt);
+   case 2:
+      return generic ?
+         of_pack_attribute_generic_idx32(dst, src, stride, width, idx32 + first, cnt) :
+         of_pack_attribute_idx32(dst, src, stride, width, idx32 + first, cnt);
+   default:
+      return generic ?
+         of_pack_attribute_generic_seq(dst, src, stride, width, first, cnt) :
+         of_pack_attribute_seq(dst, src, stride, width, first, cnt);
+   }
+}
+
+
+static boolean
+test_one(unsigned index_type, uint8_t width, unsigned stride,
+         unsigned offset, unsigned first, unsigned cnt)
+{
+   uint8_t ref[MAX_VERTICES * 16 + 4], res[MAX_VERTICES * 16 + 4];
+   const uint8_t *src = vertex_data + offset;
+   unsigned ref_size, res_size;
+   unsigned i;
+
+   /* padding bytes are left alone, so start from the same garbage */
+   for (i = 0; i < sizeof ref; ++i)
+      ref[i] = res[i] = rand();
+
+   ref_size = pack(index_type, TRUE, ref, src, stride, width, first, cnt);
+   res_size = pack(index_type, FALSE, res, src, stride, width, first, cnt);
+
+   if (ref_size != res_size || memcmp(ref, res, sizeof ref)) {
+      printf("FAILED: %s width %u stride %u offset %u first %u count %u\n",
+             index_names[index_type], width, stride, offset, first, cnt);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static void
+benchmark(unsigned index_type, uint8_t width, unsigned num_vertices)
+{
+   static uint8_t dst[MAX_VERTICES * 16];
+   const unsigned stride = 32;
+   int64_t start, generic_time, kernel_time;
+   unsigned i, n;
+
+   n = (num_vertices + MAX_VERTICES - 1) / MAX_VERTICES;
+
+   start = os_time_get_nano();
+   for (i = 0; i < n; ++i)
+      pack(index_type, TRUE, dst, vertex_data, stride, width, 0, MAX_VERTICES);
+   generic_time = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (i = 0; i < n; ++i)
+      pack(index_type, FALSE, dst, vertex_data, stride, width, 0, MAX_VERTICES);
+   kernel_time = os_time_get_nano() - start;
+
+   printf("%-5s %2u bytes: generic %6.2f ns/vertex, kernel %6.2f ns/vertex"
+          " (%.2fx)\n", index_names[index_type], width,
+          (double)generic_time / (n * MAX_VERTICES),
+          (double)kernel_time / (n * MAX_VERTICES),
+          kernel_time ? (double)generic_time / kernel_time : 0.0);
+}
+
+
+int main(int argc, char **argv)
+{
+   static const uint8_t bench_widths[] = { 4, 8, 12, 16 };
+   unsigned num_vertices = 1 << 22;
+   unsigned passed = 0, total = 0;
+   unsigned i, type, width, run;
+
+   if (argc > 1)
+      num_vertices = atoi(argv[1]);
+
+   for (i = 0; i < sizeof vertex_data; ++i)
+      vertex_data[i] = rand();
+
+   for (i = 0; i < MAX_VERTICES; ++i) {
+      idx32[i] = idx16[i] = idx8[i] = rand() % MAX_VERTICES;
+   }
+
+   for (type = 0; type < Elements(index_names); ++type) {
+      for (width = 1; width <= 16; ++width) {
+         for (run = 0; run < NUM_RUNS; ++run) {
+            unsigned stride = width + rand() % (MAX_STRIDE - width + 1);
+            unsigned offset = rand() % 4;
+            unsigned cnt = rand() % (MAX_VERTICES + 1);
+            unsigned first = rand() % (MAX_VERTICES - cnt + 1);
+
+            ++total;
+            if (test_one(type, width, stride, offset, first, cnt))
+               ++passed;
+         }
+      }
+   }
+
+   printf("%u/%u tests passed\n", passed, total);
+
+   for (type = 0; type < Elements(index_names); ++type)
+      for (i = 0; i < Elements(bench_widths); ++i)
+         benchmark(type, bench_widths[i], num_vertices);
+
+   return passed == total ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Checks that the pre-decoded fragment shader handlers of tgsi_exec give
+ * bit for bit the same results as the interpreter, NaN payloads aside, by
+ * running each test shader on random quads once through
+ * tgsi_exec_machine::Ops and once with Ops cleared.
+ *
+ * The handlers use SSE when tgsi_exec is built with it and the micro ops
+ * otherwise, so building for a target without SSE2 covers the latter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_config.h"
+#include "tgsi/tgsi_exec.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+
+#define NUM_QUADS 1000
+
+/* TEMP[4..7] hold random per pixel values, as inputs are interpolated */
+#define FIRST_RANDOM_TEMP 4
+#define NUM_RANDOM_TEMPS 4
+
+/* Constant buffer size, in floats; CONST[2] and up are out of bounds */
+#define NUM_CONSTS 8
+
+
+static const char *shaders[] = {
+   /* all the handled instructions, with partial write masks, swizzles
+    * and source modifiers
+    */
+   "FRAG\n"
+   "DCL IN[0], GENERIC[0], LINEAR\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL CONST[0..1]\n"
+   "DCL TEMP[0..7]\n"
+   "IMM[0] FLT32 {    0.5,    -2.0,     0.0,     1.0 }\n"
+   "  0: ADD TEMP[0], TEMP[4], TEMP[5].yzwx\n"
+   "  1: SUB TEMP[1].xz, -TEMP[4], |TEMP[5]|\n"
+   "  2: MUL TEMP[1].yw, TEMP[4].wzyx, IMM[0]\n"
+   "  3: MIN TEMP[2], TEMP[0], TEMP[1]\n"
+   "  4: MAX TEMP[2].xy, TEMP[2], -|TEMP[6]|\n"
+   "  5: MAD TEMP[0].w, TEMP[1].xxxx, TEMP[6].yyyy, CONST[0].zzzz\n"
+   "  6: LRP TEMP[1], TEMP[7].xxxx, TEMP[2], TEMP[5]\n"
+   "  7: CMP TEMP[2].yzw, TEMP[6], TEMP[0], CONST[1]\n"
+   "  8: DP3 TEMP[3].y, TEMP[1], TEMP[2]\n"
+   "  9: DP4 TEMP[3].xw, TEMP[0], -TEMP[7]\n"
+   " 10: MOV TEMP[0], TEMP[0].yxwz\n"
+   " 11: MUL TEMP[3].z, IN[0].xxxx, IN[0].wwww\n"
+   " 12: ADD OUT[0], TEMP[3], TEMP[0]\n"
+   " 13: MAD OUT[0].yz, OUT[0], TEMP[1], OUT[0].wzyx\n"
+   " 14: END\n",
+
+   /* both saturation modes */
+   "FRAG\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL CONST[0..1]\n"
+   "DCL TEMP[0..7]\n"
+   "  0: MOV_SAT TEMP[0], TEMP[4]\n"
+   "  1: ADD_SATNV TEMP[1].xyw, TEMP[4], TEMP[5]\n"
+   "  2: MUL_SAT TEMP[2].z, TEMP[6], CONST[1].wwww\n"
+   "  3: MIN_SATNV TEMP[2].xy, TEMP[5], TEMP[7]\n"
+   "  4: MAX_SAT TEMP[3], TEMP[6].zwxy, -TEMP[7]\n"
+   "  5: MAD_SATNV TEMP[1].z, TEMP[4], TEMP[5], TEMP[6]\n"
+   "  6: LRP_SAT OUT[0], TEMP[0], TEMP[1], TEMP[2]\n"
+   "  7: CMP_SATNV OUT[1], TEMP[7], TEMP[3], -TEMP[4]\n"
+   "  8: DP3_SAT TEMP[2].w, TEMP[4], TEMP[5]\n"
+   "  9: DP4_SATNV OUT[1].xy, TEMP[6], TEMP[7]\n"
+   " 10: SUB_SAT OUT[0].w, TEMP[2], TEMP[3]\n"
+   " 11: END\n",
+
+   /* constants in and out of the buffer bounds */
+   "FRAG\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL CONST[0..3]\n"
+   "DCL TEMP[0..7]\n"
+   "  0: MOV TEMP[0], CONST[0]\n"
+   "  1: ADD TEMP[1], CONST[1].wzyx, CONST[2]\n"
+   "  2: MAD TEMP[2], TEMP[4], CONST[3].xyxy, -|CONST[1]|\n"
+   "  3: DP4 TEMP[3].x, CONST[0], CONST[3]\n"
+   "  4: DP3 TEMP[3].yz, CONST[1], TEMP[5]\n"
+   "  5: CMP TEMP[3].w, CONST[0].yyyy, TEMP[6], CONST[2]\n"
+   "  6: MOV OUT[0], CONST[3]\n"
+   "  7: END\n",
+
+   /* handled instructions under a partial ExecMask */
+   "FRAG\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL CONST[0..1]\n"
+   "DCL TEMP[0..7]\n"
+   "  0: MOV TEMP[0], TEMP[4]\n"
+   "  1: IF TEMP[7].xxxx :6\n"
+   "  2:   ADD TEMP[0].xy, TEMP[5], TEMP[6]\n"
+   "  3:   MAD_SAT TEMP[1], TEMP[4], TEMP[5], CONST[0]\n"
+   "  4:   DP4 TEMP[2].xz, TEMP[6], TEMP[7]\n"
+   "  5: ELSE :9\n"
+   "  6:   LRP TEMP[0].zw, TEMP[4], TEMP[5], TEMP[6]\n"
+   "  7:   MIN TEMP[1].yw, TEMP[7], CONST[1]\n"
+   "  8:   MOV_SATNV TEMP[2], -TEMP[5]\n"
+   "  9: ENDIF\n"
+   " 10: MAX OUT[0], TEMP[0], TEMP[1]\n"
+   " 11: END\n",
+};
+
+
+/**
+ * Values the interpreter and the handlers could disagree on.
+ */
+static const uint special_values[] = {
+   0x00000000,   /* 0.0 */
+   0x80000000,   /* -0.0 */
+   0x3f800000,   /* 1.0 */
+   0xbf800000,   /* -1.0 */
+   0x3f000000,   /* 0.5 */
+   0x7fc00000,   /* NaN */
+   0xffc00000,   /* -NaN */
+   0x7f800001,   /* signaling NaN */
+   0x7f800000,   /* inf */
+   0xff800000,   /* -inf */
+   0x00000001,   /* denormal */
+   0x7f7fffff,   /* max float */
+};
+
+
+static float
+random_float(void)
+{
+   union fi v;
+
+   if (rand() % 4 == 0)
+      v.ui = special_values[rand() % Elements(special_values)];
+   else
+      v.f = (float) rand() / RAND_MAX * 8.0f - 4.0f;
+
+   return v.f;
+}
+
+
+/**
+ * Put the machine in the given state before running a shader.
+ */
+static void
+init_machine(struct tgsi_exec_machine *mach,
+             const struct tgsi_exec_vector *temps,
+             const struct tgsi_exec_vector *outputs)
+{
+   memcpy(mach->Temps, temps, TGSI_EXEC_NUM_TEMPS * sizeof *temps);
+   memcpy(mach->Outputs, outputs, PIPE_MAX_SHADER_OUTPUTS * sizeof *outputs);
+}
+
+
+static boolean
+compare_vectors(const char *name,
+                const struct tgsi_exec_vector *expected,
+                const struct tgsi_exec_vector *actual,
+                unsigned count)
+{
+   unsigned i, chan, j;
+
+   for (i = 0; i < count; i++) {
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         for (j = 0; j < TGSI_QUAD_SIZE; j++) {
+            const uint e = expected[i].xyzw[chan].u[j];
+            const uint a = actual[i].xyzw[chan].u[j];
+
+            /*
+             * Which NaN comes out of an operation on NaNs depends on the
+             * operand order, which C compilers don't preserve, so any NaN
+             * matches any other.
+             */
+            if (e != a && !(util_is_nan(uif(e)) && util_is_nan(uif(a)))) {
+               printf("  %s[%u].%c pixel %u: expected 0x%08x (%g), "
+                      "got 0x%08x (%g)\n",
+                      name, i, "xyzw"[chan], j,
+                      e, uif(e), a, uif(a));
+               return FALSE;
+            }
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+test_shader(struct tgsi_exec_machine *mach, unsigned index)
+{
+   static struct tgsi_exec_vector temps[TGSI_EXEC_NUM_TEMPS];
+   static struct tgsi_exec_vector outputs[PIPE_MAX_SHADER_OUTPUTS];
+   static struct tgsi_exec_vector expected_temps[TGSI_EXEC_NUM_TEMPS];
+   static struct tgsi_exec_vector expected_outputs[PIPE_MAX_SHADER_OUTPUTS];
+   struct tgsi_token tokens[1024];
+   struct tgsi_interp_coef coefs[1];
+   float consts[NUM_CONSTS];
+   const void *bufs[1];
+   unsigned sizes[1];
+   struct tgsi_exec_op *ops;
+   unsigned i, j, chan, quad;
+
+   if (!tgsi_text_translate(shaders[index], tokens, Elements(tokens))) {
+      printf("shader %u: failed to translate\n", index);
+      return FALSE;
+   }
+
+   bufs[0] = consts;
+   sizes[0] = NUM_CONSTS;
+   tgsi_exec_set_constant_buffers(mach, 1, bufs, sizes);
+
+   memset(coefs, 0, sizeof coefs);
+   mach->InterpCoefs = coefs;
+
+   tgsi_exec_machine_bind_shader(mach, tokens, NULL);
+   if (!mach->Ops) {
+      printf("shader %u: not pre-decoded\n", index);
+      return FALSE;
+   }
+   ops = mach->Ops;
+
+   for (quad = 0; quad < NUM_QUADS; quad++) {
+      for (i = 0; i < NUM_CONSTS; i++)
+         consts[i] = random_float();
+
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         coefs[0].a0[chan] = random_float();
+         coefs[0].dadx[chan] = random_float();
+         coefs[0].dady[chan] = random_float();
+      }
+
+      for (i = 0; i < TGSI_EXEC_NUM_TEMPS; i++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+            for (j = 0; j < TGSI_QUAD_SIZE; j++) {
+               temps[i].xyzw[chan].f[j] =
+                  i >= FIRST_RANDOM_TEMP &&
+                  i < FIRST_RANDOM_TEMP + NUM_RANDOM_TEMPS ?
+                  random_float() : (float) (i * 16 + chan * 4 + j);
+            }
+         }
+      }
+      for (i = 0; i < PIPE_MAX_SHADER_OUTPUTS; i++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+            for (j = 0; j < TGSI_QUAD_SIZE; j++)
+               outputs[i].xyzw[chan].f[j] = -(float) (i * 16 + chan * 4 + j);
+         }
+      }
+
+      /* reference: the interpreter */
+      mach->Ops = NULL;
+      init_machine(mach, temps, outputs);
+      tgsi_exec_machine_run(mach);
+      memcpy(expected_temps, mach->Temps, sizeof expected_temps);
+      memcpy(expected_outputs, mach->Outputs, sizeof expected_outputs);
+
+      mach->Ops = ops;
+      init_machine(mach, temps, outputs);
+      tgsi_exec_machine_run(mach);
+
+      if (!compare_vectors("TEMP", expected_temps, mach->Temps,
+                           TGSI_EXEC_NUM_TEMPS) ||
+          !compare_vectors("OUT", expected_outputs, mach->Outputs,
+                           PIPE_MAX_SHADER_OUTPUTS)) {
+         printf("shader %u: quad %u differs\n", index, quad);
+         mach->InterpCoefs = NULL;
+         return FALSE;
+      }
+   }
+
+   mach->InterpCoefs = NULL;
+
+   return TRUE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct tgsi_exec_machine *mach;
+   unsigned passed = 0;
+   unsigned i;
+
+   mach = tgsi_exec_machine_create();
+   if (!mach) {
+      printf("failed to create the machine\n");
+      return 1;
+   }
+
+   for (i = 0; i < Elements(shaders); i++) {
+      if (test_shader(mach, i))
+         ++passed;
+   }
+
+   tgsi_exec_machine_destroy(mach);
+
+   printf("%u/%u shaders passed (%s)\n", passed, (unsigned)Elements(shaders),
+#if defined(PIPE_ARCH_SSE)
+          "sse"
+#else
+          "no sse"
+#endif
+          );
+
+   return passed != Elements(shaders);
+}